@@ -0,0 +1,1514 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* vmath microbenchmarks
+ *
+ * usage: bench [-csv] [-t <seconds>] [-T <threads>] [-l] [name filters ...]
+ *
+ * Each benchmark runs a function over a batch of inputs, repeatedly, and
+ * reports the best time per operation (one operation is one element of the
+ * batch) and the corresponding throughput. With -csv the results are printed
+ * as comma-separated values, one line per benchmark, for tracking changes
+ * between versions.
+ *
+ * The multi-threaded benchmarks then run again with 1, 2, 4, ... threads, up
+ * to the number of processors or the -T argument, with the speedup over one
+ * thread.
+ */
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE	199309L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vmath.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BATCH		1024
+#define NUM_RUNS	5
+
+struct Bench {
+	const char *name;
+	int batch;				/* operations per call of func */
+	void (*func)();
+};
+
+static double get_time();
+static double run_bench(const Bench *b, double min_time);
+static void init_data();
+static scalar_t rnd(scalar_t low, scalar_t high);
+
+/* results are summed up here, so that the compiler can't discard the work */
+static volatile scalar_t sink;
+
+/* threads for the multi-threaded benchmarks, 0 for one per processor */
+static int bench_threads;
+
+/* input data */
+static vec3_t va[BATCH], vb[BATCH], vres[BATCH];
+static vec4_t v4a[BATCH], v4res[BATCH];
+static scalar_t sa[BATCH], sb[BATCH], sc[BATCH], sres[BATCH];
+static vec3_soa_t soa_a, soa_b, soa_res;
+static mat4_t mata[BATCH], matb[BATCH], matc[BATCH], matres[BATCH];
+static Matrix4x4 mat_cpp[BATCH], matres_cpp[BATCH];
+static Matrix3x3 mat3_cpp[BATCH], mat3res_cpp[BATCH];
+static mat3_t mat3res[BATCH];
+static mat3x4_t mat34a[BATCH], mat34b[BATCH], mat34c[BATCH], mat34res[BATCH];
+static mat3_soa_t mat3_soa, mat3res_soa;
+static quat_t qa[BATCH], qb[BATCH], qres[BATCH];
+static Quaternion qa_cpp[BATCH], qb_cpp[BATCH];
+static quat_soa_t qsoa_a, qsoa_b, qsoa_res;
+static scalar_t tparam[BATCH];
+static scalar_t qmc_pts[BATCH * 2];
+static ray_t rays[BATCH], rays_res[BATCH];
+static Ray rays_cpp[BATCH], rays_res_cpp[BATCH];
+static ray_rcp_t rays_rcp[BATCH];
+static sphere_t spheres[BATCH];
+static plane_t planes[BATCH];
+static aabox_t boxes[BATCH];
+static aabox8_t box_pkts[BATCH / 8];
+static ray8_t ray_pkts[BATCH / 8];
+
+/* triangles around the spheres, and the same triangles and rays in SoA form,
+ * tested in groups: one ray against a mesh chunk, or a ray packet against
+ * one triangle.
+ */
+#define TRI_GROUP	64
+static triangle_t tris[BATCH];
+static triangle_soa_t tri_soa;
+static ray_soa_t ray_soa;
+static vec2_soa_t ray_bary;
+static scalar_t ray_pos[BATCH];
+static int ray_hit[BATCH];
+
+#define NUM_BONES	64
+static dualquat_t bone_dq[NUM_BONES];
+static int bone_idx[BATCH * 4];
+static scalar_t bone_weights[BATCH * 4];
+
+/* skinning at the scale of a crowd of characters */
+#define SKIN_VERTS	1000000
+static mat3x4_t skin_bones[NUM_BONES];
+static Matrix4x4 skin_bones_cpp[NUM_BONES];
+static skin_soa_t skin_in, skin_out;
+static int *skin_idx;
+static scalar_t *skin_weights;
+
+/* a large scene graph, with a random tree shape */
+#define XFORM_NODES	500000
+static int *xform_parent;
+static int *xform_dirty;	/* nodes marked dirty by the update benchmarks */
+static xform_tree_t xform_tree;
+static Matrix4x4 *xform_local_cpp, *xform_world_cpp;
+
+#define NOISE_GRID	32
+static scalar_t noise_res[NOISE_GRID * NOISE_GRID * NOISE_GRID];
+
+#define BVH_PRIMS	(BATCH * 64)
+static sphere_t bvh_spheres[BVH_PRIMS];
+static aabox_t bvh_bounds[BVH_PRIMS];
+static bvh_t bvh, lbvh;
+/* bvh_refit of every 16th primitive */
+#define REFIT_STRIDE	16
+static int refit_changed[BVH_PRIMS / REFIT_STRIDE];
+
+/* instances of one small tree of spheres, scattered around the same volume */
+#define TLAS_BLAS_PRIMS	1024
+#define TLAS_INST		1024
+static sphere_t tlas_spheres[TLAS_BLAS_PRIMS];
+static bvh_t tlas_blas;
+static bvh_tlas_t tlas;
+
+/* incoherent secondary rays from the surfaces of the bvh spheres */
+#define STREAM_RAYS		BVH_PRIMS
+static ray_t stream_rays[STREAM_RAYS];
+static ray_stream_t stream;
+static int stream_prim[STREAM_RAYS];
+static scalar_t stream_pos[STREAM_RAYS];
+static vec3_t mt_points[BVH_PRIMS];
+
+/* frustum culling of the same spheres and boxes */
+static frustum_t cull_frustum;
+static sphere_soa_t cull_sph;
+static aabox_soa_t cull_box;
+static unsigned char *cull_vis, *cull_hint;
+static int *cull_idx;
+
+/* broadphase: the same spheres in cells of consecutive ones */
+#define OVERLAP_CELL	64
+static int overlap_pairs[OVERLAP_CELL * OVERLAP_CELL];
+
+/* ---- benchmark functions ---- */
+
+static void b_v3_add()
+{
+	for(int i=0; i<BATCH; i++) {
+		vres[i] = v3_add(va[i], vb[i]);
+	}
+	sink += vres[BATCH - 1].x;
+}
+
+static void b_v3_cross()
+{
+	for(int i=0; i<BATCH; i++) {
+		vres[i] = v3_cross(va[i], vb[i]);
+	}
+	sink += vres[BATCH - 1].x;
+}
+
+static void b_v3_normalize()
+{
+	for(int i=0; i<BATCH; i++) {
+		vres[i] = v3_normalize(va[i]);
+	}
+	sink += vres[BATCH - 1].x;
+}
+
+static void b_v3_transform()
+{
+	for(int i=0; i<BATCH; i++) {
+		vres[i] = v3_transform(va[i], mata[0]);
+	}
+	sink += vres[BATCH - 1].x;
+}
+
+static void b_v3_add_soa()
+{
+	v3_add_soa(soa_res, soa_a, soa_b, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_v3_cross_soa()
+{
+	v3_cross_soa(soa_res, soa_a, soa_b, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_v3_normalize_soa()
+{
+	v3_normalize_soa(soa_res, soa_a, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_v3_transform_soa()
+{
+	v3_transform_soa(soa_res, soa_a, mata[0], BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_v3_transform_points()
+{
+	v3_transform_points(vres, 0, va, 0, BATCH, mata[0]);
+	sink += vres[BATCH - 1].x;
+}
+
+static void b_v4_transform_array()
+{
+	v4_transform_array(v4res, 0, v4a, 0, BATCH, mata[0]);
+	sink += v4res[BATCH - 1].x;
+}
+
+static void b_Vector3_transform()
+{
+	for(int i=0; i<BATCH; i++) {
+		Vector3 v = Vector3(va[i].x, va[i].y, va[i].z).transformed(mat_cpp[0]);
+		vres[i].x = v.x;
+	}
+	sink += vres[BATCH - 1].x;
+}
+
+static void b_m4_mult()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_mult(matres[i], mata[i], matb[i]);
+	}
+	sink += matres[BATCH - 1][0][0];
+}
+
+static void b_Matrix4x4_mult()
+{
+	for(int i=0; i<BATCH; i++) {
+		matres_cpp[i] = mat_cpp[i] * mat_cpp[BATCH - 1 - i];
+	}
+	sink += matres_cpp[BATCH - 1][0][0];
+}
+
+static void b_m4_inverse()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_inverse(matres[i], mata[i]);
+	}
+	sink += matres[BATCH - 1][0][0];
+}
+
+static void b_Matrix4x4_inverse()
+{
+	for(int i=0; i<BATCH; i++) {
+		matres_cpp[i] = mat_cpp[i].inverse();
+	}
+	sink += matres_cpp[BATCH - 1][0][0];
+}
+
+static void b_m4_inverse_rigid()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_inverse_rigid(matres[i], mata[i]);
+	}
+	sink += matres[BATCH - 1][0][0];
+}
+
+static void b_m4_inverse_affine()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_inverse_affine(matres[i], matc[i]);
+	}
+	sink += matres[BATCH - 1][0][0];
+}
+
+static void b_m4_inverse_auto_rigid()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_inverse_auto(matres[i], mata[i]);
+	}
+	sink += matres[BATCH - 1][0][0];
+}
+
+static void b_m4_inverse_auto_affine()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_inverse_auto(matres[i], matc[i]);
+	}
+	sink += matres[BATCH - 1][0][0];
+}
+
+static void b_Matrix4x4_inverse_auto()
+{
+	for(int i=0; i<BATCH; i++) {
+		matres_cpp[i] = mat_cpp[i].inverse_auto();
+	}
+	sink += matres_cpp[BATCH - 1][0][0];
+}
+
+static void b_m3x4_mult()
+{
+	for(int i=0; i<BATCH; i++) {
+		m3x4_mult(mat34res[i], mat34a[i], mat34b[i]);
+	}
+	sink += mat34res[BATCH - 1][0][0];
+}
+
+static void b_m3x4_mult_array()
+{
+	m3x4_mult_array(mat34res, mat34a, mat34b, BATCH);
+	sink += mat34res[BATCH - 1][0][0];
+}
+
+static void b_m3x4_inverse()
+{
+	for(int i=0; i<BATCH; i++) {
+		m3x4_inverse(mat34res[i], mat34c[i]);
+	}
+	sink += mat34res[BATCH - 1][0][0];
+}
+
+static void b_m3x4_inverse_rigid()
+{
+	for(int i=0; i<BATCH; i++) {
+		m3x4_inverse_rigid(mat34res[i], mat34a[i]);
+	}
+	sink += mat34res[BATCH - 1][0][0];
+}
+
+static void b_v3_transform_soa_m3x4()
+{
+	v3_transform_soa_m3x4(soa_res, soa_a, mat34a[0], BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_Matrix3x3_inverse()
+{
+	for(int i=0; i<BATCH; i++) {
+		mat3res_cpp[i] = mat3_cpp[i].inverse();
+	}
+	sink += mat3res_cpp[BATCH - 1][0][0];
+}
+
+static void b_m4_normal_matrix()
+{
+	for(int i=0; i<BATCH; i++) {
+		m4_normal_matrix(mat3res[i], matc[i]);
+	}
+	sink += mat3res[BATCH - 1][0][0];
+}
+
+static void b_m3_normal_matrix_soa()
+{
+	m3_normal_matrix_soa(mat3res_soa, mat3_soa, BATCH);
+	sink += mat3res_soa.m[0][0][BATCH - 1];
+}
+
+static void b_Matrix4x4_get_rotation_quat()
+{
+	scalar_t sum = 0.0;
+	for(int i=0; i<BATCH; i++) {
+		sum += mat_cpp[i].get_rotation_quat().s;
+	}
+	sink += sum;
+}
+
+static void b_quat_slerp()
+{
+	for(int i=0; i<BATCH; i++) {
+		qres[i] = quat_slerp(qa[i], qb[i], tparam[i]);
+	}
+	sink += qres[BATCH - 1].x;
+}
+
+static void b_Quaternion_slerp()
+{
+	scalar_t sum = 0.0;
+	for(int i=0; i<BATCH; i++) {
+		sum += slerp(qa_cpp[i], qb_cpp[i], tparam[i]).s;
+	}
+	sink += sum;
+}
+
+static void b_quat_slerp_soa()
+{
+	quat_slerp_soa(qsoa_res, qsoa_a, qsoa_b, tparam, BATCH);
+	sink += qsoa_res.x[BATCH - 1];
+}
+
+static void b_quat_nlerp_soa()
+{
+	quat_nlerp_soa(qsoa_res, qsoa_a, qsoa_b, tparam, BATCH);
+	sink += qsoa_res.x[BATCH - 1];
+}
+
+static void b_dq_skin_soa()
+{
+	dq_skin_soa(soa_res, soa_res, soa_a, soa_b, bone_dq, bone_idx, bone_weights, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void skin_lbs(int count, bool mt)
+{
+	if(mt) {
+		skin_lbs_soa_mt(&skin_out, &skin_in, skin_bones, skin_idx, skin_weights, count, bench_threads);
+	} else {
+		skin_lbs_soa(&skin_out, &skin_in, skin_bones, skin_idx, skin_weights, count);
+	}
+	sink += skin_out.pos.x[count - 1];
+}
+
+static void b_skin_lbs_100k() { skin_lbs(100000, false); }
+static void b_skin_lbs_1M() { skin_lbs(1000000, false); }
+static void b_skin_lbs_mt_1M() { skin_lbs(1000000, true); }
+
+/* the straightforward way: blend Matrix4x4 bones, transform with Vector3 */
+static void b_skin_Matrix4x4_100k()
+{
+	scalar_t sum = 0.0;
+	for(int i=0; i<100000; i++) {
+		const int *idx = skin_idx + i * 4;
+		const scalar_t *w = skin_weights + i * 4;
+		Matrix4x4 m = skin_bones_cpp[idx[0]] * w[0] + skin_bones_cpp[idx[1]] * w[1] +
+			skin_bones_cpp[idx[2]] * w[2] + skin_bones_cpp[idx[3]] * w[3];
+
+		Vector3 p = Vector3(skin_in.pos.x[i], skin_in.pos.y[i], skin_in.pos.z[i]).transformed(m);
+		Vector3 n = Vector3(skin_in.norm.x[i], skin_in.norm.y[i], skin_in.norm.z[i]).transformed(Matrix3x3(m));
+		Vector3 t = Vector3(skin_in.tang.x[i], skin_in.tang.y[i], skin_in.tang.z[i]).transformed(Matrix3x3(m));
+		sum += p.x + n.x + t.x;
+	}
+	sink += sum;
+}
+
+static void xform_update(int num_dirty, bool mt)
+{
+	for(int i=0; i<num_dirty; i++) {
+		xform_tree_mark_dirty(&xform_tree, xform_dirty[i]);
+	}
+	if(mt) {
+		xform_tree_update_mt(&xform_tree, bench_threads);
+	} else {
+		xform_tree_update(&xform_tree);
+	}
+	sink += xform_tree.world[XFORM_NODES - 1][0][3];
+}
+
+static void b_xform_tree_update_all() { xform_update(XFORM_NODES, false); }
+static void b_xform_tree_update_mt_all() { xform_update(XFORM_NODES, true); }
+static void b_xform_tree_update_500() { xform_update(500, false); }
+
+/* the same hierarchy with Matrix4x4, parents always come before children */
+static void b_xform_Matrix4x4()
+{
+	for(int i=0; i<XFORM_NODES; i++) {
+		int p = xform_parent[i];
+		if(p < 0) {
+			xform_world_cpp[i] = xform_local_cpp[i];
+		} else {
+			xform_world_cpp[i] = xform_world_cpp[p];
+			xform_world_cpp[i] *= xform_local_cpp[i];
+		}
+	}
+	sink += xform_world_cpp[XFORM_NODES - 1][0][3];
+}
+
+static void b_frand()
+{
+	for(int i=0; i<BATCH; i++) {
+		sres[i] = frand(1.0);
+	}
+	sink += sres[BATCH - 1];
+}
+
+static void b_rng_frand_array()
+{
+	static rng_t rng;
+	if(!rng.s[0]) rng_seed(&rng, 1);
+	rng_frand_array(&rng, sres, BATCH);
+	sink += sres[BATCH - 1];
+}
+
+static void b_rng_sphere_soa()
+{
+	static rng_t rng;
+	if(!rng.s[0]) rng_seed(&rng, 1);
+	rng_sphere_soa(&rng, soa_res, 1.0, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_rng_hemisphere_cos_soa()
+{
+	static rng_t rng;
+	if(!rng.s[0]) rng_seed(&rng, 1);
+	rng_hemisphere_cos_soa(&rng, soa_res, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_qmc_sobol_array()
+{
+	qmc_sobol_array(qmc_pts, 0, BATCH, 2, 1);
+	sink += qmc_pts[BATCH * 2 - 1];
+}
+
+static void b_qmc_halton_array()
+{
+	qmc_halton_array(qmc_pts, 0, BATCH, 2);
+	sink += qmc_pts[BATCH * 2 - 1];
+}
+
+static void b_qmc_rd_array()
+{
+	qmc_rd_array(qmc_pts, 0, BATCH, 2);
+	sink += qmc_pts[BATCH * 2 - 1];
+}
+
+static void b_warp_hemisphere_cos_soa()
+{
+	warp_hemisphere_cos_soa(soa_res, qmc_pts, BATCH);
+	sink += soa_res.x[BATCH - 1];
+}
+
+static void b_noise2()
+{
+	for(int i=0; i<BATCH; i++) {
+		sres[i] = noise2(sa[i], sb[i]);
+	}
+	sink += sres[BATCH - 1];
+}
+
+static void b_noise3()
+{
+	for(int i=0; i<BATCH; i++) {
+		sres[i] = noise3(sa[i], sb[i], sc[i]);
+	}
+	sink += sres[BATCH - 1];
+}
+
+static void b_fbm3()
+{
+	for(int i=0; i<BATCH; i++) {
+		sres[i] = fbm3(sa[i], sb[i], sc[i], 4);
+	}
+	sink += sres[BATCH - 1];
+}
+
+static void b_turbulence3()
+{
+	for(int i=0; i<BATCH; i++) {
+		sres[i] = turbulence3(sa[i], sb[i], sc[i], 4);
+	}
+	sink += sres[BATCH - 1];
+}
+
+static void b_noise3_grid()
+{
+	scalar_t d = 1.0 / 8.0;
+	noise3_grid_ctx(noise_default_ctx(), noise_res, NOISE_GRID, NOISE_GRID, NOISE_GRID,
+			0, 0, 0, d, d, d);
+	sink += noise_res[0];
+}
+
+static void b_fbm3_grid()
+{
+	scalar_t d = 1.0 / 8.0;
+	fbm3_grid_ctx(noise_default_ctx(), noise_res, NOISE_GRID, NOISE_GRID, NOISE_GRID,
+			0, 0, 0, d, d, d, 4);
+	sink += noise_res[0];
+}
+
+static void b_noise3_grid_mt()
+{
+	scalar_t d = 1.0 / 8.0;
+	noise3_grid_ctx_mt(noise_default_ctx(), noise_res, NOISE_GRID, NOISE_GRID, NOISE_GRID,
+			0, 0, 0, d, d, d, bench_threads, 0);
+	sink += noise_res[0];
+}
+
+static void b_fbm3_grid_mt()
+{
+	scalar_t d = 1.0 / 8.0;
+	fbm3_grid_ctx_mt(noise_default_ctx(), noise_res, NOISE_GRID, NOISE_GRID, NOISE_GRID,
+			0, 0, 0, d, d, d, 4, bench_threads, 0);
+	sink += noise_res[0];
+}
+
+static void b_fbm3_points()
+{
+	fbm3_points_ctx(noise_default_ctx(), sres, va, BATCH, 4);
+	sink += sres[BATCH - 1];
+}
+
+static void b_sphere_ray_intersect()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += sphere_ray_intersect(rays[i], spheres[i], &t);
+	}
+	sink += hits;
+}
+
+static void b_plane_ray_intersect()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += plane_ray_intersect(rays[i], planes[i], &t);
+	}
+	sink += hits;
+}
+
+static void b_aabox_ray_intersect()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += aabox_ray_intersect(rays[i], boxes[i], &t);
+	}
+	sink += hits;
+}
+
+static void b_aabox_ray_slab()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += aabox_ray_slab(rays_rcp + i, boxes + i, &t);
+	}
+	sink += hits;
+}
+
+static void b_aabox8_ray_intersect()
+{
+	int hits = 0;
+	for(int i=0; i<BATCH / 8; i++) {
+		hits += aabox8_ray_intersect(box_pkts + i, rays_rcp + i, 0);
+	}
+	sink += hits;
+}
+
+static void b_aabox_ray8_intersect()
+{
+	int hits = 0;
+	for(int i=0; i<BATCH / 8; i++) {
+		hits += aabox_ray8_intersect(ray_pkts + i, boxes + i, 0);
+	}
+	sink += hits;
+}
+
+static void b_triangle_ray_intersect()
+{
+	int hits = 0;
+	scalar_t t;
+	vec2_t bary;
+	for(int i=0; i<BATCH; i++) {
+		hits += triangle_ray_intersect(rays[i], tris + i, &t, &bary);
+	}
+	sink += hits;
+}
+
+static void b_triangle_soa_ray_intersect()
+{
+	int hits = 0;
+	scalar_t t;
+	vec2_t bary;
+	for(int i=0; i<BATCH; i+=TRI_GROUP) {
+		triangle_soa_t grp;
+		grp.v0.x = tri_soa.v0.x + i; grp.v0.y = tri_soa.v0.y + i; grp.v0.z = tri_soa.v0.z + i;
+		grp.v1.x = tri_soa.v1.x + i; grp.v1.y = tri_soa.v1.y + i; grp.v1.z = tri_soa.v1.z + i;
+		grp.v2.x = tri_soa.v2.x + i; grp.v2.y = tri_soa.v2.y + i; grp.v2.z = tri_soa.v2.z + i;
+		hits += triangle_soa_ray_intersect(rays[i], grp, TRI_GROUP, &t, &bary) >= 0;
+	}
+	sink += hits;
+}
+
+static void b_triangle_ray_soa_intersect()
+{
+	int hits = 0;
+	for(int i=0; i<BATCH; i+=TRI_GROUP) {
+		ray_soa_t grp;
+		vec2_soa_t bary;
+		grp.origin.x = ray_soa.origin.x + i; grp.origin.y = ray_soa.origin.y + i;
+		grp.origin.z = ray_soa.origin.z + i;
+		grp.dir.x = ray_soa.dir.x + i; grp.dir.y = ray_soa.dir.y + i; grp.dir.z = ray_soa.dir.z + i;
+		bary.x = ray_bary.x + i;
+		bary.y = ray_bary.y + i;
+		for(int j=0; j<TRI_GROUP; j++) {
+			ray_pos[i + j] = 1.0;
+		}
+		hits += triangle_ray_soa_intersect(tris + i, i, grp, TRI_GROUP, ray_pos + i, bary, ray_hit + i);
+	}
+	sink += hits;
+}
+
+static void b_ray_transform()
+{
+	for(int i=0; i<BATCH; i++) {
+		rays_res[i] = ray_transform(rays[i], mata[i]);
+	}
+	sink += rays_res[BATCH - 1].origin.x;
+}
+
+static void b_Ray_transform()
+{
+	for(int i=0; i<BATCH; i++) {
+		rays_res_cpp[i] = rays_cpp[i];
+		rays_res_cpp[i].transform(mat_cpp[i]);
+	}
+	sink += rays_res_cpp[BATCH - 1].origin.x;
+}
+
+static int bvh_hit_sphere(int prim, ray_t ray, scalar_t tmax, scalar_t *t, void *cls)
+{
+	scalar_t tt;
+	if(sphere_ray_intersect(ray, bvh_spheres[prim], &tt) && tt < tmax) {
+		*t = tt;
+		return 1;
+	}
+	return 0;
+}
+
+static int tlas_hit_sphere(int prim, ray_t ray, scalar_t tmax, scalar_t *t, void *cls)
+{
+	scalar_t tt;
+	if(sphere_ray_intersect(ray, ((sphere_t*)cls)[prim], &tt) && tt < tmax) {
+		*t = tt;
+		return 1;
+	}
+	return 0;
+}
+
+static void b_frustum_aabox_test()
+{
+	int count = 0;
+	for(int i=0; i<BVH_PRIMS; i++) {
+		count += frustum_aabox_test(&cull_frustum, bvh_bounds + i, cull_hint + i);
+	}
+	sink += count;
+}
+
+static void b_frustum_cull_spheres_soa()
+{
+	sink += frustum_cull_spheres_soa(&cull_frustum, cull_sph, BVH_PRIMS, 0, cull_idx, 0);
+}
+
+static void b_frustum_cull_spheres_soa_mt()
+{
+	sink += frustum_cull_spheres_soa_mt(&cull_frustum, cull_sph, BVH_PRIMS, 0, cull_idx, 0, bench_threads, 0);
+}
+
+static void b_frustum_cull_aabox_soa()
+{
+	sink += frustum_cull_aabox_soa(&cull_frustum, cull_box, BVH_PRIMS, 0, cull_idx, 0);
+}
+
+static void b_frustum_cull_aabox_soa_hint()
+{
+	sink += frustum_cull_aabox_soa(&cull_frustum, cull_box, BVH_PRIMS, cull_vis, 0, cull_hint);
+}
+
+static void b_sphere_sphere_overlap()
+{
+	int count = 0;
+	sphere_t sph = sphere_cons(0, 0, 0, 2);
+	for(int i=0; i<BVH_PRIMS; i++) {
+		count += sphere_sphere_overlap(sph, bvh_spheres[i]);
+	}
+	sink += count;
+}
+
+static void b_sphere_overlap_soa()
+{
+	sink += sphere_overlap_soa(sphere_cons(0, 0, 0, 2), cull_sph, BVH_PRIMS, 0, cull_idx);
+}
+
+static void b_sphere_overlap_pairs_soa()
+{
+	int count = 0;
+	for(int i=0; i<BVH_PRIMS; i+=OVERLAP_CELL) {
+		sphere_soa_t cell;
+		cell.x = cull_sph.x + i;
+		cell.y = cull_sph.y + i;
+		cell.z = cull_sph.z + i;
+		cell.rad = cull_sph.rad + i;
+		count += sphere_overlap_pairs_soa(cell, OVERLAP_CELL, overlap_pairs, OVERLAP_CELL * OVERLAP_CELL / 2);
+	}
+	sink += count;
+}
+
+static void b_bvh_build()
+{
+	bvh_build(&bvh, bvh_bounds, BVH_PRIMS);
+	sink += bvh.num_nodes;
+}
+
+static void b_bvh_build_lbvh()
+{
+	bvh_build_lbvh(&lbvh, bvh_bounds, BVH_PRIMS, BVH_MORTON30, 1);
+	sink += lbvh.num_nodes;
+}
+
+static void b_bvh_build_lbvh_mt()
+{
+	bvh_build_lbvh(&lbvh, bvh_bounds, BVH_PRIMS, BVH_MORTON30, bench_threads);
+	sink += lbvh.num_nodes;
+}
+
+static void b_bvh_ray_closest()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += bvh_ray_closest(&bvh, rays[i], bvh_hit_sphere, 0, &t, 0) >= 0;
+	}
+	sink += hits;
+}
+
+static void b_bvh_ray_any()
+{
+	int hits = 0;
+	for(int i=0; i<BATCH; i++) {
+		hits += bvh_ray_any(&bvh, rays[i], bvh_hit_sphere, 0, 0, 0) >= 0;
+	}
+	sink += hits;
+}
+
+static void b_bvh_refit()
+{
+	bvh_refit(&lbvh, bvh_bounds, refit_changed, BVH_PRIMS / REFIT_STRIDE, 0);
+	sink += lbvh.refit_stats.num_refit;
+}
+
+static void b_bvh_refit_rotate()
+{
+	bvh_refit(&lbvh, bvh_bounds, refit_changed, BVH_PRIMS / REFIT_STRIDE, 1);
+	sink += lbvh.refit_stats.num_refit;
+}
+
+static void b_lbvh_ray_closest()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += bvh_ray_closest(&lbvh, rays[i], bvh_hit_sphere, 0, &t, 0) >= 0;
+	}
+	sink += hits;
+}
+
+static void b_bvh_ray_closest_stream_mt()
+{
+	sink += bvh_ray_closest_stream_mt(&bvh, &stream, bvh_hit_sphere, 0, stream_prim, stream_pos, 0, bench_threads, 0);
+}
+
+/* the centers of the bvh spheres, strided */
+static void b_v3_transform_points_64k()
+{
+	v3_transform_points(mt_points, 0, &bvh_spheres[0].pos, sizeof *bvh_spheres, BVH_PRIMS, mata[0]);
+	sink += mt_points[BVH_PRIMS - 1].x;
+}
+
+static void b_v3_transform_points_mt()
+{
+	v3_transform_points_mt(mt_points, 0, &bvh_spheres[0].pos, sizeof *bvh_spheres, BVH_PRIMS, mata[0], bench_threads, 0);
+	sink += mt_points[BVH_PRIMS - 1].x;
+}
+
+static void b_tlas_ray_closest()
+{
+	int hits = 0;
+	scalar_t t;
+	for(int i=0; i<BATCH; i++) {
+		hits += bvh_tlas_ray_closest(&tlas, rays[i], 0, &t, 0) >= 0;
+	}
+	sink += hits;
+}
+
+static void b_tlas_update()
+{
+	bvh_tlas_update(&tlas, 0, TLAS_INST, 0);
+	sink += tlas.top.refit_stats.num_refit;
+}
+
+static void b_ray_stream_sort()
+{
+	ray_stream_sort(&stream, stream_rays, STREAM_RAYS, 0, RAY_SORT_OCTANT_CELL, 1);
+	sink += stream.order[0];
+}
+
+static void b_bvh_ray_closest_incoherent()
+{
+	int hits = 0;
+	for(int i=0; i<STREAM_RAYS; i++) {
+		hits += (stream_prim[i] = bvh_ray_closest(&bvh, stream_rays[i], bvh_hit_sphere, 0,
+					stream_pos + i, 0)) >= 0;
+	}
+	sink += hits;
+}
+
+static void b_bvh_ray_closest_stream()
+{
+	sink += bvh_ray_closest_stream(&bvh, &stream, bvh_hit_sphere, 0, stream_prim, stream_pos, 0);
+}
+
+/* the scheduler on its own: batches of empty chunks, and batches started from
+ * within batches
+ */
+#define SCHED_CHUNKS	64
+
+static void empty_chunk(int start, int end, void *cls)
+{
+}
+
+static void b_parallel_for_empty()
+{
+	vmath_parallel_for(SCHED_CHUNKS, bench_threads, 1, empty_chunk, 0);
+	sink += 1;
+}
+
+static void sched_nested_chunk(int start, int end, void *cls)
+{
+	vmath_parallel_for(SCHED_CHUNKS, bench_threads, 1, empty_chunk, 0);
+}
+
+static void b_parallel_for_nested()
+{
+	vmath_parallel_for(SCHED_CHUNKS, bench_threads, 1, sched_nested_chunk, 0);
+	sink += 1;
+}
+
+static Bench benchmarks[] = {
+	{"v3_add", BATCH, b_v3_add},
+	{"v3_cross", BATCH, b_v3_cross},
+	{"v3_normalize", BATCH, b_v3_normalize},
+	{"v3_transform", BATCH, b_v3_transform},
+	{"v3_add_soa", BATCH, b_v3_add_soa},
+	{"v3_cross_soa", BATCH, b_v3_cross_soa},
+	{"v3_normalize_soa", BATCH, b_v3_normalize_soa},
+	{"v3_transform_soa", BATCH, b_v3_transform_soa},
+	{"v3_transform_points", BATCH, b_v3_transform_points},
+	{"v4_transform_array", BATCH, b_v4_transform_array},
+	{"Vector3::transformed", BATCH, b_Vector3_transform},
+
+	{"m4_mult", BATCH, b_m4_mult},
+	{"Matrix4x4::operator*", BATCH, b_Matrix4x4_mult},
+	{"m4_inverse", BATCH, b_m4_inverse},
+	{"Matrix4x4::inverse", BATCH, b_Matrix4x4_inverse},
+	{"m4_inverse_rigid", BATCH, b_m4_inverse_rigid},
+	{"m4_inverse_affine", BATCH, b_m4_inverse_affine},
+	{"m4_inverse_auto (rigid)", BATCH, b_m4_inverse_auto_rigid},
+	{"m4_inverse_auto (affine)", BATCH, b_m4_inverse_auto_affine},
+	{"Matrix4x4::inverse_auto", BATCH, b_Matrix4x4_inverse_auto},
+	{"m3x4_mult", BATCH, b_m3x4_mult},
+	{"m3x4_mult_array", BATCH, b_m3x4_mult_array},
+	{"m3x4_inverse", BATCH, b_m3x4_inverse},
+	{"m3x4_inverse_rigid", BATCH, b_m3x4_inverse_rigid},
+	{"v3_transform_soa_m3x4", BATCH, b_v3_transform_soa_m3x4},
+	{"Matrix3x3::inverse", BATCH, b_Matrix3x3_inverse},
+	{"m4_normal_matrix", BATCH, b_m4_normal_matrix},
+	{"m3_normal_matrix_soa", BATCH, b_m3_normal_matrix_soa},
+	{"Matrix4x4::get_rotation_quat", BATCH, b_Matrix4x4_get_rotation_quat},
+
+	{"quat_slerp", BATCH, b_quat_slerp},
+	{"quat_slerp_soa", BATCH, b_quat_slerp_soa},
+	{"quat_nlerp_soa", BATCH, b_quat_nlerp_soa},
+	{"dq_skin_soa", BATCH, b_dq_skin_soa},
+	{"skin_Matrix4x4_100k", 100000, b_skin_Matrix4x4_100k},
+	{"skin_lbs_100k", 100000, b_skin_lbs_100k},
+	{"skin_lbs_1M", 1000000, b_skin_lbs_1M},
+	{"skin_lbs_mt_1M", 1000000, b_skin_lbs_mt_1M},
+	{"Quaternion slerp", BATCH, b_Quaternion_slerp},
+
+	{"Matrix4x4 hierarchy", XFORM_NODES, b_xform_Matrix4x4},
+	{"xform_tree_update (all)", XFORM_NODES, b_xform_tree_update_all},
+	{"xform_tree_update_mt (all)", XFORM_NODES, b_xform_tree_update_mt_all},
+	{"xform_tree_update (500 dirty)", XFORM_NODES, b_xform_tree_update_500},
+
+	{"frand", BATCH, b_frand},
+	{"rng_frand_array", BATCH, b_rng_frand_array},
+	{"rng_sphere_soa", BATCH, b_rng_sphere_soa},
+	{"rng_hemisphere_cos_soa", BATCH, b_rng_hemisphere_cos_soa},
+
+	{"qmc_sobol_array (2D, owen)", BATCH, b_qmc_sobol_array},
+	{"qmc_halton_array (2D)", BATCH, b_qmc_halton_array},
+	{"qmc_rd_array (2D)", BATCH, b_qmc_rd_array},
+	{"warp_hemisphere_cos_soa", BATCH, b_warp_hemisphere_cos_soa},
+
+	{"noise2", BATCH, b_noise2},
+	{"noise3", BATCH, b_noise3},
+	{"fbm3 (4 octaves)", BATCH, b_fbm3},
+	{"turbulence3 (4 octaves)", BATCH, b_turbulence3},
+	{"noise3_grid_ctx", NOISE_GRID * NOISE_GRID * NOISE_GRID, b_noise3_grid},
+	{"fbm3_grid_ctx (4 octaves)", NOISE_GRID * NOISE_GRID * NOISE_GRID, b_fbm3_grid},
+	{"noise3_grid_ctx_mt", NOISE_GRID * NOISE_GRID * NOISE_GRID, b_noise3_grid_mt},
+	{"fbm3_grid_ctx_mt (4 octaves)", NOISE_GRID * NOISE_GRID * NOISE_GRID, b_fbm3_grid_mt},
+	{"fbm3_points_ctx (4 octaves)", BATCH, b_fbm3_points},
+
+	{"sphere_ray_intersect", BATCH, b_sphere_ray_intersect},
+	{"plane_ray_intersect", BATCH, b_plane_ray_intersect},
+	{"aabox_ray_intersect", BATCH, b_aabox_ray_intersect},
+	{"aabox_ray_slab", BATCH, b_aabox_ray_slab},
+	{"aabox8_ray_intersect (per box)", BATCH, b_aabox8_ray_intersect},
+	{"aabox_ray8_intersect (per ray)", BATCH, b_aabox_ray8_intersect},
+	{"triangle_ray_intersect", BATCH, b_triangle_ray_intersect},
+	{"triangle_soa_ray_intersect", BATCH, b_triangle_soa_ray_intersect},
+	{"triangle_ray_soa_intersect", BATCH, b_triangle_ray_soa_intersect},
+
+	{"ray_transform", BATCH, b_ray_transform},
+	{"Ray::transform", BATCH, b_Ray_transform},
+
+	{"frustum_aabox_test (hints)", BVH_PRIMS, b_frustum_aabox_test},
+	{"frustum_cull_spheres_soa", BVH_PRIMS, b_frustum_cull_spheres_soa},
+	{"frustum_cull_spheres_soa_mt", BVH_PRIMS, b_frustum_cull_spheres_soa_mt},
+	{"frustum_cull_aabox_soa", BVH_PRIMS, b_frustum_cull_aabox_soa},
+	{"frustum_cull_aabox_soa (hints)", BVH_PRIMS, b_frustum_cull_aabox_soa_hint},
+
+	{"sphere_sphere_overlap", BVH_PRIMS, b_sphere_sphere_overlap},
+	{"sphere_overlap_soa", BVH_PRIMS, b_sphere_overlap_soa},
+	{"sphere_overlap_pairs_soa (pair)", BVH_PRIMS / OVERLAP_CELL * (OVERLAP_CELL * (OVERLAP_CELL - 1) / 2),
+		b_sphere_overlap_pairs_soa},
+
+	{"bvh_build (per primitive)", BVH_PRIMS, b_bvh_build},
+	{"bvh_ray_closest", BATCH, b_bvh_ray_closest},
+	{"bvh_ray_any", BATCH, b_bvh_ray_any},
+	{"bvh_build_lbvh (per primitive)", BVH_PRIMS, b_bvh_build_lbvh},
+	{"bvh_build_lbvh mt (per prim)", BVH_PRIMS, b_bvh_build_lbvh_mt},
+	{"bvh_ray_closest (lbvh)", BATCH, b_lbvh_ray_closest},
+	{"bvh_refit (per changed prim)", BVH_PRIMS / REFIT_STRIDE, b_bvh_refit},
+	{"bvh_refit rotate (per changed)", BVH_PRIMS / REFIT_STRIDE, b_bvh_refit_rotate},
+	{"bvh_tlas_ray_closest", BATCH, b_tlas_ray_closest},
+	{"bvh_tlas_update (per instance)", TLAS_INST, b_tlas_update},
+	{"ray_stream_sort (per ray)", STREAM_RAYS, b_ray_stream_sort},
+	{"bvh_ray_closest (incoherent)", STREAM_RAYS, b_bvh_ray_closest_incoherent},
+	{"bvh_ray_closest_stream (sorted)", STREAM_RAYS, b_bvh_ray_closest_stream},
+	{"bvh_ray_closest_stream_mt", STREAM_RAYS, b_bvh_ray_closest_stream_mt},
+	{"v3_transform_points (64k)", BVH_PRIMS, b_v3_transform_points_64k},
+	{"v3_transform_points_mt (64k)", BVH_PRIMS, b_v3_transform_points_mt},
+
+	{0, 0, 0}
+};
+
+/* the multi-threaded benchmarks, run again with 1, 2, 4, ... threads up to the
+ * number of processors (or -T)
+ */
+static Bench scaling[] = {
+	{"parallel_for (empty chunk)", SCHED_CHUNKS, b_parallel_for_empty},
+	{"parallel_for nested (chunk)", SCHED_CHUNKS * SCHED_CHUNKS, b_parallel_for_nested},
+	{"skin_lbs_mt_1M", 1000000, b_skin_lbs_mt_1M},
+	{"xform_tree_update_mt (all)", XFORM_NODES, b_xform_tree_update_mt_all},
+	{"fbm3_grid_ctx_mt (4 octaves)", NOISE_GRID * NOISE_GRID * NOISE_GRID, b_fbm3_grid_mt},
+	{"frustum_cull_spheres_soa_mt", BVH_PRIMS, b_frustum_cull_spheres_soa_mt},
+	{"bvh_build_lbvh mt (per prim)", BVH_PRIMS, b_bvh_build_lbvh_mt},
+	{"bvh_ray_closest_stream_mt", STREAM_RAYS, b_bvh_ray_closest_stream_mt},
+	{"v3_transform_points_mt (64k)", BVH_PRIMS, b_v3_transform_points_mt},
+
+	{0, 0, 0}
+};
+
+static bool match_filters(const char *name, const char **filters, int num_filters);
+static void print_result(const char *name, int batch, double ns, bool csv);
+
+
+int main(int argc, char **argv)
+{
+	bool csv = false;
+	double min_time = 0.25;
+	int max_threads = vmath_num_cpus();
+	const char **filters = new const char*[argc];
+	int num_filters = 0;
+
+	for(int i=1; i<argc; i++) {
+		if(argv[i][0] == '-') {
+			if(strcmp(argv[i], "-csv") == 0) {
+				csv = true;
+			} else if(strcmp(argv[i], "-t") == 0 && i < argc - 1) {
+				min_time = atof(argv[++i]);
+			} else if(strcmp(argv[i], "-T") == 0 && i < argc - 1) {
+				max_threads = atoi(argv[++i]);
+				if(max_threads < 1) max_threads = 1;
+				if(max_threads > VMATH_MAX_THREADS) max_threads = VMATH_MAX_THREADS;
+			} else if(strcmp(argv[i], "-l") == 0) {
+				for(int j=0; benchmarks[j].name; j++) {
+					puts(benchmarks[j].name);
+				}
+				return 0;
+			} else {
+				fprintf(stderr, "usage: %s [-csv] [-t <seconds>] [-T <threads>] [-l] [name filters ...]\n", argv[0]);
+				fprintf(stderr, "  -csv: output comma-separated values\n");
+				fprintf(stderr, "  -t: minimum time spent on each benchmark (default: 0.25)\n");
+				fprintf(stderr, "  -T: most threads for the scaling runs (default: number of processors)\n");
+				fprintf(stderr, "  -l: list the available benchmarks\n");
+				return strcmp(argv[i], "-h") == 0 ? 0 : 1;
+			}
+		} else {
+			filters[num_filters++] = argv[i];
+		}
+	}
+
+	init_data();
+
+	if(csv) {
+		printf("name,batch,ns_per_op,mops_per_sec\n");
+	} else {
+		printf("%-32s %8s %12s %12s\n", "benchmark", "batch", "ns/op", "Mops/s");
+	}
+
+	for(int i=0; benchmarks[i].name; i++) {
+		const Bench *b = benchmarks + i;
+		if(!match_filters(b->name, filters, num_filters)) continue;
+
+		print_result(b->name, b->batch, run_bench(b, min_time), csv);
+	}
+
+	if(!csv) {
+		printf("\n%-32s %8s %12s %12s %8s\n", "scaling", "threads", "ns/op", "Mops/s", "speedup");
+	}
+	for(int i=0; scaling[i].name; i++) {
+		const Bench *b = scaling + i;
+		if(!match_filters(b->name, filters, num_filters)) continue;
+
+		double ns1 = 0.0;
+		for(int n=1; ; n = n * 2 < max_threads ? n * 2 : max_threads) {
+			bench_threads = n;
+			double ns = run_bench(b, min_time);
+			if(n == 1) ns1 = ns;
+
+			if(csv) {
+				char name[64];
+				sprintf(name, "%.40s (%d thr)", b->name, n);
+				print_result(name, b->batch, ns, csv);
+			} else {
+				printf("%-32s %8d %12.3f %12.2f %8.2f\n", b->name, n, ns, 1000.0 / ns, ns1 / ns);
+				fflush(stdout);
+			}
+			if(n >= max_threads) break;
+		}
+	}
+	bench_threads = 0;
+
+	bvh_destroy(&bvh);
+	bvh_destroy(&lbvh);
+	bvh_tlas_destroy(&tlas);
+	bvh_destroy(&tlas_blas);
+	ray_stream_destroy(&stream);
+	delete [] filters;
+	return 0;
+}
+
+static bool match_filters(const char *name, const char **filters, int num_filters)
+{
+	if(!num_filters) return true;
+
+	for(int i=0; i<num_filters; i++) {
+		if(strstr(name, filters[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void print_result(const char *name, int batch, double ns, bool csv)
+{
+	if(csv) {
+		printf("\"%s\",%d,%.4f,%.4f\n", name, batch, ns, 1000.0 / ns);
+	} else {
+		printf("%-32s %8d %12.3f %12.2f\n", name, batch, ns, 1000.0 / ns);
+	}
+	fflush(stdout);
+}
+
+/* returns the best time per operation in nanoseconds. The number of calls per
+ * run is calibrated so that all NUM_RUNS runs take about min_time in total.
+ */
+static double run_bench(const Bench *b, double min_time)
+{
+	long iter = 1;
+	double t;
+
+	b->func();	/* warm-up */
+
+	for(;;) {
+		t = get_time();
+		for(long i=0; i<iter; i++) {
+			b->func();
+		}
+		t = get_time() - t;
+		if(t >= min_time / (NUM_RUNS * 4) || iter >= (1L << 28)) {
+			break;
+		}
+		iter *= 2;
+	}
+	if(t > 0.0) {
+		long n = (long)(iter * (min_time / NUM_RUNS) / t);
+		iter = n > 1 ? n : 1;
+	}
+
+	double best = -1.0;
+	for(int run=0; run<NUM_RUNS; run++) {
+		t = get_time();
+		for(long i=0; i<iter; i++) {
+			b->func();
+		}
+		t = get_time() - t;
+		if(best < 0.0 || t < best) {
+			best = t;
+		}
+	}
+	return best * 1e9 / ((double)iter * b->batch);
+}
+
+#ifdef _WIN32
+static double get_time()
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if(!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+}
+#else
+static double get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+#endif
+
+static void init_data()
+{
+	static scalar_t soa_mem[9][BATCH];
+	static scalar_t mat3_soa_mem[18][BATCH];
+	static scalar_t quat_soa_mem[12][BATCH];
+	static scalar_t tri_soa_mem[9][BATCH];
+	static scalar_t ray_soa_mem[8][BATCH];
+	int i;
+
+	soa_a.x = soa_mem[0]; soa_a.y = soa_mem[1]; soa_a.z = soa_mem[2];
+	soa_b.x = soa_mem[3]; soa_b.y = soa_mem[4]; soa_b.z = soa_mem[5];
+	soa_res.x = soa_mem[6]; soa_res.y = soa_mem[7]; soa_res.z = soa_mem[8];
+
+	for(i=0; i<9; i++) {
+		mat3_soa.m[i / 3][i % 3] = mat3_soa_mem[i];
+		mat3res_soa.m[i / 3][i % 3] = mat3_soa_mem[9 + i];
+	}
+
+	qsoa_a.x = quat_soa_mem[0]; qsoa_a.y = quat_soa_mem[1]; qsoa_a.z = quat_soa_mem[2]; qsoa_a.w = quat_soa_mem[3];
+	qsoa_b.x = quat_soa_mem[4]; qsoa_b.y = quat_soa_mem[5]; qsoa_b.z = quat_soa_mem[6]; qsoa_b.w = quat_soa_mem[7];
+	qsoa_res.x = quat_soa_mem[8]; qsoa_res.y = quat_soa_mem[9]; qsoa_res.z = quat_soa_mem[10]; qsoa_res.w = quat_soa_mem[11];
+
+	for(i=0; i<BATCH; i++) {
+		va[i] = v3_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10));
+		vb[i] = v3_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10));
+		v4a[i] = v4_cons(va[i].x, va[i].y, va[i].z, 1.0);
+		soa_a.x[i] = va[i].x; soa_a.y[i] = va[i].y; soa_a.z[i] = va[i].z;
+		soa_b.x[i] = vb[i].x; soa_b.y[i] = vb[i].y; soa_b.z[i] = vb[i].z;
+
+		sa[i] = rnd(0, 100);
+		sb[i] = rnd(0, 100);
+		sc[i] = rnd(0, 100);
+
+		/* rigid transformations, the most common kind */
+		Vector3 axis = Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized();
+		Matrix4x4 xform;
+		xform.translate(Vector3(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10)));
+		xform.rotate(axis, rnd(0, TWO_PI));
+		mat_cpp[i] = xform;
+		memcpy(mata[i], xform.m, sizeof(mat4_t));
+
+		axis = Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized();
+		xform.rotate(axis, rnd(0, TWO_PI));
+		memcpy(matb[i], xform.m, sizeof(mat4_t));
+
+		/* ... and affine ones, with non-uniform scaling */
+		xform.scale(Vector4(rnd(0.5, 2), rnd(0.5, 2), rnd(0.5, 2), 1));
+		memcpy(matc[i], xform.m, sizeof(mat4_t));
+
+		m4_to_m3x4(mat34a[i], mata[i]);
+		m4_to_m3x4(mat34b[i], matb[i]);
+		m4_to_m3x4(mat34c[i], matc[i]);
+
+		for(int j=0; j<3; j++) {
+			for(int k=0; k<3; k++) {
+				mat3_cpp[i][j][k] = matc[i][j][k];
+				mat3_soa_mem[j * 3 + k][i] = matc[i][j][k];
+			}
+		}
+
+		qa_cpp[i] = Quaternion(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+		qb_cpp[i] = Quaternion(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+		qa[i] = quat_cons(qa_cpp[i].s, qa_cpp[i].v.x, qa_cpp[i].v.y, qa_cpp[i].v.z);
+		qb[i] = quat_cons(qb_cpp[i].s, qb_cpp[i].v.x, qb_cpp[i].v.y, qb_cpp[i].v.z);
+		qsoa_a.x[i] = qa[i].x; qsoa_a.y[i] = qa[i].y; qsoa_a.z[i] = qa[i].z; qsoa_a.w[i] = qa[i].w;
+		qsoa_b.x[i] = qb[i].x; qsoa_b.y[i] = qb[i].y; qsoa_b.z[i] = qb[i].z; qsoa_b.w[i] = qb[i].w;
+		tparam[i] = rnd(0, 1);
+
+		/* rays from around the origin, towards spheres/boxes of the same
+		 * index, which they hit about half of the time.
+		 */
+		vec3_t targ = v3_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10));
+		rays[i].origin = v3_cons(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1));
+		rays[i].dir = v3_scale(v3_sub(targ, rays[i].origin), 2.0);
+		rays_cpp[i] = Ray(Vector3(rays[i].origin.x, rays[i].origin.y, rays[i].origin.z),
+				Vector3(rays[i].dir.x, rays[i].dir.y, rays[i].dir.z));
+		rays_rcp[i] = ray_rcp_cons(rays[i]);
+
+		scalar_t rad = rnd(0.5, 2.0);
+		vec3_t c = v3_add(targ, v3_cons(rnd(-2, 2), rnd(-2, 2), rnd(-2, 2)));
+		spheres[i] = sphere_cons(c.x, c.y, c.z, rad);
+		boxes[i] = aabox_cons(c.x - rad, c.y - rad, c.z - rad, c.x + rad, c.y + rad, c.z + rad);
+		planes[i] = plane_ptnorm(c, v3_normalize(v3_cons(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1))));
+
+		for(int j=0; j<3; j++) {
+			tris[i].v[j] = v3_add(c, v3_cons(rnd(-rad, rad), rnd(-rad, rad), rnd(-rad, rad)));
+			tri_soa_mem[j * 3][i] = tris[i].v[j].x;
+			tri_soa_mem[j * 3 + 1][i] = tris[i].v[j].y;
+			tri_soa_mem[j * 3 + 2][i] = tris[i].v[j].z;
+		}
+		ray_soa_mem[0][i] = rays[i].origin.x;
+		ray_soa_mem[1][i] = rays[i].origin.y;
+		ray_soa_mem[2][i] = rays[i].origin.z;
+		ray_soa_mem[3][i] = rays[i].dir.x;
+		ray_soa_mem[4][i] = rays[i].dir.y;
+		ray_soa_mem[5][i] = rays[i].dir.z;
+	}
+	tri_soa.v0.x = tri_soa_mem[0]; tri_soa.v0.y = tri_soa_mem[1]; tri_soa.v0.z = tri_soa_mem[2];
+	tri_soa.v1.x = tri_soa_mem[3]; tri_soa.v1.y = tri_soa_mem[4]; tri_soa.v1.z = tri_soa_mem[5];
+	tri_soa.v2.x = tri_soa_mem[6]; tri_soa.v2.y = tri_soa_mem[7]; tri_soa.v2.z = tri_soa_mem[8];
+	ray_soa.origin.x = ray_soa_mem[0]; ray_soa.origin.y = ray_soa_mem[1]; ray_soa.origin.z = ray_soa_mem[2];
+	ray_soa.dir.x = ray_soa_mem[3]; ray_soa.dir.y = ray_soa_mem[4]; ray_soa.dir.z = ray_soa_mem[5];
+	ray_bary.x = ray_soa_mem[6];
+	ray_bary.y = ray_soa_mem[7];
+
+	for(i=0; i<BATCH / 8; i++) {
+		aabox8_pack(box_pkts + i, boxes + i * 8, 8);
+		ray8_pack(ray_pkts + i, rays_rcp + i * 8, 8);
+	}
+
+	/* bone palette from the rigid transformations, 4 random influences per vertex */
+	for(i=0; i<NUM_BONES; i++) {
+		bone_dq[i] = dq_from_mat4(mata[i]);
+	}
+	for(i=0; i<BATCH; i++) {
+		scalar_t wsum = 0.0;
+		for(int j=0; j<4; j++) {
+			bone_idx[i * 4 + j] = (int)rnd(0, NUM_BONES - 0.01);
+			bone_weights[i * 4 + j] = rnd(0, 1);
+			wsum += bone_weights[i * 4 + j];
+		}
+		for(int j=0; j<4; j++) {
+			bone_weights[i * 4 + j] /= wsum;
+		}
+	}
+
+	for(i=0; i<NUM_BONES; i++) {
+		memcpy(skin_bones[i], mata[i], sizeof skin_bones[i]);
+		skin_bones_cpp[i] = mat_cpp[i];
+	}
+
+	scalar_t *skin_mem = new scalar_t[SKIN_VERTS * 22];
+	vec3_soa_t *streams[] = {&skin_in.pos, &skin_in.norm, &skin_in.tang,
+		&skin_out.pos, &skin_out.norm, &skin_out.tang};
+	for(i=0; i<6; i++) {
+		streams[i]->x = skin_mem + (i * 3) * SKIN_VERTS;
+		streams[i]->y = skin_mem + (i * 3 + 1) * SKIN_VERTS;
+		streams[i]->z = skin_mem + (i * 3 + 2) * SKIN_VERTS;
+	}
+	skin_weights = skin_mem + 18 * SKIN_VERTS;
+	skin_idx = new int[SKIN_VERTS * 4];
+
+	for(i=0; i<SKIN_VERTS; i++) {
+		vec3_t n = v3_normalize(v3_cons(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)));
+		vec3_t t = v3_normalize(v3_cross(n, v3_cons(0, 1, 0)));
+		skin_in.pos.x[i] = rnd(-1, 1);
+		skin_in.pos.y[i] = rnd(0, 2);
+		skin_in.pos.z[i] = rnd(-1, 1);
+		skin_in.norm.x[i] = n.x; skin_in.norm.y[i] = n.y; skin_in.norm.z[i] = n.z;
+		skin_in.tang.x[i] = t.x; skin_in.tang.y[i] = t.y; skin_in.tang.z[i] = t.z;
+
+		scalar_t wsum = 0.0;
+		for(int j=0; j<4; j++) {
+			skin_idx[i * 4 + j] = (int)rnd(0, NUM_BONES - 0.01);
+			skin_weights[i * 4 + j] = rnd(0, 1);
+			wsum += skin_weights[i * 4 + j];
+		}
+		for(int j=0; j<4; j++) {
+			skin_weights[i * 4 + j] /= wsum;
+		}
+	}
+
+	xform_parent = new int[XFORM_NODES];
+	xform_dirty = new int[XFORM_NODES];
+	xform_local_cpp = new Matrix4x4[XFORM_NODES];
+	xform_world_cpp = new Matrix4x4[XFORM_NODES];
+	xform_tree_init(&xform_tree);
+	for(i=0; i<XFORM_NODES; i++) {
+		xform_parent[i] = i < 16 ? -1 : (int)rnd(0, i - 1);
+	}
+	xform_tree_build(&xform_tree, xform_parent, XFORM_NODES);
+	for(i=0; i<XFORM_NODES; i++) {
+		Matrix3x4 xform;
+		xform.translate(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)));
+		xform.rotate(Vector3(0, 1, 0), rnd(0, TWO_PI));
+		xform_tree_set_local(&xform_tree, i, xform.m);
+		xform_local_cpp[i] = Matrix4x4(xform);
+	}
+
+	for(i=0; i<BVH_PRIMS; i++) {
+		scalar_t rad = rnd(0.02, 0.1);
+		vec3_t c = v3_cons(rnd(-20, 20), rnd(-20, 20), rnd(-20, 20));
+		bvh_spheres[i] = sphere_cons(c.x, c.y, c.z, rad);
+		bvh_bounds[i] = aabox_cons(c.x - rad, c.y - rad, c.z - rad, c.x + rad, c.y + rad, c.z + rad);
+	}
+	bvh_init(&bvh);
+	bvh_build(&bvh, bvh_bounds, BVH_PRIMS);
+	bvh_init(&lbvh);
+	bvh_build_lbvh(&lbvh, bvh_bounds, BVH_PRIMS, BVH_MORTON30, 1);
+	for(i=0; i<BVH_PRIMS / REFIT_STRIDE; i++) {
+		refit_changed[i] = i * REFIT_STRIDE;
+	}
+
+	aabox_t *tlas_bounds = new aabox_t[TLAS_BLAS_PRIMS];
+	for(i=0; i<TLAS_BLAS_PRIMS; i++) {
+		scalar_t rad = rnd(0.02, 0.1);
+		vec3_t c = v3_cons(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1));
+		tlas_spheres[i] = sphere_cons(c.x, c.y, c.z, rad);
+		tlas_bounds[i] = aabox_cons(c.x - rad, c.y - rad, c.z - rad, c.x + rad, c.y + rad, c.z + rad);
+	}
+	bvh_init(&tlas_blas);
+	bvh_build(&tlas_blas, tlas_bounds, TLAS_BLAS_PRIMS);
+	delete [] tlas_bounds;
+
+	bvh_inst_t *tlas_inst = new bvh_inst_t[TLAS_INST];
+	for(i=0; i<TLAS_INST; i++) {
+		Matrix3x4 xform;
+		xform.translate(Vector3(rnd(-20, 20), rnd(-20, 20), rnd(-20, 20)));
+		xform.rotate(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+		xform.scale(Vector3(1, 1, 1) * rnd(0.5, 1.5));
+		tlas_inst[i].bvh = &tlas_blas;
+		tlas_inst[i].hit = tlas_hit_sphere;
+		tlas_inst[i].cls = tlas_spheres;
+		m3x4_copy(tlas_inst[i].xform, xform.m);
+	}
+	bvh_tlas_init(&tlas);
+	bvh_tlas_build(&tlas, tlas_inst, TLAS_INST);
+	delete [] tlas_inst;
+
+	for(i=0; i<STREAM_RAYS; i++) {
+		const sphere_t *sph = bvh_spheres + (int)rnd(0, BVH_PRIMS - 0.01);
+		Vector3 n = Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized();
+		Ray in(Vector3(0, 0, 0), Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)) * 10.0);
+		Ray out = reflect(in, n);
+		stream_rays[i].origin = v3_add(sph->pos, v3_scale(v3_cons(n.x, n.y, n.z), sph->rad * 1.01));
+		stream_rays[i].dir = v3_cons(out.dir.x, out.dir.y, out.dir.z);
+	}
+	ray_stream_init(&stream);
+	ray_stream_sort(&stream, stream_rays, STREAM_RAYS, 0, RAY_SORT_OCTANT_CELL, 1);
+
+	Matrix4x4 proj, view;
+	proj.set_perspective(DEG_TO_RAD(60), 1.333, 0.5, 30.0);
+	view.set_lookat(Vector3(0, 2, 20), Vector3(0, 0, 0), Vector3(0, 1, 0));
+	frustum_from_matrix(&cull_frustum, proj * view);
+
+	scalar_t *cull_mem = new scalar_t[BVH_PRIMS * 10];
+	scalar_t **cull_streams[] = {&cull_sph.x, &cull_sph.y, &cull_sph.z, &cull_sph.rad,
+		&cull_box.min.x, &cull_box.min.y, &cull_box.min.z,
+		&cull_box.max.x, &cull_box.max.y, &cull_box.max.z};
+	for(i=0; i<10; i++) {
+		*cull_streams[i] = cull_mem + i * BVH_PRIMS;
+	}
+	for(i=0; i<BVH_PRIMS; i++) {
+		cull_sph.x[i] = bvh_spheres[i].pos.x;
+		cull_sph.y[i] = bvh_spheres[i].pos.y;
+		cull_sph.z[i] = bvh_spheres[i].pos.z;
+		cull_sph.rad[i] = bvh_spheres[i].rad;
+		cull_box.min.x[i] = bvh_bounds[i].min.x;
+		cull_box.min.y[i] = bvh_bounds[i].min.y;
+		cull_box.min.z[i] = bvh_bounds[i].min.z;
+		cull_box.max.x[i] = bvh_bounds[i].max.x;
+		cull_box.max.y[i] = bvh_bounds[i].max.y;
+		cull_box.max.z[i] = bvh_bounds[i].max.z;
+	}
+	cull_vis = new unsigned char[BVH_PRIMS];
+	cull_hint = new unsigned char[BVH_PRIMS];
+	cull_idx = new int[BVH_PRIMS];
+	memset(cull_hint, 0, BVH_PRIMS);
+
+	for(i=0; i<XFORM_NODES; i++) {
+		xform_dirty[i] = (int)rnd(0, XFORM_NODES - 1);
+	}
+}
+
+/* deterministic input data, independent of rand() */
+static scalar_t rnd(scalar_t low, scalar_t high)
+{
+	static unsigned long state = 1;
+	state = (state * 1103515245 + 12345) & 0x7fffffff;
+	return low + (high - low) * (scalar_t)(state >> 8) / (scalar_t)(0x7fffffff >> 8);
+}
@@ -0,0 +1,864 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vmath.h"
+#include "bvh.h"
+#include "vmath_thread.h"
+
+#define NUM_BINS	16
+/* below this depth the builder stops using the SAH and splits in the middle,
+ * which is enough to keep any tree of 2^31 primitives within BVH_MAX_DEPTH.
+ */
+#define SAH_MAX_DEPTH	(BVH_MAX_DEPTH - 32)
+
+/* stream queries split across threads, with the hit count and the query
+ * counters of each chunk kept apart, and added up at the end
+ */
+struct stream_job {
+	const bvh_t *bvh;
+	const ray_stream_t *all;
+	bvh_hit_func_t hit;
+	void *cls;
+	int *prim;
+	scalar_t *pos;
+	int any, chunk_size;
+	struct stream_chunk {
+		int num_hits;
+		bvh_query_stats_t stats;
+	} *chunks;
+};
+
+/* refit flags of interior nodes: marked, and the number of marked children
+ * which are not done yet in the low bits. Leaves are just marked.
+ */
+#define REFIT_MARKED	0x80
+
+struct bbox {
+	scalar_t min[3], max[3];
+};
+
+struct build_ctx {
+	bvh_t *bvh;
+	const aabox_t *bounds;
+	vec3_t *cent;
+	scalar_t inv_root_area;
+};
+
+static void build_node(struct build_ctx *ctx, int nidx, int start, int end, int depth);
+static void make_leaf(struct build_ctx *ctx, bvh_node_t *node, int start, int count, scalar_t area);
+static int bin_index(scalar_t c, scalar_t cmin, scalar_t scale);
+
+static void bbox_reset(struct bbox *b);
+static void bbox_add_box(struct bbox *b, const aabox_t *box);
+static void bbox_add_point(struct bbox *b, const vec3_t *p);
+static void bbox_merge(struct bbox *b, const struct bbox *b2);
+static scalar_t bbox_area(const struct bbox *b);
+
+static int refit_setup(bvh_t *bvh);
+static void refit_leaf(bvh_t *bvh, const aabox_t *bounds, int nidx);
+static void refit_node(bvh_t *bvh, int nidx);
+static int rotate_node(bvh_t *bvh, int nidx);
+static void swap_nodes(bvh_t *bvh, int a, int b);
+static scalar_t node_area(const bvh_node_t *node);
+
+static int traverse(const bvh_t *bvh, ray_t ray, scalar_t tmax, bvh_hit_func_t hit,
+		void *cls, scalar_t *pos, bvh_query_stats_t *stats, int any);
+static int node_slab(const bvh_node_t *node, const ray_rcp_t *ray, scalar_t *tnear);
+static int traverse_stream(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int any);
+static int traverse_stream_mt(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int any,
+		int num_threads, int chunk_size);
+
+
+void bvh_init(bvh_t *bvh)
+{
+	bvh->nodes = 0;
+	bvh->num_nodes = 0;
+	bvh->prim = 0;
+	bvh->num_prims = 0;
+
+	bvh->max_leaf_prims = 4;
+	bvh->trav_cost = 1.0;
+	bvh->isect_cost = 1.0;
+
+	bvh->stats.num_nodes = bvh->stats.num_leaves = 0;
+	bvh->stats.max_depth = bvh->stats.max_leaf_prims = 0;
+	bvh->stats.sah_cost = bvh->stats.build_time = 0.0;
+
+	bvh->parent = bvh->leaf = 0;
+	bvh->height = 0;
+	bvh->cost_sum = 0.0;
+	bvh->refit_stats.num_refit = bvh->refit_stats.num_rotations = 0;
+	bvh->refit_stats.sah_cost = bvh->refit_stats.lost_time = 0.0;
+
+	bvh->node_mem = 0;
+	bvh->refit_mem = 0;
+}
+
+void bvh_destroy(bvh_t *bvh)
+{
+	free(bvh->node_mem);
+	free(bvh->prim);
+	free(bvh->refit_mem);
+	bvh->node_mem = 0;
+	bvh->nodes = 0;
+	bvh->prim = 0;
+	bvh->num_nodes = bvh->num_prims = 0;
+
+	bvh->refit_mem = 0;
+	bvh->parent = bvh->leaf = 0;
+	bvh->height = 0;
+	bvh->cost_sum = 0.0;
+	bvh->refit_stats.num_refit = bvh->refit_stats.num_rotations = 0;
+	bvh->refit_stats.sah_cost = bvh->refit_stats.lost_time = 0.0;
+}
+
+int bvh_build(bvh_t *bvh, const aabox_t *bounds, int count)
+{
+	int i, max_nodes;
+	struct build_ctx ctx;
+	struct bbox rootbox;
+	double start_time = vmath_time();
+
+	bvh_destroy(bvh);
+	bvh->stats.num_nodes = bvh->stats.num_leaves = 0;
+	bvh->stats.max_depth = bvh->stats.max_leaf_prims = 0;
+	bvh->stats.sah_cost = 0.0;
+
+	if(count <= 0) {
+		bvh->stats.build_time = 0.0;
+		return count < 0 ? -1 : 0;
+	}
+	if(bvh->max_leaf_prims < 1) {
+		bvh->max_leaf_prims = 1;
+	}
+
+	/* root, padding, and at most count - 1 pairs of children */
+	max_nodes = count * 2;
+	if(!(bvh->node_mem = malloc(max_nodes * sizeof *bvh->nodes + 63))) {
+		return -1;
+	}
+	bvh->nodes = (bvh_node_t*)(((size_t)bvh->node_mem + 63) & ~(size_t)63);
+
+	if(!(bvh->prim = malloc(count * sizeof *bvh->prim)) ||
+			!(ctx.cent = malloc(count * sizeof *ctx.cent))) {
+		bvh_destroy(bvh);
+		return -1;
+	}
+	bvh->num_prims = count;
+
+	bbox_reset(&rootbox);
+	for(i=0; i<count; i++) {
+		bvh->prim[i] = i;
+		ctx.cent[i].x = (bounds[i].min.x + bounds[i].max.x) * 0.5;
+		ctx.cent[i].y = (bounds[i].min.y + bounds[i].max.y) * 0.5;
+		ctx.cent[i].z = (bounds[i].min.z + bounds[i].max.z) * 0.5;
+		bbox_add_box(&rootbox, bounds + i);
+	}
+
+	ctx.bvh = bvh;
+	ctx.bounds = bounds;
+	ctx.inv_root_area = bbox_area(&rootbox);
+	ctx.inv_root_area = ctx.inv_root_area > 0.0 ? 1.0 / ctx.inv_root_area : 0.0;
+
+	bvh->num_nodes = count > 1 ? 2 : 1;
+	build_node(&ctx, 0, 0, count, 0);
+
+	free(ctx.cent);
+
+	bvh->stats.num_nodes = bvh->num_nodes > 1 ? bvh->num_nodes - 1 : 1;
+	bvh->stats.build_time = vmath_time() - start_time;
+	return 0;
+}
+
+int bvh_refit(bvh_t *bvh, const aabox_t *bounds, const int *changed, int num_changed, int rotate)
+{
+	int i, n, p, head, tail, num_rot = 0;
+	int *queue;
+	unsigned char *flags;
+	scalar_t root_area;
+
+	bvh->refit_stats.num_refit = bvh->refit_stats.num_rotations = 0;
+	if(!bvh->num_nodes) {
+		return 0;
+	}
+	if(!bvh->refit_mem && refit_setup(bvh) == -1) {
+		return -1;
+	}
+	/* scratch space, after the parent indices and the heights */
+	queue = bvh->parent + bvh->num_nodes;
+	flags = bvh->height + bvh->num_nodes;
+
+	/* mark the leaves of the changed primitives and their ancestors, and
+	 * count the marked children of each node, up to the first ancestor which
+	 * was already marked from another leaf
+	 */
+	if(!changed) {
+		num_changed = bvh->num_prims;
+	}
+	tail = 0;
+	for(i=0; i<num_changed; i++) {
+		n = bvh->leaf[changed ? changed[i] : i];
+		if(flags[n]) continue;
+		flags[n] = REFIT_MARKED;
+		queue[tail++] = n;
+
+		while((p = bvh->parent[n]) >= 0) {
+			if(flags[p]) {
+				flags[p]++;
+				break;
+			}
+			flags[p] = REFIT_MARKED | 1;
+			n = p;
+		}
+	}
+
+	/* a node is queued when all its marked children are done */
+	for(head=0; head<tail; head++) {
+		n = queue[head];
+		if(bvh->nodes[n].count) {
+			refit_leaf(bvh, bounds, n);
+		} else {
+			refit_node(bvh, n);
+			if(rotate) {
+				num_rot += rotate_node(bvh, n);
+			}
+		}
+		flags[n] = 0;
+
+		if((p = bvh->parent[n]) >= 0 && --flags[p] == REFIT_MARKED) {
+			queue[tail++] = p;
+		}
+	}
+
+	root_area = node_area(bvh->nodes);
+	bvh->refit_stats.num_refit = tail;
+	bvh->refit_stats.num_rotations = num_rot;
+	bvh->refit_stats.sah_cost = root_area > 0.0 ? bvh->cost_sum / root_area : 0.0;
+	return 0;
+}
+
+int bvh_rebuild_pays_off(bvh_t *bvh, double query_time)
+{
+	double decay;
+
+	if(!bvh->refit_mem || bvh->stats.sah_cost <= 0.0) {
+		return 0;	/* not refitted since the build */
+	}
+	decay = bvh->refit_stats.sah_cost / bvh->stats.sah_cost - 1.0;
+	if(decay > 0.0) {
+		bvh->refit_stats.lost_time += query_time * decay;
+	}
+	return bvh->refit_stats.lost_time > bvh->stats.build_time;
+}
+
+int bvh_ray_closest(const bvh_t *bvh, ray_t ray, bvh_hit_func_t hit, void *cls,
+		scalar_t *pos, bvh_query_stats_t *stats)
+{
+	return traverse(bvh, ray, 1.0, hit, cls, pos, stats, 0);
+}
+
+int bvh_ray_any(const bvh_t *bvh, ray_t ray, bvh_hit_func_t hit, void *cls,
+		scalar_t *pos, bvh_query_stats_t *stats)
+{
+	return traverse(bvh, ray, 1.0, hit, cls, pos, stats, 1);
+}
+
+int bvh_ray_closest_tmax(const bvh_t *bvh, ray_t ray, scalar_t tmax, bvh_hit_func_t hit,
+		void *cls, scalar_t *pos, bvh_query_stats_t *stats)
+{
+	return traverse(bvh, ray, tmax, hit, cls, pos, stats, 0);
+}
+
+int bvh_ray_any_tmax(const bvh_t *bvh, ray_t ray, scalar_t tmax, bvh_hit_func_t hit,
+		void *cls, scalar_t *pos, bvh_query_stats_t *stats)
+{
+	return traverse(bvh, ray, tmax, hit, cls, pos, stats, 1);
+}
+
+int bvh_ray_closest_stream(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats)
+{
+	return traverse_stream(bvh, rs, hit, cls, prim, pos, stats, 0);
+}
+
+int bvh_ray_any_stream(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats)
+{
+	return traverse_stream(bvh, rs, hit, cls, prim, pos, stats, 1);
+}
+
+int bvh_ray_closest_stream_mt(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int num_threads, int chunk_size)
+{
+	return traverse_stream_mt(bvh, rs, hit, cls, prim, pos, stats, 0, num_threads, chunk_size);
+}
+
+int bvh_ray_any_stream_mt(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int num_threads, int chunk_size)
+{
+	return traverse_stream_mt(bvh, rs, hit, cls, prim, pos, stats, 1, num_threads, chunk_size);
+}
+
+
+static void build_node(struct build_ctx *ctx, int nidx, int start, int end, int depth)
+{
+	int i, j, axis, b, n, tmp, mid, left;
+	int count = end - start;
+	int best_axis = -1, best_bin = 0;
+	int bin_count[NUM_BINS], right_count[NUM_BINS];
+	scalar_t right_area[NUM_BINS];
+	scalar_t area, inv_area, extent, cost, best_cost, leaf_cost;
+	scalar_t scale[3];
+	struct bbox nbox, cbox, acc, bins[NUM_BINS];
+	bvh_t *bvh = ctx->bvh;
+	bvh_node_t *node = bvh->nodes + nidx;
+	int *prim = bvh->prim;
+
+	if(depth > bvh->stats.max_depth) {
+		bvh->stats.max_depth = depth;
+	}
+
+	bbox_reset(&nbox);
+	bbox_reset(&cbox);
+	for(i=start; i<end; i++) {
+		bbox_add_box(&nbox, ctx->bounds + prim[i]);
+		bbox_add_point(&cbox, ctx->cent + prim[i]);
+	}
+	for(i=0; i<3; i++) {
+		node->bmin[i] = nbox.min[i];
+		node->bmax[i] = nbox.max[i];
+	}
+	area = bbox_area(&nbox);
+
+	if(count == 1) {
+		make_leaf(ctx, node, start, count, area);
+		return;
+	}
+
+	leaf_cost = count * bvh->isect_cost;
+	best_cost = HUGE_VAL;
+	inv_area = area > 0.0 ? 1.0 / area : 0.0;
+
+	/* binned SAH, over all three axes */
+	for(axis=0; axis<3 && depth < SAH_MAX_DEPTH; axis++) {
+		extent = cbox.max[axis] - cbox.min[axis];
+		if(extent <= 0.0) {
+			scale[axis] = 0.0;
+			continue;
+		}
+		scale[axis] = NUM_BINS / extent;
+
+		for(i=0; i<NUM_BINS; i++) {
+			bin_count[i] = 0;
+			bbox_reset(bins + i);
+		}
+		for(i=start; i<end; i++) {
+			b = bin_index((&ctx->cent[prim[i]].x)[axis], cbox.min[axis], scale[axis]);
+			bin_count[b]++;
+			bbox_add_box(bins + b, ctx->bounds + prim[i]);
+		}
+
+		/* sweep from the right to get the areas and counts right of each split ... */
+		bbox_reset(&acc);
+		n = 0;
+		for(i=NUM_BINS-1; i>0; i--) {
+			n += bin_count[i];
+			bbox_merge(&acc, bins + i);
+			right_count[i] = n;
+			right_area[i] = n ? bbox_area(&acc) : 0.0;
+		}
+		/* ... and then from the left, evaluating the cost of each split */
+		bbox_reset(&acc);
+		n = 0;
+		for(i=1; i<NUM_BINS; i++) {
+			n += bin_count[i - 1];
+			bbox_merge(&acc, bins + i - 1);
+			if(!n || !right_count[i]) continue;
+
+			cost = bvh->trav_cost + bvh->isect_cost * inv_area *
+				(bbox_area(&acc) * n + right_area[i] * right_count[i]);
+			if(cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_bin = i;
+			}
+		}
+	}
+
+	if(count <= bvh->max_leaf_prims && (best_axis == -1 || best_cost >= leaf_cost)) {
+		make_leaf(ctx, node, start, count, area);
+		return;
+	}
+
+	if(best_axis >= 0) {
+		i = start;
+		j = end - 1;
+		while(i <= j) {
+			if(bin_index((&ctx->cent[prim[i]].x)[best_axis], cbox.min[best_axis], scale[best_axis]) < best_bin) {
+				i++;
+			} else {
+				tmp = prim[i];
+				prim[i] = prim[j];
+				prim[j--] = tmp;
+			}
+		}
+		mid = i;
+	} else {
+		/* no usable split (coincident centroids or too deep), split the range in half */
+		mid = start + count / 2;
+	}
+
+	bvh->stats.sah_cost += bvh->trav_cost * area * ctx->inv_root_area;
+
+	left = bvh->num_nodes;
+	bvh->num_nodes += 2;
+	node->offs = left;
+	node->count = 0;
+
+	build_node(ctx, left, start, mid, depth + 1);
+	build_node(ctx, left + 1, mid, end, depth + 1);
+}
+
+static void make_leaf(struct build_ctx *ctx, bvh_node_t *node, int start, int count, scalar_t area)
+{
+	bvh_t *bvh = ctx->bvh;
+
+	node->offs = start;
+	node->count = count;
+
+	bvh->stats.num_leaves++;
+	if(count > bvh->stats.max_leaf_prims) {
+		bvh->stats.max_leaf_prims = count;
+	}
+	bvh->stats.sah_cost += bvh->isect_cost * count * area * ctx->inv_root_area;
+}
+
+static int bin_index(scalar_t c, scalar_t cmin, scalar_t scale)
+{
+	int b = (int)((c - cmin) * scale);
+	return b < NUM_BINS ? b : NUM_BINS - 1;
+}
+
+static void bbox_reset(struct bbox *b)
+{
+	b->min[0] = b->min[1] = b->min[2] = HUGE_VAL;
+	b->max[0] = b->max[1] = b->max[2] = -HUGE_VAL;
+}
+
+static void bbox_add_box(struct bbox *b, const aabox_t *box)
+{
+	if(box->min.x < b->min[0]) b->min[0] = box->min.x;
+	if(box->min.y < b->min[1]) b->min[1] = box->min.y;
+	if(box->min.z < b->min[2]) b->min[2] = box->min.z;
+	if(box->max.x > b->max[0]) b->max[0] = box->max.x;
+	if(box->max.y > b->max[1]) b->max[1] = box->max.y;
+	if(box->max.z > b->max[2]) b->max[2] = box->max.z;
+}
+
+static void bbox_add_point(struct bbox *b, const vec3_t *p)
+{
+	if(p->x < b->min[0]) b->min[0] = p->x;
+	if(p->y < b->min[1]) b->min[1] = p->y;
+	if(p->z < b->min[2]) b->min[2] = p->z;
+	if(p->x > b->max[0]) b->max[0] = p->x;
+	if(p->y > b->max[1]) b->max[1] = p->y;
+	if(p->z > b->max[2]) b->max[2] = p->z;
+}
+
+static void bbox_merge(struct bbox *b, const struct bbox *b2)
+{
+	int i;
+	for(i=0; i<3; i++) {
+		if(b2->min[i] < b->min[i]) b->min[i] = b2->min[i];
+		if(b2->max[i] > b->max[i]) b->max[i] = b2->max[i];
+	}
+}
+
+static scalar_t bbox_area(const struct bbox *b)
+{
+	scalar_t dx = b->max[0] - b->min[0];
+	scalar_t dy = b->max[1] - b->min[1];
+	scalar_t dz = b->max[2] - b->min[2];
+	return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+
+/* the refit data of the tree as it was built: parents, leaves and heights
+ * from a breadth-first pass, and the SAH cost sum from the reverse order,
+ * children first
+ */
+static int refit_setup(bvh_t *bvh)
+{
+	int i, n, head, tail, num_nodes = bvh->num_nodes;
+	int *queue;
+	bvh_node_t *node;
+
+	if(!(bvh->refit_mem = malloc(num_nodes * 2 * (sizeof *bvh->parent + 1) +
+					bvh->num_prims * sizeof *bvh->leaf))) {
+		return -1;
+	}
+	bvh->parent = bvh->refit_mem;
+	queue = bvh->parent + num_nodes;
+	bvh->leaf = queue + num_nodes;
+	bvh->height = (unsigned char*)(bvh->leaf + bvh->num_prims);
+	/* the flags after the heights start cleared */
+	memset(bvh->height, 0, num_nodes * 2);
+	for(i=0; i<num_nodes; i++) {
+		bvh->parent[i] = -1;
+	}
+
+	queue[0] = 0;
+	tail = 1;
+	for(head=0; head<tail; head++) {
+		node = bvh->nodes + (n = queue[head]);
+		if(node->count) {
+			for(i=0; i<node->count; i++) {
+				bvh->leaf[bvh->prim[node->offs + i]] = n;
+			}
+		} else {
+			bvh->parent[node->offs] = bvh->parent[node->offs + 1] = n;
+			queue[tail++] = node->offs;
+			queue[tail++] = node->offs + 1;
+		}
+	}
+
+	bvh->cost_sum = 0.0;
+	for(i=tail-1; i>=0; i--) {
+		node = bvh->nodes + (n = queue[i]);
+		if(node->count) {
+			bvh->cost_sum += bvh->isect_cost * node->count * node_area(node);
+		} else {
+			bvh->height[n] = 1 + MAX(bvh->height[node->offs], bvh->height[node->offs + 1]);
+			bvh->cost_sum += bvh->trav_cost * node_area(node);
+		}
+	}
+	return 0;
+}
+
+static void refit_leaf(bvh_t *bvh, const aabox_t *bounds, int nidx)
+{
+	int i;
+	struct bbox box;
+	bvh_node_t *node = bvh->nodes + nidx;
+	scalar_t area = node_area(node);
+
+	bbox_reset(&box);
+	for(i=0; i<node->count; i++) {
+		bbox_add_box(&box, bounds + bvh->prim[node->offs + i]);
+	}
+	for(i=0; i<3; i++) {
+		node->bmin[i] = box.min[i];
+		node->bmax[i] = box.max[i];
+	}
+	bvh->cost_sum += bvh->isect_cost * node->count * (node_area(node) - area);
+}
+
+static void refit_node(bvh_t *bvh, int nidx)
+{
+	int i;
+	bvh_node_t *node = bvh->nodes + nidx;
+	bvh_node_t *ch = bvh->nodes + node->offs;
+	scalar_t area = node_area(node);
+
+	for(i=0; i<3; i++) {
+		node->bmin[i] = MIN(ch[0].bmin[i], ch[1].bmin[i]);
+		node->bmax[i] = MAX(ch[0].bmax[i], ch[1].bmax[i]);
+	}
+	bvh->height[nidx] = 1 + MAX(bvh->height[node->offs], bvh->height[node->offs + 1]);
+	bvh->cost_sum += bvh->trav_cost * (node_area(node) - area);
+}
+
+/* tries the four rotations of a node with up to date children: one of the
+ * children swapped with one of the children of the other. The bounds of the
+ * node stay the same, only the other child changes, so the best rotation is
+ * the one which shrinks it the most. Rotations which would make the subtree
+ * taller are skipped, the depth of the tree stays within what it was built
+ * with. Returns 1 if the node was rotated.
+ */
+static int rotate_node(bvh_t *bvh, int nidx)
+{
+	int i, j, a, b, g, keep, height, best_a = -1, best_g = -1;
+	scalar_t area, best_gain = 0.0;
+	bvh_node_t box, *nodes = bvh->nodes;
+	int first = nodes[nidx].offs;
+
+	for(i=0; i<2; i++) {
+		a = first + i;			/* moves down */
+		b = first + 1 - i;		/* gets a as a child instead of g */
+		if(nodes[b].count) continue;
+
+		for(j=0; j<2; j++) {
+			g = nodes[b].offs + j;
+			keep = nodes[b].offs + 1 - j;
+
+			height = 1 + MAX(bvh->height[a], bvh->height[keep]);
+			if(1 + MAX(bvh->height[g], height) > bvh->height[nidx]) {
+				continue;
+			}
+
+			box.bmin[0] = MIN(nodes[a].bmin[0], nodes[keep].bmin[0]);
+			box.bmin[1] = MIN(nodes[a].bmin[1], nodes[keep].bmin[1]);
+			box.bmin[2] = MIN(nodes[a].bmin[2], nodes[keep].bmin[2]);
+			box.bmax[0] = MAX(nodes[a].bmax[0], nodes[keep].bmax[0]);
+			box.bmax[1] = MAX(nodes[a].bmax[1], nodes[keep].bmax[1]);
+			box.bmax[2] = MAX(nodes[a].bmax[2], nodes[keep].bmax[2]);
+			area = node_area(nodes + b) - node_area(&box);
+			if(area > best_gain) {
+				best_gain = area;
+				best_a = a;
+				best_g = g;
+			}
+		}
+	}
+
+	if(best_a == -1) {
+		return 0;
+	}
+	b = best_a == first ? first + 1 : first;
+	swap_nodes(bvh, best_a, best_g);
+	refit_node(bvh, b);
+	bvh->height[nidx] = 1 + MAX(bvh->height[first], bvh->height[first + 1]);
+	return 1;
+}
+
+/* swaps two nodes of the tree with their subtrees, which stay in place */
+static void swap_nodes(bvh_t *bvh, int a, int b)
+{
+	int i, j, n;
+	unsigned char h;
+	bvh_node_t tmp, *node;
+
+	tmp = bvh->nodes[a];
+	bvh->nodes[a] = bvh->nodes[b];
+	bvh->nodes[b] = tmp;
+	h = bvh->height[a];
+	bvh->height[a] = bvh->height[b];
+	bvh->height[b] = h;
+
+	for(i=0; i<2; i++) {
+		n = i ? b : a;
+		node = bvh->nodes + n;
+		if(node->count) {
+			for(j=0; j<node->count; j++) {
+				bvh->leaf[bvh->prim[node->offs + j]] = n;
+			}
+		} else {
+			bvh->parent[node->offs] = bvh->parent[node->offs + 1] = n;
+		}
+	}
+}
+
+static scalar_t node_area(const bvh_node_t *node)
+{
+	scalar_t dx = node->bmax[0] - node->bmin[0];
+	scalar_t dy = node->bmax[1] - node->bmin[1];
+	scalar_t dz = node->bmax[2] - node->bmin[2];
+	return 2.0 * (dx * dy + dy * dz + dz * dx);
+}
+
+
+/* ordered depth-first traversal: at each interior node the nearer child is
+ * visited first, and the other one is pushed along with its entry distance,
+ * so that it can be skipped if a closer hit is found in the meantime.
+ */
+static int traverse(const bvh_t *bvh, ray_t ray, scalar_t tmax, bvh_hit_func_t hit,
+		void *cls, scalar_t *pos, bvh_query_stats_t *stats, int any)
+{
+	int i, p, hit0, hit1, top = 0, res = -1;
+	int stack[BVH_MAX_DEPTH];
+	scalar_t tstack[BVH_MAX_DEPTH];
+	scalar_t t, t0, t1;
+	unsigned long nvisited = 0, nboxes = 1, nprims = 0;
+	const bvh_node_t *node, *child;
+	ray_rcp_t rr;
+
+	if(!bvh->num_nodes) {
+		return -1;
+	}
+
+	rr = ray_rcp_cons(ray);
+	rr.tmax = tmax;
+	node = bvh->nodes;
+	if(!node_slab(node, &rr, &t0)) {
+		goto done;
+	}
+
+	for(;;) {
+		nvisited++;
+
+		if(node->count) {
+			for(i=0; i<node->count; i++) {
+				p = bvh->prim[node->offs + i];
+				nprims++;
+				if(hit(p, ray, rr.tmax, &t, cls)) {
+					rr.tmax = t;
+					res = p;
+					if(any) goto done;
+				}
+			}
+		} else {
+			child = bvh->nodes + node->offs;
+			hit0 = node_slab(child, &rr, &t0);
+			hit1 = node_slab(child + 1, &rr, &t1);
+			nboxes += 2;
+
+			if(hit0 && hit1) {
+				if(t1 < t0) {
+					stack[top] = node->offs;
+					tstack[top++] = t0;
+					node = child + 1;
+				} else {
+					stack[top] = node->offs + 1;
+					tstack[top++] = t1;
+					node = child;
+				}
+				continue;
+			}
+			if(hit0) {
+				node = child;
+				continue;
+			}
+			if(hit1) {
+				node = child + 1;
+				continue;
+			}
+		}
+
+		/* pop the next node, skipping any which start beyond the closest hit */
+		do {
+			if(!top) goto done;
+			top--;
+		} while(tstack[top] > rr.tmax);
+		node = bvh->nodes + stack[top];
+	}
+
+done:
+	if(res != -1 && pos) {
+		*pos = rr.tmax;
+	}
+	if(stats) {
+		stats->nodes_visited += nvisited;
+		stats->boxes_tested += nboxes;
+		stats->prims_tested += nprims;
+	}
+	return res;
+}
+
+static int node_slab(const bvh_node_t *node, const ray_rcp_t *ray, scalar_t *tnear)
+{
+	scalar_t t0, t1;
+	scalar_t tn = ray->tmin;
+	scalar_t tf = ray->tmax;
+
+	t0 = (node->bmin[0] - ray->origin.x) * ray->inv_dir.x;
+	t1 = (node->bmax[0] - ray->origin.x) * ray->inv_dir.x;
+	tn = MAX(MIN(t0, t1), tn);
+	tf = MIN(MAX(t0, t1), tf);
+
+	t0 = (node->bmin[1] - ray->origin.y) * ray->inv_dir.y;
+	t1 = (node->bmax[1] - ray->origin.y) * ray->inv_dir.y;
+	tn = MAX(MIN(t0, t1), tn);
+	tf = MIN(MAX(t0, t1), tf);
+
+	t0 = (node->bmin[2] - ray->origin.z) * ray->inv_dir.z;
+	t1 = (node->bmax[2] - ray->origin.z) * ray->inv_dir.z;
+	tn = MAX(MIN(t0, t1), tn);
+	tf = MIN(MAX(t0, t1), tf);
+
+	*tnear = tn;
+	return tn <= tf;
+}
+
+/* the rays are traced in stream order, and the results go straight to the
+ * positions of the rays in the input batch
+ */
+static int traverse_stream(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int any)
+{
+	int i, p, num_hits = 0;
+	scalar_t t;
+
+	for(i=0; i<rs->count; i++) {
+		p = traverse(bvh, rs->rays[i], 1.0, hit, cls, &t, stats, any);
+		if(p != -1) {
+			num_hits++;
+			if(pos) pos[rs->order[i]] = t;
+		}
+		if(prim) prim[rs->order[i]] = p;
+	}
+	return num_hits;
+}
+
+static void stream_job(int start, int end, void *cls)
+{
+	struct stream_job *job = cls;
+	struct stream_chunk *chunk = job->chunks + start / job->chunk_size;
+	ray_stream_t rs = *job->all;
+
+	rs.rays += start;
+	rs.order += start;
+	rs.count = end - start;
+
+	chunk->stats.nodes_visited = chunk->stats.boxes_tested = chunk->stats.prims_tested = 0;
+	chunk->num_hits = traverse_stream(job->bvh, &rs, job->hit, job->cls, job->prim, job->pos,
+			&chunk->stats, job->any);
+}
+
+/* consecutive rays of the stream are the coherent ones, so each thread gets
+ * runs of them
+ */
+static int traverse_stream_mt(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int any,
+		int num_threads, int chunk_size)
+{
+	int i, num_chunks, num_hits = 0;
+	struct stream_job job;
+
+	if(rs->count <= 0) return 0;
+
+	job.bvh = bvh;
+	job.all = rs;
+	job.hit = hit;
+	job.cls = cls;
+	job.prim = prim;
+	job.pos = pos;
+	job.any = any;
+	job.chunk_size = vmath_chunk_size(rs->count, num_threads, chunk_size, 1);
+	num_chunks = (rs->count - 1) / job.chunk_size + 1;
+	if(!(job.chunks = malloc(num_chunks * sizeof *job.chunks))) {
+		return traverse_stream(bvh, rs, hit, cls, prim, pos, stats, any);
+	}
+
+	vmath_parallel_for(rs->count, num_threads, job.chunk_size, stream_job, &job);
+
+	for(i=0; i<num_chunks; i++) {
+		num_hits += job.chunks[i].num_hits;
+		if(stats) {
+			stats->nodes_visited += job.chunks[i].stats.nodes_visited;
+			stats->boxes_tested += job.chunks[i].stats.boxes_tested;
+			stats->prims_tested += job.chunks[i].stats.prims_tested;
+		}
+	}
+	free(job.chunks);
+	return num_hits;
+}
@@ -0,0 +1,195 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_BVH_H_
+#define LIBVMATH_BVH_H_
+
+#include "geom.h"
+#include "ray_stream.h"
+
+/* max depth of the tree, the builder falls back to median splits to stay within it */
+#define BVH_MAX_DEPTH	96
+
+/* Morton code lengths for bvh_build_lbvh */
+#define BVH_MORTON30	30
+#define BVH_MORTON63	63
+/* the LBVH depth is at most the code length plus the bits of the primitive
+ * index, which breaks ties between equal codes, so this keeps it within
+ * BVH_MAX_DEPTH
+ */
+#define BVH_LBVH_MAX_PRIMS	(1 << 29)
+/* builds of fewer primitives than this are not split across threads */
+#define BVH_LBVH_MT_MIN		16384
+
+/* BVH node: 32 bytes in single precision. The two children of an interior
+ * node are always stored next to each other, starting at an even index, so
+ * with the (64-byte aligned) node array each sibling pair fills one cache line.
+ */
+typedef struct {
+	scalar_t bmin[3];
+	int offs;	/* interior: index of the first child, leaf: first primitive in bvh->prim */
+	scalar_t bmax[3];
+	int count;	/* number of primitives for leaves, 0 for interior nodes */
+} bvh_node_t;
+
+typedef struct {
+	int num_nodes, num_leaves;
+	int max_depth, max_leaf_prims;
+	double sah_cost;	/* SAH cost of the whole tree, relative to the root area */
+	double build_time;	/* seconds of wall-clock time */
+} bvh_build_stats_t;
+
+/* counters of the last bvh_refit, and the decay of the tree since the build */
+typedef struct {
+	int num_refit;		/* nodes whose bounds were recomputed */
+	int num_rotations;
+	double sah_cost;	/* SAH cost of the refitted tree, relative to the root area */
+	double lost_time;	/* estimated query time lost to the decay, see bvh_rebuild_pays_off */
+} bvh_refit_stats_t;
+
+/* query counters are incremented, not reset, so they can add up over many queries */
+typedef struct {
+	unsigned long nodes_visited;
+	unsigned long boxes_tested;
+	unsigned long prims_tested;
+} bvh_query_stats_t;
+
+typedef struct {
+	bvh_node_t *nodes;	/* node 0 is the root, node 1 is unused padding */
+	int num_nodes;
+	int *prim;			/* primitive indices, referenced by the leaves */
+	int num_prims;
+
+	/* build parameters, set to defaults by bvh_init */
+	int max_leaf_prims;
+	scalar_t trav_cost, isect_cost;
+
+	bvh_build_stats_t stats;
+
+	/* refit data, set up by the first bvh_refit after a build */
+	int *parent;			/* per node: index of the parent, -1 for the root */
+	int *leaf;				/* per primitive: index of the leaf which references it */
+	unsigned char *height;	/* per node: height of its subtree, 0 for leaves */
+	double cost_sum;		/* SAH cost before the division by the root area */
+	bvh_refit_stats_t refit_stats;
+
+	void *node_mem, *refit_mem;
+} bvh_t;
+
+/* primitive intersection callback: returns non-zero if the ray hits primitive
+ * prim at a parametric distance t < tmax, and stores the distance in *t.
+ */
+typedef int (*bvh_hit_func_t)(int prim, ray_t ray, scalar_t tmax, scalar_t *t, void *cls);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void bvh_init(bvh_t *bvh);
+void bvh_destroy(bvh_t *bvh);
+
+/* builds the tree over count primitives, given their bounding boxes, with
+ * the binned surface area heuristic. Returns 0 on success, -1 on failure.
+ */
+int bvh_build(bvh_t *bvh, const aabox_t *bounds, int count);
+
+/* linear BVH builder for scenes which change too much to refit, rebuilt every
+ * frame. Much faster to build than bvh_build, but trees are slower to trace.
+ * The primitive centroids are sorted along a Morton curve with morton_bits
+ * (BVH_MORTON30 or BVH_MORTON63, finer for large or clustered scenes) codes,
+ * and the tree follows the bits of the codes: every node splits its range of
+ * primitives where the next bit changes. Ranges of up to max_leaf_prims
+ * primitives become leaves. The work is split across num_threads threads
+ * (0 for one per processor). Trees have the same layout as the ones of
+ * bvh_build. Returns 0 on success, -1 on failure.
+ */
+int bvh_build_lbvh(bvh_t *bvh, const aabox_t *bounds, int count, int morton_bits, int num_threads);
+/* same, over the bounding boxes of spheres */
+int bvh_build_lbvh_spheres(bvh_t *bvh, const sphere_t *spheres, int count, int morton_bits, int num_threads);
+
+/* updates the tree for primitives which moved but are still the same ones,
+ * such as the triangles of a deforming mesh. bounds are the new boxes of all
+ * the primitives, and changed the indices of the ones which moved (null for
+ * all of them, in which case num_changed is ignored). Only their leaves and
+ * the ancestors of those are recomputed, bottom-up.
+ *
+ * A refitted tree slows down queries as the primitives move away from where
+ * they were at the build. With rotate, the refitted interior nodes also try
+ * tree rotations (Kopta et al. 2012): a child is swapped with a grandchild
+ * under the other child, if that shrinks the area of the other child. This
+ * slows down the decay, and never makes the tree deeper.
+ * Returns 0 on success, -1 if it runs out of memory.
+ */
+int bvh_refit(bvh_t *bvh, const aabox_t *bounds, const int *changed, int num_changed, int rotate);
+
+/* whether a rebuild would pay off: the query time lost since the build, to
+ * the SAH cost of the refitted tree being higher than the cost of the built
+ * one, is accumulated as query_time * (cost / build cost - 1). query_time is
+ * the time spent on queries since the last call, in seconds of wall-clock
+ * time like stats.build_time: for queries split across threads, the time
+ * the whole batch took, not the sum over the threads. Once the lost time is
+ * more than the build took, a rebuild right after the build would have been
+ * cheaper, and this returns 1. Waiting until then costs at most twice as much
+ * as rebuilding at the best time would have.
+ */
+int bvh_rebuild_pays_off(bvh_t *bvh, double query_time);
+
+/* ray queries, over the parametric interval [0, 1] of the ray like the rest
+ * of the intersection functions. bvh_ray_closest returns the index of the
+ * nearest primitive hit (pos gets its distance), bvh_ray_any returns the
+ * first primitive it finds. Both return -1 if nothing is hit. stats may be null.
+ */
+int bvh_ray_closest(const bvh_t *bvh, ray_t ray, bvh_hit_func_t hit, void *cls,
+		scalar_t *pos, bvh_query_stats_t *stats);
+int bvh_ray_any(const bvh_t *bvh, ray_t ray, bvh_hit_func_t hit, void *cls,
+		scalar_t *pos, bvh_query_stats_t *stats);
+/* same, over the interval [0, tmax] instead, for instance up to the closest
+ * hit found so far in another tree
+ */
+int bvh_ray_closest_tmax(const bvh_t *bvh, ray_t ray, scalar_t tmax, bvh_hit_func_t hit,
+		void *cls, scalar_t *pos, bvh_query_stats_t *stats);
+int bvh_ray_any_tmax(const bvh_t *bvh, ray_t ray, scalar_t tmax, bvh_hit_func_t hit,
+		void *cls, scalar_t *pos, bvh_query_stats_t *stats);
+
+/* same, for all the rays of a sorted stream (see ray_stream_sort). For
+ * incoherent rays and trees which don't fit in the cache, tracing them in
+ * stream order is much faster than in the order they were made. prim and
+ * pos are indexed like the batch the stream was sorted from: prim gets the
+ * primitive hit by each ray or -1, and pos the distance of the hits
+ * (untouched for misses). Either may be null. Returns the number of rays
+ * which hit something.
+ */
+int bvh_ray_closest_stream(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats);
+int bvh_ray_any_stream(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats);
+
+/* same, with runs of chunk_size consecutive rays of the stream (0 for the
+ * default, see vmath_parallel_for) traced by num_threads threads (0 for one
+ * per processor). hit is called from all of them at once.
+ */
+int bvh_ray_closest_stream_mt(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int num_threads, int chunk_size);
+int bvh_ray_any_stream_mt(const bvh_t *bvh, const ray_stream_t *rs, bvh_hit_func_t hit,
+		void *cls, int *prim, scalar_t *pos, bvh_query_stats_t *stats, int num_threads, int chunk_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_BVH_H_ */
@@ -0,0 +1,205 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "vmath.h"
+#include "bvh_inst.h"
+
+struct tlas_query {
+	const bvh_tlas_t *tlas;
+	bvh_query_stats_t *stats;
+	int prim;
+	int any;
+};
+
+static void inst_bounds(bvh_tlas_t *tlas, int i);
+static int inst_hit(int i, ray_t ray, scalar_t tmax, scalar_t *t, void *cls);
+static int query(const bvh_tlas_t *tlas, ray_t ray, int *prim, scalar_t *pos,
+		bvh_query_stats_t *stats, int any);
+
+
+void bvh_tlas_init(bvh_tlas_t *tlas)
+{
+	bvh_init(&tlas->top);
+	tlas->inst = 0;
+	tlas->bounds = 0;
+	tlas->num_inst = 0;
+}
+
+void bvh_tlas_destroy(bvh_tlas_t *tlas)
+{
+	bvh_destroy(&tlas->top);
+	free(tlas->inst);
+	free(tlas->bounds);
+	tlas->inst = 0;
+	tlas->bounds = 0;
+	tlas->num_inst = 0;
+}
+
+int bvh_tlas_build(bvh_tlas_t *tlas, const bvh_inst_t *inst, int count)
+{
+	int i;
+
+	bvh_tlas_destroy(tlas);
+	if(count <= 0) {
+		return count < 0 ? -1 : 0;
+	}
+
+	if(!(tlas->inst = malloc(count * sizeof *tlas->inst)) ||
+			!(tlas->bounds = malloc(count * sizeof *tlas->bounds))) {
+		bvh_tlas_destroy(tlas);
+		return -1;
+	}
+	memcpy(tlas->inst, inst, count * sizeof *inst);
+	tlas->num_inst = count;
+
+	for(i=0; i<count; i++) {
+		m3x4_inverse(tlas->inst[i].inv_xform, tlas->inst[i].xform);
+		inst_bounds(tlas, i);
+	}
+
+	if(bvh_build(&tlas->top, tlas->bounds, count) == -1) {
+		bvh_tlas_destroy(tlas);
+		return -1;
+	}
+	return 0;
+}
+
+void bvh_tlas_set_xform(bvh_tlas_t *tlas, int inst, mat3x4_t xform)
+{
+	m3x4_copy(tlas->inst[inst].xform, xform);
+	m3x4_inverse(tlas->inst[inst].inv_xform, xform);
+	inst_bounds(tlas, inst);
+}
+
+int bvh_tlas_update(bvh_tlas_t *tlas, const int *changed, int num_changed, int rotate)
+{
+	int i;
+
+	if(!changed) {
+		num_changed = tlas->num_inst;
+	}
+	/* the bottom level bounds may have changed too */
+	for(i=0; i<num_changed; i++) {
+		inst_bounds(tlas, changed ? changed[i] : i);
+	}
+	return bvh_refit(&tlas->top, tlas->bounds, changed, num_changed, rotate);
+}
+
+int bvh_tlas_ray_closest(const bvh_tlas_t *tlas, ray_t ray, int *prim, scalar_t *pos,
+		bvh_query_stats_t *stats)
+{
+	return query(tlas, ray, prim, pos, stats, 0);
+}
+
+int bvh_tlas_ray_any(const bvh_tlas_t *tlas, ray_t ray, int *prim, scalar_t *pos,
+		bvh_query_stats_t *stats)
+{
+	return query(tlas, ray, prim, pos, stats, 1);
+}
+
+vec3_t bvh_inst_normal_to_world(const bvh_inst_t *inst, vec3_t n)
+{
+	vec3_t res;
+	const scalar_t (*m)[4] = inst->inv_xform;
+
+	res.x = m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z;
+	res.y = m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z;
+	res.z = m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z;
+	return res;
+}
+
+
+/* world space box of the bottom level root box (Arvo 1990): each axis of
+ * the result is the translation plus the sum of the extremes of each matrix
+ * element times the corresponding axis of the object space box.
+ */
+static void inst_bounds(bvh_tlas_t *tlas, int i)
+{
+	int j, k;
+	scalar_t a, b, bmin[3], bmax[3];
+	const bvh_inst_t *inst = tlas->inst + i;
+	const bvh_node_t *root;
+
+	if(!inst->bvh->num_nodes) {
+		/* nothing to hit, a point at the origin of the instance */
+		tlas->bounds[i].min = tlas->bounds[i].max =
+			v3_cons(inst->xform[0][3], inst->xform[1][3], inst->xform[2][3]);
+		return;
+	}
+	root = inst->bvh->nodes;
+
+	for(j=0; j<3; j++) {
+		bmin[j] = bmax[j] = inst->xform[j][3];
+		for(k=0; k<3; k++) {
+			a = inst->xform[j][k] * root->bmin[k];
+			b = inst->xform[j][k] * root->bmax[k];
+			bmin[j] += MIN(a, b);
+			bmax[j] += MAX(a, b);
+		}
+	}
+	tlas->bounds[i] = aabox_cons(bmin[0], bmin[1], bmin[2], bmax[0], bmax[1], bmax[2]);
+}
+
+/* top level primitive intersection: the ray goes to the object space of the
+ * instance, and down its bottom level tree, up to the closest hit so far
+ */
+static int inst_hit(int i, ray_t ray, scalar_t tmax, scalar_t *t, void *cls)
+{
+	int prim;
+	ray_t oray;
+	struct tlas_query *q = cls;
+	bvh_inst_t *inst = q->tlas->inst + i;
+
+	oray.origin = v3_transform_m3x4(ray.origin, inst->inv_xform);
+	oray.dir = v3_transform_dir_m3x4(ray.dir, inst->inv_xform);
+
+	if(q->any) {
+		prim = bvh_ray_any_tmax(inst->bvh, oray, tmax, inst->hit, inst->cls, t, q->stats);
+	} else {
+		prim = bvh_ray_closest_tmax(inst->bvh, oray, tmax, inst->hit, inst->cls, t, q->stats);
+	}
+	if(prim == -1) {
+		return 0;
+	}
+	q->prim = prim;
+	return 1;
+}
+
+static int query(const bvh_tlas_t *tlas, ray_t ray, int *prim, scalar_t *pos,
+		bvh_query_stats_t *stats, int any)
+{
+	int res;
+	struct tlas_query q;
+
+	q.tlas = tlas;
+	q.stats = stats;
+	q.prim = -1;
+	q.any = any;
+
+	if(any) {
+		res = bvh_ray_any(&tlas->top, ray, inst_hit, &q, pos, stats);
+	} else {
+		res = bvh_ray_closest(&tlas->top, ray, inst_hit, &q, pos, stats);
+	}
+	if(prim) {
+		*prim = res == -1 ? -1 : q.prim;
+	}
+	return res;
+}
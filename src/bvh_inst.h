@@ -0,0 +1,104 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_BVH_INST_H_
+#define LIBVMATH_BVH_INST_H_
+
+#include "bvh.h"
+#include "matrix.h"
+
+/* an instance of a bottom level tree, built in object space, placed in the
+ * world by an affine transformation. Any number of instances can share the
+ * same tree.
+ */
+typedef struct {
+	const bvh_t *bvh;
+	bvh_hit_func_t hit;	/* primitive intersection, called with object space rays */
+	void *cls;
+	mat3x4_t xform;		/* object to world */
+	mat3x4_t inv_xform;	/* world to object, kept up to date by bvh_tlas_build/bvh_tlas_set_xform */
+} bvh_inst_t;
+
+/* two-level structure: a top level tree over the world space bounds of the
+ * instances. Rays are moved into the object space of each instance they
+ * reach, origin and direction by the cached inverse, and the bottom level
+ * tree is traversed with the transformed ray. Since the direction isn't
+ * normalized, distances along the ray stay the same in both spaces, and hits
+ * need no transformation back: the world space hit point is at pos along the
+ * original ray. Normals of the hit primitives can be brought to world space
+ * with bvh_inst_normal_to_world.
+ */
+typedef struct {
+	bvh_t top;
+	bvh_inst_t *inst;	/* copy of the instances, top.prim refers to these */
+	aabox_t *bounds;	/* world space bounds of each instance */
+	int num_inst;
+} bvh_tlas_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void bvh_tlas_init(bvh_tlas_t *tlas);
+void bvh_tlas_destroy(bvh_tlas_t *tlas);
+
+/* builds the top level tree over count instances, which are copied. Only
+ * the xform of each instance needs to be set, the inverses are computed
+ * here. The bottom level trees must stay valid, and their bounds unchanged
+ * (call bvh_tlas_update after refitting one). Returns 0 on success, -1 on
+ * failure.
+ */
+int bvh_tlas_build(bvh_tlas_t *tlas, const bvh_inst_t *inst, int count);
+
+/* moves an instance: sets its transformation, its inverse and its world
+ * bounds. The top level tree is only updated by bvh_tlas_update.
+ */
+void bvh_tlas_set_xform(bvh_tlas_t *tlas, int inst, mat3x4_t xform);
+
+/* refits the top level tree after some instances moved (or their bottom
+ * level trees were refitted), see bvh_refit. changed lists the instances,
+ * or null for all of them. Returns 0 on success, -1 on failure.
+ */
+int bvh_tlas_update(bvh_tlas_t *tlas, const int *changed, int num_changed, int rotate);
+
+/* ray queries over all the instances, see bvh_ray_closest and bvh_ray_any.
+ * Return the index of the instance hit, or -1 if nothing is hit, and prim
+ * gets the primitive of its bottom level tree. prim and stats may be null,
+ * the counters of both levels are added up.
+ */
+int bvh_tlas_ray_closest(const bvh_tlas_t *tlas, ray_t ray, int *prim, scalar_t *pos,
+		bvh_query_stats_t *stats);
+int bvh_tlas_ray_any(const bvh_tlas_t *tlas, ray_t ray, int *prim, scalar_t *pos,
+		bvh_query_stats_t *stats);
+
+/* object space normal to world space, by the transposed inverse (not normalized) */
+vec3_t bvh_inst_normal_to_world(const bvh_inst_t *inst, vec3_t n);
+
+#ifdef __cplusplus
+}
+
+/* the bottom row of the matrix is dropped, it must be an affine transformation */
+inline void bvh_tlas_set_xform(bvh_tlas_t *tlas, int inst, const Matrix4x4 &xform)
+{
+	mat3x4_t m;
+	m4_to_m3x4(m, (scalar_t (*)[4])xform.m);
+	bvh_tlas_set_xform(tlas, inst, m);
+}
+#endif
+
+#endif	/* LIBVMATH_BVH_INST_H_ */
@@ -0,0 +1,121 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <string.h>
+#include "dualquat.h"
+#include "vmath.h"
+
+static inline quat_t to_quat_t(const Quaternion &q)
+{
+	return quat_cons(q.s, q.v.x, q.v.y, q.v.z);
+}
+
+static inline dualquat_t to_dualquat_t(const DualQuaternion &dq)
+{
+	return dq_cons(to_quat_t(dq.real), to_quat_t(dq.dual));
+}
+
+DualQuaternion::DualQuaternion()
+	: dual(0.0, 0.0, 0.0, 0.0)
+{
+}
+
+DualQuaternion::DualQuaternion(const Quaternion &real_arg, const Quaternion &dual_arg)
+	: real(real_arg), dual(dual_arg)
+{
+}
+
+DualQuaternion::DualQuaternion(const Quaternion &rot, const Vector3 &trans)
+	: real(rot)
+{
+	dual = Quaternion(0.0, trans) * rot;
+	dual.s *= 0.5;
+	dual.v *= 0.5;
+}
+
+DualQuaternion::DualQuaternion(const Matrix4x4 &mat)
+{
+	mat4_t m;
+	memcpy(m, mat.m, sizeof m);
+	*this = DualQuaternion(dq_from_mat4(m));
+}
+
+DualQuaternion::DualQuaternion(const dualquat_t &dq)
+	: real(dq.real), dual(dq.dual)
+{
+}
+
+/* (r1 + e d1)(r2 + e d2) = r1 r2 + e (r1 d2 + d1 r2) */
+DualQuaternion DualQuaternion::operator *(const DualQuaternion &dq) const
+{
+	return DualQuaternion(real * dq.real, real * dq.dual + dual * dq.real);
+}
+
+void DualQuaternion::operator *=(const DualQuaternion &dq)
+{
+	*this = *this * dq;
+}
+
+void DualQuaternion::reset_identity()
+{
+	real = Quaternion();
+	dual = Quaternion(0.0, 0.0, 0.0, 0.0);
+}
+
+DualQuaternion DualQuaternion::conjugate() const
+{
+	return DualQuaternion(real.conjugate(), dual.conjugate());
+}
+
+void DualQuaternion::normalize()
+{
+	*this = DualQuaternion(dq_normalize(to_dualquat_t(*this)));
+}
+
+DualQuaternion DualQuaternion::normalized() const
+{
+	return DualQuaternion(dq_normalize(to_dualquat_t(*this)));
+}
+
+Quaternion DualQuaternion::get_rotation() const
+{
+	return real;
+}
+
+Vector3 DualQuaternion::get_translation() const
+{
+	return (dual * real.conjugate()).v * 2.0;
+}
+
+Matrix4x4 DualQuaternion::get_matrix() const
+{
+	Matrix4x4 res;
+	dq_to_mat4(res.m, to_dualquat_t(*this));
+	return res;
+}
+
+Vector3 DualQuaternion::transform_point(const Vector3 &v) const
+{
+	return transform_vector(v) + get_translation();
+}
+
+/* v + 2 r.v x (r.v x v + r.w v) */
+Vector3 DualQuaternion::transform_vector(const Vector3 &v) const
+{
+	Vector3 tmp = cross_product(real.v, v) + v * real.s;
+	return v + cross_product(real.v, tmp) * 2.0;
+}
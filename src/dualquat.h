@@ -0,0 +1,108 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_DUALQUAT_H_
+#define LIBVMATH_DUALQUAT_H_
+
+#include <stdio.h>
+#include "vmath_types.h"
+#include "quat.h"
+
+/* Unit dual quaternions represent rigid transformations: the real part is
+ * the rotation quaternion r, and the dual part is t * r / 2, where t is the
+ * translation as a pure quaternion. The rotation is applied first.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+static inline dualquat_t dq_cons(quat_t real, quat_t dual);
+static inline dualquat_t dq_identity(void);
+static inline dualquat_t dq_from_rot_trans(quat_t rot, vec3_t trans);
+void dq_print(FILE *fp, dualquat_t dq);
+
+/* dq_mul(a, b) applies b first, then a, like the matrix product */
+static inline dualquat_t dq_mul(dualquat_t dq1, dualquat_t dq2);
+/* quaternion conjugate of both parts: the inverse of a unit dual quaternion */
+static inline dualquat_t dq_conjugate(dualquat_t dq);
+
+static inline quat_t dq_rotation(dualquat_t dq);
+static inline vec3_t dq_translation(dualquat_t dq);
+
+/* scales both parts to make the real part unit length, and removes any
+ * component of the dual part along the real part.
+ */
+dualquat_t dq_normalize(dualquat_t dq);
+
+/* conversions from/to rigid transformation matrices. dq_from_mat4 ignores
+ * any scaling or projection terms, dq_to_mat4 expects a unit dual quaternion.
+ */
+dualquat_t dq_from_mat4(mat4_t m);
+void dq_to_mat4(mat4_t res, dualquat_t dq);
+
+static inline vec3_t dq_transform_point(dualquat_t dq, vec3_t v);
+static inline vec3_t dq_transform_vector(dualquat_t dq, vec3_t v);
+
+/* dual quaternion linear blend skinning of count vertices. Each vertex has 4
+ * bone influences: the palette indices and weights of vertex i are
+ * bone_idx[i * 4 + k] and bone_weights[i * 4 + k] (k = 0..3). Unused
+ * influences need a weight of 0, but still a valid index.
+ * The blended dual quaternions are renormalized, so the weights don't have to
+ * add up to exactly 1. Normals are only rotated, not renormalized; pass null
+ * pointers in norm to skip them. The results may overwrite the inputs.
+ */
+void dq_skin_soa(vec3_soa_t pos_res, vec3_soa_t norm_res, vec3_soa_t pos, vec3_soa_t norm,
+		const dualquat_t *bones, const int *bone_idx, const scalar_t *bone_weights, int count);
+
+#ifdef __cplusplus
+}	/* extern "C" */
+
+class DualQuaternion {
+public:
+	Quaternion real, dual;
+
+	DualQuaternion();
+	DualQuaternion(const Quaternion &real, const Quaternion &dual);
+	DualQuaternion(const Quaternion &rot, const Vector3 &trans);
+	DualQuaternion(const Matrix4x4 &mat);
+	DualQuaternion(const dualquat_t &dq);
+
+	DualQuaternion operator *(const DualQuaternion &dq) const;
+	void operator *=(const DualQuaternion &dq);
+
+	void reset_identity();
+
+	DualQuaternion conjugate() const;
+
+	void normalize();
+	DualQuaternion normalized() const;
+
+	Quaternion get_rotation() const;
+	Vector3 get_translation() const;
+	Matrix4x4 get_matrix() const;
+
+	Vector3 transform_point(const Vector3 &v) const;
+	Vector3 transform_vector(const Vector3 &v) const;
+};
+
+#endif	/* __cplusplus */
+
+#include "dualquat.inl"
+
+#endif	/* LIBVMATH_DUALQUAT_H_ */
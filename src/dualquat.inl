@@ -0,0 +1,85 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+static inline dualquat_t dq_cons(quat_t real, quat_t dual)
+{
+	dualquat_t dq;
+	dq.real = real;
+	dq.dual = dual;
+	return dq;
+}
+
+static inline dualquat_t dq_identity(void)
+{
+	return dq_cons(quat_identity(), quat_cons(0.0, 0.0, 0.0, 0.0));
+}
+
+static inline dualquat_t dq_from_rot_trans(quat_t rot, vec3_t trans)
+{
+	quat_t tq = quat_cons(0.0, trans.x, trans.y, trans.z);
+	return dq_cons(rot, v4_scale(quat_mul(tq, rot), 0.5));
+}
+
+/* (r1 + e d1)(r2 + e d2) = r1 r2 + e (r1 d2 + d1 r2) */
+static inline dualquat_t dq_mul(dualquat_t dq1, dualquat_t dq2)
+{
+	dualquat_t res;
+	res.real = quat_mul(dq1.real, dq2.real);
+	res.dual = quat_add(quat_mul(dq1.real, dq2.dual), quat_mul(dq1.dual, dq2.real));
+	return res;
+}
+
+static inline dualquat_t dq_conjugate(dualquat_t dq)
+{
+	dq.real = quat_conjugate(dq.real);
+	dq.dual = quat_conjugate(dq.dual);
+	return dq;
+}
+
+static inline quat_t dq_rotation(dualquat_t dq)
+{
+	return dq.real;
+}
+
+/* t = 2 d r* */
+static inline vec3_t dq_translation(dualquat_t dq)
+{
+	quat_t t = quat_mul(dq.dual, quat_conjugate(dq.real));
+	return v3_cons(2.0 * t.x, 2.0 * t.y, 2.0 * t.z);
+}
+
+/* v + 2 r.v x (r.v x v + r.w v) */
+static inline vec3_t dq_transform_vector(dualquat_t dq, vec3_t v)
+{
+	vec3_t rv = quat_vec(dq.real);
+	vec3_t tmp = v3_add(v3_cross(rv, v), v3_scale(v, dq.real.w));
+	return v3_add(v, v3_scale(v3_cross(rv, tmp), 2.0));
+}
+
+static inline vec3_t dq_transform_point(dualquat_t dq, vec3_t v)
+{
+	return v3_add(dq_transform_vector(dq, v), dq_translation(dq));
+}
+
+#ifdef __cplusplus
+}	/* extern "C" */
+#endif	/* __cplusplus */
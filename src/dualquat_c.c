@@ -0,0 +1,229 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include "dualquat.h"
+#include "matrix.h"
+#include "vmath_simd.h"
+
+void dq_print(FILE *fp, dualquat_t dq)
+{
+	fputs("(", fp);
+	quat_print(fp, dq.real);
+	fputs(" + e", fp);
+	quat_print(fp, dq.dual);
+	fputs(")", fp);
+}
+
+dualquat_t dq_normalize(dualquat_t dq)
+{
+	scalar_t len = quat_length(dq.real);
+
+	if(len != 0.0) {
+		dq.real = v4_scale(dq.real, 1.0 / len);
+		dq.dual = v4_scale(dq.dual, 1.0 / len);
+		dq.dual = quat_sub(dq.dual, v4_scale(dq.real, v4_dot(dq.real, dq.dual)));
+	}
+	return dq;
+}
+
+dualquat_t dq_from_mat4(mat4_t m)
+{
+	quat_t rot = quat_normalize(m4_rotation_quat(m));
+	return dq_from_rot_trans(rot, v3_cons(m[0][3], m[1][3], m[2][3]));
+}
+
+void dq_to_mat4(mat4_t res, dualquat_t dq)
+{
+	vec3_t t = dq_translation(dq);
+
+	quat_to_mat4(res, dq.real);
+	res[0][3] = t.x;
+	res[1][3] = t.y;
+	res[2][3] = t.z;
+}
+
+/* ---- skinning ----
+ * The 4 bone dual quaternions of each vertex are blended with their weights,
+ * negated where needed so that the rotations are all in the same hemisphere
+ * as the first one, and the sum is scaled by 1 / |real|. The vertex is then
+ * transformed with the same formulas as dq_transform_point/vector.
+ */
+
+#ifdef VMATH_SSE
+#define CROSS_SSE(rx, ry, rz, ax, ay, az, bx, by, bz) \
+	do { \
+		rx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)); \
+		ry = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)); \
+		rz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)); \
+	} while(0)
+
+/* loads the k-th influence of 4 vertices, transposed to SoA form */
+static void load_influence(__m128 *real, __m128 *dual, const dualquat_t *bones, const int *idx, int k)
+{
+	const dualquat_t *b0 = bones + idx[k];
+	const dualquat_t *b1 = bones + idx[4 + k];
+	const dualquat_t *b2 = bones + idx[8 + k];
+	const dualquat_t *b3 = bones + idx[12 + k];
+
+	real[0] = _mm_loadu_ps(&b0->real.x);
+	real[1] = _mm_loadu_ps(&b1->real.x);
+	real[2] = _mm_loadu_ps(&b2->real.x);
+	real[3] = _mm_loadu_ps(&b3->real.x);
+	_MM_TRANSPOSE4_PS(real[0], real[1], real[2], real[3]);
+
+	dual[0] = _mm_loadu_ps(&b0->dual.x);
+	dual[1] = _mm_loadu_ps(&b1->dual.x);
+	dual[2] = _mm_loadu_ps(&b2->dual.x);
+	dual[3] = _mm_loadu_ps(&b3->dual.x);
+	_MM_TRANSPOSE4_PS(dual[0], dual[1], dual[2], dual[3]);
+}
+
+static void skin4_sse(vec3_soa_t pos_res, vec3_soa_t norm_res, vec3_soa_t pos, vec3_soa_t norm,
+		const dualquat_t *bones, const int *idx, const scalar_t *weights, int i)
+{
+	int j, k;
+	__m128 w[4], r0[4], r[4], d[4], br[4], bd[4];
+	__m128 dot, s, px, py, pz, cx, cy, cz, tx, ty, tz;
+	__m128 signmask = _mm_set1_ps(-0.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+
+	w[0] = _mm_loadu_ps(weights);
+	w[1] = _mm_loadu_ps(weights + 4);
+	w[2] = _mm_loadu_ps(weights + 8);
+	w[3] = _mm_loadu_ps(weights + 12);
+	_MM_TRANSPOSE4_PS(w[0], w[1], w[2], w[3]);
+
+	load_influence(r0, d, bones, idx, 0);
+	for(j=0; j<4; j++) {
+		r[j] = _mm_mul_ps(r0[j], w[0]);
+		d[j] = _mm_mul_ps(d[j], w[0]);
+	}
+	for(k=1; k<4; k++) {
+		load_influence(br, bd, bones, idx, k);
+
+		/* flip the weight if this rotation is in the opposite hemisphere */
+		dot = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(br[0], r0[0]), _mm_mul_ps(br[1], r0[1])),
+					_mm_mul_ps(br[2], r0[2])), _mm_mul_ps(br[3], r0[3]));
+		s = _mm_xor_ps(w[k], _mm_and_ps(dot, signmask));
+
+		for(j=0; j<4; j++) {
+			r[j] = _mm_add_ps(r[j], _mm_mul_ps(br[j], s));
+			d[j] = _mm_add_ps(d[j], _mm_mul_ps(bd[j], s));
+		}
+	}
+
+	/* normalize */
+	s = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], r[0]), _mm_mul_ps(r[1], r[1])),
+				_mm_mul_ps(r[2], r[2])), _mm_mul_ps(r[3], r[3]));
+	s = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(s));
+	for(j=0; j<4; j++) {
+		r[j] = _mm_mul_ps(r[j], s);
+		d[j] = _mm_mul_ps(d[j], s);
+	}
+
+	/* translation: 2 (r.w d.v - d.w r.v + r.v x d.v) */
+	CROSS_SSE(tx, ty, tz, r[0], r[1], r[2], d[0], d[1], d[2]);
+	tx = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(d[0], r[3]), _mm_mul_ps(r[0], d[3])), tx), two);
+	ty = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(d[1], r[3]), _mm_mul_ps(r[1], d[3])), ty), two);
+	tz = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(_mm_mul_ps(d[2], r[3]), _mm_mul_ps(r[2], d[3])), tz), two);
+
+	/* rotate: v + 2 r.v x (r.v x v + r.w v) */
+	px = _mm_loadu_ps(pos.x + i);
+	py = _mm_loadu_ps(pos.y + i);
+	pz = _mm_loadu_ps(pos.z + i);
+	CROSS_SSE(cx, cy, cz, r[0], r[1], r[2], px, py, pz);
+	cx = _mm_add_ps(cx, _mm_mul_ps(px, r[3]));
+	cy = _mm_add_ps(cy, _mm_mul_ps(py, r[3]));
+	cz = _mm_add_ps(cz, _mm_mul_ps(pz, r[3]));
+	CROSS_SSE(s, dot, w[0], r[0], r[1], r[2], cx, cy, cz);
+	_mm_storeu_ps(pos_res.x + i, _mm_add_ps(_mm_add_ps(px, _mm_mul_ps(s, two)), tx));
+	_mm_storeu_ps(pos_res.y + i, _mm_add_ps(_mm_add_ps(py, _mm_mul_ps(dot, two)), ty));
+	_mm_storeu_ps(pos_res.z + i, _mm_add_ps(_mm_add_ps(pz, _mm_mul_ps(w[0], two)), tz));
+
+	if(norm.x) {
+		px = _mm_loadu_ps(norm.x + i);
+		py = _mm_loadu_ps(norm.y + i);
+		pz = _mm_loadu_ps(norm.z + i);
+		CROSS_SSE(cx, cy, cz, r[0], r[1], r[2], px, py, pz);
+		cx = _mm_add_ps(cx, _mm_mul_ps(px, r[3]));
+		cy = _mm_add_ps(cy, _mm_mul_ps(py, r[3]));
+		cz = _mm_add_ps(cz, _mm_mul_ps(pz, r[3]));
+		CROSS_SSE(s, dot, w[0], r[0], r[1], r[2], cx, cy, cz);
+		_mm_storeu_ps(norm_res.x + i, _mm_add_ps(px, _mm_mul_ps(s, two)));
+		_mm_storeu_ps(norm_res.y + i, _mm_add_ps(py, _mm_mul_ps(dot, two)));
+		_mm_storeu_ps(norm_res.z + i, _mm_add_ps(pz, _mm_mul_ps(w[0], two)));
+	}
+}
+#endif	/* VMATH_SSE */
+
+static void skin1(vec3_soa_t pos_res, vec3_soa_t norm_res, vec3_soa_t pos, vec3_soa_t norm,
+		const dualquat_t *bones, const int *idx, const scalar_t *weights, int i)
+{
+	int k;
+	scalar_t s;
+	dualquat_t dq;
+	const dualquat_t *b0 = bones + idx[0];
+	const dualquat_t *b;
+	vec3_t v;
+
+	dq.real = v4_scale(b0->real, weights[0]);
+	dq.dual = v4_scale(b0->dual, weights[0]);
+	for(k=1; k<4; k++) {
+		b = bones + idx[k];
+		s = weights[k];
+		if(v4_dot(b->real, b0->real) < 0.0) {
+			s = -s;
+		}
+		dq.real = v4_add(dq.real, v4_scale(b->real, s));
+		dq.dual = v4_add(dq.dual, v4_scale(b->dual, s));
+	}
+
+	s = 1.0 / quat_length(dq.real);
+	dq.real = v4_scale(dq.real, s);
+	dq.dual = v4_scale(dq.dual, s);
+
+	v = dq_transform_point(dq, v3_cons(pos.x[i], pos.y[i], pos.z[i]));
+	pos_res.x[i] = v.x;
+	pos_res.y[i] = v.y;
+	pos_res.z[i] = v.z;
+
+	if(norm.x) {
+		v = dq_transform_vector(dq, v3_cons(norm.x[i], norm.y[i], norm.z[i]));
+		norm_res.x[i] = v.x;
+		norm_res.y[i] = v.y;
+		norm_res.z[i] = v.z;
+	}
+}
+
+void dq_skin_soa(vec3_soa_t pos_res, vec3_soa_t norm_res, vec3_soa_t pos, vec3_soa_t norm,
+		const dualquat_t *bones, const int *bone_idx, const scalar_t *bone_weights, int count)
+{
+	int i = 0;
+
+#ifdef VMATH_SSE
+	for(; i<count - 3; i+=4) {
+		skin4_sse(pos_res, norm_res, pos, norm, bones, bone_idx + i * 4, bone_weights + i * 4, i);
+	}
+#endif
+
+	for(; i<count; i++) {
+		skin1(pos_res, norm_res, pos, norm, bones, bone_idx + i * 4, bone_weights + i * 4, i);
+	}
+}
@@ -0,0 +1,496 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "frustum.h"
+#include "vmath_simd.h"
+#include "vmath_thread.h"
+
+/* plane with the absolute values of its normal, for the box tests. A box with
+ * center c and half-extents e is outside if n.c - d + |n|.e < 0, which is the
+ * same as testing its corner furthest along the normal.
+ */
+struct cull_plane {
+	scalar_t nx, ny, nz, ax, ay, az, d;
+};
+
+/* spheres: x, y, z are the centers and r the radii.
+ * boxes: x, y, z are the min corners, mx, my, mz the max corners, r is null.
+ */
+struct cull_job {
+	struct cull_plane plane[6];
+	const scalar_t *x, *y, *z, *r;
+	const scalar_t *mx, *my, *mz;
+	unsigned char *hint;
+};
+
+/* a batch split across threads: each chunk writes the indices of its visible
+ * objects at its own start in idx, and its count in num_vis, and they are
+ * moved together at the end
+ */
+struct cull_mt_job {
+	const struct cull_job *job;
+	unsigned char *vis;
+	int *idx;
+	int chunk_size;
+	int *num_vis;
+};
+
+void frustum_from_matrix(frustum_t *frust, mat4_t m)
+{
+	int i;
+
+	/* the planes are w + x >= 0, w - x >= 0 etc, in clip space */
+	for(i=0; i<3; i++) {
+		plane_t *p = frust->plane + i * 2;
+		p[0].norm = v3_cons(m[3][0] + m[i][0], m[3][1] + m[i][1], m[3][2] + m[i][2]);
+		p[0].d = -(m[3][3] + m[i][3]);
+		p[1].norm = v3_cons(m[3][0] - m[i][0], m[3][1] - m[i][1], m[3][2] - m[i][2]);
+		p[1].d = -(m[3][3] - m[i][3]);
+	}
+
+	for(i=0; i<6; i++) {
+		plane_t *p = frust->plane + i;
+		scalar_t len = v3_length(p->norm);
+		if(len != 0.0) {
+			p->norm = v3_scale(p->norm, 1.0 / len);
+			p->d /= len;
+		}
+	}
+}
+
+/* all the code paths compute the distances in the same order, and produce the
+ * same results.
+ */
+#define SPHERE_DIST(p, cx, cy, cz, r) \
+	((p)->norm.x * (cx) + (p)->norm.y * (cy) + (p)->norm.z * (cz) - (p)->d + (r))
+
+int frustum_sphere_test(const frustum_t *frust, sphere_t sph, unsigned char *hint)
+{
+	int i, p, h = hint ? *hint : 0;
+
+	for(i=0; i<6; i++) {
+		/* the hint plane first, then the rest in order */
+		p = i == 0 ? h : (i - 1 < h ? i - 1 : i);
+		if(SPHERE_DIST(frust->plane + p, sph.pos.x, sph.pos.y, sph.pos.z, sph.rad) < 0.0) {
+			if(hint) *hint = p;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int frustum_aabox_test(const frustum_t *frust, const aabox_t *box, unsigned char *hint)
+{
+	int i, p, h = hint ? *hint : 0;
+	scalar_t cx, cy, cz, ex, ey, ez;
+	scalar_t ax, ay, az;
+	const plane_t *pl;
+
+	cx = (box->min.x + box->max.x) * 0.5;
+	cy = (box->min.y + box->max.y) * 0.5;
+	cz = (box->min.z + box->max.z) * 0.5;
+	ex = (box->max.x - box->min.x) * 0.5;
+	ey = (box->max.y - box->min.y) * 0.5;
+	ez = (box->max.z - box->min.z) * 0.5;
+
+	for(i=0; i<6; i++) {
+		p = i == 0 ? h : (i - 1 < h ? i - 1 : i);
+		pl = frust->plane + p;
+		ax = fabs(pl->norm.x);
+		ay = fabs(pl->norm.y);
+		az = fabs(pl->norm.z);
+		if(SPHERE_DIST(pl, cx, cy, cz, ax * ex + ay * ey + az * ez) < 0.0) {
+			if(hint) *hint = p;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* ---- batch culling ---- */
+
+static int cull1(const struct cull_job *job, int i)
+{
+	int j, p, h = job->hint ? job->hint[i] : 0;
+	scalar_t cx, cy, cz, ex = 0, ey = 0, ez = 0, r, dist;
+	const struct cull_plane *pl;
+
+	if(job->r) {
+		cx = job->x[i];
+		cy = job->y[i];
+		cz = job->z[i];
+	} else {
+		cx = (job->x[i] + job->mx[i]) * 0.5f;
+		cy = (job->y[i] + job->my[i]) * 0.5f;
+		cz = (job->z[i] + job->mz[i]) * 0.5f;
+		ex = (job->mx[i] - job->x[i]) * 0.5f;
+		ey = (job->my[i] - job->y[i]) * 0.5f;
+		ez = (job->mz[i] - job->z[i]) * 0.5f;
+	}
+
+	for(j=0; j<6; j++) {
+		p = j == 0 ? h : (j - 1 < h ? j - 1 : j);
+		pl = job->plane + p;
+
+		r = job->r ? job->r[i] : pl->ax * ex + pl->ay * ey + pl->az * ez;
+		dist = pl->nx * cx + pl->ny * cy + pl->nz * cz - pl->d + r;
+		if(dist < 0.0f) {
+			if(job->hint) job->hint[i] = p;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* stores the results of a group of objects starting at index base, with bit k
+ * of bits set if object base + k is visible. Returns the new visible count.
+ */
+static int emit_group(int bits, int base, int width, unsigned char *vis, int *idx, int num_vis)
+{
+	int k;
+
+	if(vis) {
+		for(k=0; k<width; k++) {
+			vis[base + k] = (bits >> k) & 1;
+		}
+	}
+	for(k=0; bits; k++, bits >>= 1) {
+		if(bits & 1) {
+			if(idx) idx[num_vis] = base + k;
+			num_vis++;
+		}
+	}
+	return num_vis;
+}
+
+static int cull_range_scalar(const struct cull_job *job, int start, int end,
+		unsigned char *vis, int *idx, int num_vis)
+{
+	int i;
+	for(i=start; i<end; i++) {
+		num_vis = emit_group(cull1(job, i), i, 1, vis, idx, num_vis);
+	}
+	return num_vis;
+}
+
+#ifdef VMATH_SSE
+static int cull4_sse(const struct cull_job *job, int i)
+{
+	int p, out, alive = 0xf;
+	__m128 cx, cy, cz, ex, ey, ez, r, dist, zero = _mm_setzero_ps();
+	unsigned char *hint = job->hint ? job->hint + i : 0;
+	const struct cull_plane *pl = job->plane;
+
+	if(job->r) {
+		cx = _mm_loadu_ps(job->x + i);
+		cy = _mm_loadu_ps(job->y + i);
+		cz = _mm_loadu_ps(job->z + i);
+		r = _mm_loadu_ps(job->r + i);
+		ex = ey = ez = zero;
+	} else {
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 mn, mx;
+		mn = _mm_loadu_ps(job->x + i); mx = _mm_loadu_ps(job->mx + i);
+		cx = _mm_mul_ps(_mm_add_ps(mn, mx), half);
+		ex = _mm_mul_ps(_mm_sub_ps(mx, mn), half);
+		mn = _mm_loadu_ps(job->y + i); mx = _mm_loadu_ps(job->my + i);
+		cy = _mm_mul_ps(_mm_add_ps(mn, mx), half);
+		ey = _mm_mul_ps(_mm_sub_ps(mx, mn), half);
+		mn = _mm_loadu_ps(job->z + i); mx = _mm_loadu_ps(job->mz + i);
+		cz = _mm_mul_ps(_mm_add_ps(mn, mx), half);
+		ez = _mm_mul_ps(_mm_sub_ps(mx, mn), half);
+		r = zero;
+	}
+
+#define DIST4(nx, ny, nz, ax, ay, az, d) \
+	do { \
+		if(!job->r) { \
+			r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ex), _mm_mul_ps(ay, ey)), _mm_mul_ps(az, ez)); \
+		} \
+		dist = _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)); \
+		dist = _mm_sub_ps(_mm_add_ps(dist, _mm_mul_ps(nz, cz)), d); \
+		dist = _mm_add_ps(dist, r); \
+	} while(0)
+
+	if(hint) {
+		/* each object against its own hint plane first */
+#define HINT4(c)	_mm_set_ps(pl[hint[3]].c, pl[hint[2]].c, pl[hint[1]].c, pl[hint[0]].c)
+		DIST4(HINT4(nx), HINT4(ny), HINT4(nz), HINT4(ax), HINT4(ay), HINT4(az), HINT4(d));
+		alive &= ~_mm_movemask_ps(_mm_cmplt_ps(dist, zero));
+		if(!alive) return 0;
+#undef HINT4
+	}
+
+	for(p=0; p<6; p++) {
+		DIST4(_mm_set1_ps(pl[p].nx), _mm_set1_ps(pl[p].ny), _mm_set1_ps(pl[p].nz),
+				_mm_set1_ps(pl[p].ax), _mm_set1_ps(pl[p].ay), _mm_set1_ps(pl[p].az),
+				_mm_set1_ps(pl[p].d));
+		if((out = _mm_movemask_ps(_mm_cmplt_ps(dist, zero)) & alive)) {
+			if(hint) {
+				if(out & 1) hint[0] = p;
+				if(out & 2) hint[1] = p;
+				if(out & 4) hint[2] = p;
+				if(out & 8) hint[3] = p;
+			}
+			if(!(alive &= ~out)) break;
+		}
+	}
+#undef DIST4
+	return alive;
+}
+
+static int cull_range_sse(const struct cull_job *job, int start, int end,
+		unsigned char *vis, int *idx, int num_vis)
+{
+	int i;
+	for(i=start; i<=end - 4; i+=4) {
+		num_vis = emit_group(cull4_sse(job, i), i, 4, vis, idx, num_vis);
+	}
+	return cull_range_scalar(job, i, end, vis, idx, num_vis);
+}
+#endif	/* VMATH_SSE */
+
+#ifdef VMATH_AVX
+VMATH_TARGET_AVX
+static int cull8_avx(const struct cull_job *job, int i)
+{
+	int p, out, k, alive = 0xff;
+	__m256 cx, cy, cz, ex, ey, ez, r, dist, zero = _mm256_setzero_ps();
+	unsigned char *hint = job->hint ? job->hint + i : 0;
+	const struct cull_plane *pl = job->plane;
+
+	if(job->r) {
+		cx = _mm256_loadu_ps(job->x + i);
+		cy = _mm256_loadu_ps(job->y + i);
+		cz = _mm256_loadu_ps(job->z + i);
+		r = _mm256_loadu_ps(job->r + i);
+		ex = ey = ez = zero;
+	} else {
+		__m256 half = _mm256_set1_ps(0.5f);
+		__m256 mn, mx;
+		mn = _mm256_loadu_ps(job->x + i); mx = _mm256_loadu_ps(job->mx + i);
+		cx = _mm256_mul_ps(_mm256_add_ps(mn, mx), half);
+		ex = _mm256_mul_ps(_mm256_sub_ps(mx, mn), half);
+		mn = _mm256_loadu_ps(job->y + i); mx = _mm256_loadu_ps(job->my + i);
+		cy = _mm256_mul_ps(_mm256_add_ps(mn, mx), half);
+		ey = _mm256_mul_ps(_mm256_sub_ps(mx, mn), half);
+		mn = _mm256_loadu_ps(job->z + i); mx = _mm256_loadu_ps(job->mz + i);
+		cz = _mm256_mul_ps(_mm256_add_ps(mn, mx), half);
+		ez = _mm256_mul_ps(_mm256_sub_ps(mx, mn), half);
+		r = zero;
+	}
+
+#define DIST8(nx, ny, nz, ax, ay, az, d) \
+	do { \
+		if(!job->r) { \
+			r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, ex), _mm256_mul_ps(ay, ey)), \
+					_mm256_mul_ps(az, ez)); \
+		} \
+		dist = _mm256_add_ps(_mm256_mul_ps(nx, cx), _mm256_mul_ps(ny, cy)); \
+		dist = _mm256_sub_ps(_mm256_add_ps(dist, _mm256_mul_ps(nz, cz)), d); \
+		dist = _mm256_add_ps(dist, r); \
+	} while(0)
+
+	if(hint) {
+#define HINT8(c)	_mm256_set_ps(pl[hint[7]].c, pl[hint[6]].c, pl[hint[5]].c, pl[hint[4]].c, \
+		pl[hint[3]].c, pl[hint[2]].c, pl[hint[1]].c, pl[hint[0]].c)
+		DIST8(HINT8(nx), HINT8(ny), HINT8(nz), HINT8(ax), HINT8(ay), HINT8(az), HINT8(d));
+		alive &= ~_mm256_movemask_ps(_mm256_cmp_ps(dist, zero, _CMP_LT_OQ));
+		if(!alive) return 0;
+#undef HINT8
+	}
+
+	for(p=0; p<6; p++) {
+		DIST8(_mm256_set1_ps(pl[p].nx), _mm256_set1_ps(pl[p].ny), _mm256_set1_ps(pl[p].nz),
+				_mm256_set1_ps(pl[p].ax), _mm256_set1_ps(pl[p].ay), _mm256_set1_ps(pl[p].az),
+				_mm256_set1_ps(pl[p].d));
+		if((out = _mm256_movemask_ps(_mm256_cmp_ps(dist, zero, _CMP_LT_OQ)) & alive)) {
+			if(hint) {
+				for(k=0; k<8; k++) {
+					if(out & (1 << k)) hint[k] = p;
+				}
+			}
+			if(!(alive &= ~out)) break;
+		}
+	}
+#undef DIST8
+	return alive;
+}
+
+VMATH_TARGET_AVX
+static int cull_range_avx(const struct cull_job *job, int start, int end,
+		unsigned char *vis, int *idx, int num_vis)
+{
+	int i;
+	for(i=start; i<=end - 8; i+=8) {
+		num_vis = emit_group(cull8_avx(job, i), i, 8, vis, idx, num_vis);
+	}
+	/* not always done by the compiler before the tail call */
+	_mm256_zeroupper();
+	return cull_range_scalar(job, i, end, vis, idx, num_vis);
+}
+#endif	/* VMATH_AVX */
+
+typedef int (*cull_range_func_t)(const struct cull_job*, int, int, unsigned char*, int*, int);
+
+/* picked once, on the first call of any of the culling functions */
+static cull_range_func_t cull_range;
+static vmath_once_t cull_range_once = VMATH_ONCE_INIT;
+
+static void init_cull_range(void)
+{
+	cull_range_func_t func = cull_range_scalar;
+
+#ifdef VMATH_SSE
+	func = cull_range_sse;
+#endif
+#ifdef VMATH_AVX
+	if(vmath_cpu_features() & VMATH_CPU_AVX) {
+		func = cull_range_avx;
+	}
+#endif
+	cull_range = func;
+}
+
+static void setup_planes(struct cull_job *job, const frustum_t *frust)
+{
+	int i;
+	for(i=0; i<6; i++) {
+		const plane_t *p = frust->plane + i;
+		job->plane[i].nx = p->norm.x;
+		job->plane[i].ny = p->norm.y;
+		job->plane[i].nz = p->norm.z;
+		job->plane[i].ax = fabs(p->norm.x);
+		job->plane[i].ay = fabs(p->norm.y);
+		job->plane[i].az = fabs(p->norm.z);
+		job->plane[i].d = p->d;
+	}
+}
+
+int frustum_cull_spheres_soa(const frustum_t *frust, sphere_soa_t sph, int count,
+		unsigned char *vis, int *idx, unsigned char *hint)
+{
+	struct cull_job job;
+
+	setup_planes(&job, frust);
+	job.x = sph.x;
+	job.y = sph.y;
+	job.z = sph.z;
+	job.r = sph.rad;
+	job.mx = job.my = job.mz = 0;
+	job.hint = hint;
+
+	vmath_once(&cull_range_once, init_cull_range);
+	return cull_range(&job, 0, count, vis, idx, 0);
+}
+
+int frustum_cull_aabox_soa(const frustum_t *frust, aabox_soa_t box, int count,
+		unsigned char *vis, int *idx, unsigned char *hint)
+{
+	struct cull_job job;
+
+	setup_planes(&job, frust);
+	job.x = box.min.x;
+	job.y = box.min.y;
+	job.z = box.min.z;
+	job.r = 0;
+	job.mx = box.max.x;
+	job.my = box.max.y;
+	job.mz = box.max.z;
+	job.hint = hint;
+
+	vmath_once(&cull_range_once, init_cull_range);
+	return cull_range(&job, 0, count, vis, idx, 0);
+}
+
+static void cull_mt_range(int start, int end, void *cls)
+{
+	struct cull_mt_job *mt = cls;
+	int *idx = mt->idx ? mt->idx + start : 0;
+
+	mt->num_vis[start / mt->chunk_size] = cull_range(mt->job, start, end, mt->vis, idx, 0);
+}
+
+static int cull_mt(const struct cull_job *job, int count, unsigned char *vis, int *idx,
+		int num_threads, int chunk_size)
+{
+	int i, num_chunks, num_vis;
+	struct cull_mt_job mt;
+
+	if(count <= 0) return 0;
+	vmath_once(&cull_range_once, init_cull_range);
+
+	mt.job = job;
+	mt.vis = vis;
+	mt.idx = idx;
+	/* whole groups of 8 in each chunk */
+	mt.chunk_size = vmath_chunk_size(count, num_threads, chunk_size, 8);
+	num_chunks = (count - 1) / mt.chunk_size + 1;
+	if(!(mt.num_vis = malloc(num_chunks * sizeof *mt.num_vis))) {
+		return cull_range(job, 0, count, vis, idx, 0);
+	}
+
+	vmath_parallel_for(count, num_threads, mt.chunk_size, cull_mt_range, &mt);
+
+	num_vis = mt.num_vis[0];
+	for(i=1; i<num_chunks; i++) {
+		if(idx && mt.num_vis[i]) {
+			memmove(idx + num_vis, idx + i * mt.chunk_size, mt.num_vis[i] * sizeof *idx);
+		}
+		num_vis += mt.num_vis[i];
+	}
+	free(mt.num_vis);
+	return num_vis;
+}
+
+int frustum_cull_spheres_soa_mt(const frustum_t *frust, sphere_soa_t sph, int count,
+		unsigned char *vis, int *idx, unsigned char *hint, int num_threads, int chunk_size)
+{
+	struct cull_job job;
+
+	setup_planes(&job, frust);
+	job.x = sph.x;
+	job.y = sph.y;
+	job.z = sph.z;
+	job.r = sph.rad;
+	job.mx = job.my = job.mz = 0;
+	job.hint = hint;
+
+	return cull_mt(&job, count, vis, idx, num_threads, chunk_size);
+}
+
+int frustum_cull_aabox_soa_mt(const frustum_t *frust, aabox_soa_t box, int count,
+		unsigned char *vis, int *idx, unsigned char *hint, int num_threads, int chunk_size)
+{
+	struct cull_job job;
+
+	setup_planes(&job, frust);
+	job.x = box.min.x;
+	job.y = box.min.y;
+	job.z = box.min.z;
+	job.r = 0;
+	job.mx = box.max.x;
+	job.my = box.max.y;
+	job.mz = box.max.z;
+	job.hint = hint;
+
+	return cull_mt(&job, count, vis, idx, num_threads, chunk_size);
+}
@@ -0,0 +1,101 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_FRUSTUM_H_
+#define LIBVMATH_FRUSTUM_H_
+
+#include "geom.h"
+#include "matrix.h"
+
+enum {
+	FRUSTUM_LEFT,
+	FRUSTUM_RIGHT,
+	FRUSTUM_BOTTOM,
+	FRUSTUM_TOP,
+	FRUSTUM_NEAR,
+	FRUSTUM_FAR
+};
+
+/* the normals of the planes point inside, so a point p is in the frustum if
+ * v3_dot(plane.norm, p) >= plane.d for all six of them.
+ */
+typedef struct {
+	plane_t plane[6];
+} frustum_t;
+
+/* SoA array of boxes for the batch culling functions, sphere_soa_t is in geom.h */
+typedef struct {
+	vec3_soa_t min, max;
+} aabox_soa_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* extracts the planes of the frustum from a projection or view-projection
+ * matrix, with the OpenGL clip space conventions (-w <= z <= w) of
+ * Matrix4x4::set_perspective and friends. The planes are normalized. With a
+ * view-projection matrix they are in world space, with a projection matrix
+ * alone in view space.
+ */
+void frustum_from_matrix(frustum_t *frust, mat4_t m);
+
+/* conservative visibility tests: return 0 if the object is completely outside
+ * one of the planes, 1 otherwise. Objects near the corners of the frustum
+ * may be reported as visible even if they are outside.
+ *
+ * hint (may be null) enables plane coherency: the plane it points to is
+ * tested first, and if the object is culled it's updated to the plane which
+ * rejected it. An object which was culled by a plane in one frame is usually
+ * culled by the same plane in the next, with a single test. Hints should be
+ * kept per object and start at 0.
+ */
+int frustum_sphere_test(const frustum_t *frust, sphere_t sph, unsigned char *hint);
+int frustum_aabox_test(const frustum_t *frust, const aabox_t *box, unsigned char *hint);
+
+/* batch versions of the above. Objects are tested 4 or 8 at a time, and a
+ * group is rejected as soon as all of its objects are outside. Returns the
+ * number of visible objects. Any of the outputs may be null:
+ *  - vis[i] gets 1 if object i is visible, 0 otherwise.
+ *  - idx gets the indices of the visible objects, in ascending order.
+ *  - hint is an array of count plane hints, as in the single object tests.
+ */
+int frustum_cull_spheres_soa(const frustum_t *frust, sphere_soa_t sph, int count,
+		unsigned char *vis, int *idx, unsigned char *hint);
+int frustum_cull_aabox_soa(const frustum_t *frust, aabox_soa_t box, int count,
+		unsigned char *vis, int *idx, unsigned char *hint);
+
+/* same, split across num_threads threads (0 for one per processor), in
+ * chunks of chunk_size objects (0 for the default, see vmath_parallel_for),
+ * rounded up to a multiple of 8. The results are the same as above.
+ */
+int frustum_cull_spheres_soa_mt(const frustum_t *frust, sphere_soa_t sph, int count,
+		unsigned char *vis, int *idx, unsigned char *hint, int num_threads, int chunk_size);
+int frustum_cull_aabox_soa_mt(const frustum_t *frust, aabox_soa_t box, int count,
+		unsigned char *vis, int *idx, unsigned char *hint, int num_threads, int chunk_size);
+
+#ifdef __cplusplus
+}
+
+inline void frustum_from_matrix(frustum_t *frust, const Matrix4x4 &m)
+{
+	frustum_from_matrix(frust, (scalar_t (*)[4])m.m);
+}
+#endif
+
+#endif	/* LIBVMATH_FRUSTUM_H_ */
@@ -17,9 +17,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include "geom.h"
 #include "vector.h"
+#include "vmath_simd.h"
+#include "vmath_thread.h"
+
+/* NaN-tolerant min/max: if a is NaN (0 * inf in the slab test), b is returned */
+#define FMIN(a, b)	((a) < (b) ? (a) : (b))
+#define FMAX(a, b)	((a) > (b) ? (a) : (b))
 
 plane_t plane_cons(scalar_t nx, scalar_t ny, scalar_t nz, scalar_t d)
 {
@@ -146,5 +154,1130 @@ int sphere_ray_intersect(ray_t ray, sphere_t sph, scalar_t *pos)
 
 int sphere_sphere_intersect(sphere_t sph1, sphere_t sph2, scalar_t *pos, scalar_t *rad)
 {
-	return -1;
+	scalar_t dist_sq, dist, d, rad_sq;
+	vec3_t dir = v3_sub(sph2.pos, sph1.pos);
+
+	dist_sq = v3_dot(dir, dir);
+	dist = sqrt(dist_sq);
+	/* concentric spheres have no circle, even if they coincide */
+	if(dist == 0.0 || dist > sph1.rad + sph2.rad || dist < fabs(sph1.rad - sph2.rad)) {
+		return 0;
+	}
+
+	/* subtracting the two sphere equations gives the plane of the circle */
+	d = (dist_sq + sph1.rad * sph1.rad - sph2.rad * sph2.rad) / (2.0 * dist);
+	rad_sq = sph1.rad * sph1.rad - d * d;
+
+	if(pos) {
+		*pos = d;
+	}
+	if(rad) {
+		*rad = rad_sq > 0.0 ? sqrt(rad_sq) : 0.0;
+	}
+	return 1;
+}
+
+int sphere_sphere_overlap(sphere_t sph1, sphere_t sph2)
+{
+	scalar_t dx = sph2.pos.x - sph1.pos.x;
+	scalar_t dy = sph2.pos.y - sph1.pos.y;
+	scalar_t dz = sph2.pos.z - sph1.pos.z;
+	scalar_t rsum = sph1.rad + sph2.rad;
+	return dx * dx + dy * dy + dz * dz <= rsum * rsum;
+}
+
+aabox_t aabox_cons(scalar_t x0, scalar_t y0, scalar_t z0, scalar_t x1, scalar_t y1, scalar_t z1)
+{
+	aabox_t box;
+	box.min.x = x0;
+	box.min.y = y0;
+	box.min.z = z0;
+	box.max.x = x1;
+	box.max.y = y1;
+	box.max.z = z1;
+	return box;
+}
+
+int aabox_ray_intersect(ray_t ray, aabox_t box, scalar_t *pos)
+{
+	ray_rcp_t rr = ray_rcp_cons(ray);
+	return aabox_ray_slab(&rr, &box, pos);
+}
+
+ray_rcp_t ray_rcp_cons(ray_t ray)
+{
+	ray_rcp_t rr;
+	rr.origin = ray.origin;
+	rr.inv_dir.x = 1.0 / ray.dir.x;
+	rr.inv_dir.y = 1.0 / ray.dir.y;
+	rr.inv_dir.z = 1.0 / ray.dir.z;
+	rr.tmin = 0.0;
+	rr.tmax = 1.0;
+	return rr;
+}
+
+int aabox_ray_slab(const ray_rcp_t *ray, const aabox_t *box, scalar_t *pos)
+{
+	scalar_t t0, t1;
+	scalar_t tnear = ray->tmin;
+	scalar_t tfar = ray->tmax;
+
+	t0 = (box->min.x - ray->origin.x) * ray->inv_dir.x;
+	t1 = (box->max.x - ray->origin.x) * ray->inv_dir.x;
+	tnear = FMAX(FMIN(t0, t1), tnear);
+	tfar = FMIN(FMAX(t0, t1), tfar);
+
+	t0 = (box->min.y - ray->origin.y) * ray->inv_dir.y;
+	t1 = (box->max.y - ray->origin.y) * ray->inv_dir.y;
+	tnear = FMAX(FMIN(t0, t1), tnear);
+	tfar = FMIN(FMAX(t0, t1), tfar);
+
+	t0 = (box->min.z - ray->origin.z) * ray->inv_dir.z;
+	t1 = (box->max.z - ray->origin.z) * ray->inv_dir.z;
+	tnear = FMAX(FMIN(t0, t1), tnear);
+	tfar = FMIN(FMAX(t0, t1), tfar);
+
+	if(pos) {
+		*pos = tnear;
+	}
+	return tnear <= tfar;
+}
+
+/* unused ray lanes get an empty interval, and unused box lanes get an
+ * inverted infinite box, so they never report a hit.
+ */
+#define PACK_RAYS(pkt, rays, count, width) \
+	do { \
+		int i_; \
+		for(i_=0; i_<(width); i_++) { \
+			if(i_ < (count)) { \
+				(pkt)->ox[i_] = (rays)[i_].origin.x; \
+				(pkt)->oy[i_] = (rays)[i_].origin.y; \
+				(pkt)->oz[i_] = (rays)[i_].origin.z; \
+				(pkt)->idx[i_] = (rays)[i_].inv_dir.x; \
+				(pkt)->idy[i_] = (rays)[i_].inv_dir.y; \
+				(pkt)->idz[i_] = (rays)[i_].inv_dir.z; \
+				(pkt)->tmin[i_] = (rays)[i_].tmin; \
+				(pkt)->tmax[i_] = (rays)[i_].tmax; \
+			} else { \
+				(pkt)->ox[i_] = (pkt)->oy[i_] = (pkt)->oz[i_] = 0.0; \
+				(pkt)->idx[i_] = (pkt)->idy[i_] = (pkt)->idz[i_] = 1.0; \
+				(pkt)->tmin[i_] = 1.0; \
+				(pkt)->tmax[i_] = 0.0; \
+			} \
+		} \
+	} while(0)
+
+#define PACK_BOXES(pkt, boxes, count, width) \
+	do { \
+		int i_; \
+		for(i_=0; i_<(width); i_++) { \
+			if(i_ < (count)) { \
+				(pkt)->minx[i_] = (boxes)[i_].min.x; \
+				(pkt)->miny[i_] = (boxes)[i_].min.y; \
+				(pkt)->minz[i_] = (boxes)[i_].min.z; \
+				(pkt)->maxx[i_] = (boxes)[i_].max.x; \
+				(pkt)->maxy[i_] = (boxes)[i_].max.y; \
+				(pkt)->maxz[i_] = (boxes)[i_].max.z; \
+			} else { \
+				(pkt)->minx[i_] = (pkt)->miny[i_] = (pkt)->minz[i_] = HUGE_VAL; \
+				(pkt)->maxx[i_] = (pkt)->maxy[i_] = (pkt)->maxz[i_] = -HUGE_VAL; \
+			} \
+		} \
+	} while(0)
+
+void ray4_pack(ray4_t *pkt, const ray_rcp_t *rays, int count)
+{
+	PACK_RAYS(pkt, rays, count, 4);
+}
+
+void ray8_pack(ray8_t *pkt, const ray_rcp_t *rays, int count)
+{
+	PACK_RAYS(pkt, rays, count, 8);
+}
+
+void aabox4_pack(aabox4_t *pkt, const aabox_t *boxes, int count)
+{
+	PACK_BOXES(pkt, boxes, count, 4);
+}
+
+void aabox8_pack(aabox8_t *pkt, const aabox_t *boxes, int count)
+{
+	PACK_BOXES(pkt, boxes, count, 8);
+}
+
+/* scalar versions of the packet tests, for any packet width. The box packet
+ * tests pick the near and far slab planes from the sign of the ray direction
+ * instead of sorting the two distances, since it's the same for all lanes.
+ */
+#define RAYPKT_SCALAR(rays, box, tnear, width) \
+	do { \
+		int i_, res_ = 0; \
+		ray_rcp_t r_; \
+		scalar_t t_; \
+		for(i_=0; i_<(width); i_++) { \
+			r_.origin = v3_cons((rays)->ox[i_], (rays)->oy[i_], (rays)->oz[i_]); \
+			r_.inv_dir = v3_cons((rays)->idx[i_], (rays)->idy[i_], (rays)->idz[i_]); \
+			r_.tmin = (rays)->tmin[i_]; \
+			r_.tmax = (rays)->tmax[i_]; \
+			if(aabox_ray_slab(&r_, (box), &t_)) res_ |= 1 << i_; \
+			if(tnear) (tnear)[i_] = t_; \
+		} \
+		return res_; \
+	} while(0)
+
+#define BOXPKT_SCALAR(boxes, ray, tnear, width) \
+	do { \
+		int i_, res_ = 0; \
+		const scalar_t *nx_, *ny_, *nz_, *fx_, *fy_, *fz_; \
+		scalar_t tn_, tf_; \
+		nx_ = (ray)->inv_dir.x >= 0.0 ? (boxes)->minx : (boxes)->maxx; \
+		fx_ = (ray)->inv_dir.x >= 0.0 ? (boxes)->maxx : (boxes)->minx; \
+		ny_ = (ray)->inv_dir.y >= 0.0 ? (boxes)->miny : (boxes)->maxy; \
+		fy_ = (ray)->inv_dir.y >= 0.0 ? (boxes)->maxy : (boxes)->miny; \
+		nz_ = (ray)->inv_dir.z >= 0.0 ? (boxes)->minz : (boxes)->maxz; \
+		fz_ = (ray)->inv_dir.z >= 0.0 ? (boxes)->maxz : (boxes)->minz; \
+		for(i_=0; i_<(width); i_++) { \
+			tn_ = FMAX((nx_[i_] - (ray)->origin.x) * (ray)->inv_dir.x, (ray)->tmin); \
+			tn_ = FMAX((ny_[i_] - (ray)->origin.y) * (ray)->inv_dir.y, tn_); \
+			tn_ = FMAX((nz_[i_] - (ray)->origin.z) * (ray)->inv_dir.z, tn_); \
+			tf_ = FMIN((fx_[i_] - (ray)->origin.x) * (ray)->inv_dir.x, (ray)->tmax); \
+			tf_ = FMIN((fy_[i_] - (ray)->origin.y) * (ray)->inv_dir.y, tf_); \
+			tf_ = FMIN((fz_[i_] - (ray)->origin.z) * (ray)->inv_dir.z, tf_); \
+			if(tn_ <= tf_) res_ |= 1 << i_; \
+			if(tnear) (tnear)[i_] = tn_; \
+		} \
+		return res_; \
+	} while(0)
+
+#ifdef VMATH_SSE
+static int ray4_sse(const scalar_t *ox, const scalar_t *oy, const scalar_t *oz,
+		const scalar_t *idx, const scalar_t *idy, const scalar_t *idz,
+		const scalar_t *tmin, const scalar_t *tmax, const aabox_t *box, scalar_t *tnear)
+{
+	__m128 t0, t1, o, id, tn, tf;
+
+	tn = _mm_loadu_ps(tmin);
+	tf = _mm_loadu_ps(tmax);
+
+	o = _mm_loadu_ps(ox);
+	id = _mm_loadu_ps(idx);
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box->min.x), o), id);
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box->max.x), o), id);
+	tn = _mm_max_ps(_mm_min_ps(t0, t1), tn);
+	tf = _mm_min_ps(_mm_max_ps(t0, t1), tf);
+
+	o = _mm_loadu_ps(oy);
+	id = _mm_loadu_ps(idy);
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box->min.y), o), id);
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box->max.y), o), id);
+	tn = _mm_max_ps(_mm_min_ps(t0, t1), tn);
+	tf = _mm_min_ps(_mm_max_ps(t0, t1), tf);
+
+	o = _mm_loadu_ps(oz);
+	id = _mm_loadu_ps(idz);
+	t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box->min.z), o), id);
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(box->max.z), o), id);
+	tn = _mm_max_ps(_mm_min_ps(t0, t1), tn);
+	tf = _mm_min_ps(_mm_max_ps(t0, t1), tf);
+
+	if(tnear) _mm_storeu_ps(tnear, tn);
+	return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+}
+
+static int box4_sse(const scalar_t *nx, const scalar_t *ny, const scalar_t *nz,
+		const scalar_t *fx, const scalar_t *fy, const scalar_t *fz,
+		const ray_rcp_t *ray, scalar_t *tnear)
+{
+	__m128 tn, tf, o, id;
+
+	o = _mm_set1_ps(ray->origin.x);
+	id = _mm_set1_ps(ray->inv_dir.x);
+	tn = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nx), o), id), _mm_set1_ps(ray->tmin));
+	tf = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(fx), o), id), _mm_set1_ps(ray->tmax));
+
+	o = _mm_set1_ps(ray->origin.y);
+	id = _mm_set1_ps(ray->inv_dir.y);
+	tn = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(ny), o), id), tn);
+	tf = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(fy), o), id), tf);
+
+	o = _mm_set1_ps(ray->origin.z);
+	id = _mm_set1_ps(ray->inv_dir.z);
+	tn = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(nz), o), id), tn);
+	tf = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(fz), o), id), tf);
+
+	if(tnear) _mm_storeu_ps(tnear, tn);
+	return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+}
+#endif	/* VMATH_SSE */
+
+/* selects the near/far plane arrays of a box packet according to the ray signs */
+#define SELECT_PLANES(boxes, ray) \
+	const scalar_t *nx = (ray)->inv_dir.x >= 0.0 ? (boxes)->minx : (boxes)->maxx; \
+	const scalar_t *fx = (ray)->inv_dir.x >= 0.0 ? (boxes)->maxx : (boxes)->minx; \
+	const scalar_t *ny = (ray)->inv_dir.y >= 0.0 ? (boxes)->miny : (boxes)->maxy; \
+	const scalar_t *fy = (ray)->inv_dir.y >= 0.0 ? (boxes)->maxy : (boxes)->miny; \
+	const scalar_t *nz = (ray)->inv_dir.z >= 0.0 ? (boxes)->minz : (boxes)->maxz; \
+	const scalar_t *fz = (ray)->inv_dir.z >= 0.0 ? (boxes)->maxz : (boxes)->minz
+
+int aabox_ray4_intersect(const ray4_t *rays, const aabox_t *box, scalar_t *tnear)
+{
+#ifdef VMATH_SSE
+	return ray4_sse(rays->ox, rays->oy, rays->oz, rays->idx, rays->idy, rays->idz,
+			rays->tmin, rays->tmax, box, tnear);
+#else
+	RAYPKT_SCALAR(rays, box, tnear, 4);
+#endif
+}
+
+int aabox4_ray_intersect(const aabox4_t *boxes, const ray_rcp_t *ray, scalar_t *tnear)
+{
+#ifdef VMATH_SSE
+	SELECT_PLANES(boxes, ray);
+	return box4_sse(nx, ny, nz, fx, fy, fz, ray, tnear);
+#else
+	BOXPKT_SCALAR(boxes, ray, tnear, 4);
+#endif
+}
+
+/* 8-wide tests: AVX if the CPU supports it, otherwise two SSE halves */
+#ifdef VMATH_AVX
+VMATH_TARGET_AVX
+static int ray8_avx(const ray8_t *rays, const aabox_t *box, scalar_t *tnear)
+{
+	__m256 t0, t1, o, id, tn, tf;
+
+	tn = _mm256_loadu_ps(rays->tmin);
+	tf = _mm256_loadu_ps(rays->tmax);
+
+	o = _mm256_loadu_ps(rays->ox);
+	id = _mm256_loadu_ps(rays->idx);
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box->min.x), o), id);
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box->max.x), o), id);
+	tn = _mm256_max_ps(_mm256_min_ps(t0, t1), tn);
+	tf = _mm256_min_ps(_mm256_max_ps(t0, t1), tf);
+
+	o = _mm256_loadu_ps(rays->oy);
+	id = _mm256_loadu_ps(rays->idy);
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box->min.y), o), id);
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box->max.y), o), id);
+	tn = _mm256_max_ps(_mm256_min_ps(t0, t1), tn);
+	tf = _mm256_min_ps(_mm256_max_ps(t0, t1), tf);
+
+	o = _mm256_loadu_ps(rays->oz);
+	id = _mm256_loadu_ps(rays->idz);
+	t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box->min.z), o), id);
+	t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(box->max.z), o), id);
+	tn = _mm256_max_ps(_mm256_min_ps(t0, t1), tn);
+	tf = _mm256_min_ps(_mm256_max_ps(t0, t1), tf);
+
+	if(tnear) _mm256_storeu_ps(tnear, tn);
+	return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+}
+
+VMATH_TARGET_AVX
+static int box8_avx(const aabox8_t *boxes, const ray_rcp_t *ray, scalar_t *tnear)
+{
+	__m256 tn, tf, o, id;
+	SELECT_PLANES(boxes, ray);
+
+	o = _mm256_set1_ps(ray->origin.x);
+	id = _mm256_set1_ps(ray->inv_dir.x);
+	tn = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(nx), o), id), _mm256_set1_ps(ray->tmin));
+	tf = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(fx), o), id), _mm256_set1_ps(ray->tmax));
+
+	o = _mm256_set1_ps(ray->origin.y);
+	id = _mm256_set1_ps(ray->inv_dir.y);
+	tn = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(ny), o), id), tn);
+	tf = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(fy), o), id), tf);
+
+	o = _mm256_set1_ps(ray->origin.z);
+	id = _mm256_set1_ps(ray->inv_dir.z);
+	tn = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(nz), o), id), tn);
+	tf = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(fz), o), id), tf);
+
+	if(tnear) _mm256_storeu_ps(tnear, tn);
+	return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+}
+#endif	/* VMATH_AVX */
+
+static int ray8_default(const ray8_t *rays, const aabox_t *box, scalar_t *tnear)
+{
+#ifdef VMATH_SSE
+	int lo, hi;
+	lo = ray4_sse(rays->ox, rays->oy, rays->oz, rays->idx, rays->idy, rays->idz,
+			rays->tmin, rays->tmax, box, tnear);
+	hi = ray4_sse(rays->ox + 4, rays->oy + 4, rays->oz + 4, rays->idx + 4, rays->idy + 4,
+			rays->idz + 4, rays->tmin + 4, rays->tmax + 4, box, tnear ? tnear + 4 : 0);
+	return lo | (hi << 4);
+#else
+	RAYPKT_SCALAR(rays, box, tnear, 8);
+#endif
+}
+
+static int box8_default(const aabox8_t *boxes, const ray_rcp_t *ray, scalar_t *tnear)
+{
+#ifdef VMATH_SSE
+	int lo, hi;
+	SELECT_PLANES(boxes, ray);
+	lo = box4_sse(nx, ny, nz, fx, fy, fz, ray, tnear);
+	hi = box4_sse(nx + 4, ny + 4, nz + 4, fx + 4, fy + 4, fz + 4, ray, tnear ? tnear + 4 : 0);
+	return lo | (hi << 4);
+#else
+	BOXPKT_SCALAR(boxes, ray, tnear, 8);
+#endif
+}
+
+/* output of the sphere overlap loops */
+struct overlap_out {
+	unsigned char *res;
+	int *idx;
+	int stride, max_idx;
+	int num;
+};
+
+/* sphere overlap batches split across threads. One sphere against an array:
+ * each chunk writes the indices of its overlapping spheres at its own start
+ * in idx, and its count in num, and they are moved together at the end, as
+ * in frustum.c. All pairs: each chunk of first spheres collects its pairs in
+ * its own buffer, and they are copied out in order at the end.
+ */
+struct overlap_mt_job {
+	const sphere_t *sph;
+	const sphere_soa_t *arr;
+	int count, chunk_size;
+	unsigned char *res;
+	int *idx;
+	int *num;			/* per chunk */
+	struct pair_buf *buf;	/* per chunk, null to only count the pairs */
+};
+
+struct pair_buf {
+	int *pairs;
+	int num, max;	/* pairs found, and room in pairs */
+	int failed;		/* ran out of memory, num is still counted */
+};
+
+static int overlap_pairs(const sphere_soa_t *arr, int count, int start, int end,
+		int *pairs, int max_pairs);
+
+static void overlap_emit(struct overlap_out *out, int start, int width, int mask)
+{
+	int i;
+
+	if(out->res) {
+		for(i=0; i<width; i++) {
+			out->res[start + i] = (mask >> i) & 1;
+		}
+	}
+	if(!mask) return;
+
+	for(i=0; i<width; i++) {
+		if(mask & (1 << i)) {
+			if(out->num < out->max_idx) {
+				out->idx[out->num * out->stride] = start + i;
+			}
+			out->num++;
+		}
+	}
+}
+
+/* the SIMD versions compute the same expressions as sphere_sphere_overlap,
+ * in the same order, so all of them give exactly the same results.
+ */
+static void overlap_scalar(const sphere_t *sph, const sphere_soa_t *arr, int start, int end,
+		struct overlap_out *out)
+{
+	int i;
+	scalar_t dx, dy, dz, rsum;
+
+	for(i=start; i<end; i++) {
+		dx = arr->x[i] - sph->pos.x;
+		dy = arr->y[i] - sph->pos.y;
+		dz = arr->z[i] - sph->pos.z;
+		rsum = sph->rad + arr->rad[i];
+		overlap_emit(out, i, 1, dx * dx + dy * dy + dz * dz <= rsum * rsum);
+	}
+}
+
+#ifdef VMATH_SSE
+static void overlap_sse(const sphere_t *sph, const sphere_soa_t *arr, int start, int end,
+		struct overlap_out *out)
+{
+	int i;
+	__m128 cx, cy, cz, rad, dx, dy, dz, rsum, dsq;
+
+	cx = _mm_set1_ps(sph->pos.x);
+	cy = _mm_set1_ps(sph->pos.y);
+	cz = _mm_set1_ps(sph->pos.z);
+	rad = _mm_set1_ps(sph->rad);
+
+	for(i=start; i<end - 3; i+=4) {
+		dx = _mm_sub_ps(_mm_loadu_ps(arr->x + i), cx);
+		dy = _mm_sub_ps(_mm_loadu_ps(arr->y + i), cy);
+		dz = _mm_sub_ps(_mm_loadu_ps(arr->z + i), cz);
+		rsum = _mm_add_ps(rad, _mm_loadu_ps(arr->rad + i));
+		dsq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		overlap_emit(out, i, 4, _mm_movemask_ps(_mm_cmple_ps(dsq, _mm_mul_ps(rsum, rsum))));
+	}
+	overlap_scalar(sph, arr, i, end, out);
+}
+#endif	/* VMATH_SSE */
+
+#ifdef VMATH_AVX
+VMATH_TARGET_AVX
+static void overlap_avx(const sphere_t *sph, const sphere_soa_t *arr, int start, int end,
+		struct overlap_out *out)
+{
+	int i;
+	__m256 cx, cy, cz, rad, dx, dy, dz, rsum, dsq;
+
+	cx = _mm256_set1_ps(sph->pos.x);
+	cy = _mm256_set1_ps(sph->pos.y);
+	cz = _mm256_set1_ps(sph->pos.z);
+	rad = _mm256_set1_ps(sph->rad);
+
+	for(i=start; i<end - 7; i+=8) {
+		dx = _mm256_sub_ps(_mm256_loadu_ps(arr->x + i), cx);
+		dy = _mm256_sub_ps(_mm256_loadu_ps(arr->y + i), cy);
+		dz = _mm256_sub_ps(_mm256_loadu_ps(arr->z + i), cz);
+		rsum = _mm256_add_ps(rad, _mm256_loadu_ps(arr->rad + i));
+		dsq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+				_mm256_mul_ps(dz, dz));
+		overlap_emit(out, i, 8, _mm256_movemask_ps(_mm256_cmp_ps(dsq,
+						_mm256_mul_ps(rsum, rsum), _CMP_LE_OQ)));
+	}
+	/* the compiler doesn't always do it before the tail call, and mixing the
+	 * dirty upper halves with the non-VEX SSE code is very slow
+	 */
+	_mm256_zeroupper();
+	overlap_sse(sph, arr, i, end, out);
+}
+#endif	/* VMATH_AVX */
+
+/* picked once, on the first call of any function which uses them */
+static int (*ray8_func)(const ray8_t*, const aabox_t*, scalar_t*);
+static int (*box8_func)(const aabox8_t*, const ray_rcp_t*, scalar_t*);
+static void (*overlap_func)(const sphere_t*, const sphere_soa_t*, int, int, struct overlap_out*);
+static vmath_once_t packet_funcs_once = VMATH_ONCE_INIT;
+
+static void init_packet_funcs(void)
+{
+	int (*rfunc)(const ray8_t*, const aabox_t*, scalar_t*) = ray8_default;
+	int (*bfunc)(const aabox8_t*, const ray_rcp_t*, scalar_t*) = box8_default;
+	void (*ofunc)(const sphere_t*, const sphere_soa_t*, int, int, struct overlap_out*);
+
+#ifdef VMATH_SSE
+	ofunc = overlap_sse;
+#else
+	ofunc = overlap_scalar;
+#endif
+#ifdef VMATH_AVX
+	if(vmath_cpu_features() & VMATH_CPU_AVX) {
+		rfunc = ray8_avx;
+		bfunc = box8_avx;
+		ofunc = overlap_avx;
+	}
+#endif
+	ray8_func = rfunc;
+	box8_func = bfunc;
+	overlap_func = ofunc;
+}
+
+int aabox_ray8_intersect(const ray8_t *rays, const aabox_t *box, scalar_t *tnear)
+{
+	vmath_once(&packet_funcs_once, init_packet_funcs);
+	return ray8_func(rays, box, tnear);
+}
+
+int aabox8_ray_intersect(const aabox8_t *boxes, const ray_rcp_t *ray, scalar_t *tnear)
+{
+	vmath_once(&packet_funcs_once, init_packet_funcs);
+	return box8_func(boxes, ray, tnear);
+}
+
+int sphere_overlap_soa(sphere_t sph, sphere_soa_t arr, int count, unsigned char *res, int *idx)
+{
+	struct overlap_out out;
+
+	out.res = res;
+	out.idx = idx;
+	out.stride = 1;
+	out.max_idx = idx ? count : 0;
+	out.num = 0;
+	vmath_once(&packet_funcs_once, init_packet_funcs);
+	overlap_func(&sph, &arr, 0, count, &out);
+	return out.num;
+}
+
+int sphere_overlap_pairs_soa(sphere_soa_t arr, int count, int *pairs, int max_pairs)
+{
+	return overlap_pairs(&arr, count, 0, count, pairs, max_pairs);
+}
+
+/* the pairs of the spheres [start, end) with the spheres after them, see
+ * sphere_overlap_pairs_soa
+ */
+static int overlap_pairs(const sphere_soa_t *arr, int count, int start, int end,
+		int *pairs, int max_pairs)
+{
+	int i, j, nfit, num = 0;
+	sphere_t sph;
+	struct overlap_out out;
+
+	out.res = 0;
+	out.stride = 2;
+	vmath_once(&packet_funcs_once, init_packet_funcs);
+
+	if(end > count - 1) end = count - 1;
+	for(i=start; i<end; i++) {
+		sph = sphere_cons(arr->x[i], arr->y[i], arr->z[i], arr->rad[i]);
+
+		/* the second indices go to the odd elements, then the first ones are
+		 * filled in for the pairs which fit
+		 */
+		out.num = 0;
+		if(pairs && num < max_pairs) {
+			out.idx = pairs + 2 * num + 1;
+			out.max_idx = max_pairs - num;
+		} else {
+			out.idx = 0;
+			out.max_idx = 0;
+		}
+		overlap_func(&sph, arr, i + 1, count, &out);
+
+		nfit = out.num < out.max_idx ? out.num : out.max_idx;
+		for(j=0; j<nfit; j++) {
+			out.idx[2 * j - 1] = i;
+		}
+		num += out.num;
+	}
+	return num;
+}
+
+static void overlap_mt_range(int start, int end, void *cls)
+{
+	struct overlap_mt_job *mt = cls;
+	struct overlap_out out;
+
+	out.res = mt->res;
+	out.idx = mt->idx ? mt->idx + start : 0;
+	out.stride = 1;
+	out.max_idx = mt->idx ? end - start : 0;
+	out.num = 0;
+	overlap_func(mt->sph, mt->arr, start, end, &out);
+	mt->num[start / mt->chunk_size] = out.num;
+}
+
+int sphere_overlap_soa_mt(sphere_t sph, sphere_soa_t arr, int count, unsigned char *res,
+		int *idx, int num_threads, int chunk_size)
+{
+	int i, num_chunks, num;
+	struct overlap_mt_job mt;
+
+	if(count <= 0) return 0;
+	vmath_once(&packet_funcs_once, init_packet_funcs);
+
+	mt.sph = &sph;
+	mt.arr = &arr;
+	mt.res = res;
+	mt.idx = idx;
+	/* whole groups of 8 in each chunk */
+	mt.chunk_size = vmath_chunk_size(count, num_threads, chunk_size, 8);
+	num_chunks = (count - 1) / mt.chunk_size + 1;
+	if(!(mt.num = malloc(num_chunks * sizeof *mt.num))) {
+		return sphere_overlap_soa(sph, arr, count, res, idx);
+	}
+
+	vmath_parallel_for(count, num_threads, mt.chunk_size, overlap_mt_range, &mt);
+
+	num = mt.num[0];
+	for(i=1; i<num_chunks; i++) {
+		if(idx && mt.num[i]) {
+			memmove(idx + num, idx + i * mt.chunk_size, mt.num[i] * sizeof *idx);
+		}
+		num += mt.num[i];
+	}
+	free(mt.num);
+	return num;
+}
+
+static void pairs_mt_range(int start, int end, void *cls)
+{
+	int i, room, *mem;
+	struct overlap_mt_job *mt = cls;
+	struct pair_buf *buf;
+
+	if(!mt->buf) {
+		mt->num[start / mt->chunk_size] = overlap_pairs(mt->arr, mt->count, start, end, 0, 0);
+		return;
+	}
+
+	/* one sphere at a time, with room for all of its pairs */
+	buf = mt->buf + start / mt->chunk_size;
+	for(i=start; i<end && i<mt->count - 1; i++) {
+		room = mt->count - i - 1;
+		if(!buf->failed && buf->max - buf->num < room) {
+			int max = buf->max * 2 > buf->num + room ? buf->max * 2 : buf->num + room;
+			if(!(mem = realloc(buf->pairs, max * 2 * sizeof *mem))) {
+				buf->failed = 1;
+			} else {
+				buf->pairs = mem;
+				buf->max = max;
+			}
+		}
+		if(buf->failed) {
+			buf->num += overlap_pairs(mt->arr, mt->count, i, i + 1, 0, 0);
+		} else {
+			buf->num += overlap_pairs(mt->arr, mt->count, i, i + 1, buf->pairs + 2 * buf->num, room);
+		}
+	}
+}
+
+int sphere_overlap_pairs_soa_mt(sphere_soa_t arr, int count, int *pairs, int max_pairs,
+		int num_threads, int chunk_size)
+{
+	int i, num_chunks, num, n, failed = 0;
+	struct overlap_mt_job mt;
+
+	if(count <= 1) return 0;
+
+	mt.arr = &arr;
+	mt.count = count;
+	mt.chunk_size = vmath_chunk_size(count, num_threads, chunk_size, 1);
+	num_chunks = (count - 1) / mt.chunk_size + 1;
+	mt.num = 0;
+	mt.buf = 0;
+	if(pairs && max_pairs > 0) {
+		if(!(mt.buf = calloc(num_chunks, sizeof *mt.buf))) {
+			return sphere_overlap_pairs_soa(arr, count, pairs, max_pairs);
+		}
+	} else if(!(mt.num = malloc(num_chunks * sizeof *mt.num))) {
+		return sphere_overlap_pairs_soa(arr, count, pairs, max_pairs);
+	}
+
+	vmath_parallel_for(count, num_threads, mt.chunk_size, pairs_mt_range, &mt);
+
+	num = 0;
+	for(i=0; i<num_chunks; i++) {
+		if(!mt.buf) {
+			num += mt.num[i];
+			continue;
+		}
+		failed |= mt.buf[i].failed;
+		if(!failed && num < max_pairs) {
+			n = mt.buf[i].num < max_pairs - num ? mt.buf[i].num : max_pairs - num;
+			memcpy(pairs + 2 * num, mt.buf[i].pairs, n * 2 * sizeof *pairs);
+		}
+		num += mt.buf[i].num;
+		free(mt.buf[i].pairs);
+	}
+	free(mt.buf);
+	free(mt.num);
+
+	if(failed) {
+		return sphere_overlap_pairs_soa(arr, count, pairs, max_pairs);
+	}
+	return num;
+}
+
+triangle_t triangle_cons(vec3_t v0, vec3_t v1, vec3_t v2)
+{
+	triangle_t tri;
+	tri.v[0] = v0;
+	tri.v[1] = v1;
+	tri.v[2] = v2;
+	return tri;
+}
+
+/* the watertight ray-triangle test of Woop, Benthin and Wald transforms the
+ * vertices so that the ray starts at the origin and points along +z, by
+ * translating, permuting the axes (kz is the dominant axis of the ray) and
+ * shearing. The 2D edge functions of the transformed triangle at (0, 0) are
+ * then exact in sign, and only exactly zero ones (ray through an edge or a
+ * vertex) are recomputed in double precision.
+ */
+struct wt_ray {
+	int kx, ky, kz;
+	scalar_t org[3];
+	scalar_t sx, sy, sz;
+};
+
+static void wt_setup(struct wt_ray *wr, ray_t ray)
+{
+	int tmp;
+	scalar_t d[3];
+
+	d[0] = ray.dir.x;
+	d[1] = ray.dir.y;
+	d[2] = ray.dir.z;
+	wr->org[0] = ray.origin.x;
+	wr->org[1] = ray.origin.y;
+	wr->org[2] = ray.origin.z;
+
+	wr->kz = 0;
+	if(fabs(d[1]) > fabs(d[wr->kz])) wr->kz = 1;
+	if(fabs(d[2]) > fabs(d[wr->kz])) wr->kz = 2;
+	wr->kx = wr->kz == 2 ? 0 : wr->kz + 1;
+	wr->ky = wr->kx == 2 ? 0 : wr->kx + 1;
+	/* keep the winding of the triangles */
+	if(d[wr->kz] < 0) {
+		tmp = wr->kx;
+		wr->kx = wr->ky;
+		wr->ky = tmp;
+	}
+
+	wr->sx = d[wr->kx] / d[wr->kz];
+	wr->sy = d[wr->ky] / d[wr->kz];
+	wr->sz = (scalar_t)1 / d[wr->kz];
+}
+
+/* NaNs (degenerate rays or triangles) fail the comparisons and miss */
+static int wt_test(const struct wt_ray *wr, const scalar_t *a, const scalar_t *b,
+		const scalar_t *c, scalar_t tmax, scalar_t *t, scalar_t *u, scalar_t *v)
+{
+	scalar_t akz, bkz, ckz, ax, ay, bx, by, cx, cy, eu, ev, ew, det, tscaled;
+
+	akz = a[wr->kz] - wr->org[wr->kz];
+	bkz = b[wr->kz] - wr->org[wr->kz];
+	ckz = c[wr->kz] - wr->org[wr->kz];
+	ax = (a[wr->kx] - wr->org[wr->kx]) - wr->sx * akz;
+	ay = (a[wr->ky] - wr->org[wr->ky]) - wr->sy * akz;
+	bx = (b[wr->kx] - wr->org[wr->kx]) - wr->sx * bkz;
+	by = (b[wr->ky] - wr->org[wr->ky]) - wr->sy * bkz;
+	cx = (c[wr->kx] - wr->org[wr->kx]) - wr->sx * ckz;
+	cy = (c[wr->ky] - wr->org[wr->ky]) - wr->sy * ckz;
+
+	eu = cx * by - cy * bx;
+	ev = ax * cy - ay * cx;
+	ew = bx * ay - by * ax;
+	if(eu == 0 || ev == 0 || ew == 0) {
+		eu = (double)cx * by - (double)cy * bx;
+		ev = (double)ax * cy - (double)ay * cx;
+		ew = (double)bx * ay - (double)by * ax;
+	}
+
+	if((eu < 0 || ev < 0 || ew < 0) && (eu > 0 || ev > 0 || ew > 0)) {
+		return 0;
+	}
+	det = eu + ev + ew;
+	if(det == 0) {
+		return 0;
+	}
+
+	/* the hit distance scaled by det */
+	tscaled = eu * (wr->sz * akz) + ev * (wr->sz * bkz) + ew * (wr->sz * ckz);
+	if(det < 0) {
+		tscaled = -tscaled;
+		ev = -ev;
+		ew = -ew;
+		det = -det;
+	}
+	if(!(tscaled > 0 && tscaled <= tmax * det)) {
+		return 0;
+	}
+
+	*t = tscaled / det;
+	*u = ev / det;
+	*v = ew / det;
+	return 1;
+}
+
+static int tri_soa_test(const struct wt_ray *wr, const triangle_soa_t *tris, int i,
+		scalar_t tmax, scalar_t *t, scalar_t *u, scalar_t *v)
+{
+	scalar_t a[3], b[3], c[3];
+
+	a[0] = tris->v0.x[i]; a[1] = tris->v0.y[i]; a[2] = tris->v0.z[i];
+	b[0] = tris->v1.x[i]; b[1] = tris->v1.y[i]; b[2] = tris->v1.z[i];
+	c[0] = tris->v2.x[i]; c[1] = tris->v2.y[i]; c[2] = tris->v2.z[i];
+	return wt_test(wr, a, b, c, tmax, t, u, v);
+}
+
+static int ray_soa_test(const triangle_t *tri, const ray_soa_t *rays, int i,
+		scalar_t tmax, scalar_t *t, scalar_t *u, scalar_t *v)
+{
+	ray_t ray;
+	struct wt_ray wr;
+
+	ray.origin = v3_cons(rays->origin.x[i], rays->origin.y[i], rays->origin.z[i]);
+	ray.dir = v3_cons(rays->dir.x[i], rays->dir.y[i], rays->dir.z[i]);
+	wt_setup(&wr, ray);
+	return wt_test(&wr, &tri->v[0].x, &tri->v[1].x, &tri->v[2].x, tmax, t, u, v);
+}
+
+int triangle_ray_intersect(ray_t ray, const triangle_t *tri, scalar_t *pos, vec2_t *bary)
+{
+	struct wt_ray wr;
+	scalar_t t, u, v;
+
+	wt_setup(&wr, ray);
+	if(!wt_test(&wr, &tri->v[0].x, &tri->v[1].x, &tri->v[2].x, 1, &t, &u, &v)) {
+		return 0;
+	}
+	if(pos) *pos = t;
+	if(bary) {
+		bary->x = u;
+		bary->y = v;
+	}
+	return 1;
+}
+
+#ifdef VMATH_SSE
+/* the SSE versions compute the same expressions in the same order as wt_test,
+ * so they return exactly the same results. Lanes which need the double
+ * precision edge functions go through wt_test.
+ */
+#define WT_EDGES_SSE() \
+	do { \
+		eu = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx)); \
+		ev = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx)); \
+		ew = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax)); \
+		zero = _mm_or_ps(_mm_or_ps(_mm_cmpeq_ps(eu, _mm_setzero_ps()), \
+				_mm_cmpeq_ps(ev, _mm_setzero_ps())), _mm_cmpeq_ps(ew, _mm_setzero_ps())); \
+		neg = _mm_or_ps(_mm_or_ps(_mm_cmplt_ps(eu, _mm_setzero_ps()), \
+				_mm_cmplt_ps(ev, _mm_setzero_ps())), _mm_cmplt_ps(ew, _mm_setzero_ps())); \
+		posm = _mm_or_ps(_mm_or_ps(_mm_cmpgt_ps(eu, _mm_setzero_ps()), \
+				_mm_cmpgt_ps(ev, _mm_setzero_ps())), _mm_cmpgt_ps(ew, _mm_setzero_ps())); \
+		det = _mm_add_ps(_mm_add_ps(eu, ev), ew); \
+		valid = _mm_andnot_ps(_mm_and_ps(neg, posm), _mm_cmpneq_ps(det, _mm_setzero_ps())); \
+		tsc = _mm_add_ps(_mm_add_ps(_mm_mul_ps(eu, az), _mm_mul_ps(ev, bz)), _mm_mul_ps(ew, cz)); \
+		sign = _mm_and_ps(det, signbit); \
+		tsc = _mm_xor_ps(tsc, sign); \
+		ev = _mm_xor_ps(ev, sign); \
+		ew = _mm_xor_ps(ew, sign); \
+		det = _mm_xor_ps(det, sign); \
+	} while(0)
+
+/* one ray against 4 triangles at a time, returns the number of triangles done */
+static int tri4_sse(const struct wt_ray *wr, const triangle_soa_t *tris, int count,
+		scalar_t *tmax, scalar_t *bu, scalar_t *bv, int *hit)
+{
+	int i, j, mask, zmask;
+	const scalar_t *vx[3], *vy[3], *vz[3];
+	const scalar_t *comp[3][3];
+	__m128 ox, oy, oz, sx, sy, sz, akz, bkz, ckz, ax, ay, az, bx, by, bz, cx, cy, cz;
+	__m128 eu, ev, ew, det, tsc, sign, zero, neg, posm, valid;
+	__m128 signbit = _mm_set1_ps(-0.0f);
+	scalar_t vv[4], vw[4], vdet[4], vt[4], t, u, v;
+
+	comp[0][0] = tris->v0.x; comp[0][1] = tris->v0.y; comp[0][2] = tris->v0.z;
+	comp[1][0] = tris->v1.x; comp[1][1] = tris->v1.y; comp[1][2] = tris->v1.z;
+	comp[2][0] = tris->v2.x; comp[2][1] = tris->v2.y; comp[2][2] = tris->v2.z;
+	for(j=0; j<3; j++) {
+		vx[j] = comp[j][wr->kx];
+		vy[j] = comp[j][wr->ky];
+		vz[j] = comp[j][wr->kz];
+	}
+
+	ox = _mm_set1_ps(wr->org[wr->kx]);
+	oy = _mm_set1_ps(wr->org[wr->ky]);
+	oz = _mm_set1_ps(wr->org[wr->kz]);
+	sx = _mm_set1_ps(wr->sx);
+	sy = _mm_set1_ps(wr->sy);
+	sz = _mm_set1_ps(wr->sz);
+
+	for(i=0; i<(count & ~3); i+=4) {
+		akz = _mm_sub_ps(_mm_loadu_ps(vz[0] + i), oz);
+		bkz = _mm_sub_ps(_mm_loadu_ps(vz[1] + i), oz);
+		ckz = _mm_sub_ps(_mm_loadu_ps(vz[2] + i), oz);
+		ax = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(vx[0] + i), ox), _mm_mul_ps(sx, akz));
+		ay = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(vy[0] + i), oy), _mm_mul_ps(sy, akz));
+		bx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(vx[1] + i), ox), _mm_mul_ps(sx, bkz));
+		by = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(vy[1] + i), oy), _mm_mul_ps(sy, bkz));
+		cx = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(vx[2] + i), ox), _mm_mul_ps(sx, ckz));
+		cy = _mm_sub_ps(_mm_sub_ps(_mm_loadu_ps(vy[2] + i), oy), _mm_mul_ps(sy, ckz));
+		az = _mm_mul_ps(sz, akz);
+		bz = _mm_mul_ps(sz, bkz);
+		cz = _mm_mul_ps(sz, ckz);
+
+		WT_EDGES_SSE();
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(tsc, _mm_setzero_ps()),
+					_mm_cmple_ps(tsc, _mm_mul_ps(_mm_set1_ps(*tmax), det))));
+
+		zmask = _mm_movemask_ps(zero);
+		mask = _mm_movemask_ps(valid) & ~zmask;
+		if(!(mask | zmask)) continue;
+
+		_mm_storeu_ps(vv, ev);
+		_mm_storeu_ps(vw, ew);
+		_mm_storeu_ps(vdet, det);
+		_mm_storeu_ps(vt, tsc);
+
+		/* in order, with the closest hit so far, as the scalar loop does */
+		for(j=0; j<4; j++) {
+			if(zmask & (1 << j)) {
+				if(!tri_soa_test(wr, tris, i + j, *tmax, &t, &u, &v)) continue;
+			} else if((mask & (1 << j)) && vt[j] <= *tmax * vdet[j]) {
+				t = vt[j] / vdet[j];
+				u = vv[j] / vdet[j];
+				v = vw[j] / vdet[j];
+			} else {
+				continue;
+			}
+			*tmax = t;
+			*bu = u;
+			*bv = v;
+			*hit = i + j;
+		}
+	}
+	return i;
+}
+
+/* selects the x, y or z lanes of a, b, c according to the masks */
+#define SEL3(mx, my, mz, a, b, c) \
+	_mm_or_ps(_mm_or_ps(_mm_and_ps(mx, a), _mm_and_ps(my, b)), _mm_and_ps(mz, c))
+
+/* permutes the axes of the vectors (x, y, z) per lane, like wt_setup: kz is
+ * the dominant axis of the ray, kx and ky the next ones, swapped if the ray
+ * points to -kz.
+ */
+#define PERMUTE_SSE(px, py, pz, x, y, z) \
+	do { \
+		__m128 px_ = SEL3(mx, my, mz, y, z, x); \
+		__m128 py_ = SEL3(mx, my, mz, z, x, y); \
+		pz = SEL3(mx, my, mz, x, y, z); \
+		px = _mm_or_ps(_mm_and_ps(swap, py_), _mm_andnot_ps(swap, px_)); \
+		py = _mm_or_ps(_mm_and_ps(swap, px_), _mm_andnot_ps(swap, py_)); \
+	} while(0)
+
+#define PERMUTE_VERT_SSE(px, py, pz, vert) \
+	PERMUTE_SSE(px, py, pz, _mm_sub_ps(_mm_set1_ps(tri->v[vert].x), ox), \
+			_mm_sub_ps(_mm_set1_ps(tri->v[vert].y), oy), \
+			_mm_sub_ps(_mm_set1_ps(tri->v[vert].z), oz))
+
+/* 4 rays at a time against one triangle, returns the number of rays done */
+static int rays4_sse(const triangle_t *tri, int tri_id, const ray_soa_t *rays, int count,
+		scalar_t *pos, vec2_soa_t *bary, int *hit_id, int *num_hit)
+{
+	int i, j, mask, zmask;
+	__m128 ox, oy, oz, dx, dy, dz, adx, ady, adz, mx, my, mz, swap, dkx, dky, dkz;
+	__m128 sx, sy, sz, akx, aky, akz, bkx, bky, bkz, ckx, cky, ckz;
+	__m128 ax, ay, az, bx, by, bz, cx, cy, cz;
+	__m128 eu, ev, ew, det, tsc, sign, zero, neg, posm, valid;
+	__m128 signbit = _mm_set1_ps(-0.0f);
+	scalar_t vv[4], vw[4], vdet[4], vt[4], t, u, v;
+
+	for(i=0; i<(count & ~3); i+=4) {
+		dx = _mm_loadu_ps(rays->dir.x + i);
+		dy = _mm_loadu_ps(rays->dir.y + i);
+		dz = _mm_loadu_ps(rays->dir.z + i);
+		adx = _mm_andnot_ps(signbit, dx);
+		ady = _mm_andnot_ps(signbit, dy);
+		adz = _mm_andnot_ps(signbit, dz);
+
+		my = _mm_cmpgt_ps(ady, adx);
+		mz = _mm_cmpgt_ps(adz, _mm_or_ps(_mm_and_ps(my, ady), _mm_andnot_ps(my, adx)));
+		my = _mm_andnot_ps(mz, my);
+		mx = _mm_andnot_ps(_mm_or_ps(my, mz), _mm_cmpeq_ps(signbit, signbit));
+
+		dkz = SEL3(mx, my, mz, dx, dy, dz);
+		swap = _mm_cmplt_ps(dkz, _mm_setzero_ps());
+		PERMUTE_SSE(dkx, dky, dkz, dx, dy, dz);
+		sx = _mm_div_ps(dkx, dkz);
+		sy = _mm_div_ps(dky, dkz);
+		sz = _mm_div_ps(_mm_set1_ps(1.0f), dkz);
+
+		ox = _mm_loadu_ps(rays->origin.x + i);
+		oy = _mm_loadu_ps(rays->origin.y + i);
+		oz = _mm_loadu_ps(rays->origin.z + i);
+		PERMUTE_VERT_SSE(akx, aky, akz, 0);
+		PERMUTE_VERT_SSE(bkx, bky, bkz, 1);
+		PERMUTE_VERT_SSE(ckx, cky, ckz, 2);
+		ax = _mm_sub_ps(akx, _mm_mul_ps(sx, akz));
+		ay = _mm_sub_ps(aky, _mm_mul_ps(sy, akz));
+		bx = _mm_sub_ps(bkx, _mm_mul_ps(sx, bkz));
+		by = _mm_sub_ps(bky, _mm_mul_ps(sy, bkz));
+		cx = _mm_sub_ps(ckx, _mm_mul_ps(sx, ckz));
+		cy = _mm_sub_ps(cky, _mm_mul_ps(sy, ckz));
+		az = _mm_mul_ps(sz, akz);
+		bz = _mm_mul_ps(sz, bkz);
+		cz = _mm_mul_ps(sz, ckz);
+
+		WT_EDGES_SSE();
+		valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(tsc, _mm_setzero_ps()),
+					_mm_cmple_ps(tsc, _mm_mul_ps(_mm_loadu_ps(pos + i), det))));
+
+		zmask = _mm_movemask_ps(zero);
+		mask = _mm_movemask_ps(valid) & ~zmask;
+		if(!(mask | zmask)) continue;
+
+		_mm_storeu_ps(vv, ev);
+		_mm_storeu_ps(vw, ew);
+		_mm_storeu_ps(vdet, det);
+		_mm_storeu_ps(vt, tsc);
+
+		for(j=0; j<4; j++) {
+			if(zmask & (1 << j)) {
+				if(!ray_soa_test(tri, rays, i + j, pos[i + j], &t, &u, &v)) continue;
+			} else if(mask & (1 << j)) {
+				t = vt[j] / vdet[j];
+				u = vv[j] / vdet[j];
+				v = vw[j] / vdet[j];
+			} else {
+				continue;
+			}
+			pos[i + j] = t;
+			if(bary->x) {
+				bary->x[i + j] = u;
+				bary->y[i + j] = v;
+			}
+			if(hit_id) hit_id[i + j] = tri_id;
+			++*num_hit;
+		}
+	}
+	return i;
+}
+#endif	/* VMATH_SSE */
+
+int triangle_soa_ray_intersect(ray_t ray, triangle_soa_t tris, int count, scalar_t *pos, vec2_t *bary)
+{
+	int i = 0, hit = -1;
+	struct wt_ray wr;
+	scalar_t tmax = 1, bu = 0, bv = 0, t, u, v;
+
+	wt_setup(&wr, ray);
+#ifdef VMATH_SSE
+	i = tri4_sse(&wr, &tris, count, &tmax, &bu, &bv, &hit);
+#endif
+	for(; i<count; i++) {
+		if(tri_soa_test(&wr, &tris, i, tmax, &t, &u, &v)) {
+			tmax = t;
+			bu = u;
+			bv = v;
+			hit = i;
+		}
+	}
+
+	if(hit >= 0) {
+		if(pos) *pos = tmax;
+		if(bary) {
+			bary->x = bu;
+			bary->y = bv;
+		}
+	}
+	return hit;
+}
+
+int triangle_ray_soa_intersect(const triangle_t *tri, int tri_id, ray_soa_t rays, int count,
+		scalar_t *pos, vec2_soa_t bary, int *hit_id)
+{
+	int i = 0, num_hit = 0;
+	scalar_t t, u, v;
+
+#ifdef VMATH_SSE
+	i = rays4_sse(tri, tri_id, &rays, count, pos, &bary, hit_id, &num_hit);
+#endif
+	for(; i<count; i++) {
+		if(ray_soa_test(tri, &rays, i, pos[i], &t, &u, &v)) {
+			pos[i] = t;
+			if(bary.x) {
+				bary.x[i] = u;
+				bary.y[i] = v;
+			}
+			if(hit_id) hit_id[i] = tri_id;
+			num_hit++;
+		}
+	}
+	return num_hit;
 }
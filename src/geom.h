@@ -35,6 +35,54 @@ typedef struct {
 	vec3_t min, max;
 } aabox_t;
 
+/* ray with precomputed reciprocal direction, for repeated box tests.
+ * [tmin, tmax] is the parametric interval of the ray which is tested.
+ */
+typedef struct {
+	vec3_t origin, inv_dir;
+	scalar_t tmin, tmax;
+} ray_rcp_t;
+
+/* SoA packets of 4 or 8 rays (already in reciprocal form) and of 4 or 8 boxes */
+typedef struct {
+	scalar_t ox[4], oy[4], oz[4];
+	scalar_t idx[4], idy[4], idz[4];
+	scalar_t tmin[4], tmax[4];
+} ray4_t;
+
+typedef struct {
+	scalar_t ox[8], oy[8], oz[8];
+	scalar_t idx[8], idy[8], idz[8];
+	scalar_t tmin[8], tmax[8];
+} ray8_t;
+
+typedef struct {
+	scalar_t minx[4], miny[4], minz[4];
+	scalar_t maxx[4], maxy[4], maxz[4];
+} aabox4_t;
+
+typedef struct {
+	scalar_t minx[8], miny[8], minz[8];
+	scalar_t maxx[8], maxy[8], maxz[8];
+} aabox8_t;
+
+typedef struct {
+	vec3_t v[3];
+} triangle_t;
+
+/* SoA arrays of spheres, triangles and rays, for the batch tests */
+typedef struct {
+	scalar_t *x, *y, *z, *rad;
+} sphere_soa_t;
+
+typedef struct {
+	vec3_soa_t v0, v1, v2;
+} triangle_soa_t;
+
+typedef struct {
+	vec3_soa_t origin, dir;
+} ray_soa_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -56,8 +104,110 @@ int plane_ray_intersect(ray_t ray, plane_t plane, scalar_t *pos);
 sphere_t sphere_cons(scalar_t x, scalar_t y, scalar_t z, scalar_t rad);
 
 int sphere_ray_intersect(ray_t ray, sphere_t sph, scalar_t *pos);
+
+/* returns 1 if the surfaces of the spheres intersect, 0 if they are apart or
+ * one is inside the other. The intersection is a circle on a plane
+ * perpendicular to the line between the centers: pos gets the distance of
+ * that plane from the center of sph1 towards the center of sph2 (negative if
+ * it's on the other side), and rad the radius of the circle. Spheres which
+ * just touch have a circle of radius 0. Either output may be null.
+ */
 int sphere_sphere_intersect(sphere_t sph1, sphere_t sph2, scalar_t *pos, scalar_t *rad);
 
+/* sphere overlap tests for broadphase collision detection: two spheres
+ * overlap if the distance of their centers is at most the sum of their radii
+ * (touching counts, as does one inside the other). The spheres of the array
+ * are tested 4 or 8 at a time.
+ */
+int sphere_sphere_overlap(sphere_t sph1, sphere_t sph2);
+
+/* one sphere against count spheres of an array. Returns the number of
+ * overlapping ones. Either output may be null:
+ *  - res[i] gets 1 if sphere i overlaps, 0 otherwise.
+ *  - idx gets the indices of the overlapping spheres, in ascending order.
+ */
+int sphere_overlap_soa(sphere_t sph, sphere_soa_t arr, int count, unsigned char *res, int *idx);
+
+/* all overlapping pairs among count spheres, for instance the contents of a
+ * spatial grid cell. Pair k is (pairs[2 * k], pairs[2 * k + 1]), with the
+ * first index lower than the second, in ascending order of both. At most
+ * max_pairs pairs are written, but the return value is the total number of
+ * overlapping pairs, so that a caller can retry with a larger buffer.
+ */
+int sphere_overlap_pairs_soa(sphere_soa_t arr, int count, int *pairs, int max_pairs);
+
+/* same, split across num_threads threads (0 for one per processor), in
+ * chunks of chunk_size spheres (0 for the default, see vmath_parallel_for),
+ * rounded up to a multiple of 8 for sphere_overlap_soa_mt. The pairs of each
+ * chunk of first spheres are kept in a temporary buffer until they are all
+ * found. The results are the same as above.
+ */
+int sphere_overlap_soa_mt(sphere_t sph, sphere_soa_t arr, int count, unsigned char *res,
+		int *idx, int num_threads, int chunk_size);
+int sphere_overlap_pairs_soa_mt(sphere_soa_t arr, int count, int *pairs, int max_pairs,
+		int num_threads, int chunk_size);
+
+/* axis-aligned boxes */
+aabox_t aabox_cons(scalar_t x0, scalar_t y0, scalar_t z0, scalar_t x1, scalar_t y1, scalar_t z1);
+
+/* same conventions as sphere_ray_intersect: the ray is tested in the
+ * parametric interval [0, 1], and pos gets the entry distance.
+ */
+int aabox_ray_intersect(ray_t ray, aabox_t box, scalar_t *pos);
+
+/* the slab test proper. ray_rcp_cons sets up the reciprocal ray with the
+ * default [0, 1] interval, which can be changed afterwards. A ray which starts
+ * inside the box reports its tmin as the entry distance.
+ */
+ray_rcp_t ray_rcp_cons(ray_t ray);
+int aabox_ray_slab(const ray_rcp_t *ray, const aabox_t *box, scalar_t *pos);
+
+/* packet tests. Bit i of the return value is set if ray (or box) i hits, and
+ * tnear[i] gets its entry distance (may be null). The tnear value of lanes
+ * which miss is undefined.
+ */
+void ray4_pack(ray4_t *pkt, const ray_rcp_t *rays, int count);
+void ray8_pack(ray8_t *pkt, const ray_rcp_t *rays, int count);
+void aabox4_pack(aabox4_t *pkt, const aabox_t *boxes, int count);
+void aabox8_pack(aabox8_t *pkt, const aabox_t *boxes, int count);
+
+int aabox_ray4_intersect(const ray4_t *rays, const aabox_t *box, scalar_t *tnear);
+int aabox_ray8_intersect(const ray8_t *rays, const aabox_t *box, scalar_t *tnear);
+int aabox4_ray_intersect(const aabox4_t *boxes, const ray_rcp_t *ray, scalar_t *tnear);
+int aabox8_ray_intersect(const aabox8_t *boxes, const ray_rcp_t *ray, scalar_t *tnear);
+
+/* triangles. The ray tests are watertight (Woop, Benthin and Wald): rays
+ * through a shared edge or vertex of a mesh always hit at least one of the
+ * triangles sharing it. Both sides of the triangles are hit. Hits count in
+ * the parametric interval (0, 1] of the ray, and the barycentric coordinates
+ * (u, v) of the hit point are the weights of v[1] and v[2]: the point is
+ * (1 - u - v) * v[0] + u * v[1] + v * v[2]. bary may be null.
+ */
+triangle_t triangle_cons(vec3_t v0, vec3_t v1, vec3_t v2);
+
+int triangle_ray_intersect(ray_t ray, const triangle_t *tri, scalar_t *pos, vec2_t *bary);
+
+/* one ray against count triangles: returns the index of the closest triangle
+ * hit, or -1, with pos and bary like triangle_ray_intersect.
+ */
+int triangle_soa_ray_intersect(ray_t ray, triangle_soa_t tris, int count, scalar_t *pos, vec2_t *bary);
+
+/* count rays against one triangle. pos[i] is the distance of the closest hit
+ * of ray i so far (1 if none), and only hits closer than that count. For the
+ * rays which hit, pos[i], the barycentric coordinates bary.x[i], bary.y[i]
+ * and hit_id[i] = tri_id are updated. bary.x and hit_id may be null. Returns
+ * the number of rays updated. Calling this for every triangle of a mesh finds
+ * the closest hit of each ray.
+ */
+int triangle_ray_soa_intersect(const triangle_t *tri, int tri_id, ray_soa_t rays, int count,
+		scalar_t *pos, vec2_soa_t bary, int *hit_id);
+
+/* the triangle tests have no _mt versions: a call is usually one ray against
+ * the triangles of a leaf, or one triangle against a packet of rays, which is
+ * too little work to split. They don't share any state, so callers split
+ * their rays across threads instead, see vmath_parallel_for.
+ */
+
 #ifdef __cplusplus
 }
 
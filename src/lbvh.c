@@ -0,0 +1,717 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* linear BVH builder (Lauterbach et al. 2009, Karras 2012, Apetrei 2014):
+ * the primitives are sorted along a Morton curve through their centroids,
+ * and the tree is the radix tree of the sorted codes. Its interior nodes
+ * are the n - 1 gaps between adjacent codes, and each one splits the range
+ * of codes around it which only has longer common prefixes across its gaps.
+ * So the ends of the range are the nearest gaps on either side with a
+ * shorter prefix, and the parent is the one of those two with the longer
+ * prefix. All the steps are split across threads.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vmath.h"
+#include "bvh.h"
+#include "vmath_thread.h"
+#include "radix_sort.h"
+
+/* the sort buffer of count keys is reused for three per gap int arrays, this
+ * fails to compile if a key is ever made too small for that. 30-bit codes
+ * only use the low half of the keys, and the values are the primitives.
+ */
+typedef char key_fits_three_ints[sizeof(struct radix_key) >= 3 * sizeof(int) ? 1 : -1];
+
+struct bbox {
+	scalar_t min[3], max[3];
+};
+
+/* per thread job partial results */
+struct chunk {
+	struct bbox cbox;
+	int num_nodes;	/* interior nodes, then the first one's number */
+};
+
+struct lbvh_ctx {
+	bvh_t *bvh;
+	const aabox_t *bounds;
+	const sphere_t *spheres;
+	int count, bits;
+
+	int num_chunks;
+	struct chunk *chunks;
+
+	struct radix_key *keys, *tmp;
+	scalar_t cmin[3], scale[3];
+
+	/* per gap between keys i and i + 1: the length of their common prefix,
+	 * the nearest gaps to the left and right with a shorter one (-1 and
+	 * count - 1 if there are none), and the slot pair of its children
+	 */
+	unsigned char *prefix;
+	int *left, *right, *slot;
+
+	/* bounds pass: roots of the subtrees done in parallel, and their depths */
+	int *subtree;
+	int *subtree_depth;
+	struct subtree_stats {
+		int num_leaves, max_depth, max_leaf_prims;
+		double leaf_area, node_area;
+	} *sub_stats;
+};
+
+static int build(bvh_t *bvh, const aabox_t *bounds, const sphere_t *spheres,
+		int count, int morton_bits, int num_threads);
+static void centroid(const struct lbvh_ctx *ctx, int i, scalar_t *c);
+static void prim_bounds(const struct lbvh_ctx *ctx, int i, scalar_t *bmin, scalar_t *bmax);
+static void chunk_range(const struct lbvh_ctx *ctx, int c, int *start, int *end);
+static void gap_range(const struct lbvh_ctx *ctx, int c, int *start, int *end);
+
+static void cbox_job(int start, int end, void *cls);
+static void morton_job(int start, int end, void *cls);
+static void prefix_job(int start, int end, void *cls);
+static void nearest_job(int start, int end, void *cls);
+static void nearest_fixup(struct lbvh_ctx *ctx);
+static int node_parent(const struct lbvh_ctx *ctx, int g);
+static void count_job(int start, int end, void *cls);
+static void slot_job(int start, int end, void *cls);
+static void emit_job(int start, int end, void *cls);
+static void leaf_bounds(const struct lbvh_ctx *ctx, bvh_node_t *leaf);
+static void bounds_job(int start, int end, void *cls);
+static void subtree_bounds(struct lbvh_ctx *ctx, int nidx, int depth, struct subtree_stats *st);
+
+static int clz32(unsigned int x);
+
+
+int bvh_build_lbvh(bvh_t *bvh, const aabox_t *bounds, int count, int morton_bits, int num_threads)
+{
+	return build(bvh, bounds, 0, count, morton_bits, num_threads);
+}
+
+int bvh_build_lbvh_spheres(bvh_t *bvh, const sphere_t *spheres, int count, int morton_bits, int num_threads)
+{
+	return build(bvh, 0, spheres, count, morton_bits, num_threads);
+}
+
+static int build(bvh_t *bvh, const aabox_t *bounds, const sphere_t *spheres,
+		int count, int morton_bits, int num_threads)
+{
+	int i, j, c, max_sub, num_sub, num_top, max_depth, num_nodes;
+	int *top = 0, *next, *next_depth;
+	double root_area, leaf_area = 0.0, node_area = 0.0;
+	scalar_t dx, dy, dz, cmax;
+	struct lbvh_ctx ctx;
+	bvh_node_t *node;
+	double start_time = vmath_time();
+
+	bvh_destroy(bvh);
+	bvh->stats.num_nodes = bvh->stats.num_leaves = 0;
+	bvh->stats.max_depth = bvh->stats.max_leaf_prims = 0;
+	bvh->stats.sah_cost = 0.0;
+
+	if(count <= 0) {
+		bvh->stats.build_time = 0.0;
+		return count < 0 ? -1 : 0;
+	}
+	if((!bounds && !spheres) || count > BVH_LBVH_MAX_PRIMS) {
+		return -1;
+	}
+	if(bvh->max_leaf_prims < 1) {
+		bvh->max_leaf_prims = 1;
+	}
+
+	if(num_threads <= 0) {
+		num_threads = vmath_num_cpus();
+	}
+
+	memset(&ctx, 0, sizeof ctx);
+	ctx.bvh = bvh;
+	ctx.bounds = bounds;
+	ctx.spheres = spheres;
+	ctx.count = count;
+	ctx.bits = morton_bits > 30 ? 21 : 10;
+	/* small builds aren't worth the threads */
+	ctx.num_chunks = count < BVH_LBVH_MT_MIN ? 1 : num_threads;
+	if(ctx.num_chunks == 1) {
+		num_threads = 1;
+	}
+
+	if(!(bvh->prim = malloc(count * sizeof *bvh->prim)) ||
+			!(ctx.keys = malloc(count * sizeof *ctx.keys)) ||
+			!(ctx.tmp = malloc(count * sizeof *ctx.tmp)) ||
+			!(ctx.chunks = calloc(ctx.num_chunks, sizeof *ctx.chunks))) {
+		goto fail;
+	}
+	bvh->num_prims = count;
+
+	/* quantize the centroids in their bounding box */
+	vmath_parallel_range(ctx.num_chunks, num_threads, 1, cbox_job, &ctx);
+	for(c=1; c<ctx.num_chunks; c++) {
+		for(i=0; i<3; i++) {
+			ctx.chunks[0].cbox.min[i] = MIN(ctx.chunks[0].cbox.min[i], ctx.chunks[c].cbox.min[i]);
+			ctx.chunks[0].cbox.max[i] = MAX(ctx.chunks[0].cbox.max[i], ctx.chunks[c].cbox.max[i]);
+		}
+	}
+	/* the same scale on all axes keeps the cells cubic */
+	dx = ctx.chunks[0].cbox.max[0] - ctx.chunks[0].cbox.min[0];
+	dy = ctx.chunks[0].cbox.max[1] - ctx.chunks[0].cbox.min[1];
+	dz = ctx.chunks[0].cbox.max[2] - ctx.chunks[0].cbox.min[2];
+	cmax = MAX(MAX(dx, dy), dz);
+	for(i=0; i<3; i++) {
+		ctx.cmin[i] = ctx.chunks[0].cbox.min[i];
+		ctx.scale[i] = cmax > 0.0 ? (scalar_t)((1 << ctx.bits) - 1) / cmax : 0.0;
+	}
+	vmath_parallel_range(ctx.num_chunks, num_threads, 1, morton_job, &ctx);
+
+	if(vmath_radix_sort(&ctx.keys, &ctx.tmp, count, ctx.bits * 3, ctx.num_chunks, num_threads) == -1) {
+		goto fail;
+	}
+
+	/* the tree, one interior node per gap between adjacent codes. The sort
+	 * buffer has room for the three per gap arrays (see key_fits_three_ints),
+	 * and it's already paged in.
+	 */
+	if(!(ctx.prefix = malloc(count))) {
+		goto fail;
+	}
+	ctx.left = (int*)ctx.tmp;
+	ctx.right = ctx.left + count;
+	ctx.slot = ctx.right + count;
+	vmath_parallel_range(ctx.num_chunks, num_threads, 1, prefix_job, &ctx);
+	free(ctx.keys);
+	ctx.keys = 0;
+
+	if(count <= bvh->max_leaf_prims) {
+		num_nodes = 1;
+	} else {
+		vmath_parallel_range(ctx.num_chunks, num_threads, 1, nearest_job, &ctx);
+		nearest_fixup(&ctx);
+		vmath_parallel_range(ctx.num_chunks, num_threads, 1, count_job, &ctx);
+
+		/* number the interior nodes which are not part of a leaf in order */
+		num_nodes = 0;
+		for(c=0; c<ctx.num_chunks; c++) {
+			int n = ctx.chunks[c].num_nodes;
+			ctx.chunks[c].num_nodes = num_nodes;
+			num_nodes += n;
+		}
+		vmath_parallel_range(ctx.num_chunks, num_threads, 1, slot_job, &ctx);
+		num_nodes = num_nodes * 2 + 2;
+	}
+
+	/* same layout as bvh_build: root, padding, and a slot pair for the
+	 * children of each interior node
+	 */
+	if(!(bvh->node_mem = malloc(num_nodes * sizeof *bvh->nodes + 63))) {
+		goto fail;
+	}
+	bvh->nodes = (bvh_node_t*)(((size_t)bvh->node_mem + 63) & ~(size_t)63);
+	bvh->num_nodes = num_nodes;
+
+	node = bvh->nodes;
+	if(num_nodes == 1) {
+		node->offs = 0;
+		node->count = count;
+		leaf_bounds(&ctx, node);
+	} else {
+		vmath_parallel_range(ctx.num_chunks, num_threads, 1, emit_job, &ctx);
+	}
+	free(ctx.prefix);
+	free(ctx.tmp);
+	ctx.prefix = 0;
+	ctx.tmp = 0;
+
+	/* bounds, bottom-up. The top levels are expanded breadth-first until there
+	 * are enough subtrees to keep the threads busy, the subtrees are done in
+	 * parallel, and then the expanded nodes in reverse order, children first.
+	 */
+	max_sub = num_threads > 1 ? num_threads * 8 : 1;
+	if(!(top = malloc(max_sub * 2 * sizeof *top)) ||
+			!(ctx.subtree = malloc(max_sub * 8 * sizeof *ctx.subtree)) ||
+			!(ctx.sub_stats = malloc(max_sub * 2 * sizeof *ctx.sub_stats))) {
+		goto fail;
+	}
+	ctx.subtree_depth = ctx.subtree + max_sub * 2;
+	next = ctx.subtree + max_sub * 4;
+	next_depth = ctx.subtree + max_sub * 6;
+
+	ctx.subtree[0] = 0;
+	ctx.subtree_depth[0] = 0;
+	num_sub = 1;
+	num_top = 0;
+	while(num_sub < max_sub) {
+		int num_next = 0;
+		for(i=0; i<num_sub; i++) {
+			node = bvh->nodes + ctx.subtree[i];
+			if(node->count) {
+				next[num_next] = ctx.subtree[i];
+				next_depth[num_next++] = ctx.subtree_depth[i];
+			} else {
+				top[num_top++] = ctx.subtree[i];
+				next[num_next] = node->offs;
+				next_depth[num_next++] = ctx.subtree_depth[i] + 1;
+				next[num_next] = node->offs + 1;
+				next_depth[num_next++] = ctx.subtree_depth[i] + 1;
+			}
+		}
+		if(num_next == num_sub) break;	/* all leaves */
+		memcpy(ctx.subtree, next, num_next * sizeof *next);
+		memcpy(ctx.subtree_depth, next_depth, num_next * sizeof *next_depth);
+		num_sub = num_next;
+	}
+
+	vmath_parallel_range(num_sub, num_threads, 1, bounds_job, &ctx);
+
+	max_depth = 0;
+	for(i=0; i<num_sub; i++) {
+		struct subtree_stats *st = ctx.sub_stats + i;
+		bvh->stats.num_leaves += st->num_leaves;
+		max_depth = MAX(max_depth, st->max_depth);
+		bvh->stats.max_leaf_prims = MAX(bvh->stats.max_leaf_prims, st->max_leaf_prims);
+		leaf_area += st->leaf_area;
+		node_area += st->node_area;
+	}
+	for(i=num_top-1; i>=0; i--) {
+		bvh_node_t *n = bvh->nodes + top[i];
+		bvh_node_t *ch = bvh->nodes + n->offs;
+		for(j=0; j<3; j++) {
+			n->bmin[j] = MIN(ch[0].bmin[j], ch[1].bmin[j]);
+			n->bmax[j] = MAX(ch[0].bmax[j], ch[1].bmax[j]);
+		}
+		dx = n->bmax[0] - n->bmin[0];
+		dy = n->bmax[1] - n->bmin[1];
+		dz = n->bmax[2] - n->bmin[2];
+		node_area += 2.0 * (dx * dy + dy * dz + dz * dx);
+	}
+
+	node = bvh->nodes;
+	dx = node->bmax[0] - node->bmin[0];
+	dy = node->bmax[1] - node->bmin[1];
+	dz = node->bmax[2] - node->bmin[2];
+	root_area = 2.0 * (dx * dy + dy * dz + dz * dx);
+	if(root_area > 0.0) {
+		bvh->stats.sah_cost = (bvh->trav_cost * node_area + bvh->isect_cost * leaf_area) / root_area;
+	}
+	bvh->stats.max_depth = max_depth;
+	bvh->stats.num_nodes = bvh->stats.num_leaves * 2 - 1;
+
+	free(top);
+	free(ctx.subtree);
+	free(ctx.sub_stats);
+	free(ctx.chunks);
+
+	bvh->stats.build_time = vmath_time() - start_time;
+	return 0;
+
+fail:
+	free(top);
+	free(ctx.subtree);
+	free(ctx.sub_stats);
+	free(ctx.keys);
+	free(ctx.tmp);
+	free(ctx.prefix);
+	free(ctx.chunks);
+	bvh_destroy(bvh);
+	return -1;
+}
+
+
+static void centroid(const struct lbvh_ctx *ctx, int i, scalar_t *c)
+{
+	if(ctx->bounds) {
+		const aabox_t *box = ctx->bounds + i;
+		c[0] = (box->min.x + box->max.x) * 0.5;
+		c[1] = (box->min.y + box->max.y) * 0.5;
+		c[2] = (box->min.z + box->max.z) * 0.5;
+	} else {
+		c[0] = ctx->spheres[i].pos.x;
+		c[1] = ctx->spheres[i].pos.y;
+		c[2] = ctx->spheres[i].pos.z;
+	}
+}
+
+static void prim_bounds(const struct lbvh_ctx *ctx, int i, scalar_t *bmin, scalar_t *bmax)
+{
+	if(ctx->bounds) {
+		const aabox_t *box = ctx->bounds + i;
+		bmin[0] = box->min.x;
+		bmin[1] = box->min.y;
+		bmin[2] = box->min.z;
+		bmax[0] = box->max.x;
+		bmax[1] = box->max.y;
+		bmax[2] = box->max.z;
+	} else {
+		const sphere_t *sph = ctx->spheres + i;
+		bmin[0] = sph->pos.x - sph->rad;
+		bmin[1] = sph->pos.y - sph->rad;
+		bmin[2] = sph->pos.z - sph->rad;
+		bmax[0] = sph->pos.x + sph->rad;
+		bmax[1] = sph->pos.y + sph->rad;
+		bmax[2] = sph->pos.z + sph->rad;
+	}
+}
+
+/* the same fixed split of the primitives is used by all the passes */
+static void chunk_range(const struct lbvh_ctx *ctx, int c, int *start, int *end)
+{
+	*start = (int)((double)ctx->count * c / ctx->num_chunks);
+	*end = (int)((double)ctx->count * (c + 1) / ctx->num_chunks);
+}
+
+/* gaps of chunk c, the last chunk has one less */
+static void gap_range(const struct lbvh_ctx *ctx, int c, int *start, int *end)
+{
+	chunk_range(ctx, c, start, end);
+	if(*end == ctx->count) {
+		--*end;
+	}
+}
+
+static void cbox_job(int start, int end, void *cls)
+{
+	int c, i, j, s, e;
+	scalar_t p[3];
+	struct lbvh_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		struct bbox *b = &ctx->chunks[c].cbox;
+		for(j=0; j<3; j++) {
+			b->min[j] = HUGE_VAL;
+			b->max[j] = -HUGE_VAL;
+		}
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			centroid(ctx, i, p);
+			for(j=0; j<3; j++) {
+				if(p[j] < b->min[j]) b->min[j] = p[j];
+				if(p[j] > b->max[j]) b->max[j] = p[j];
+			}
+		}
+	}
+}
+
+/* the 8 low bits of x, moved to every third bit */
+static unsigned int spread_byte(unsigned int x)
+{
+	x &= 0xff;
+	x = (x | (x << 8)) & 0x0000f00f;
+	x = (x | (x << 4)) & 0x000c30c3;
+	x = (x | (x << 2)) & 0x00249249;
+	return x;
+}
+
+static void morton_job(int start, int end, void *cls)
+{
+	int c, i, j, k, s, e;
+	unsigned int q, hi, lo, ahi, alo;
+	scalar_t p[3], f;
+	struct lbvh_ctx *ctx = cls;
+	scalar_t qmax = (scalar_t)((1 << ctx->bits) - 1);
+
+	for(c=start; c<end; c++) {
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			centroid(ctx, i, p);
+			hi = lo = 0;
+			for(j=0; j<3; j++) {
+				f = (p[j] - ctx->cmin[j]) * ctx->scale[j];
+				/* also catches NaNs */
+				if(!(f > 0.0)) f = 0.0;
+				if(f > qmax) f = qmax;
+				q = (unsigned int)f;
+
+				/* every third bit of the 63-bit code, x in the highest */
+				alo = spread_byte(q) | (spread_byte(q >> 8) << 24);
+				ahi = (spread_byte(q >> 8) >> 8) | (spread_byte(q >> 16) << 16);
+				k = 2 - j;
+				if(k) {
+					ahi = (ahi << k) | (alo >> (32 - k));
+					alo <<= k;
+				}
+				hi |= ahi;
+				lo |= alo;
+			}
+			ctx->keys[i].hi = hi;
+			ctx->keys[i].lo = lo;
+			ctx->keys[i].value = i;
+		}
+	}
+}
+
+static int clz32(unsigned int x)
+{
+	int n = 0;
+
+	if(!x) return 32;
+	if(!(x & 0xffff0000)) { n += 16; x <<= 16; }
+	if(!(x & 0xff000000)) { n += 8; x <<= 8; }
+	if(!(x & 0xf0000000)) { n += 4; x <<= 4; }
+	if(!(x & 0xc0000000)) { n += 2; x <<= 2; }
+	if(!(x & 0x80000000)) { n += 1; }
+	return n;
+}
+
+/* primitive order, and the length of the common prefix of adjacent keys.
+ * Duplicate codes are told apart by their position, which continues the
+ * code in the lowest bits.
+ */
+static void prefix_job(int start, int end, void *cls)
+{
+	int c, i, s, e;
+	unsigned int x;
+	struct lbvh_ctx *ctx = cls;
+	const struct radix_key *keys = ctx->keys;
+
+	for(c=start; c<end; c++) {
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			ctx->bvh->prim[i] = keys[i].value;
+		}
+		if(e == ctx->count) e--;
+		for(i=s; i<e; i++) {
+			if((x = keys[i].hi ^ keys[i + 1].hi)) {
+				ctx->prefix[i] = clz32(x);
+			} else if((x = keys[i].lo ^ keys[i + 1].lo)) {
+				ctx->prefix[i] = 32 + clz32(x);
+			} else {
+				ctx->prefix[i] = 64 + clz32((unsigned int)(i ^ (i + 1)));
+			}
+		}
+	}
+}
+
+/* nearest shorter prefix within the chunk, jumping over the gaps which were
+ * already found to be longer. Gaps which have none get the one just outside
+ * the chunk, and nearest_fixup continues from there.
+ */
+static void nearest_job(int start, int end, void *cls)
+{
+	int c, i, j, s, e;
+	struct lbvh_ctx *ctx = cls;
+	const unsigned char *prefix = ctx->prefix;
+	int *left = ctx->left, *right = ctx->right;
+
+	for(c=start; c<end; c++) {
+		gap_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			j = i - 1;
+			while(j >= s && prefix[j] >= prefix[i]) {
+				j = left[j];
+			}
+			left[i] = j;
+		}
+		for(i=e-1; i>=s; i--) {
+			j = i + 1;
+			while(j < e && prefix[j] >= prefix[i]) {
+				j = right[j];
+			}
+			right[i] = j;
+		}
+	}
+}
+
+/* the gaps which have no shorter prefix on one side within their chunk are
+ * the successive minima from that end, at most one per prefix length. Their
+ * searches continue across the neighbouring chunks, which are done first.
+ */
+static void nearest_fixup(struct lbvh_ctx *ctx)
+{
+	int c, i, j, s, e, ngaps = ctx->count - 1;
+	const unsigned char *prefix = ctx->prefix;
+	int *left = ctx->left, *right = ctx->right;
+
+	for(c=1; c<ctx->num_chunks; c++) {
+		gap_range(ctx, c, &s, &e);
+		for(i=s; i<e; i=right[i]) {
+			j = left[i];
+			while(j >= 0 && prefix[j] >= prefix[i]) {
+				j = left[j];
+			}
+			left[i] = j;
+		}
+	}
+	for(c=ctx->num_chunks-2; c>=0; c--) {
+		gap_range(ctx, c, &s, &e);
+		for(i=e-1; i>=s; i=left[i]) {
+			j = right[i];
+			while(j < ngaps && prefix[j] >= prefix[i]) {
+				j = right[j];
+			}
+			right[i] = j;
+		}
+	}
+}
+
+/* interior node g (the gap between keys g and g + 1) covers keys
+ * left[g] + 1 to right[g]. Small ranges become leaves, and the interior
+ * nodes below them are dropped. Returns the parent of a node, or -1 for the
+ * root: the one of the two neighbouring gaps with the longer prefix.
+ */
+static int node_parent(const struct lbvh_ctx *ctx, int g)
+{
+	int l = ctx->left[g], r = ctx->right[g];
+
+	if(l < 0) {
+		return r < ctx->count - 1 ? r : -1;
+	}
+	if(r >= ctx->count - 1) {
+		return l;
+	}
+	return ctx->prefix[l] > ctx->prefix[r] ? l : r;
+}
+
+#define IS_NODE(ctx, g)	((ctx)->right[g] - (ctx)->left[g] > (ctx)->bvh->max_leaf_prims)
+
+static void count_job(int start, int end, void *cls)
+{
+	int c, g, s, e, n;
+	struct lbvh_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		gap_range(ctx, c, &s, &e);
+		n = 0;
+		for(g=s; g<e; g++) {
+			if(IS_NODE(ctx, g)) n++;
+		}
+		ctx->chunks[c].num_nodes = n;
+	}
+}
+
+static void slot_job(int start, int end, void *cls)
+{
+	int c, g, s, e, n;
+	struct lbvh_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		gap_range(ctx, c, &s, &e);
+		n = ctx->chunks[c].num_nodes;
+		for(g=s; g<e; g++) {
+			if(IS_NODE(ctx, g)) {
+				ctx->slot[g] = n++ * 2 + 2;
+			}
+		}
+	}
+}
+
+/* every interior node links itself into the slot pair of its parent, and its
+ * children into its own pair if they are leaves
+ */
+static void emit_job(int start, int end, void *cls)
+{
+	int c, g, s, e, p, first, last;
+	struct lbvh_ctx *ctx = cls;
+	int max_leaf = ctx->bvh->max_leaf_prims;
+	bvh_node_t *nodes = ctx->bvh->nodes, *child;
+
+	for(c=start; c<end; c++) {
+		gap_range(ctx, c, &s, &e);
+		for(g=s; g<e; g++) {
+			if(!IS_NODE(ctx, g)) continue;
+
+			if((p = node_parent(ctx, g)) < 0) {
+				child = nodes;
+			} else {
+				/* left child if the parent gap is after the range */
+				child = nodes + ctx->slot[p] + (p > g ? 0 : 1);
+			}
+			child->offs = ctx->slot[g];
+			child->count = 0;
+
+			child = nodes + ctx->slot[g];
+			first = ctx->left[g] + 1;
+			last = ctx->right[g];
+			if(g - first < max_leaf) {
+				child[0].offs = first;
+				child[0].count = g - first + 1;
+				leaf_bounds(ctx, child);
+			}
+			if(last - g <= max_leaf) {
+				child[1].offs = g + 1;
+				child[1].count = last - g;
+				leaf_bounds(ctx, child + 1);
+			}
+		}
+	}
+}
+
+static void leaf_bounds(const struct lbvh_ctx *ctx, bvh_node_t *leaf)
+{
+	int i, j;
+	scalar_t bmin[3], bmax[3];
+	const int *prim = ctx->bvh->prim + leaf->offs;
+
+	prim_bounds(ctx, prim[0], leaf->bmin, leaf->bmax);
+	for(i=1; i<leaf->count; i++) {
+		prim_bounds(ctx, prim[i], bmin, bmax);
+		for(j=0; j<3; j++) {
+			if(bmin[j] < leaf->bmin[j]) leaf->bmin[j] = bmin[j];
+			if(bmax[j] > leaf->bmax[j]) leaf->bmax[j] = bmax[j];
+		}
+	}
+}
+
+static void bounds_job(int start, int end, void *cls)
+{
+	int i;
+	struct lbvh_ctx *ctx = cls;
+
+	for(i=start; i<end; i++) {
+		struct subtree_stats *st = ctx->sub_stats + i;
+		st->num_leaves = st->max_depth = st->max_leaf_prims = 0;
+		st->leaf_area = st->node_area = 0.0;
+		subtree_bounds(ctx, ctx->subtree[i], ctx->subtree_depth[i], st);
+	}
+}
+
+static void subtree_bounds(struct lbvh_ctx *ctx, int nidx, int depth, struct subtree_stats *st)
+{
+	int j;
+	scalar_t dx, dy, dz;
+	bvh_node_t *node = ctx->bvh->nodes + nidx;
+
+	if(depth > st->max_depth) {
+		st->max_depth = depth;
+	}
+
+	if(node->count) {
+		/* the leaf bounds were done by emit_job */
+		st->num_leaves++;
+		if(node->count > st->max_leaf_prims) {
+			st->max_leaf_prims = node->count;
+		}
+	} else {
+		bvh_node_t *ch = ctx->bvh->nodes + node->offs;
+		subtree_bounds(ctx, node->offs, depth + 1, st);
+		subtree_bounds(ctx, node->offs + 1, depth + 1, st);
+		for(j=0; j<3; j++) {
+			node->bmin[j] = MIN(ch[0].bmin[j], ch[1].bmin[j]);
+			node->bmax[j] = MAX(ch[0].bmax[j], ch[1].bmax[j]);
+		}
+	}
+
+	dx = node->bmax[0] - node->bmin[0];
+	dy = node->bmax[1] - node->bmin[1];
+	dz = node->bmax[2] - node->bmin[2];
+	if(node->count) {
+		st->leaf_area += node->count * 2.0 * (dx * dy + dy * dz + dz * dx);
+	} else {
+		st->node_area += 2.0 * (dx * dy + dy * dz + dz * dx);
+	}
+}
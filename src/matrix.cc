@@ -278,41 +278,7 @@ void Matrix3x3::set_rotation(const Vector3 &axis, scalar_t angle)
 // adapted from: http://www.geometrictools.com/LibMathematics/Algebra/Wm5Quaternion.inl
 Quaternion Matrix3x3::get_rotation_quat() const
 {
-	static const int next[3] = {1, 2, 0};
-
-	float quat[4];
-
-	scalar_t trace = m[0][0] + m[1][1] + m[2][2];
-	scalar_t root;
-
-	if(trace > 0.0f) {
-		// |w| > 1/2
-		root = sqrt(trace + 1.0f);	// 2w
-		quat[0] = 0.5f * root;
-		root = 0.5f / root;	// 1 / 4w
-		quat[1] = (m[2][1] - m[1][2]) * root;
-		quat[2] = (m[0][2] - m[2][0]) * root;
-		quat[3] = (m[1][0] - m[0][1]) * root;
-	} else {
-		// |w| <= 1/2
-		int i = 0;
-		if(m[1][1] > m[0][0]) {
-			i = 1;
-		}
-		if(m[2][2] > m[i][i]) {
-			i = 2;
-		}
-		int j = next[i];
-		int k = next[j];
-
-		root = sqrt(m[i][i] - m[j][j] - m[k][k] + 1.0f);
-		quat[i + 1] = 0.5f * root;
-		root = 0.5f / root;
-		quat[0] = (m[k][j] - m[j][k]) * root;
-		quat[j + 1] = (m[j][i] - m[i][j]) * root;
-		quat[k + 1] = (m[k][i] - m[i][k]) * root;
-	}
-	return Quaternion(quat[0], quat[1], quat[2], quat[3]);
+	return Quaternion(m3_rotation_quat((scalar_t (*)[3])m));
 }
 
 void Matrix3x3::scale(const Vector3 &scale_vec)
@@ -384,8 +350,9 @@ scalar_t Matrix3x3::determinant() const
 
 Matrix3x3 Matrix3x3::inverse() const
 {
-	// TODO: implement 3x3 inverse
-	return *this;
+	Matrix3x3 res;
+	m3_inverse(res.m, (scalar_t (*)[3])m);
+	return res;
 }
 
 /*ostream &operator <<(ostream &out, const Matrix3x3 &mat)
@@ -435,6 +402,11 @@ Matrix4x4::Matrix4x4(const Matrix3x3 &mat3x3)
 	}
 }
 
+Matrix4x4::Matrix4x4(const Matrix3x4 &mat3x4)
+{
+	m3x4_to_m4(m, (scalar_t (*)[4])mat3x4.m);
+}
+
 Matrix4x4 operator +(const Matrix4x4 &m1, const Matrix4x4 &m2)
 {
 	Matrix4x4 res;
@@ -622,8 +594,7 @@ void Matrix4x4::set_rotation(const Quaternion &quat)
 
 Quaternion Matrix4x4::get_rotation_quat() const
 {
-	Matrix3x3 mat3 = *this;
-	return mat3.get_rotation_quat();
+	return Quaternion(m4_rotation_quat((scalar_t (*)[4])m));
 }
 
 void Matrix4x4::scale(const Vector4 &scale_vec)
@@ -859,6 +830,126 @@ Matrix4x4 Matrix4x4::inverse() const
 	return adj * (1.0f / determinant());
 }
 
+Matrix4x4 Matrix4x4::inverse_rigid() const
+{
+	Matrix4x4 res;
+	m4_inverse_rigid(res.m, (scalar_t (*)[4])m);
+	return res;
+}
+
+Matrix4x4 Matrix4x4::inverse_affine() const
+{
+	Matrix4x4 res;
+	m4_inverse_affine(res.m, (scalar_t (*)[4])m);
+	return res;
+}
+
+Matrix4x4 Matrix4x4::inverse_auto() const
+{
+	Matrix4x4 res;
+	m4_inverse_auto(res.m, (scalar_t (*)[4])m);
+	return res;
+}
+
+
+
+Matrix3x4 Matrix3x4::identity = Matrix3x4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0);
+
+Matrix3x4::Matrix3x4()
+{
+	m3x4_identity(m);
+}
+
+Matrix3x4::Matrix3x4(	scalar_t m11, scalar_t m12, scalar_t m13, scalar_t m14,
+						scalar_t m21, scalar_t m22, scalar_t m23, scalar_t m24,
+						scalar_t m31, scalar_t m32, scalar_t m33, scalar_t m34)
+{
+	m3x4_cons(m, m11, m12, m13, m14, m21, m22, m23, m24, m31, m32, m33, m34);
+}
+
+Matrix3x4::Matrix3x4(const mat3x4_t cmat)
+{
+	memcpy(m, cmat, sizeof(mat3x4_t));
+}
+
+Matrix3x4::Matrix3x4(const Matrix3x3 &mat3x3)
+{
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<3; j++) {
+			m[i][j] = mat3x3[i][j];
+		}
+		m[i][3] = 0.0;
+	}
+}
+
+Matrix3x4::Matrix3x4(const Matrix4x4 &mat4x4)
+{
+	memcpy(m, mat4x4.m, sizeof(mat3x4_t));
+}
+
+void Matrix3x4::translate(const Vector3 &trans)
+{
+	*this *= Matrix3x4(1, 0, 0, trans.x, 0, 1, 0, trans.y, 0, 0, 1, trans.z);
+}
+
+void Matrix3x4::set_translation(const Vector3 &trans)
+{
+	*this = Matrix3x4(1, 0, 0, trans.x, 0, 1, 0, trans.y, 0, 0, 1, trans.z);
+}
+
+Vector3 Matrix3x4::get_translation() const
+{
+	return Vector3(m[0][3], m[1][3], m[2][3]);
+}
+
+void Matrix3x4::rotate(const Vector3 &axis, scalar_t angle)
+{
+	Matrix3x3 rot;
+	rot.set_rotation(axis, angle);
+	*this *= Matrix3x4(rot);
+}
+
+void Matrix3x4::rotate(const Quaternion &quat)
+{
+	*this *= Matrix3x4(quat.get_rotation_matrix());
+}
+
+void Matrix3x4::set_rotation(const Vector3 &axis, scalar_t angle)
+{
+	Matrix3x3 rot;
+	rot.set_rotation(axis, angle);
+	*this = Matrix3x4(rot);
+}
+
+void Matrix3x4::set_rotation(const Quaternion &quat)
+{
+	*this = Matrix3x4(quat.get_rotation_matrix());
+}
+
+void Matrix3x4::scale(const Vector3 &scale_vec)
+{
+	*this *= Matrix3x4(scale_vec.x, 0, 0, 0, 0, scale_vec.y, 0, 0, 0, 0, scale_vec.z, 0);
+}
+
+void Matrix3x4::set_scaling(const Vector3 &scale_vec)
+{
+	*this = Matrix3x4(scale_vec.x, 0, 0, 0, 0, scale_vec.y, 0, 0, 0, 0, scale_vec.z, 0);
+}
+
+Matrix3x4 Matrix3x4::inverse() const
+{
+	Matrix3x4 res;
+	m3x4_inverse(res.m, (scalar_t (*)[4])m);
+	return res;
+}
+
+Matrix3x4 Matrix3x4::inverse_rigid() const
+{
+	Matrix3x4 res;
+	m3x4_inverse_rigid(res.m, (scalar_t (*)[4])m);
+	return res;
+}
+
 /*
 ostream &operator <<(ostream &out, const Matrix4x4 &mat)
 {
@@ -36,6 +36,19 @@ static inline void m3_cons(mat3_t m,
 static inline void m3_copy(mat3_t dest, mat3_t src);
 void m3_to_m4(mat4_t dest, mat3_t src);
 
+scalar_t m3_determinant(mat3_t m);
+void m3_inverse(mat3_t res, mat3_t m);
+/* inverse transpose of the upper 3x3 part of m, for transforming normals */
+void m4_normal_matrix(mat3_t res, mat4_t m);
+/* rotation quaternion of a rotation matrix, not normalized */
+quat_t m3_rotation_quat(mat3_t m);
+
+/* batch versions of the above, for count matrices in SoA form.
+ * m3_normal_matrix_soa calculates the inverse transpose of each matrix.
+ */
+void m3_inverse_soa(mat3_soa_t res, mat3_soa_t m, int count);
+void m3_normal_matrix_soa(mat3_soa_t res, mat3_soa_t m, int count);
+
 void m3_print(FILE *fp, mat3_t m);
 
 /* C matrix 4x4 functions */
@@ -48,7 +61,8 @@ static inline void m4_cons(mat4_t m,
 static inline void m4_copy(mat4_t dest, mat4_t src);
 void m4_to_m3(mat3_t dest, mat4_t src);
 
-static inline void m4_mult(mat4_t res, mat4_t m1, mat4_t m2);
+/* uses the fastest SIMD implementation supported by the CPU, res may alias m1 or m2 */
+void m4_mult(mat4_t res, mat4_t m1, mat4_t m2);
 
 void m4_set_translation(mat4_t m, scalar_t x, scalar_t y, scalar_t z);
 void m4_translate(mat4_t m, scalar_t x, scalar_t y, scalar_t z);
@@ -66,6 +80,8 @@ void m4_set_rotation_axis(mat4_t m, scalar_t angle, scalar_t x, scalar_t y, scal
 void m4_rotate_axis(mat4_t m, scalar_t angle, scalar_t x, scalar_t y, scalar_t z);
 /* concatentate a rotation quaternion */
 void m4_rotate_quat(mat4_t m, quat_t q);
+/* rotation quaternion of the upper 3x3 part, see m3_rotation_quat */
+quat_t m4_rotation_quat(mat4_t m);
 
 void m4_set_scaling(mat4_t m, scalar_t x, scalar_t y, scalar_t z);
 void m4_scale(mat4_t m, scalar_t x, scalar_t y, scalar_t z);
@@ -78,8 +94,53 @@ scalar_t m4_determinant(mat4_t m);
 void m4_adjoint(mat4_t res, mat4_t m);
 void m4_inverse(mat4_t res, mat4_t m);
 
+/* matrix classes for the specialized inverses. Rigid and affine matrices have
+ * a (0, 0, 0, 1) bottom row, and rigid ones an orthonormal upper 3x3 part.
+ */
+enum { M4_GENERAL, M4_AFFINE, M4_RIGID };
+
+int m4_classify(mat4_t m);
+
+/* m4_inverse_rigid and m4_inverse_affine are only correct for matrices of the
+ * respective class, but are a lot faster than m4_inverse. m4_inverse_auto
+ * classifies the matrix and uses the cheapest of the three which applies,
+ * returning the class.
+ */
+void m4_inverse_rigid(mat4_t res, mat4_t m);
+void m4_inverse_affine(mat4_t res, mat4_t m);
+int m4_inverse_auto(mat4_t res, mat4_t m);
+
 void m4_print(FILE *fp, mat4_t m);
 
+/* C affine 3x4 matrix functions. These work like the 4x4 ones, with an
+ * implicit (0, 0, 0, 1) bottom row which is never stored or computed.
+ */
+static inline void m3x4_identity(mat3x4_t m);
+static inline void m3x4_cons(mat3x4_t m,
+		scalar_t m11, scalar_t m12, scalar_t m13, scalar_t m14,
+		scalar_t m21, scalar_t m22, scalar_t m23, scalar_t m24,
+		scalar_t m31, scalar_t m32, scalar_t m33, scalar_t m34);
+static inline void m3x4_copy(mat3x4_t dest, mat3x4_t src);
+static inline void m4_to_m3x4(mat3x4_t dest, mat4_t src);	/* drops the bottom row */
+static inline void m3x4_to_m4(mat4_t dest, mat3x4_t src);
+
+/* res may alias m1 or m2 */
+void m3x4_mult(mat3x4_t res, mat3x4_t m1, mat3x4_t m2);
+
+/* m3x4_inverse works for any invertible affine matrix, m3x4_inverse_rigid
+ * only for rigid transformations (orthonormal upper 3x3 part).
+ */
+void m3x4_inverse(mat3x4_t res, mat3x4_t m);
+void m3x4_inverse_rigid(mat3x4_t res, mat3x4_t m);
+
+/* batch versions: res[i] = m1[i] * m2[i] and res[i] = inverse(m[i]).
+ * res may be the same array as any of the inputs.
+ */
+void m3x4_mult_array(mat3x4_t *res, mat3x4_t *m1, mat3x4_t *m2, int count);
+void m3x4_inverse_array(mat3x4_t *res, mat3x4_t *m, int count);
+
+void m3x4_print(FILE *fp, mat3x4_t m);
+
 #ifdef __cplusplus
 }
 
@@ -178,6 +239,7 @@ public:
 	Matrix4x4(const mat4_t cmat);
 
 	Matrix4x4(const Matrix3x3 &mat3x3);
+	Matrix4x4(const Matrix3x4 &mat3x4);
 
 	/* binary operations matrix (op) matrix */
 	friend Matrix4x4 operator +(const Matrix4x4 &m1, const Matrix4x4 &m2);
@@ -231,6 +293,9 @@ public:
 	scalar_t determinant() const;
 	Matrix4x4 adjoint() const;
 	Matrix4x4 inverse() const;
+	Matrix4x4 inverse_rigid() const;	/* see m4_inverse_rigid */
+	Matrix4x4 inverse_affine() const;
+	Matrix4x4 inverse_auto() const;
 };
 
 /* binary operations matrix (op) matrix */
@@ -248,6 +313,50 @@ Matrix4x4 operator *(scalar_t scalar, const Matrix4x4 &mat);
 
 void operator *=(Matrix4x4 &mat, scalar_t scalar);
 
+
+/** affine 3x4 matrix: a 4x4 matrix without the constant (0, 0, 0, 1) bottom row */
+class Matrix3x4 {
+public:
+	scalar_t m[3][4];
+
+	static Matrix3x4 identity;
+
+	Matrix3x4();
+	Matrix3x4(	scalar_t m11, scalar_t m12, scalar_t m13, scalar_t m14,
+				scalar_t m21, scalar_t m22, scalar_t m23, scalar_t m24,
+				scalar_t m31, scalar_t m32, scalar_t m33, scalar_t m34);
+	Matrix3x4(const mat3x4_t cmat);
+
+	Matrix3x4(const Matrix3x3 &mat3x3);
+	Matrix3x4(const Matrix4x4 &mat4x4);		/* drops the bottom row */
+
+	friend inline Matrix3x4 operator *(const Matrix3x4 &m1, const Matrix3x4 &m2);
+	friend inline void operator *=(Matrix3x4 &m1, const Matrix3x4 &m2);
+
+	inline scalar_t *operator [](int index);
+	inline const scalar_t *operator [](int index) const;
+
+	inline void reset_identity();
+
+	void translate(const Vector3 &trans);
+	void set_translation(const Vector3 &trans);
+	Vector3 get_translation() const;
+
+	void rotate(const Vector3 &axis, scalar_t angle);
+	void rotate(const Quaternion &quat);
+	void set_rotation(const Vector3 &axis, scalar_t angle);
+	void set_rotation(const Quaternion &quat);
+
+	void scale(const Vector3 &scale_vec);
+	void set_scaling(const Vector3 &scale_vec);
+
+	Matrix3x4 inverse() const;
+	Matrix3x4 inverse_rigid() const;	/* see m3x4_inverse_rigid */
+};
+
+inline Matrix3x4 operator *(const Matrix3x4 &m1, const Matrix3x4 &m2);
+inline void operator *=(Matrix3x4 &m1, const Matrix3x4 &m2);
+
 #endif	/* __cplusplus */
 
 #include "matrix.inl"
@@ -69,42 +69,6 @@ static inline void m4_copy(mat4_t dest, mat4_t src)
 	memcpy(dest, src, sizeof(mat4_t));
 }
 
-static inline void m4_mult(mat4_t res, mat4_t m1, mat4_t m2)
-{
-	mat4_t tmp;
-
-	/*
-	int i, j;
-	for(i=0; i<4; i++) {
-		for(j=0; j<4; j++) {
-			tmp[i][j] = m1[i][0] * m2[0][j] + m1[i][1] * m2[1][j] + m1[i][2] * m2[2][j] + m1[i][3] * m2[3][j];
-		}
-	}
-	*/
-
-	tmp[0][0] = m1[0][0] * m2[0][0] + m1[0][1] * m2[1][0] + m1[0][2] * m2[2][0] + m1[0][3] * m2[3][0];
-	tmp[0][1] = m1[0][0] * m2[0][1] + m1[0][1] * m2[1][1] + m1[0][2] * m2[2][1] + m1[0][3] * m2[3][1];
-	tmp[0][2] = m1[0][0] * m2[0][2] + m1[0][1] * m2[1][2] + m1[0][2] * m2[2][2] + m1[0][3] * m2[3][2];
-	tmp[0][3] = m1[0][0] * m2[0][3] + m1[0][1] * m2[1][3] + m1[0][2] * m2[2][3] + m1[0][3] * m2[3][3];
-
-	tmp[1][0] = m1[1][0] * m2[0][0] + m1[1][1] * m2[1][0] + m1[1][2] * m2[2][0] + m1[1][3] * m2[3][0];
-	tmp[1][1] = m1[1][0] * m2[0][1] + m1[1][1] * m2[1][1] + m1[1][2] * m2[2][1] + m1[1][3] * m2[3][1];
-	tmp[1][2] = m1[1][0] * m2[0][2] + m1[1][1] * m2[1][2] + m1[1][2] * m2[2][2] + m1[1][3] * m2[3][2];
-	tmp[1][3] = m1[1][0] * m2[0][3] + m1[1][1] * m2[1][3] + m1[1][2] * m2[2][3] + m1[1][3] * m2[3][3];
-
-	tmp[2][0] = m1[2][0] * m2[0][0] + m1[2][1] * m2[1][0] + m1[2][2] * m2[2][0] + m1[2][3] * m2[3][0];
-	tmp[2][1] = m1[2][0] * m2[0][1] + m1[2][1] * m2[1][1] + m1[2][2] * m2[2][1] + m1[2][3] * m2[3][1];
-	tmp[2][2] = m1[2][0] * m2[0][2] + m1[2][1] * m2[1][2] + m1[2][2] * m2[2][2] + m1[2][3] * m2[3][2];
-	tmp[2][3] = m1[2][0] * m2[0][3] + m1[2][1] * m2[1][3] + m1[2][2] * m2[2][3] + m1[2][3] * m2[3][3];
-
-	tmp[3][0] = m1[3][0] * m2[0][0] + m1[3][1] * m2[1][0] + m1[3][2] * m2[2][0] + m1[3][3] * m2[3][0];
-	tmp[3][1] = m1[3][0] * m2[0][1] + m1[3][1] * m2[1][1] + m1[3][2] * m2[2][1] + m1[3][3] * m2[3][1];
-	tmp[3][2] = m1[3][0] * m2[0][2] + m1[3][1] * m2[1][2] + m1[3][2] * m2[2][2] + m1[3][3] * m2[3][2];
-	tmp[3][3] = m1[3][0] * m2[0][3] + m1[3][1] * m2[1][3] + m1[3][2] * m2[2][3] + m1[3][3] * m2[3][3];
-
-	m4_copy(res, tmp);
-}
-
 static inline void m4_set_column(mat4_t m, vec4_t v, int idx)
 {
 	m[0][idx] = v.x;
@@ -121,43 +85,49 @@ static inline void m4_set_row(mat4_t m, vec4_t v, int idx)
 	m[idx][3] = v.w;
 }
 
+
+/* C affine 3x4 matrix functions */
+static inline void m3x4_identity(mat3x4_t m)
+{
+	static const mat3x4_t id = {{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}};
+	memcpy(m, id, sizeof id);
+}
+
+static inline void m3x4_cons(mat3x4_t m,
+		scalar_t m11, scalar_t m12, scalar_t m13, scalar_t m14,
+		scalar_t m21, scalar_t m22, scalar_t m23, scalar_t m24,
+		scalar_t m31, scalar_t m32, scalar_t m33, scalar_t m34)
+{
+	m[0][0] = m11; m[0][1] = m12; m[0][2] = m13; m[0][3] = m14;
+	m[1][0] = m21; m[1][1] = m22; m[1][2] = m23; m[1][3] = m24;
+	m[2][0] = m31; m[2][1] = m32; m[2][2] = m33; m[2][3] = m34;
+}
+
+static inline void m3x4_copy(mat3x4_t dest, mat3x4_t src)
+{
+	memcpy(dest, src, sizeof(mat3x4_t));
+}
+
+static inline void m4_to_m3x4(mat3x4_t dest, mat4_t src)
+{
+	memcpy(dest, src, sizeof(mat3x4_t));
+}
+
+static inline void m3x4_to_m4(mat4_t dest, mat3x4_t src)
+{
+	memcpy(dest, src, sizeof(mat3x4_t));
+	dest[3][0] = dest[3][1] = dest[3][2] = 0.0;
+	dest[3][3] = 1.0;
+}
+
 #ifdef __cplusplus
 }	/* extern "C" */
 
 
-/* unrolled to hell and inline */
 inline Matrix4x4 operator *(const Matrix4x4 &m1, const Matrix4x4 &m2)
 {
 	Matrix4x4 res;
-
-	/*
-	for(i=0; i<4; i++) {
-		for(j=0; j<4; j++) {
-			res.m[i][j] = m1.m[i][0] * m2.m[0][j] + m1.m[i][1] * m2.m[1][j] + m1.m[i][2] * m2.m[2][j] + m1.m[i][3] * m2.m[3][j];
-		}
-	}
-	*/
-
-	res.m[0][0] = m1.m[0][0] * m2.m[0][0] + m1.m[0][1] * m2.m[1][0] + m1.m[0][2] * m2.m[2][0] + m1.m[0][3] * m2.m[3][0];
-	res.m[0][1] = m1.m[0][0] * m2.m[0][1] + m1.m[0][1] * m2.m[1][1] + m1.m[0][2] * m2.m[2][1] + m1.m[0][3] * m2.m[3][1];
-	res.m[0][2] = m1.m[0][0] * m2.m[0][2] + m1.m[0][1] * m2.m[1][2] + m1.m[0][2] * m2.m[2][2] + m1.m[0][3] * m2.m[3][2];
-	res.m[0][3] = m1.m[0][0] * m2.m[0][3] + m1.m[0][1] * m2.m[1][3] + m1.m[0][2] * m2.m[2][3] + m1.m[0][3] * m2.m[3][3];
-
-	res.m[1][0] = m1.m[1][0] * m2.m[0][0] + m1.m[1][1] * m2.m[1][0] + m1.m[1][2] * m2.m[2][0] + m1.m[1][3] * m2.m[3][0];
-	res.m[1][1] = m1.m[1][0] * m2.m[0][1] + m1.m[1][1] * m2.m[1][1] + m1.m[1][2] * m2.m[2][1] + m1.m[1][3] * m2.m[3][1];
-	res.m[1][2] = m1.m[1][0] * m2.m[0][2] + m1.m[1][1] * m2.m[1][2] + m1.m[1][2] * m2.m[2][2] + m1.m[1][3] * m2.m[3][2];
-	res.m[1][3] = m1.m[1][0] * m2.m[0][3] + m1.m[1][1] * m2.m[1][3] + m1.m[1][2] * m2.m[2][3] + m1.m[1][3] * m2.m[3][3];
-
-	res.m[2][0] = m1.m[2][0] * m2.m[0][0] + m1.m[2][1] * m2.m[1][0] + m1.m[2][2] * m2.m[2][0] + m1.m[2][3] * m2.m[3][0];
-	res.m[2][1] = m1.m[2][0] * m2.m[0][1] + m1.m[2][1] * m2.m[1][1] + m1.m[2][2] * m2.m[2][1] + m1.m[2][3] * m2.m[3][1];
-	res.m[2][2] = m1.m[2][0] * m2.m[0][2] + m1.m[2][1] * m2.m[1][2] + m1.m[2][2] * m2.m[2][2] + m1.m[2][3] * m2.m[3][2];
-	res.m[2][3] = m1.m[2][0] * m2.m[0][3] + m1.m[2][1] * m2.m[1][3] + m1.m[2][2] * m2.m[2][3] + m1.m[2][3] * m2.m[3][3];
-
-	res.m[3][0] = m1.m[3][0] * m2.m[0][0] + m1.m[3][1] * m2.m[1][0] + m1.m[3][2] * m2.m[2][0] + m1.m[3][3] * m2.m[3][0];
-	res.m[3][1] = m1.m[3][0] * m2.m[0][1] + m1.m[3][1] * m2.m[1][1] + m1.m[3][2] * m2.m[2][1] + m1.m[3][3] * m2.m[3][1];
-	res.m[3][2] = m1.m[3][0] * m2.m[0][2] + m1.m[3][1] * m2.m[1][2] + m1.m[3][2] * m2.m[2][2] + m1.m[3][3] * m2.m[3][2];
-	res.m[3][3] = m1.m[3][0] * m2.m[0][3] + m1.m[3][1] * m2.m[1][3] + m1.m[3][2] * m2.m[2][3] + m1.m[3][3] * m2.m[3][3];
-
+	m4_mult(res.m, (scalar_t (*)[4])m1.m, (scalar_t (*)[4])m2.m);
 	return res;
 }
 
@@ -197,4 +167,31 @@ inline void Matrix4x4::reset_identity()
 {
 	*this = identity;
 }
+
+inline Matrix3x4 operator *(const Matrix3x4 &m1, const Matrix3x4 &m2)
+{
+	Matrix3x4 res;
+	m3x4_mult(res.m, (scalar_t (*)[4])m1.m, (scalar_t (*)[4])m2.m);
+	return res;
+}
+
+inline void operator *=(Matrix3x4 &m1, const Matrix3x4 &m2)
+{
+	m3x4_mult(m1.m, m1.m, (scalar_t (*)[4])m2.m);
+}
+
+inline scalar_t *Matrix3x4::operator [](int index)
+{
+	return m[index];
+}
+
+inline const scalar_t *Matrix3x4::operator [](int index) const
+{
+	return m[index];
+}
+
+inline void Matrix3x4::reset_identity()
+{
+	*this = identity;
+}
 #endif	/* __cplusplus */
@@ -21,6 +21,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "matrix.h"
 #include "vector.h"
 #include "quat.h"
+#include "vmath.h"
+#include "vmath_simd.h"
+#include "vmath_thread.h"
 
 void m3_to_m4(mat4_t dest, mat3_t src)
 {
@@ -35,6 +38,144 @@ void m3_to_m4(mat4_t dest, mat3_t src)
 	dest[3][3] = 1.0;
 }
 
+/* cofactor matrix: the inverse transpose times the determinant */
+#define COFACTORS(c, m) \
+	do { \
+		c[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1]; \
+		c[0][1] = m[1][2] * m[2][0] - m[1][0] * m[2][2]; \
+		c[0][2] = m[1][0] * m[2][1] - m[1][1] * m[2][0]; \
+		c[1][0] = m[2][1] * m[0][2] - m[2][2] * m[0][1]; \
+		c[1][1] = m[2][2] * m[0][0] - m[2][0] * m[0][2]; \
+		c[1][2] = m[2][0] * m[0][1] - m[2][1] * m[0][0]; \
+		c[2][0] = m[0][1] * m[1][2] - m[0][2] * m[1][1]; \
+		c[2][1] = m[0][2] * m[1][0] - m[0][0] * m[1][2]; \
+		c[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0]; \
+	} while(0)
+
+scalar_t m3_determinant(mat3_t m)
+{
+	return	m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+			m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+			m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+void m3_inverse(mat3_t res, mat3_t m)
+{
+	int i, j;
+	mat3_t cof;
+	scalar_t inv_det;
+
+	COFACTORS(cof, m);
+	inv_det = 1.0 / (m[0][0] * cof[0][0] + m[0][1] * cof[0][1] + m[0][2] * cof[0][2]);
+
+	for(i=0; i<3; i++) {
+		for(j=0; j<3; j++) {
+			res[i][j] = cof[j][i] * inv_det;
+		}
+	}
+}
+
+void m4_normal_matrix(mat3_t res, mat4_t m)
+{
+	int i, j;
+	mat3_t cof;
+	scalar_t inv_det;
+
+	COFACTORS(cof, m);
+	inv_det = 1.0 / (m[0][0] * cof[0][0] + m[0][1] * cof[0][1] + m[0][2] * cof[0][2]);
+
+	for(i=0; i<3; i++) {
+		for(j=0; j<3; j++) {
+			res[i][j] = cof[i][j] * inv_det;
+		}
+	}
+}
+
+quat_t m3_rotation_quat(mat3_t m)
+{
+	mat4_t m4;
+	m3_to_m4(m4, m);
+	return m4_rotation_quat(m4);
+}
+
+/* batch inverse/inverse transpose, 4 matrices at a time with SSE. The
+ * transpose flag swaps the output element pointers.
+ */
+static void inverse_soa(mat3_soa_t res, mat3_soa_t m, int count, int transpose)
+{
+	int i = 0, j, k;
+	scalar_t *out[3][3];
+
+	for(j=0; j<3; j++) {
+		for(k=0; k<3; k++) {
+			out[j][k] = transpose ? res.m[j][k] : res.m[k][j];
+		}
+	}
+
+#ifdef VMATH_SSE
+	for(; i<count - 3; i+=4) {
+		__m128 a[3][3], c[3][3], inv_det;
+
+		for(j=0; j<3; j++) {
+			for(k=0; k<3; k++) {
+				a[j][k] = _mm_loadu_ps(m.m[j][k] + i);
+			}
+		}
+
+#define CROSSV(x0, y0, x1, y1)	_mm_sub_ps(_mm_mul_ps(a x0, a y0), _mm_mul_ps(a x1, a y1))
+		c[0][0] = CROSSV([1][1], [2][2], [1][2], [2][1]);
+		c[0][1] = CROSSV([1][2], [2][0], [1][0], [2][2]);
+		c[0][2] = CROSSV([1][0], [2][1], [1][1], [2][0]);
+		c[1][0] = CROSSV([2][1], [0][2], [2][2], [0][1]);
+		c[1][1] = CROSSV([2][2], [0][0], [2][0], [0][2]);
+		c[1][2] = CROSSV([2][0], [0][1], [2][1], [0][0]);
+		c[2][0] = CROSSV([0][1], [1][2], [0][2], [1][1]);
+		c[2][1] = CROSSV([0][2], [1][0], [0][0], [1][2]);
+		c[2][2] = CROSSV([0][0], [1][1], [0][1], [1][0]);
+#undef CROSSV
+
+		inv_det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0][0], c[0][0]), _mm_mul_ps(a[0][1], c[0][1])),
+				_mm_mul_ps(a[0][2], c[0][2]));
+		inv_det = _mm_div_ps(_mm_set1_ps(1.0f), inv_det);
+
+		for(j=0; j<3; j++) {
+			for(k=0; k<3; k++) {
+				_mm_storeu_ps(out[j][k] + i, _mm_mul_ps(c[j][k], inv_det));
+			}
+		}
+	}
+#endif
+
+	for(; i<count; i++) {
+		mat3_t a, c;
+		scalar_t inv_det;
+
+		for(j=0; j<3; j++) {
+			for(k=0; k<3; k++) {
+				a[j][k] = m.m[j][k][i];
+			}
+		}
+		COFACTORS(c, a);
+		inv_det = 1.0 / (a[0][0] * c[0][0] + a[0][1] * c[0][1] + a[0][2] * c[0][2]);
+
+		for(j=0; j<3; j++) {
+			for(k=0; k<3; k++) {
+				out[j][k][i] = c[j][k] * inv_det;
+			}
+		}
+	}
+}
+
+void m3_inverse_soa(mat3_soa_t res, mat3_soa_t m, int count)
+{
+	inverse_soa(res, m, count, 0);
+}
+
+void m3_normal_matrix_soa(mat3_soa_t res, mat3_soa_t m, int count)
+{
+	inverse_soa(res, m, count, 1);
+}
+
 void m3_print(FILE *fp, mat3_t m)
 {
 	int i;
@@ -54,6 +195,122 @@ void m4_to_m3(mat3_t dest, mat4_t src)
 	}
 }
 
+/* ---- 4x4 matrix multiplication ----
+ * m4_mult dispatches through a function pointer to the best implementation for
+ * the CPU, which is picked once, on the first call from any thread. The SSE and AVX versions use
+ * the same operation order as the scalar one and produce identical results,
+ * the FMA version rounds once per multiply-add and may differ in the last bit.
+ */
+static void (*m4_mult_func)(mat4_t, mat4_t, mat4_t);
+static vmath_once_t m4_mult_once = VMATH_ONCE_INIT;
+
+static void m4_mult_scalar(mat4_t res, mat4_t m1, mat4_t m2)
+{
+	int i;
+	mat4_t tmp;
+
+	for(i=0; i<4; i++) {
+		tmp[i][0] = m1[i][0] * m2[0][0] + m1[i][1] * m2[1][0] + m1[i][2] * m2[2][0] + m1[i][3] * m2[3][0];
+		tmp[i][1] = m1[i][0] * m2[0][1] + m1[i][1] * m2[1][1] + m1[i][2] * m2[2][1] + m1[i][3] * m2[3][1];
+		tmp[i][2] = m1[i][0] * m2[0][2] + m1[i][1] * m2[1][2] + m1[i][2] * m2[2][2] + m1[i][3] * m2[3][2];
+		tmp[i][3] = m1[i][0] * m2[0][3] + m1[i][1] * m2[1][3] + m1[i][2] * m2[2][3] + m1[i][3] * m2[3][3];
+	}
+	m4_copy(res, tmp);
+}
+
+#ifdef VMATH_SSE
+/* each row of the result is a linear combination of the rows of m2 */
+static void m4_mult_sse(mat4_t res, mat4_t m1, mat4_t m2)
+{
+	int i;
+	__m128 r, b0, b1, b2, b3;
+
+	b0 = _mm_loadu_ps(m2[0]);
+	b1 = _mm_loadu_ps(m2[1]);
+	b2 = _mm_loadu_ps(m2[2]);
+	b3 = _mm_loadu_ps(m2[3]);
+
+	for(i=0; i<4; i++) {
+		r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m1[i][0]), b0), _mm_mul_ps(_mm_set1_ps(m1[i][1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m1[i][2]), b2));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m1[i][3]), b3));
+		_mm_storeu_ps(res[i], r);
+	}
+}
+#endif
+
+#ifdef VMATH_AVX
+/* two rows per iteration: the rows of m2 are duplicated in both 128bit lanes,
+ * and each lane gets the broadcast elements of one row of m1.
+ */
+#define PAIR(a, b)	_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a)), _mm_set1_ps(b), 1)
+
+VMATH_TARGET_AVX
+static void m4_mult_avx(mat4_t res, mat4_t m1, mat4_t m2)
+{
+	int i;
+	__m256 r, b0, b1, b2, b3;
+
+	b0 = _mm256_broadcast_ps((const __m128*)m2[0]);
+	b1 = _mm256_broadcast_ps((const __m128*)m2[1]);
+	b2 = _mm256_broadcast_ps((const __m128*)m2[2]);
+	b3 = _mm256_broadcast_ps((const __m128*)m2[3]);
+
+	for(i=0; i<4; i+=2) {
+		r = _mm256_add_ps(_mm256_mul_ps(PAIR(m1[i][0], m1[i + 1][0]), b0),
+				_mm256_mul_ps(PAIR(m1[i][1], m1[i + 1][1]), b1));
+		r = _mm256_add_ps(r, _mm256_mul_ps(PAIR(m1[i][2], m1[i + 1][2]), b2));
+		r = _mm256_add_ps(r, _mm256_mul_ps(PAIR(m1[i][3], m1[i + 1][3]), b3));
+		_mm256_storeu_ps(res[i], r);
+	}
+}
+
+VMATH_TARGET_FMA
+static void m4_mult_fma(mat4_t res, mat4_t m1, mat4_t m2)
+{
+	int i;
+	__m256 r, b0, b1, b2, b3;
+
+	b0 = _mm256_broadcast_ps((const __m128*)m2[0]);
+	b1 = _mm256_broadcast_ps((const __m128*)m2[1]);
+	b2 = _mm256_broadcast_ps((const __m128*)m2[2]);
+	b3 = _mm256_broadcast_ps((const __m128*)m2[3]);
+
+	for(i=0; i<4; i+=2) {
+		r = _mm256_mul_ps(PAIR(m1[i][0], m1[i + 1][0]), b0);
+		r = _mm256_fmadd_ps(PAIR(m1[i][1], m1[i + 1][1]), b1, r);
+		r = _mm256_fmadd_ps(PAIR(m1[i][2], m1[i + 1][2]), b2, r);
+		r = _mm256_fmadd_ps(PAIR(m1[i][3], m1[i + 1][3]), b3, r);
+		_mm256_storeu_ps(res[i], r);
+	}
+}
+#undef PAIR
+#endif	/* VMATH_AVX */
+
+static void init_m4_mult(void)
+{
+	void (*func)(mat4_t, mat4_t, mat4_t) = m4_mult_scalar;
+	int cpu = vmath_cpu_features();
+
+#ifdef VMATH_SSE
+	func = m4_mult_sse;
+#endif
+#ifdef VMATH_AVX
+	if(cpu & VMATH_CPU_AVX) {
+		func = (cpu & VMATH_CPU_FMA) ? m4_mult_fma : m4_mult_avx;
+	}
+#endif
+	(void)cpu;
+
+	m4_mult_func = func;
+}
+
+void m4_mult(mat4_t res, mat4_t m1, mat4_t m2)
+{
+	vmath_once(&m4_mult_once, init_m4_mult);
+	m4_mult_func(res, m1, m2);
+}
+
 void m4_set_translation(mat4_t m, scalar_t x, scalar_t y, scalar_t z)
 {
 	m4_identity(m);
@@ -156,6 +413,39 @@ void m4_rotate_quat(mat4_t m, quat_t q)
 	m4_mult(m, m, rm);
 }
 
+quat_t m4_rotation_quat(mat4_t m)
+{
+	static const int next[3] = {1, 2, 0};
+	scalar_t q[4], trace, root;
+	int i, j, k;
+
+	trace = m[0][0] + m[1][1] + m[2][2];
+	if(trace > 0.0) {
+		/* |w| > 1/2 */
+		root = sqrt(trace + 1.0);	/* 2w */
+		q[0] = 0.5 * root;
+		root = 0.5 / root;			/* 1 / 4w */
+		q[1] = (m[2][1] - m[1][2]) * root;
+		q[2] = (m[0][2] - m[2][0]) * root;
+		q[3] = (m[1][0] - m[0][1]) * root;
+	} else {
+		/* |w| <= 1/2, start from the largest of x, y, z */
+		i = 0;
+		if(m[1][1] > m[0][0]) i = 1;
+		if(m[2][2] > m[i][i]) i = 2;
+		j = next[i];
+		k = next[j];
+
+		root = sqrt(m[i][i] - m[j][j] - m[k][k] + 1.0);
+		q[i + 1] = 0.5 * root;
+		root = 0.5 / root;
+		q[0] = (m[k][j] - m[j][k]) * root;
+		q[j + 1] = (m[j][i] + m[i][j]) * root;
+		q[k + 1] = (m[k][i] + m[i][k]) * root;
+	}
+	return quat_cons(q[0], q[1], q[2], q[3]);
+}
+
 void m4_scale(mat4_t m, scalar_t x, scalar_t y, scalar_t z)
 {
 	mat4_t sm;
@@ -283,6 +573,123 @@ void m4_inverse(mat4_t res, mat4_t m)
 	}
 }
 
+/* ---- specialized inverses ----
+ * For matrices with a (0, 0, 0, 1) bottom row, the inverse of [A t] is
+ * [inv(A) -inv(A)t]. With an orthonormal A (rigid transformations), inv(A) is
+ * just its transpose. Otherwise it's calculated from the cross products of
+ * the rows of A, which are the columns of its adjugate.
+ */
+#define ORTHO_TOLERANCE		1e-5
+
+#ifdef VMATH_SSE
+#define SHUF_YZXW(v)	_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1))
+#endif
+
+int m4_classify(mat4_t m)
+{
+#ifdef VMATH_SSE
+	__m128 r0, r1, r2, diag, offd, err;
+#else
+	scalar_t d00, d11, d22, d01, d02, d12, err;
+#endif
+
+	if(m[3][0] != 0.0 || m[3][1] != 0.0 || m[3][2] != 0.0 || m[3][3] != 1.0) {
+		return M4_GENERAL;
+	}
+
+	/* the rows are orthonormal iff the columns are, and the column dot products
+	 * can be computed vertically from the rows: diag gets the squared lengths
+	 * of the columns, offd the dot products of each column with the next one.
+	 */
+#ifdef VMATH_SSE
+	r0 = _mm_loadu_ps(m[0]);
+	r1 = _mm_loadu_ps(m[1]);
+	r2 = _mm_loadu_ps(m[2]);
+
+	diag = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, r0), _mm_mul_ps(r1, r1)), _mm_mul_ps(r2, r2));
+	diag = _mm_sub_ps(diag, _mm_set1_ps(1.0f));
+	offd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, SHUF_YZXW(r0)), _mm_mul_ps(r1, SHUF_YZXW(r1))),
+			_mm_mul_ps(r2, SHUF_YZXW(r2)));
+
+	/* absolute values, and only the first three lanes matter */
+	err = _mm_max_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), diag), _mm_andnot_ps(_mm_set1_ps(-0.0f), offd));
+	return (_mm_movemask_ps(_mm_cmple_ps(err, _mm_set1_ps(ORTHO_TOLERANCE))) & 7) == 7 ? M4_RIGID : M4_AFFINE;
+#else
+	d00 = m[0][0] * m[0][0] + m[1][0] * m[1][0] + m[2][0] * m[2][0] - 1.0;
+	d11 = m[0][1] * m[0][1] + m[1][1] * m[1][1] + m[2][1] * m[2][1] - 1.0;
+	d22 = m[0][2] * m[0][2] + m[1][2] * m[1][2] + m[2][2] * m[2][2] - 1.0;
+	d01 = m[0][0] * m[0][1] + m[1][0] * m[1][1] + m[2][0] * m[2][1];
+	d12 = m[0][1] * m[0][2] + m[1][1] * m[1][2] + m[2][1] * m[2][2];
+	d02 = m[0][2] * m[0][0] + m[1][2] * m[1][0] + m[2][2] * m[2][0];
+
+	err = MAX(MAX(fabs(d00), fabs(d11)), fabs(d22));
+	err = MAX(err, MAX(MAX(fabs(d01), fabs(d12)), fabs(d02)));
+	return err <= ORTHO_TOLERANCE ? M4_RIGID : M4_AFFINE;
+#endif
+}
+
+#ifdef VMATH_SSE
+/* rows 0-2 of the result are the columns of x0-x2, and xlat is its translation */
+static void store_inverse(mat3x4_t res, __m128 x0, __m128 x1, __m128 x2, __m128 xlat)
+{
+	_MM_TRANSPOSE4_PS(x0, x1, x2, xlat);
+
+	_mm_storeu_ps(res[0], x0);
+	_mm_storeu_ps(res[1], x1);
+	_mm_storeu_ps(res[2], x2);
+}
+
+static __m128 cross_sse(__m128 a, __m128 b)
+{
+	__m128 c = _mm_sub_ps(_mm_mul_ps(a, SHUF_YZXW(b)), _mm_mul_ps(SHUF_YZXW(a), b));
+	return SHUF_YZXW(c);
+}
+
+/* -(x0 * t.x + x1 * t.y + x2 * t.z) */
+static __m128 neg_xform(__m128 x0, __m128 x1, __m128 x2, const scalar_t *t)
+{
+	__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x0, _mm_set1_ps(t[0])),
+				_mm_mul_ps(x1, _mm_set1_ps(t[1]))), _mm_mul_ps(x2, _mm_set1_ps(t[2])));
+	return _mm_sub_ps(_mm_setzero_ps(), v);
+}
+#endif	/* VMATH_SSE */
+
+/* the top 3 rows of a mat4_t are a valid mat3x4_t, so the 4x4 affine inverses
+ * are the 3x4 ones, plus the bottom row.
+ */
+void m4_inverse_rigid(mat4_t res, mat4_t m)
+{
+	m3x4_inverse_rigid(res, m);
+	res[3][0] = res[3][1] = res[3][2] = 0.0;
+	res[3][3] = 1.0;
+}
+
+void m4_inverse_affine(mat4_t res, mat4_t m)
+{
+	m3x4_inverse(res, m);
+	res[3][0] = res[3][1] = res[3][2] = 0.0;
+	res[3][3] = 1.0;
+}
+
+int m4_inverse_auto(mat4_t res, mat4_t m)
+{
+	int type = m4_classify(m);
+
+	switch(type) {
+	case M4_RIGID:
+		m4_inverse_rigid(res, m);
+		break;
+
+	case M4_AFFINE:
+		m4_inverse_affine(res, m);
+		break;
+
+	default:
+		m4_inverse(res, m);
+	}
+	return type;
+}
+
 void m4_print(FILE *fp, mat4_t m)
 {
 	int i;
@@ -290,3 +697,168 @@ void m4_print(FILE *fp, mat4_t m)
 		fprintf(fp, "[ %12.5f %12.5f %12.5f %12.5f ]\n", (float)m[i][0], (float)m[i][1], (float)m[i][2], (float)m[i][3]);
 	}
 }
+
+/* ---- affine 3x4 matrices ---- */
+
+#ifdef VMATH_SSE
+/* like m4_mult_sse, the last row of m2 being (0, 0, 0, 1) adds m1[i][3] to
+ * the last element of each row.
+ */
+static inline void m3x4_mult_sse(mat3x4_t res, mat3x4_t m1, mat3x4_t m2)
+{
+	int i;
+	__m128 r, b0, b1, b2;
+
+	b0 = _mm_loadu_ps(m2[0]);
+	b1 = _mm_loadu_ps(m2[1]);
+	b2 = _mm_loadu_ps(m2[2]);
+
+	for(i=0; i<3; i++) {
+		r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(m1[i][0]), b0), _mm_mul_ps(_mm_set1_ps(m1[i][1]), b1));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(m1[i][2]), b2));
+		r = _mm_add_ps(r, _mm_set_ps(m1[i][3], 0, 0, 0));
+		_mm_storeu_ps(res[i], r);
+	}
+}
+#else
+static void m3x4_mult_scalar(mat3x4_t res, mat3x4_t m1, mat3x4_t m2)
+{
+	int i;
+	mat3x4_t tmp;
+
+	for(i=0; i<3; i++) {
+		tmp[i][0] = m1[i][0] * m2[0][0] + m1[i][1] * m2[1][0] + m1[i][2] * m2[2][0];
+		tmp[i][1] = m1[i][0] * m2[0][1] + m1[i][1] * m2[1][1] + m1[i][2] * m2[2][1];
+		tmp[i][2] = m1[i][0] * m2[0][2] + m1[i][1] * m2[1][2] + m1[i][2] * m2[2][2];
+		tmp[i][3] = m1[i][0] * m2[0][3] + m1[i][1] * m2[1][3] + m1[i][2] * m2[2][3] + m1[i][3];
+	}
+	m3x4_copy(res, tmp);
+}
+#endif
+
+void m3x4_mult(mat3x4_t res, mat3x4_t m1, mat3x4_t m2)
+{
+#ifdef VMATH_SSE
+	m3x4_mult_sse(res, m1, m2);
+#else
+	m3x4_mult_scalar(res, m1, m2);
+#endif
+}
+
+void m3x4_mult_array(mat3x4_t *res, mat3x4_t *m1, mat3x4_t *m2, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+#ifdef VMATH_SSE
+		m3x4_mult_sse(res[i], m1[i], m2[i]);
+#else
+		m3x4_mult_scalar(res[i], m1[i], m2[i]);
+#endif
+	}
+}
+
+static inline void inverse_affine(mat3x4_t res, mat3x4_t m)
+{
+#ifdef VMATH_SSE
+	__m128 a = _mm_loadu_ps(m[0]);
+	__m128 b = _mm_loadu_ps(m[1]);
+	__m128 c = _mm_loadu_ps(m[2]);
+	__m128 x0, x1, x2, det;
+	scalar_t t[3];
+
+	t[0] = m[0][3];
+	t[1] = m[1][3];
+	t[2] = m[2][3];
+
+	x0 = cross_sse(b, c);
+	x1 = cross_sse(c, a);
+	x2 = cross_sse(a, b);
+
+	/* det = a . (b x c), broadcast to all lanes */
+	det = _mm_mul_ps(a, x0);
+	det = _mm_add_ps(_mm_add_ps(_mm_shuffle_ps(det, det, 0x00), _mm_shuffle_ps(det, det, 0x55)),
+			_mm_shuffle_ps(det, det, 0xaa));
+	det = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	/* x0, x1, x2 are the columns of inv(A) */
+	x0 = _mm_mul_ps(x0, det);
+	x1 = _mm_mul_ps(x1, det);
+	x2 = _mm_mul_ps(x2, det);
+
+	store_inverse(res, x0, x1, x2, neg_xform(x0, x1, x2, t));
+#else
+	int i;
+	scalar_t inv_det;
+	mat3x4_t tmp;
+
+	tmp[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+	tmp[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+	tmp[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+	tmp[0][1] = m[2][1] * m[0][2] - m[2][2] * m[0][1];
+	tmp[1][1] = m[2][2] * m[0][0] - m[2][0] * m[0][2];
+	tmp[2][1] = m[2][0] * m[0][1] - m[2][1] * m[0][0];
+	tmp[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+	tmp[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+	tmp[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+
+	inv_det = 1.0 / (m[0][0] * tmp[0][0] + m[0][1] * tmp[1][0] + m[0][2] * tmp[2][0]);
+
+	for(i=0; i<3; i++) {
+		tmp[i][0] *= inv_det;
+		tmp[i][1] *= inv_det;
+		tmp[i][2] *= inv_det;
+		tmp[i][3] = -(tmp[i][0] * m[0][3] + tmp[i][1] * m[1][3] + tmp[i][2] * m[2][3]);
+	}
+	m3x4_copy(res, tmp);
+#endif
+}
+
+void m3x4_inverse(mat3x4_t res, mat3x4_t m)
+{
+	inverse_affine(res, m);
+}
+
+void m3x4_inverse_array(mat3x4_t *res, mat3x4_t *m, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		inverse_affine(res[i], m[i]);
+	}
+}
+
+void m3x4_inverse_rigid(mat3x4_t res, mat3x4_t m)
+{
+#ifdef VMATH_SSE
+	__m128 r0 = _mm_loadu_ps(m[0]);
+	__m128 r1 = _mm_loadu_ps(m[1]);
+	__m128 r2 = _mm_loadu_ps(m[2]);
+	scalar_t t[3];
+
+	t[0] = m[0][3];
+	t[1] = m[1][3];
+	t[2] = m[2][3];
+	/* the inverse is the transpose of the rows, with the negated translation
+	 * transformed by the transpose.
+	 */
+	store_inverse(res, r0, r1, r2, neg_xform(r0, r1, r2, t));
+#else
+	int i, j;
+	mat3x4_t tmp;
+
+	for(i=0; i<3; i++) {
+		for(j=0; j<3; j++) {
+			tmp[i][j] = m[j][i];
+		}
+		tmp[i][3] = -(m[0][i] * m[0][3] + m[1][i] * m[1][3] + m[2][i] * m[2][3]);
+	}
+	m3x4_copy(res, tmp);
+#endif
+}
+
+void m3x4_print(FILE *fp, mat3x4_t m)
+{
+	int i;
+	for(i=0; i<3; i++) {
+		fprintf(fp, "[ %12.5f %12.5f %12.5f %12.5f ]\n", (float)m[i][0], (float)m[i][1], (float)m[i][2], (float)m[i][3]);
+	}
+}
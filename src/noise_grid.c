@@ -0,0 +1,754 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* batch evaluation of the perlin noise functions, over regular grids or
+ * arrays of points. The lattice setup of each grid column is done once per
+ * octave, and the gradients of each row of lattice cells are gathered once
+ * and reused by all the rows of samples falling in the same cells. The
+ * interpolation itself runs on 4 samples at a time, with exactly the same
+ * operations as noise2/noise3, so the results are identical to calling the
+ * scalar functions for each sample.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include "vmath.h"
+#include "vmath_noise.h"
+#include "vmath_simd.h"
+#include "vmath_sched.h"
+
+/* number of points processed at a time by the _points functions */
+#define PT_CHUNK	64
+
+enum { MODE_NOISE, MODE_FBM, MODE_TURB };
+
+/* lattice data of a run of samples: per-sample x interpolants, y and z
+ * interpolants which are either per-sample (step 1) or constant (step 0),
+ * and the gradient of each cell corner, as separate component arrays of
+ * gstride elements each.
+ */
+struct lattice {
+	const scalar_t *rx0, *rx1, *sx;
+	const scalar_t *ry0, *ry1, *sy;
+	const scalar_t *rz0, *rz1, *sz;
+	int ystep, zstep;
+	const scalar_t *grad;
+	int gstride;
+};
+
+/* rows of a grid split across threads, failed gets 1 for the chunks which
+ * failed to allocate their column data
+ */
+struct grid_job {
+	const noise_ctx_t *ctx;
+	scalar_t *res;
+	int xsz, ysz;
+	scalar_t x0, y0, z0, dx, dy, dz;
+	int octaves, mode;
+	int chunk_size;
+	char *failed;
+};
+
+/* per-octave lattice data of the grid columns */
+struct column_data {
+	int *px0, *px1;		/* perm[bx0], perm[bx1] */
+	scalar_t *rx0, *rx1, *sx;
+	scalar_t *grad;		/* gradients of the current row of cells */
+	int cur_by, cur_bz;	/* ... which are those */
+};
+
+static int grid2(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int octaves, int mode);
+static int grid3(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int octaves, int mode);
+static int grid3_rows(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int row0, int row1,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int octaves, int mode);
+static int grid3_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int octaves, int mode, int num_threads, int chunk_size);
+static void points2(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count,
+		int octaves, int mode);
+static void points3(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count,
+		int octaves, int mode);
+
+static struct column_data *alloc_columns(int xsz, int octaves, int ncomp);
+static void init_columns(const noise_ctx_t *ctx, struct column_data *col, int xsz,
+		scalar_t x0, scalar_t dx, int octaves);
+static void fill_grad2(const noise_ctx_t *ctx, struct column_data *col, int xsz, int by0, int by1);
+static void fill_grad3(const noise_ctx_t *ctx, struct column_data *col, int xsz,
+		int by0, int by1, int bz0, int bz1);
+
+static void eval2(scalar_t *res, int count, const struct lattice *lat, scalar_t freq, int mode, int first);
+static void eval3(scalar_t *res, int count, const struct lattice *lat, scalar_t freq, int mode, int first);
+
+
+int noise2_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy)
+{
+	return grid2(ctx, res, xsz, ysz, x0, y0, dx, dy, 1, MODE_NOISE);
+}
+
+int noise3_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz)
+{
+	return grid3(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, 1, MODE_NOISE);
+}
+
+int fbm2_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int octaves)
+{
+	return grid2(ctx, res, xsz, ysz, x0, y0, dx, dy, octaves, MODE_FBM);
+}
+
+int fbm3_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves)
+{
+	return grid3(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, octaves, MODE_FBM);
+}
+
+int turbulence2_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int octaves)
+{
+	return grid2(ctx, res, xsz, ysz, x0, y0, dx, dy, octaves, MODE_TURB);
+}
+
+int turbulence3_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves)
+{
+	return grid3(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, octaves, MODE_TURB);
+}
+
+int noise3_grid_ctx_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int num_threads, int chunk_size)
+{
+	return grid3_mt(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, 1, MODE_NOISE,
+			num_threads, chunk_size);
+}
+
+int fbm3_grid_ctx_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves,
+		int num_threads, int chunk_size)
+{
+	return grid3_mt(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, octaves, MODE_FBM,
+			num_threads, chunk_size);
+}
+
+int turbulence3_grid_ctx_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves,
+		int num_threads, int chunk_size)
+{
+	return grid3_mt(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, octaves, MODE_TURB,
+			num_threads, chunk_size);
+}
+
+void noise2_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count)
+{
+	points2(ctx, res, pts, count, 1, MODE_NOISE);
+}
+
+void noise3_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count)
+{
+	points3(ctx, res, pts, count, 1, MODE_NOISE);
+}
+
+void fbm2_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count, int octaves)
+{
+	points2(ctx, res, pts, count, octaves, MODE_FBM);
+}
+
+void fbm3_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count, int octaves)
+{
+	points3(ctx, res, pts, count, octaves, MODE_FBM);
+}
+
+void turbulence2_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count, int octaves)
+{
+	points2(ctx, res, pts, count, octaves, MODE_TURB);
+}
+
+void turbulence3_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count, int octaves)
+{
+	points3(ctx, res, pts, count, octaves, MODE_TURB);
+}
+
+
+static int grid2(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int octaves, int mode)
+{
+	int i, j, o, by0, by1;
+	scalar_t y, yf, freq, ry0, ry1, sy;
+	struct column_data *col;
+	struct lattice lat;
+
+	if(xsz <= 0 || ysz <= 0) return 0;
+	if(octaves < 1) {
+		for(i=0; i<xsz * ysz; i++) res[i] = 0.0;
+		return 0;
+	}
+
+	if(!(col = alloc_columns(xsz, octaves, 8))) {
+		return -1;
+	}
+	init_columns(ctx, col, xsz, x0, dx, octaves);
+
+	lat.ry0 = &ry0;
+	lat.ry1 = &ry1;
+	lat.sy = &sy;
+	lat.ystep = 0;
+	lat.gstride = xsz;
+
+	for(j=0; j<ysz; j++) {
+		y = y0 + j * dy;
+		freq = 1.0f;
+
+		for(o=0; o<octaves; o++) {
+			yf = y * freq;
+			setup(yf, by0, by1, ry0, ry1);
+			sy = s_curve(ry0);
+
+			if(by0 != col[o].cur_by) {
+				fill_grad2(ctx, col + o, xsz, by0, by1);
+			}
+
+			lat.rx0 = col[o].rx0;
+			lat.rx1 = col[o].rx1;
+			lat.sx = col[o].sx;
+			lat.grad = col[o].grad;
+			eval2(res, xsz, &lat, freq, mode, o == 0);
+
+			freq *= 2.0f;
+		}
+		res += xsz;
+	}
+
+	free(col);
+	return 0;
+}
+
+static int grid3(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int octaves, int mode)
+{
+	if(xsz <= 0 || ysz <= 0 || zsz <= 0) return 0;
+	return grid3_rows(ctx, res, xsz, ysz, 0, ysz * zsz, x0, y0, z0, dx, dy, dz, octaves, mode);
+}
+
+/* rows [row0, row1) of a 3D grid, row k * ysz + j being the xsz samples at
+ * (j, k). res is the start of the whole grid.
+ */
+static int grid3_rows(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int row0, int row1,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int octaves, int mode)
+{
+	int i, j, k, o, r, by0, by1, bz0, bz1;
+	scalar_t y, z, yf, zf, freq, ry0, ry1, sy, rz0, rz1, sz;
+	struct column_data *col;
+	struct lattice lat;
+
+	res += (size_t)row0 * xsz;
+	if(octaves < 1) {
+		for(i=0; i<xsz * (row1 - row0); i++) res[i] = 0.0;
+		return 0;
+	}
+
+	if(!(col = alloc_columns(xsz, octaves, 24))) {
+		return -1;
+	}
+	init_columns(ctx, col, xsz, x0, dx, octaves);
+
+	lat.ry0 = &ry0;
+	lat.ry1 = &ry1;
+	lat.sy = &sy;
+	lat.rz0 = &rz0;
+	lat.rz1 = &rz1;
+	lat.sz = &sz;
+	lat.ystep = lat.zstep = 0;
+	lat.gstride = xsz;
+
+	for(r=row0; r<row1; r++) {
+		k = r / ysz;
+		j = r - k * ysz;
+		z = z0 + k * dz;
+		y = y0 + j * dy;
+		freq = 1.0f;
+
+		for(o=0; o<octaves; o++) {
+			yf = y * freq;
+			zf = z * freq;
+			setup(yf, by0, by1, ry0, ry1);
+			setup(zf, bz0, bz1, rz0, rz1);
+			sy = s_curve(ry0);
+			sz = s_curve(rz0);
+
+			if(by0 != col[o].cur_by || bz0 != col[o].cur_bz) {
+				fill_grad3(ctx, col + o, xsz, by0, by1, bz0, bz1);
+			}
+
+			lat.rx0 = col[o].rx0;
+			lat.rx1 = col[o].rx1;
+			lat.sx = col[o].sx;
+			lat.grad = col[o].grad;
+			eval3(res, xsz, &lat, freq, mode, o == 0);
+
+			freq *= 2.0f;
+		}
+		res += xsz;
+	}
+
+	free(col);
+	return 0;
+}
+
+static void grid3_job(int start, int end, void *cls)
+{
+	struct grid_job *job = cls;
+
+	if(grid3_rows(job->ctx, job->res, job->xsz, job->ysz, start, end, job->x0, job->y0, job->z0,
+				job->dx, job->dy, job->dz, job->octaves, job->mode) == -1) {
+		job->failed[start / job->chunk_size] = 1;
+	}
+}
+
+/* the rows are independent, so they are split across the threads, and each
+ * chunk of rows keeps its own column data
+ */
+static int grid3_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int octaves, int mode, int num_threads, int chunk_size)
+{
+	int i, num_chunks, res_val = 0;
+	struct grid_job job;
+
+	if(xsz <= 0 || ysz <= 0 || zsz <= 0) return 0;
+
+	job.ctx = ctx;
+	job.res = res;
+	job.xsz = xsz;
+	job.ysz = ysz;
+	job.x0 = x0;
+	job.y0 = y0;
+	job.z0 = z0;
+	job.dx = dx;
+	job.dy = dy;
+	job.dz = dz;
+	job.octaves = octaves;
+	job.mode = mode;
+	job.chunk_size = vmath_chunk_size(ysz * zsz, num_threads, chunk_size, 1);
+
+	num_chunks = (ysz * zsz - 1) / job.chunk_size + 1;
+	if(!(job.failed = calloc(num_chunks, 1))) {
+		return -1;
+	}
+	vmath_parallel_for(ysz * zsz, num_threads, job.chunk_size, grid3_job, &job);
+
+	for(i=0; i<num_chunks; i++) {
+		if(job.failed[i]) res_val = -1;
+	}
+	free(job.failed);
+	return res_val;
+}
+
+static void points2(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count,
+		int octaves, int mode)
+{
+	int i, o, n, bx0, bx1, by0, by1, px0, px1, b00, b10, b01, b11;
+	scalar_t x, y, freq;
+	scalar_t rx0[PT_CHUNK], rx1[PT_CHUNK], sx[PT_CHUNK];
+	scalar_t ry0[PT_CHUNK], ry1[PT_CHUNK], sy[PT_CHUNK];
+	scalar_t grad[8 * PT_CHUNK];
+	struct lattice lat;
+
+	lat.rx0 = rx0; lat.rx1 = rx1; lat.sx = sx;
+	lat.ry0 = ry0; lat.ry1 = ry1; lat.sy = sy;
+	lat.ystep = 1;
+	lat.grad = grad;
+	lat.gstride = PT_CHUNK;
+
+	while(count > 0) {
+		n = count < PT_CHUNK ? count : PT_CHUNK;
+
+		if(octaves < 1) {
+			for(i=0; i<n; i++) res[i] = 0.0;
+		}
+
+		freq = 1.0f;
+		for(o=0; o<octaves; o++) {
+			for(i=0; i<n; i++) {
+				x = pts[i].x * freq;
+				y = pts[i].y * freq;
+				setup(x, bx0, bx1, rx0[i], rx1[i]);
+				setup(y, by0, by1, ry0[i], ry1[i]);
+				sx[i] = s_curve(rx0[i]);
+				sy[i] = s_curve(ry0[i]);
+
+				px0 = ctx->perm[bx0];
+				px1 = ctx->perm[bx1];
+				b00 = ctx->perm[px0 + by0];
+				b10 = ctx->perm[px1 + by0];
+				b01 = ctx->perm[px0 + by1];
+				b11 = ctx->perm[px1 + by1];
+
+				grad[i] = ctx->grad2[b00].x;
+				grad[PT_CHUNK + i] = ctx->grad2[b00].y;
+				grad[2 * PT_CHUNK + i] = ctx->grad2[b10].x;
+				grad[3 * PT_CHUNK + i] = ctx->grad2[b10].y;
+				grad[4 * PT_CHUNK + i] = ctx->grad2[b01].x;
+				grad[5 * PT_CHUNK + i] = ctx->grad2[b01].y;
+				grad[6 * PT_CHUNK + i] = ctx->grad2[b11].x;
+				grad[7 * PT_CHUNK + i] = ctx->grad2[b11].y;
+			}
+			eval2(res, n, &lat, freq, mode, o == 0);
+			freq *= 2.0f;
+		}
+
+		pts += n;
+		res += n;
+		count -= n;
+	}
+}
+
+static void points3(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count,
+		int octaves, int mode)
+{
+	int i, c, o, n, bx0, bx1, by0, by1, bz0, bz1, px0, px1;
+	int b[4];
+	scalar_t x, y, z, freq;
+	scalar_t rx0[PT_CHUNK], rx1[PT_CHUNK], sx[PT_CHUNK];
+	scalar_t ry0[PT_CHUNK], ry1[PT_CHUNK], sy[PT_CHUNK];
+	scalar_t rz0[PT_CHUNK], rz1[PT_CHUNK], sz[PT_CHUNK];
+	scalar_t grad[24 * PT_CHUNK];
+	const vec3_t *g;
+	struct lattice lat;
+
+	lat.rx0 = rx0; lat.rx1 = rx1; lat.sx = sx;
+	lat.ry0 = ry0; lat.ry1 = ry1; lat.sy = sy;
+	lat.rz0 = rz0; lat.rz1 = rz1; lat.sz = sz;
+	lat.ystep = lat.zstep = 1;
+	lat.grad = grad;
+	lat.gstride = PT_CHUNK;
+
+	while(count > 0) {
+		n = count < PT_CHUNK ? count : PT_CHUNK;
+
+		if(octaves < 1) {
+			for(i=0; i<n; i++) res[i] = 0.0;
+		}
+
+		freq = 1.0f;
+		for(o=0; o<octaves; o++) {
+			for(i=0; i<n; i++) {
+				x = pts[i].x * freq;
+				y = pts[i].y * freq;
+				z = pts[i].z * freq;
+				setup(x, bx0, bx1, rx0[i], rx1[i]);
+				setup(y, by0, by1, ry0[i], ry1[i]);
+				setup(z, bz0, bz1, rz0[i], rz1[i]);
+				sx[i] = s_curve(rx0[i]);
+				sy[i] = s_curve(ry0[i]);
+				sz[i] = s_curve(rz0[i]);
+
+				px0 = ctx->perm[bx0];
+				px1 = ctx->perm[bx1];
+				b[0] = ctx->perm[px0 + by0];
+				b[1] = ctx->perm[px1 + by0];
+				b[2] = ctx->perm[px0 + by1];
+				b[3] = ctx->perm[px1 + by1];
+
+				for(c=0; c<8; c++) {
+					g = ctx->grad3 + b[c & 3] + (c < 4 ? bz0 : bz1);
+					grad[(c * 3) * PT_CHUNK + i] = g->x;
+					grad[(c * 3 + 1) * PT_CHUNK + i] = g->y;
+					grad[(c * 3 + 2) * PT_CHUNK + i] = g->z;
+				}
+			}
+			eval3(res, n, &lat, freq, mode, o == 0);
+			freq *= 2.0f;
+		}
+
+		pts += n;
+		res += n;
+		count -= n;
+	}
+}
+
+/* allocates the column data of all octaves, and the arrays they point to, in one block */
+static struct column_data *alloc_columns(int xsz, int octaves, int ncomp)
+{
+	int o;
+	char *ptr;
+	struct column_data *col;
+	size_t col_size = (2 * sizeof(int) + (3 + ncomp) * sizeof(scalar_t)) * xsz;
+
+	if(!(col = malloc(octaves * (sizeof *col + col_size)))) {
+		return 0;
+	}
+	ptr = (char*)(col + octaves);
+
+	for(o=0; o<octaves; o++) {
+		col[o].rx0 = (scalar_t*)ptr;
+		col[o].rx1 = col[o].rx0 + xsz;
+		col[o].sx = col[o].rx1 + xsz;
+		col[o].grad = col[o].sx + xsz;
+		col[o].px0 = (int*)(col[o].grad + ncomp * xsz);
+		col[o].px1 = col[o].px0 + xsz;
+		ptr += col_size;
+	}
+	return col;
+}
+
+static void init_columns(const noise_ctx_t *ctx, struct column_data *col, int xsz,
+		scalar_t x0, scalar_t dx, int octaves)
+{
+	int i, o, bx0, bx1;
+	scalar_t x, freq = 1.0f;
+
+	for(o=0; o<octaves; o++) {
+		for(i=0; i<xsz; i++) {
+			x = x0 + i * dx;
+			x = x * freq;
+			setup(x, bx0, bx1, col[o].rx0[i], col[o].rx1[i]);
+			col[o].sx[i] = s_curve(col[o].rx0[i]);
+			col[o].px0[i] = ctx->perm[bx0];
+			col[o].px1[i] = ctx->perm[bx1];
+		}
+		col[o].cur_by = col[o].cur_bz = -1;
+		freq *= 2.0f;
+	}
+}
+
+/* gathers the corner gradients of the row of cells (by0, bz0). Consecutive
+ * columns in the same cell (same px0) just copy the previous column.
+ */
+static void fill_grad2(const noise_ctx_t *ctx, struct column_data *col, int xsz, int by0, int by1)
+{
+	int i, c, b[4];
+	scalar_t *g = col->grad;
+
+	for(i=0; i<xsz; i++) {
+		if(i > 0 && col->px0[i] == col->px0[i - 1]) {
+			for(c=0; c<8; c++) {
+				g[c * xsz + i] = g[c * xsz + i - 1];
+			}
+			continue;
+		}
+		b[0] = ctx->perm[col->px0[i] + by0];
+		b[1] = ctx->perm[col->px1[i] + by0];
+		b[2] = ctx->perm[col->px0[i] + by1];
+		b[3] = ctx->perm[col->px1[i] + by1];
+
+		for(c=0; c<4; c++) {
+			g[(c * 2) * xsz + i] = ctx->grad2[b[c]].x;
+			g[(c * 2 + 1) * xsz + i] = ctx->grad2[b[c]].y;
+		}
+	}
+	col->cur_by = by0;
+}
+
+static void fill_grad3(const noise_ctx_t *ctx, struct column_data *col, int xsz,
+		int by0, int by1, int bz0, int bz1)
+{
+	int i, c, b[4];
+	const vec3_t *gptr;
+	scalar_t *g = col->grad;
+
+	for(i=0; i<xsz; i++) {
+		if(i > 0 && col->px0[i] == col->px0[i - 1]) {
+			for(c=0; c<24; c++) {
+				g[c * xsz + i] = g[c * xsz + i - 1];
+			}
+			continue;
+		}
+		b[0] = ctx->perm[col->px0[i] + by0];
+		b[1] = ctx->perm[col->px1[i] + by0];
+		b[2] = ctx->perm[col->px0[i] + by1];
+		b[3] = ctx->perm[col->px1[i] + by1];
+
+		for(c=0; c<8; c++) {
+			gptr = ctx->grad3 + b[c & 3] + (c < 4 ? bz0 : bz1);
+			g[(c * 3) * xsz + i] = gptr->x;
+			g[(c * 3 + 1) * xsz + i] = gptr->y;
+			g[(c * 3 + 2) * xsz + i] = gptr->z;
+		}
+	}
+	col->cur_by = by0;
+	col->cur_bz = bz0;
+}
+
+
+/* corner c, gradient component k, sample i */
+#define GRAD(c, k)	lat->grad[((c) * ncomp + (k)) * lat->gstride + i]
+
+#ifdef VMATH_SSE
+#define LD(p)			_mm_loadu_ps((p) + i)
+#define LDSTEP(p, s)	((s) ? _mm_loadu_ps((p) + i) : _mm_set1_ps(*(p)))
+#define GRADV(c, k)		_mm_loadu_ps(&GRAD(c, k))
+#define LERPV(a, b, t)	_mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t))
+
+/* combines the noise value of an octave with the previous ones */
+#define ACCUMV(n) \
+	do { \
+		if(mode == MODE_NOISE) { \
+			_mm_storeu_ps(res + i, n); \
+		} else { \
+			n = _mm_div_ps(n, vfreq); \
+			if(mode == MODE_TURB) n = _mm_andnot_ps(signmask, n); \
+			_mm_storeu_ps(res + i, _mm_add_ps(first ? _mm_setzero_ps() : _mm_loadu_ps(res + i), n)); \
+		} \
+	} while(0)
+#endif
+
+#define ACCUM(n) \
+	do { \
+		if(mode == MODE_NOISE) { \
+			res[i] = n; \
+		} else { \
+			res[i] = (first ? 0.0f : res[i]) + (mode == MODE_TURB ? fabs(n / freq) : n / freq); \
+		} \
+	} while(0)
+
+static void eval2(scalar_t *res, int count, const struct lattice *lat, scalar_t freq, int mode, int first)
+{
+	int i = 0;
+	const int ncomp = 2;
+	scalar_t rx0, rx1, ry0, ry1, u, v, a, b, n;
+
+#ifdef VMATH_SSE
+	__m128 vrx0, vrx1, vry0, vry1, vu, vv, va, vb, vn;
+	__m128 vfreq = _mm_set1_ps(freq);
+	__m128 signmask = _mm_set1_ps(-0.0f);
+
+	for(; i<count - 3; i+=4) {
+		vrx0 = LD(lat->rx0);
+		vrx1 = LD(lat->rx1);
+		vry0 = LDSTEP(lat->ry0, lat->ystep);
+		vry1 = LDSTEP(lat->ry1, lat->ystep);
+
+		vu = _mm_add_ps(_mm_mul_ps(GRADV(0, 0), vrx0), _mm_mul_ps(GRADV(0, 1), vry0));
+		vv = _mm_add_ps(_mm_mul_ps(GRADV(1, 0), vrx1), _mm_mul_ps(GRADV(1, 1), vry0));
+		va = LERPV(vu, vv, LD(lat->sx));
+
+		vu = _mm_add_ps(_mm_mul_ps(GRADV(2, 0), vrx0), _mm_mul_ps(GRADV(2, 1), vry1));
+		vv = _mm_add_ps(_mm_mul_ps(GRADV(3, 0), vrx1), _mm_mul_ps(GRADV(3, 1), vry1));
+		vb = LERPV(vu, vv, LD(lat->sx));
+
+		vn = LERPV(va, vb, LDSTEP(lat->sy, lat->ystep));
+		ACCUMV(vn);
+	}
+#endif
+
+	for(; i<count; i++) {
+		rx0 = lat->rx0[i];
+		rx1 = lat->rx1[i];
+		ry0 = lat->ry0[i * lat->ystep];
+		ry1 = lat->ry1[i * lat->ystep];
+
+		u = GRAD(0, 0) * rx0 + GRAD(0, 1) * ry0;
+		v = GRAD(1, 0) * rx1 + GRAD(1, 1) * ry0;
+		a = lerp(u, v, lat->sx[i]);
+
+		u = GRAD(2, 0) * rx0 + GRAD(2, 1) * ry1;
+		v = GRAD(3, 0) * rx1 + GRAD(3, 1) * ry1;
+		b = lerp(u, v, lat->sx[i]);
+
+		n = lerp(a, b, lat->sy[i * lat->ystep]);
+		ACCUM(n);
+	}
+}
+
+static void eval3(scalar_t *res, int count, const struct lattice *lat, scalar_t freq, int mode, int first)
+{
+	int i = 0;
+	const int ncomp = 3;
+	scalar_t rx0, rx1, ry0, ry1, rz0, rz1, sx, sy, u, v, a, b, c, d, n;
+
+#ifdef VMATH_SSE
+	__m128 vrx0, vrx1, vry0, vry1, vrz0, vrz1, vsx, vsy, vu, vv, va, vb, vc, vd, vn;
+	__m128 vfreq = _mm_set1_ps(freq);
+	__m128 signmask = _mm_set1_ps(-0.0f);
+
+#define DOTV(c, x, y, z) \
+	_mm_add_ps(_mm_add_ps(_mm_mul_ps(GRADV(c, 0), x), _mm_mul_ps(GRADV(c, 1), y)), \
+			_mm_mul_ps(GRADV(c, 2), z))
+
+	for(; i<count - 3; i+=4) {
+		vrx0 = LD(lat->rx0);
+		vrx1 = LD(lat->rx1);
+		vry0 = LDSTEP(lat->ry0, lat->ystep);
+		vry1 = LDSTEP(lat->ry1, lat->ystep);
+		vrz0 = LDSTEP(lat->rz0, lat->zstep);
+		vrz1 = LDSTEP(lat->rz1, lat->zstep);
+		vsx = LD(lat->sx);
+		vsy = LDSTEP(lat->sy, lat->ystep);
+
+		vu = DOTV(0, vrx0, vry0, vrz0);
+		vv = DOTV(1, vrx1, vry0, vrz0);
+		va = LERPV(vu, vv, vsx);
+		vu = DOTV(2, vrx0, vry1, vrz0);
+		vv = DOTV(3, vrx1, vry1, vrz0);
+		vb = LERPV(vu, vv, vsx);
+		vc = LERPV(va, vb, vsy);
+
+		vu = DOTV(4, vrx0, vry0, vrz1);
+		vv = DOTV(5, vrx1, vry0, vrz1);
+		va = LERPV(vu, vv, vsx);
+		vu = DOTV(6, vrx0, vry1, vrz1);
+		vv = DOTV(7, vrx1, vry1, vrz1);
+		vb = LERPV(vu, vv, vsx);
+		vd = LERPV(va, vb, vsy);
+
+		vn = LERPV(vc, vd, LDSTEP(lat->sz, lat->zstep));
+		ACCUMV(vn);
+	}
+#undef DOTV
+#endif
+
+#define DOT(c, x, y, z)	(GRAD(c, 0) * x + GRAD(c, 1) * y + GRAD(c, 2) * z)
+
+	for(; i<count; i++) {
+		rx0 = lat->rx0[i];
+		rx1 = lat->rx1[i];
+		ry0 = lat->ry0[i * lat->ystep];
+		ry1 = lat->ry1[i * lat->ystep];
+		rz0 = lat->rz0[i * lat->zstep];
+		rz1 = lat->rz1[i * lat->zstep];
+		sx = lat->sx[i];
+		sy = lat->sy[i * lat->ystep];
+
+		u = DOT(0, rx0, ry0, rz0);
+		v = DOT(1, rx1, ry0, rz0);
+		a = lerp(u, v, sx);
+		u = DOT(2, rx0, ry1, rz0);
+		v = DOT(3, rx1, ry1, rz0);
+		b = lerp(u, v, sx);
+		c = lerp(a, b, sy);
+
+		u = DOT(4, rx0, ry0, rz1);
+		v = DOT(5, rx1, ry0, rz1);
+		a = lerp(u, v, sx);
+		u = DOT(6, rx0, ry1, rz1);
+		v = DOT(7, rx1, ry1, rz1);
+		b = lerp(u, v, sx);
+		d = lerp(a, b, sy);
+
+		n = lerp(c, d, lat->sz[i * lat->zstep]);
+		ACCUM(n);
+	}
+#undef DOT
+}
@@ -0,0 +1,330 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include "vmath.h"
+#include "qmc.h"
+
+/* all the sequences are computed as 32-bit fixed point fractions (unsigned int
+ * is assumed to be 32 bits), and converted like rng_frand: the top 24 bits are
+ * exactly representable, so the results are always < 1.
+ */
+#define TO_SCALAR(x)	((scalar_t)((x) >> 8) * (scalar_t)(1.0 / 16777216.0))
+
+/* Sobol direction numbers of dimensions 2 to 4, from the primitive polynomials
+ * and initial numbers of Joe and Kuo. The first dimension is the van der Corput
+ * sequence, which is just the index with its bits reversed.
+ */
+static const unsigned int sobol_dir[QMC_MAX_DIM - 1][32] = {
+	{0x80000000, 0xc0000000, 0xa0000000, 0xf0000000, 0x88000000, 0xcc000000, 0xaa000000, 0xff000000,
+	0x80800000, 0xc0c00000, 0xa0a00000, 0xf0f00000, 0x88880000, 0xcccc0000, 0xaaaa0000, 0xffff0000,
+	0x80008000, 0xc000c000, 0xa000a000, 0xf000f000, 0x88008800, 0xcc00cc00, 0xaa00aa00, 0xff00ff00,
+	0x80808080, 0xc0c0c0c0, 0xa0a0a0a0, 0xf0f0f0f0, 0x88888888, 0xcccccccc, 0xaaaaaaaa, 0xffffffff},
+	{0x80000000, 0xc0000000, 0x60000000, 0x90000000, 0xe8000000, 0x5c000000, 0x8e000000, 0xc5000000,
+	0x68800000, 0x9cc00000, 0xee600000, 0x55900000, 0x80680000, 0xc09c0000, 0x60ee0000, 0x90550000,
+	0xe8808000, 0x5cc0c000, 0x8e606000, 0xc5909000, 0x6868e800, 0x9c9c5c00, 0xeeee8e00, 0x5555c500,
+	0x8000e880, 0xc0005cc0, 0x60008e60, 0x9000c590, 0xe8006868, 0x5c009c9c, 0x8e00eeee, 0xc5005555},
+	{0x80000000, 0xc0000000, 0x20000000, 0x50000000, 0xf8000000, 0x74000000, 0xa2000000, 0x93000000,
+	0xd8800000, 0x25400000, 0x59e00000, 0xe6d00000, 0x78080000, 0xb40c0000, 0x82020000, 0xc3050000,
+	0x208f8000, 0x51474000, 0xfbea2000, 0x75d93000, 0xa0858800, 0x914e5400, 0xdbe79e00, 0x25db6d00,
+	0x58800080, 0xe54000c0, 0x79e00020, 0xb6d00050, 0x800800f8, 0xc00c0074, 0x200200a2, 0x50050093}
+};
+
+static unsigned int reverse_bits(unsigned int x)
+{
+	x = ((x >> 1) & 0x55555555) | ((x & 0x55555555) << 1);
+	x = ((x >> 2) & 0x33333333) | ((x & 0x33333333) << 2);
+	x = ((x >> 4) & 0x0f0f0f0f) | ((x & 0x0f0f0f0f) << 4);
+	x = ((x >> 8) & 0x00ff00ff) | ((x & 0x00ff00ff) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+/* Laine-Karras style permutation with Burley's constants: each bit is flipped
+ * depending only on the seed and the bits below it. Applied to reversed bits
+ * that's a nested uniform (Owen) scramble of the fraction.
+ */
+static unsigned int lk_permute(unsigned int x, unsigned int seed)
+{
+	x += seed;
+	x ^= x * 0x6c50b47c;
+	x ^= x * 0xb82f1e52;
+	x ^= x * 0xc7afe638;
+	x ^= x * 0x8d22f6e6;
+	return x;
+}
+
+static unsigned int owen_scramble(unsigned int x, unsigned int seed)
+{
+	return reverse_bits(lk_permute(reverse_bits(x), seed));
+}
+
+static unsigned int hash(unsigned int x)
+{
+	x ^= x >> 16;
+	x *= 0x21f0aaad;
+	x ^= x >> 15;
+	x *= 0x735a2d97;
+	x ^= x >> 15;
+	return x;
+}
+
+/* seeds[0] shuffles the points, seeds[i + 1] scrambles dimension i. No
+ * scrambling if seeds is null.
+ */
+static void sobol_point(scalar_t *res, unsigned int index, int ndim, const unsigned int *seeds)
+{
+	int i, j;
+	unsigned int x, idx;
+
+	if(seeds) {
+		index = owen_scramble(index, seeds[0]);
+		/* the first dimension is reverse_bits(index), so its scrambled
+		 * value is just reverse_bits(lk_permute(index))
+		 */
+		x = reverse_bits(lk_permute(index, seeds[1]));
+	} else {
+		x = reverse_bits(index);
+	}
+	res[0] = TO_SCALAR(x);
+
+	for(i=1; i<ndim; i++) {
+		const unsigned int *dir = sobol_dir[i - 1];
+
+		/* branchless and with a fixed trip count, since the bits of
+		 * scrambled indices are unpredictable
+		 */
+		x = 0;
+		for(j=0, idx=index; j<32; j++, idx >>= 1) {
+			x ^= dir[j] & (0 - (idx & 1));
+		}
+		if(seeds) {
+			x = owen_scramble(x, seeds[i + 1]);
+		}
+		res[i] = TO_SCALAR(x);
+	}
+}
+
+static const unsigned int *sobol_seeds(unsigned int *seeds, int ndim, unsigned int seed)
+{
+	int i;
+
+	if(!seed) return 0;
+	for(i=0; i<=ndim; i++) {
+		seeds[i] = hash(seed + i);
+	}
+	return seeds;
+}
+
+void qmc_sobol(scalar_t *res, unsigned int index, int ndim, unsigned int seed)
+{
+	unsigned int seeds[QMC_MAX_DIM + 1];
+	sobol_point(res, index, ndim, sobol_seeds(seeds, ndim, seed));
+}
+
+void qmc_sobol_array(scalar_t *res, unsigned int start, int count, int ndim, unsigned int seed)
+{
+	int i;
+	unsigned int seeds[QMC_MAX_DIM + 1];
+	const unsigned int *sp = sobol_seeds(seeds, ndim, seed);
+
+	for(i=0; i<count; i++) {
+		sobol_point(res + i * ndim, start + i, ndim, sp);
+	}
+}
+
+static const unsigned int primes[QMC_MAX_DIM] = {2, 3, 5, 7};
+
+static unsigned int radical_inverse(unsigned int n, unsigned int base)
+{
+	double inv = 1.0 / base, f = inv, r = 0.0;
+
+	while(n) {
+		r += (double)(n % base) * f;
+		n /= base;
+		f *= inv;
+	}
+	/* r < 1 exactly in theory, but not always after rounding */
+	r *= 4294967296.0;
+	return r >= 4294967295.0 ? 0xffffffff : (unsigned int)r;
+}
+
+static void halton_point(scalar_t *res, unsigned int index, int ndim)
+{
+	int i;
+
+	res[0] = TO_SCALAR(reverse_bits(index));
+	for(i=1; i<ndim; i++) {
+		res[i] = TO_SCALAR(radical_inverse(index, primes[i]));
+	}
+}
+
+void qmc_halton(scalar_t *res, unsigned int index, int ndim)
+{
+	halton_point(res, index, ndim);
+}
+
+void qmc_halton_array(scalar_t *res, unsigned int start, int count, int ndim)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		halton_point(res + i * ndim, start + i, ndim);
+	}
+}
+
+/* 1 / phi_d^k in 32-bit fixed point, where phi_d is the real root of
+ * x^(d + 1) = x + 1 (the golden ratio for d = 1, the plastic number for d = 2)
+ */
+static const unsigned int rd_alpha[QMC_MAX_DIM][QMC_MAX_DIM] = {
+	{0x9e3779b9},
+	{0xc13fa9a9, 0x91e10da6},
+	{0xd1b54a33, 0xabc98389, 0x8cb92ba7},
+	{0xdb4f0b91, 0xbbe05633, 0xa0f2ec76, 0x89e18285}
+};
+
+void qmc_rd(scalar_t *res, unsigned int index, int ndim)
+{
+	int i;
+	const unsigned int *alpha = rd_alpha[ndim - 1];
+
+	/* frac(0.5 + n * alpha), the multiplication wraps around modulo 1 */
+	for(i=0; i<ndim; i++) {
+		res[i] = TO_SCALAR(0x80000000 + index * alpha[i]);
+	}
+}
+
+void qmc_rd_array(scalar_t *res, unsigned int start, int count, int ndim)
+{
+	int i, j;
+	unsigned int x[QMC_MAX_DIM];
+	const unsigned int *alpha = rd_alpha[ndim - 1];
+
+	for(j=0; j<ndim; j++) {
+		x[j] = 0x80000000 + start * alpha[j];
+	}
+	for(i=0; i<count; i++) {
+		for(j=0; j<ndim; j++) {
+			*res++ = TO_SCALAR(x[j]);
+			x[j] += alpha[j];
+		}
+	}
+}
+
+/* ---- warps ---- */
+
+static inline void sphere_warp(scalar_t v, scalar_t z, scalar_t *x, scalar_t *y)
+{
+	scalar_t r = sqrt(MAX(0.0f, 1.0f - z * z));
+	scalar_t phi = (scalar_t)TWO_PI * v;
+	*x = r * cos(phi);
+	*y = r * sin(phi);
+}
+
+static inline void disk_warp(scalar_t u, scalar_t v, scalar_t *x, scalar_t *y)
+{
+	scalar_t a = 2.0f * u - 1.0f;
+	scalar_t b = 2.0f * v - 1.0f;
+	scalar_t r, phi;
+
+	if(a == 0.0f && b == 0.0f) {
+		*x = *y = 0.0f;
+		return;
+	}
+	if(a * a > b * b) {
+		r = a;
+		phi = (scalar_t)QUARTER_PI * (b / a);
+	} else {
+		r = b;
+		phi = (scalar_t)HALF_PI - (scalar_t)QUARTER_PI * (a / b);
+	}
+	*x = r * cos(phi);
+	*y = r * sin(phi);
+}
+
+static inline void cos_warp(scalar_t u, scalar_t v, scalar_t *x, scalar_t *y, scalar_t *z)
+{
+	disk_warp(u, v, x, y);
+	*z = sqrt(MAX(0.0f, 1.0f - *x * *x - *y * *y));
+}
+
+vec3_t warp_sphere(scalar_t u, scalar_t v)
+{
+	vec3_t res;
+	res.z = 1.0f - 2.0f * u;
+	sphere_warp(v, res.z, &res.x, &res.y);
+	return res;
+}
+
+vec3_t warp_hemisphere(scalar_t u, scalar_t v)
+{
+	vec3_t res;
+	res.z = 1.0f - u;
+	sphere_warp(v, res.z, &res.x, &res.y);
+	return res;
+}
+
+vec3_t warp_hemisphere_cos(scalar_t u, scalar_t v)
+{
+	vec3_t res;
+	cos_warp(u, v, &res.x, &res.y, &res.z);
+	return res;
+}
+
+vec2_t warp_disk(scalar_t u, scalar_t v)
+{
+	vec2_t res;
+	disk_warp(u, v, &res.x, &res.y);
+	return res;
+}
+
+void warp_sphere_soa(vec3_soa_t res, const scalar_t *uv, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		res.z[i] = 1.0f - 2.0f * uv[0];
+		sphere_warp(uv[1], res.z[i], res.x + i, res.y + i);
+		uv += 2;
+	}
+}
+
+void warp_hemisphere_soa(vec3_soa_t res, const scalar_t *uv, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		res.z[i] = 1.0f - uv[0];
+		sphere_warp(uv[1], res.z[i], res.x + i, res.y + i);
+		uv += 2;
+	}
+}
+
+void warp_hemisphere_cos_soa(vec3_soa_t res, const scalar_t *uv, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		cos_warp(uv[0], uv[1], res.x + i, res.y + i, res.z + i);
+		uv += 2;
+	}
+}
+
+void warp_disk_soa(vec2_soa_t res, const scalar_t *uv, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		disk_warp(uv[0], uv[1], res.x + i, res.y + i);
+		uv += 2;
+	}
+}
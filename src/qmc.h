@@ -0,0 +1,80 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_QMC_H_
+#define LIBVMATH_QMC_H_
+
+#include "vmath_types.h"
+
+/* low-discrepancy (quasi-Monte Carlo) sequences, up to this many dimensions */
+#define QMC_MAX_DIM		4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* point number index of a sequence, in ndim dimensions (1 to QMC_MAX_DIM),
+ * written to res[0] .. res[ndim - 1]. All values are in [0, 1).
+ *
+ * qmc_sobol: the Sobol sequence with the Joe-Kuo direction numbers. With a
+ * non-zero seed it's Owen-scrambled (with the hash-based nested uniform
+ * scrambling of Laine-Karras and Burley) and shuffled, which keeps the
+ * stratification of the sequence but removes its structure. Use a different
+ * seed for each pixel or each independent integral.
+ * qmc_halton: the Halton sequence, with the first ndim primes as bases.
+ * qmc_rd: Roberts' R_d sequences, additive recurrences based on the
+ * generalized golden ratio. R_2 in 2D. Very cheap, and good for any number of
+ * points, not just powers of two.
+ */
+void qmc_sobol(scalar_t *res, unsigned int index, int ndim, unsigned int seed);
+void qmc_halton(scalar_t *res, unsigned int index, int ndim);
+void qmc_rd(scalar_t *res, unsigned int index, int ndim);
+
+/* bulk versions: count consecutive points starting at point number start,
+ * interleaved, so point i is written to res[i * ndim] .. res[i * ndim + ndim - 1].
+ * The results are the same as calling the single point functions.
+ */
+void qmc_sobol_array(scalar_t *res, unsigned int start, int count, int ndim, unsigned int seed);
+void qmc_halton_array(scalar_t *res, unsigned int start, int count, int ndim);
+void qmc_rd_array(scalar_t *res, unsigned int start, int count, int ndim);
+
+/* warps of the unit square to other domains, the deterministic counterparts
+ * of the rng_* samplers, for use with 2D points of the sequences above. They
+ * are continuous and area-preserving (up to a constant), so they keep the
+ * stratification of the points.
+ *  - warp_sphere: uniform on the unit sphere.
+ *  - warp_hemisphere: uniform on the hemisphere around +Z.
+ *  - warp_hemisphere_cos: cosine-weighted on the hemisphere around +Z.
+ *  - warp_disk: uniform in the unit disk (Shirley-Chiu concentric mapping).
+ */
+vec3_t warp_sphere(scalar_t u, scalar_t v);
+vec3_t warp_hemisphere(scalar_t u, scalar_t v);
+vec3_t warp_hemisphere_cos(scalar_t u, scalar_t v);
+vec2_t warp_disk(scalar_t u, scalar_t v);
+
+/* bulk warps of count interleaved 2D points, as written by qmc_*_array with ndim = 2 */
+void warp_sphere_soa(vec3_soa_t res, const scalar_t *uv, int count);
+void warp_hemisphere_soa(vec3_soa_t res, const scalar_t *uv, int count);
+void warp_hemisphere_cos_soa(vec3_soa_t res, const scalar_t *uv, int count);
+void warp_disk_soa(vec2_soa_t res, const scalar_t *uv, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_QMC_H_ */
@@ -56,6 +56,17 @@ static inline void quat_to_mat4(mat4_t res, quat_t q);
 #define quat_lerp quat_slerp
 quat_t quat_slerp(quat_t q1, quat_t q2, scalar_t t);
 
+/* batch interpolation of count pairs of unit quaternions in SoA form, each
+ * with its own t in [0, 1]. Both take the shortest arc like quat_slerp.
+ * quat_slerp_soa uses polynomial approximations of acos and sin, and its
+ * results are within 1e-6 (per component) of an exact slerp.
+ * quat_nlerp_soa is normalized linear interpolation: it's even cheaper, but
+ * the angular velocity is not constant: for rotations 90 degrees apart the
+ * result is off by up to ~1 degree (around t = 1/4 and 3/4).
+ */
+void quat_slerp_soa(quat_soa_t res, quat_soa_t q1, quat_soa_t q2, const scalar_t *t, int count);
+void quat_nlerp_soa(quat_soa_t res, quat_soa_t q1, quat_soa_t q2, const scalar_t *t, int count);
+
 
 #ifdef __cplusplus
 }	/* extern "C" */
@@ -20,6 +20,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <math.h>
 #include "quat.h"
+#include "vmath_simd.h"
 
 void quat_print(FILE *fp, quat_t q)
 {
@@ -87,3 +88,203 @@ quat_t quat_slerp(quat_t q1, quat_t q2, scalar_t t)
 	res.w = q1.w * a + q2.w * b;
 	return res;
 }
+
+/* ---- batch slerp/nlerp ----
+ * The slerp weights sin((1 - t)a) / sin(a) and sin(ta) / sin(a) are computed
+ * as (1 - t) sinc((1 - t)a) / sinc(a) and t sinc(ta) / sinc(a), where
+ * sinc(x) = sin(x) / x. With the shortest arc a is in [0, pi/2], where
+ * sinc >= 2/pi, so there's no special case for small angles.
+ *
+ * acos: Abramowitz & Stegun 4.4.46, abs. error <= 2e-8 in [0, 1]
+ * sinc: Taylor series up to x^10, abs. error <= 5e-8 in [0, pi/2]
+ */
+#define ACOS_C0		1.5707963050f
+#define ACOS_C1		-0.2145988016f
+#define ACOS_C2		0.0889789874f
+#define ACOS_C3		-0.0501743046f
+#define ACOS_C4		0.0308918810f
+#define ACOS_C5		-0.0170881256f
+#define ACOS_C6		0.0066700901f
+#define ACOS_C7		-0.0012624911f
+
+#define SINC_C1		(-1.0f / 6.0f)
+#define SINC_C2		(1.0f / 120.0f)
+#define SINC_C3		(-1.0f / 5040.0f)
+#define SINC_C4		(1.0f / 362880.0f)
+#define SINC_C5		(-1.0f / 39916800.0f)
+
+static scalar_t acos_poly(scalar_t x)
+{
+	scalar_t p = ACOS_C7;
+	p = p * x + ACOS_C6;
+	p = p * x + ACOS_C5;
+	p = p * x + ACOS_C4;
+	p = p * x + ACOS_C3;
+	p = p * x + ACOS_C2;
+	p = p * x + ACOS_C1;
+	p = p * x + ACOS_C0;
+	return sqrt(1.0 - x) * p;
+}
+
+static scalar_t sinc_poly(scalar_t x)
+{
+	scalar_t x2 = x * x;
+	scalar_t p = SINC_C5;
+	p = p * x2 + SINC_C4;
+	p = p * x2 + SINC_C3;
+	p = p * x2 + SINC_C2;
+	p = p * x2 + SINC_C1;
+	return p * x2 + 1.0f;
+}
+
+#ifdef VMATH_SSE
+#define MADD(a, b, c)	_mm_add_ps(_mm_mul_ps(a, b), c)
+
+static __m128 acos_poly_sse(__m128 x)
+{
+	__m128 p = _mm_set1_ps(ACOS_C7);
+	p = MADD(p, x, _mm_set1_ps(ACOS_C6));
+	p = MADD(p, x, _mm_set1_ps(ACOS_C5));
+	p = MADD(p, x, _mm_set1_ps(ACOS_C4));
+	p = MADD(p, x, _mm_set1_ps(ACOS_C3));
+	p = MADD(p, x, _mm_set1_ps(ACOS_C2));
+	p = MADD(p, x, _mm_set1_ps(ACOS_C1));
+	p = MADD(p, x, _mm_set1_ps(ACOS_C0));
+	return _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x)), p);
+}
+
+static __m128 sinc_poly_sse(__m128 x)
+{
+	__m128 x2 = _mm_mul_ps(x, x);
+	__m128 p = _mm_set1_ps(SINC_C5);
+	p = MADD(p, x2, _mm_set1_ps(SINC_C4));
+	p = MADD(p, x2, _mm_set1_ps(SINC_C3));
+	p = MADD(p, x2, _mm_set1_ps(SINC_C2));
+	p = MADD(p, x2, _mm_set1_ps(SINC_C1));
+	return MADD(p, x2, _mm_set1_ps(1.0f));
+}
+
+/* loads 4 quaternions and flips the first ones where needed for the shortest arc */
+#define LOAD_PAIR() \
+	do { \
+		x1 = _mm_loadu_ps(q1.x + i); y1 = _mm_loadu_ps(q1.y + i); \
+		z1 = _mm_loadu_ps(q1.z + i); w1 = _mm_loadu_ps(q1.w + i); \
+		x2 = _mm_loadu_ps(q2.x + i); y2 = _mm_loadu_ps(q2.y + i); \
+		z2 = _mm_loadu_ps(q2.z + i); w2 = _mm_loadu_ps(q2.w + i); \
+		dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w1, w2), _mm_mul_ps(x1, x2)), \
+				_mm_add_ps(_mm_mul_ps(y1, y2), _mm_mul_ps(z1, z2))); \
+		sign = _mm_and_ps(dot, signmask); \
+		dot = _mm_xor_ps(dot, sign); \
+		x1 = _mm_xor_ps(x1, sign); y1 = _mm_xor_ps(y1, sign); \
+		z1 = _mm_xor_ps(z1, sign); w1 = _mm_xor_ps(w1, sign); \
+	} while(0)
+
+#define STORE_BLEND(a, b) \
+	do { \
+		_mm_storeu_ps(res.x + i, _mm_add_ps(_mm_mul_ps(x1, a), _mm_mul_ps(x2, b))); \
+		_mm_storeu_ps(res.y + i, _mm_add_ps(_mm_mul_ps(y1, a), _mm_mul_ps(y2, b))); \
+		_mm_storeu_ps(res.z + i, _mm_add_ps(_mm_mul_ps(z1, a), _mm_mul_ps(z2, b))); \
+		_mm_storeu_ps(res.w + i, _mm_add_ps(_mm_mul_ps(w1, a), _mm_mul_ps(w2, b))); \
+	} while(0)
+#endif	/* VMATH_SSE */
+
+/* scalar version of the above, for the remaining elements */
+#define LOAD_PAIR_SCALAR() \
+	do { \
+		a1 = quat_cons(q1.w[i], q1.x[i], q1.y[i], q1.z[i]); \
+		a2 = quat_cons(q2.w[i], q2.x[i], q2.y[i], q2.z[i]); \
+		d = a1.w * a2.w + a1.x * a2.x + (a1.y * a2.y + a1.z * a2.z); \
+		if(d < 0.0) { \
+			a1 = quat_neg(a1); \
+			d = -d; \
+		} \
+	} while(0)
+
+void quat_slerp_soa(quat_soa_t res, quat_soa_t q1, quat_soa_t q2, const scalar_t *t, int count)
+{
+	int i = 0;
+	quat_t a1, a2;
+	scalar_t d, angle, wa, wb, inv_sinc;
+
+#ifdef VMATH_SSE
+	__m128 x1, y1, z1, w1, x2, y2, z2, w2, dot, sign, vt, omt, va, vb, vang, vinv;
+	__m128 signmask = _mm_set1_ps(-0.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+
+	for(; i<count - 3; i+=4) {
+		LOAD_PAIR();
+		dot = _mm_min_ps(dot, one);
+
+		vt = _mm_loadu_ps(t + i);
+		omt = _mm_sub_ps(one, vt);
+		vang = acos_poly_sse(dot);
+		vinv = _mm_div_ps(one, sinc_poly_sse(vang));
+
+		va = _mm_mul_ps(_mm_mul_ps(omt, sinc_poly_sse(_mm_mul_ps(omt, vang))), vinv);
+		vb = _mm_mul_ps(_mm_mul_ps(vt, sinc_poly_sse(_mm_mul_ps(vt, vang))), vinv);
+		STORE_BLEND(va, vb);
+	}
+#endif
+
+	for(; i<count; i++) {
+		LOAD_PAIR_SCALAR();
+		if(d > 1.0) d = 1.0;
+
+		angle = acos_poly(d);
+		inv_sinc = 1.0f / sinc_poly(angle);
+		wa = (1.0f - t[i]) * sinc_poly((1.0f - t[i]) * angle) * inv_sinc;
+		wb = t[i] * sinc_poly(t[i] * angle) * inv_sinc;
+
+		res.x[i] = a1.x * wa + a2.x * wb;
+		res.y[i] = a1.y * wa + a2.y * wb;
+		res.z[i] = a1.z * wa + a2.z * wb;
+		res.w[i] = a1.w * wa + a2.w * wb;
+	}
+}
+
+void quat_nlerp_soa(quat_soa_t res, quat_soa_t q1, quat_soa_t q2, const scalar_t *t, int count)
+{
+	int i = 0;
+	quat_t a1, a2, q;
+	scalar_t d, s;
+
+#ifdef VMATH_SSE
+	__m128 x1, y1, z1, w1, x2, y2, z2, w2, dot, sign, vt, len, qx, qy, qz, qw;
+	__m128 signmask = _mm_set1_ps(-0.0f);
+
+	for(; i<count - 3; i+=4) {
+		LOAD_PAIR();
+
+		/* q1 + (q2 - q1) t */
+		vt = _mm_loadu_ps(t + i);
+		qx = _mm_add_ps(x1, _mm_mul_ps(_mm_sub_ps(x2, x1), vt));
+		qy = _mm_add_ps(y1, _mm_mul_ps(_mm_sub_ps(y2, y1), vt));
+		qz = _mm_add_ps(z1, _mm_mul_ps(_mm_sub_ps(z2, z1), vt));
+		qw = _mm_add_ps(w1, _mm_mul_ps(_mm_sub_ps(w2, w1), vt));
+
+		len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)),
+				_mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw)));
+		len = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(len));
+
+		_mm_storeu_ps(res.x + i, _mm_mul_ps(qx, len));
+		_mm_storeu_ps(res.y + i, _mm_mul_ps(qy, len));
+		_mm_storeu_ps(res.z + i, _mm_mul_ps(qz, len));
+		_mm_storeu_ps(res.w + i, _mm_mul_ps(qw, len));
+	}
+#endif
+
+	for(; i<count; i++) {
+		LOAD_PAIR_SCALAR();
+
+		q.x = a1.x + (a2.x - a1.x) * t[i];
+		q.y = a1.y + (a2.y - a1.y) * t[i];
+		q.z = a1.z + (a2.z - a1.z) * t[i];
+		q.w = a1.w + (a2.w - a1.w) * t[i];
+
+		s = 1.0f / sqrt(q.x * q.x + q.y * q.y + (q.z * q.z + q.w * q.w));
+		res.x[i] = q.x * s;
+		res.y[i] = q.y * s;
+		res.z[i] = q.z * s;
+		res.w[i] = q.w * s;
+	}
+}
@@ -0,0 +1,138 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* parallel LSD radix sort: per chunk histograms, a prefix sum which gives
+ * every chunk its own output positions for each digit, and a stable scatter.
+ * Digits which are the same for all keys are skipped.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "radix_sort.h"
+#include "vmath_thread.h"
+
+#define RADIX_BITS	11
+#define RADIX_SIZE	(1 << RADIX_BITS)
+
+struct sort_ctx {
+	struct radix_key *keys, *tmp;
+	int count, num_chunks;
+	int *hist;	/* RADIX_SIZE counters per chunk */
+	int shift;	/* current digit */
+};
+
+static void chunk_range(const struct sort_ctx *ctx, int c, int *start, int *end);
+static void hist_job(int start, int end, void *cls);
+static void scatter_job(int start, int end, void *cls);
+
+
+int vmath_radix_sort(struct radix_key **keys, struct radix_key **tmp, int count, int key_bits,
+		int num_chunks, int num_threads)
+{
+	int c, d, total, sum;
+	struct sort_ctx ctx;
+
+	if(count <= 1) {
+		return 0;
+	}
+	if(num_chunks < 1) {
+		num_chunks = 1;
+	}
+	if(!(ctx.hist = malloc(num_chunks * RADIX_SIZE * sizeof *ctx.hist))) {
+		return -1;
+	}
+	ctx.keys = *keys;
+	ctx.tmp = *tmp;
+	ctx.count = count;
+	ctx.num_chunks = num_chunks;
+
+	for(ctx.shift=0; ctx.shift<key_bits; ctx.shift+=RADIX_BITS) {
+		vmath_parallel_range(num_chunks, num_threads, 1, hist_job, &ctx);
+
+		sum = 0;
+		for(d=0; d<RADIX_SIZE; d++) {
+			total = 0;
+			for(c=0; c<num_chunks; c++) {
+				int *h = ctx.hist + c * RADIX_SIZE + d;
+				int n = *h;
+				*h = sum + total;
+				total += n;
+			}
+			if(total == count) break;
+			sum += total;
+		}
+		if(d < RADIX_SIZE) continue;	/* all keys had digit d */
+
+		vmath_parallel_range(num_chunks, num_threads, 1, scatter_job, &ctx);
+		*keys = ctx.tmp;
+		*tmp = ctx.keys;
+		ctx.keys = *keys;
+		ctx.tmp = *tmp;
+	}
+
+	free(ctx.hist);
+	return 0;
+}
+
+/* the same fixed split of the keys is used by both passes, so that the
+ * histograms match the ranges they are scattered from
+ */
+static void chunk_range(const struct sort_ctx *ctx, int c, int *start, int *end)
+{
+	*start = (int)((double)ctx->count * c / ctx->num_chunks);
+	*end = (int)((double)ctx->count * (c + 1) / ctx->num_chunks);
+}
+
+static unsigned int key_digit(const struct radix_key *k, int shift)
+{
+	if(shift >= 32) {
+		return (k->hi >> (shift - 32)) & (RADIX_SIZE - 1);
+	}
+	if(shift + RADIX_BITS <= 32) {
+		return (k->lo >> shift) & (RADIX_SIZE - 1);
+	}
+	return ((k->lo >> shift) | (k->hi << (32 - shift))) & (RADIX_SIZE - 1);
+}
+
+static void hist_job(int start, int end, void *cls)
+{
+	int c, i, s, e;
+	struct sort_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		int *hist = ctx->hist + c * RADIX_SIZE;
+		memset(hist, 0, RADIX_SIZE * sizeof *hist);
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			hist[key_digit(ctx->keys + i, ctx->shift)]++;
+		}
+	}
+}
+
+static void scatter_job(int start, int end, void *cls)
+{
+	int c, i, s, e;
+	struct sort_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		int *offs = ctx->hist + c * RADIX_SIZE;
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			ctx->tmp[offs[key_digit(ctx->keys + i, ctx->shift)]++] = ctx->keys[i];
+		}
+	}
+}
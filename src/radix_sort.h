@@ -0,0 +1,51 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* internal header, the parallel radix sort shared by the LBVH builder and
+ * the ray stream sort
+ */
+#ifndef LIBVMATH_RADIX_SORT_H_
+#define LIBVMATH_RADIX_SORT_H_
+
+/* a sort key of up to 64 bits, as two 32-bit halves since C89 has no 64-bit
+ * integers, and the value which goes with it
+ */
+struct radix_key {
+	unsigned int hi, lo;
+	int value;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* stable LSD radix sort of count keys by the low key_bits bits of their codes
+ * (hi bits above 32, lo below). The keys are split in num_chunks equal
+ * ranges, done by num_threads threads. tmp is a buffer of count more keys,
+ * and the two pointers are swapped as needed, so that the sorted keys end up
+ * in *keys, and *tmp is left with scratch data. Returns 0 on success, or -1
+ * if it fails to allocate the histograms, and then the keys are unsorted.
+ */
+int vmath_radix_sort(struct radix_key **keys, struct radix_key **tmp, int count, int key_bits,
+		int num_chunks, int num_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_RADIX_SORT_H_ */
@@ -33,11 +33,12 @@ Ray::Ray(const Vector3 &origin_arg, const Vector3 &dir_arg)
 
 void Ray::transform(const Matrix4x4 &xform)
 {
-	Matrix4x4 upper = xform;
-	upper[0][3] = upper[1][3] = upper[2][3] = upper[3][0] = upper[3][1] = upper[3][2] = 0.0;
-	upper[3][3] = 1.0;
+	// the direction only gets the upper 3x3 part
+	scalar_t x = dir.x, y = dir.y, z = dir.z;
+	dir.x = xform[0][0] * x + xform[0][1] * y + xform[0][2] * z;
+	dir.y = xform[1][0] * x + xform[1][1] * y + xform[1][2] * z;
+	dir.z = xform[2][0] * x + xform[2][1] * y + xform[2][2] * z;
 
-	dir.transform(upper);
 	origin.transform(xform);
 }
 
@@ -0,0 +1,307 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ray stream sorting: every ray gets a 30-bit key from its origin and
+ * direction, and the keys are sorted with the parallel radix sort of
+ * radix_sort.c, like the Morton codes of the LBVH builder. Sorting never
+ * changes the rays, only their order.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "vmath.h"
+#include "ray_stream.h"
+#include "vmath_thread.h"
+#include "radix_sort.h"
+
+/* the keys only use the low half of the radix sort keys, and the values
+ * are the indices of the rays
+ */
+#define KEY_BITS	30
+
+struct bbox {
+	scalar_t min[3], max[3];
+};
+
+struct chunk {
+	struct bbox obox;
+};
+
+struct sort_ctx {
+	ray_stream_t *rs;
+	const ray_t *rays;
+	int count, key_type;
+
+	int num_chunks;
+	struct chunk *chunks;
+
+	struct radix_key *keys, *tmp;
+	scalar_t omin[3], scale[3];
+};
+
+/* the 5 bits of the index, moved to every sixth bit */
+static const unsigned int spread6[32] = {
+	0x00000000, 0x00000001, 0x00000040, 0x00000041, 0x00001000, 0x00001001, 0x00001040, 0x00001041,
+	0x00040000, 0x00040001, 0x00040040, 0x00040041, 0x00041000, 0x00041001, 0x00041040, 0x00041041,
+	0x01000000, 0x01000001, 0x01000040, 0x01000041, 0x01001000, 0x01001001, 0x01001040, 0x01001041,
+	0x01040000, 0x01040001, 0x01040040, 0x01040041, 0x01041000, 0x01041001, 0x01041040, 0x01041041
+};
+
+static void chunk_range(const struct sort_ctx *ctx, int c, int *start, int *end);
+static void obox_job(int start, int end, void *cls);
+static void key_job(int start, int end, void *cls);
+static void gather_job(int start, int end, void *cls);
+
+
+void ray_stream_init(ray_stream_t *rs)
+{
+	rs->rays = 0;
+	rs->order = 0;
+	rs->count = 0;
+	rs->capacity = 0;
+	rs->mem = 0;
+}
+
+void ray_stream_destroy(ray_stream_t *rs)
+{
+	free(rs->mem);
+	ray_stream_init(rs);
+}
+
+int ray_stream_sort(ray_stream_t *rs, const ray_t *rays, int count, const aabox_t *box,
+		int key, int num_threads)
+{
+	int i, c;
+	scalar_t ext, qmax;
+	struct sort_ctx ctx;
+
+	if(count < 0) {
+		return -1;
+	}
+	if(count > rs->capacity) {
+		void *mem;
+		/* rays, then the sort keys, their sort buffer, and the order */
+		if(!(mem = malloc(count * (sizeof *rs->rays + 2 * sizeof *ctx.keys + sizeof *rs->order)))) {
+			return -1;
+		}
+		free(rs->mem);
+		rs->mem = mem;
+		rs->capacity = count;
+		rs->rays = mem;
+		rs->order = (int*)((struct radix_key*)(rs->rays + count) + 2 * count);
+	}
+	rs->count = count;
+	if(!count) {
+		return 0;
+	}
+
+	if(num_threads <= 0) {
+		num_threads = vmath_num_cpus();
+	}
+
+	memset(&ctx, 0, sizeof ctx);
+	ctx.rs = rs;
+	ctx.rays = rays;
+	ctx.count = count;
+	ctx.key_type = key;
+	ctx.keys = (struct radix_key*)(rs->rays + rs->capacity);
+	ctx.tmp = ctx.keys + rs->capacity;
+	ctx.num_chunks = count < RAY_STREAM_MT_MIN ? 1 : num_threads;
+	if(ctx.num_chunks == 1) {
+		num_threads = 1;
+	}
+	if(!(ctx.chunks = malloc(ctx.num_chunks * sizeof *ctx.chunks))) {
+		return -1;
+	}
+
+	if(box) {
+		ctx.chunks[0].obox.min[0] = box->min.x;
+		ctx.chunks[0].obox.min[1] = box->min.y;
+		ctx.chunks[0].obox.min[2] = box->min.z;
+		ctx.chunks[0].obox.max[0] = box->max.x;
+		ctx.chunks[0].obox.max[1] = box->max.y;
+		ctx.chunks[0].obox.max[2] = box->max.z;
+	} else {
+		vmath_parallel_range(ctx.num_chunks, num_threads, 1, obox_job, &ctx);
+		for(c=1; c<ctx.num_chunks; c++) {
+			for(i=0; i<3; i++) {
+				ctx.chunks[0].obox.min[i] = MIN(ctx.chunks[0].obox.min[i], ctx.chunks[c].obox.min[i]);
+				ctx.chunks[0].obox.max[i] = MAX(ctx.chunks[0].obox.max[i], ctx.chunks[c].obox.max[i]);
+			}
+		}
+	}
+	/* the same scale on all axes keeps the cells cubic */
+	ext = 0.0;
+	for(i=0; i<3; i++) {
+		scalar_t d = ctx.chunks[0].obox.max[i] - ctx.chunks[0].obox.min[i];
+		ext = MAX(ext, d);
+	}
+	qmax = key == RAY_SORT_MORTON ? 31.0 : 511.0;
+	for(i=0; i<3; i++) {
+		ctx.omin[i] = ctx.chunks[0].obox.min[i];
+		ctx.scale[i] = ext > 0.0 ? qmax / ext : 0.0;
+	}
+	vmath_parallel_range(ctx.num_chunks, num_threads, 1, key_job, &ctx);
+
+	if(vmath_radix_sort(&ctx.keys, &ctx.tmp, count, KEY_BITS, ctx.num_chunks, num_threads) == -1) {
+		free(ctx.chunks);
+		return -1;
+	}
+
+	vmath_parallel_range(ctx.num_chunks, num_threads, 1, gather_job, &ctx);
+	free(ctx.chunks);
+	return 0;
+}
+
+void ray_stream_scatter(const ray_stream_t *rs, const void *src, void *dest, int elem_size)
+{
+	int i;
+	const char *sp = src;
+	char *dp = dest;
+	const int *order = rs->order;
+
+	/* constant sizes let the compiler inline the copies of the common cases */
+	switch(elem_size) {
+	case 4:
+		for(i=0; i<rs->count; i++) {
+			memcpy(dp + order[i] * 4, sp + i * 4, 4);
+		}
+		break;
+
+	case 8:
+		for(i=0; i<rs->count; i++) {
+			memcpy(dp + order[i] * 8, sp + i * 8, 8);
+		}
+		break;
+
+	default:
+		for(i=0; i<rs->count; i++) {
+			memcpy(dp + (size_t)order[i] * elem_size, sp + (size_t)i * elem_size, elem_size);
+		}
+	}
+}
+
+
+/* the same fixed split of the rays is used by all the passes */
+static void chunk_range(const struct sort_ctx *ctx, int c, int *start, int *end)
+{
+	*start = (int)((double)ctx->count * c / ctx->num_chunks);
+	*end = (int)((double)ctx->count * (c + 1) / ctx->num_chunks);
+}
+
+static void obox_job(int start, int end, void *cls)
+{
+	int c, i, j, s, e;
+	scalar_t p[3];
+	struct sort_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		struct bbox *b = &ctx->chunks[c].obox;
+		for(j=0; j<3; j++) {
+			b->min[j] = HUGE_VAL;
+			b->max[j] = -HUGE_VAL;
+		}
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			p[0] = ctx->rays[i].origin.x;
+			p[1] = ctx->rays[i].origin.y;
+			p[2] = ctx->rays[i].origin.z;
+			for(j=0; j<3; j++) {
+				if(p[j] < b->min[j]) b->min[j] = p[j];
+				if(p[j] > b->max[j]) b->max[j] = p[j];
+			}
+		}
+	}
+}
+
+/* the 9 low bits of x, moved to every third bit */
+static unsigned int spread9(unsigned int x)
+{
+	x &= 0x1ff;
+	x = (x | (x << 16)) & 0x030000ff;
+	x = (x | (x << 8)) & 0x0300f00f;
+	x = (x | (x << 4)) & 0x030c30c3;
+	x = (x | (x << 2)) & 0x09249249;
+	return x;
+}
+
+static unsigned int quantize(scalar_t x, scalar_t qmax)
+{
+	/* also catches NaNs */
+	if(!(x > 0.0)) return 0;
+	if(x > qmax) return (unsigned int)qmax;
+	return (unsigned int)x;
+}
+
+static void key_job(int start, int end, void *cls)
+{
+	int c, i, s, e;
+	unsigned int o[3], d[3], oct;
+	scalar_t len, rlen;
+	struct sort_ctx *ctx = cls;
+
+	for(c=start; c<end; c++) {
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			const ray_t *ray = ctx->rays + i;
+			struct radix_key *k = ctx->keys + i;
+			k->hi = 0;
+			k->value = i;
+
+			if(ctx->key_type == RAY_SORT_MORTON) {
+				o[0] = quantize((ray->origin.x - ctx->omin[0]) * ctx->scale[0], 31.0);
+				o[1] = quantize((ray->origin.y - ctx->omin[1]) * ctx->scale[1], 31.0);
+				o[2] = quantize((ray->origin.z - ctx->omin[2]) * ctx->scale[2], 31.0);
+
+				/* directions in [-1, 1] to [0, 32) */
+				len = v3_length(ray->dir);
+				rlen = len > 0.0 ? 16.0 / len : 0.0;
+				d[0] = quantize(ray->dir.x * rlen + 16.0, 31.0);
+				d[1] = quantize(ray->dir.y * rlen + 16.0, 31.0);
+				d[2] = quantize(ray->dir.z * rlen + 16.0, 31.0);
+
+				k->lo = (spread6[o[0]] << 5) | (spread6[o[1]] << 4) | (spread6[o[2]] << 3) |
+					(spread6[d[0]] << 2) | (spread6[d[1]] << 1) | spread6[d[2]];
+			} else {
+				o[0] = quantize((ray->origin.x - ctx->omin[0]) * ctx->scale[0], 511.0);
+				o[1] = quantize((ray->origin.y - ctx->omin[1]) * ctx->scale[1], 511.0);
+				o[2] = quantize((ray->origin.z - ctx->omin[2]) * ctx->scale[2], 511.0);
+				oct = (ray->dir.x < 0.0 ? 1 : 0) | (ray->dir.y < 0.0 ? 2 : 0) |
+					(ray->dir.z < 0.0 ? 4 : 0);
+
+				k->lo = (oct << 27) | (spread9(o[0]) << 2) | (spread9(o[1]) << 1) | spread9(o[2]);
+			}
+		}
+	}
+}
+
+static void gather_job(int start, int end, void *cls)
+{
+	int c, i, s, e;
+	struct sort_ctx *ctx = cls;
+	ray_stream_t *rs = ctx->rs;
+
+	for(c=start; c<end; c++) {
+		chunk_range(ctx, c, &s, &e);
+		for(i=s; i<e; i++) {
+			int r = ctx->keys[i].value;
+			rs->rays[i] = ctx->rays[r];
+			rs->order[i] = r;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_RAY_STREAM_H_
+#define LIBVMATH_RAY_STREAM_H_
+
+#include "ray.h"
+#include "geom.h"
+
+/* sort keys for ray_stream_sort */
+enum {
+	/* direction octant, then a 512^3 grid cell of the origin, along a
+	 * Morton curve. Keeps rays with the same origin cell and direction
+	 * signs together, for instance the shadow rays to one light.
+	 */
+	RAY_SORT_OCTANT_CELL,
+	/* 6D Morton code of the origin (32^3 cells) and the normalized
+	 * direction (32^3 cells), interleaved. Also groups similar directions
+	 * within an octant, for incoherent secondary rays.
+	 */
+	RAY_SORT_MORTON
+};
+
+/* batches of rays smaller than this are not sorted across threads */
+#define RAY_STREAM_MT_MIN	16384
+
+/* a batch of rays, reordered so that rays close to each other in the stream
+ * take similar paths through an acceleration structure, and hit the same
+ * nodes while they are still in the cache. The buffers are kept from one
+ * ray_stream_sort to the next, so sorting batches of the same size every
+ * frame doesn't allocate.
+ */
+typedef struct {
+	ray_t *rays;	/* the rays in coherent order */
+	int *order;		/* order[i]: index of rays[i] in the input batch */
+	int count;
+
+	int capacity;
+	void *mem;
+} ray_stream_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void ray_stream_init(ray_stream_t *rs);
+void ray_stream_destroy(ray_stream_t *rs);
+
+/* copies count rays into the stream, sorted by key (one of the RAY_SORT
+ * values above). The origins are quantized in box, which should contain
+ * most of them (origins outside it are clamped to its faces), or in the
+ * bounding box of the origins if box is null. The sort is split across
+ * num_threads threads (0 for one per processor). rays can't be the rays
+ * of the stream itself. Returns 0 on success, -1 on failure.
+ */
+int ray_stream_sort(ray_stream_t *rs, const ray_t *rays, int count, const aabox_t *box,
+		int key, int num_threads);
+
+/* puts per ray results computed in stream order back in the order of the
+ * input batch: element i of src, elem_size bytes each, is copied to element
+ * order[i] of dest. src and dest must not overlap.
+ */
+void ray_stream_scatter(const ray_stream_t *rs, const void *src, void *dest, int elem_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_RAY_STREAM_H_ */
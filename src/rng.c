@@ -0,0 +1,260 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stddef.h>
+#include <math.h>
+#include "vmath.h"
+#include "rng.h"
+
+#if defined(_WIN32)
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT	0x0600
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#if defined(__GNUC__)
+#define THREAD_LOCAL	__thread
+#elif defined(_MSC_VER)
+#define THREAD_LOCAL	__declspec(thread)
+#else
+#define THREAD_LOCAL
+#endif
+
+/* splitmix32, to expand the seed into the 128 bits of state */
+static unsigned int splitmix(unsigned long *x)
+{
+	unsigned long z;
+
+	*x = (*x + 0x9e3779b9UL) & 0xffffffff;
+	z = *x;
+	z = ((z ^ (z >> 16)) * 0x85ebca6bUL) & 0xffffffff;
+	z = ((z ^ (z >> 13)) * 0xc2b2ae35UL) & 0xffffffff;
+	return (unsigned int)(z ^ (z >> 16));
+}
+
+void rng_seed(rng_t *rng, unsigned long seed)
+{
+	int i;
+	/* fold the top half of 64-bit longs in, in two steps to stay valid for 32-bit ones */
+	unsigned long x = (seed ^ ((seed >> 16) >> 16)) & 0xffffffff;
+
+	for(i=0; i<4; i++) {
+		rng->s[i] = splitmix(&x);
+	}
+	/* the only state xoshiro can't get out of */
+	if(!(rng->s[0] | rng->s[1] | rng->s[2] | rng->s[3])) {
+		rng->s[0] = 1;
+	}
+}
+
+void rng_jump(rng_t *rng)
+{
+	static const unsigned int jump[] = {0x8764000b, 0xf542d2d3, 0x6fa035c3, 0x77f2db5b};
+	unsigned int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	int i, b;
+
+	for(i=0; i<4; i++) {
+		for(b=0; b<32; b++) {
+			if(jump[i] & (1U << b)) {
+				s0 ^= rng->s[0];
+				s1 ^= rng->s[1];
+				s2 ^= rng->s[2];
+				s3 ^= rng->s[3];
+			}
+			rng_next(rng);
+		}
+	}
+	rng->s[0] = s0;
+	rng->s[1] = s1;
+	rng->s[2] = s2;
+	rng->s[3] = s3;
+}
+
+void rng_init_stream(rng_t *rng, unsigned long seed, int stream)
+{
+	rng_seed(rng, seed);
+	while(stream-- > 0) {
+		rng_jump(rng);
+	}
+}
+
+static THREAD_LOCAL rng_t def_rng;
+static THREAD_LOCAL int def_rng_valid;
+
+/* every thread gets the next stream of seed 0, so their sequences never
+ * overlap, and the first thread gets the same sequence every time, like
+ * rand() without srand. def_rng_next is the start of the next stream to hand
+ * out, so each thread costs a single jump, however many came before it.
+ */
+static rng_t def_rng_next;
+static int def_rng_next_valid;
+
+static void take_stream(rng_t *rng)
+{
+	if(!def_rng_next_valid) {
+		rng_seed(&def_rng_next, 0);
+		def_rng_next_valid = 1;
+	}
+	*rng = def_rng_next;
+	rng_jump(&def_rng_next);
+}
+
+#if defined(_WIN32)
+static SRWLOCK def_rng_lock = SRWLOCK_INIT;
+
+static void next_stream(rng_t *rng)
+{
+	AcquireSRWLockExclusive(&def_rng_lock);
+	take_stream(rng);
+	ReleaseSRWLockExclusive(&def_rng_lock);
+}
+
+#elif defined(__unix__) || defined(__APPLE__)
+static pthread_mutex_t def_rng_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void next_stream(rng_t *rng)
+{
+	pthread_mutex_lock(&def_rng_lock);
+	take_stream(rng);
+	pthread_mutex_unlock(&def_rng_lock);
+}
+
+#else
+/* no threads API known, fall back to no locking */
+static void next_stream(rng_t *rng)
+{
+	take_stream(rng);
+}
+#endif
+
+rng_t *rng_default(void)
+{
+	if(!def_rng_valid) {
+		next_stream(&def_rng);
+		def_rng_valid = 1;
+	}
+	return &def_rng;
+}
+
+/* ---- sampling ---- */
+
+/* Marsaglia's method: (a, b) uniform in the unit disk maps to a uniform point
+ * on the unit sphere, (2a sqrt(1 - s), 2b sqrt(1 - s), 1 - 2s) with s = a^2 + b^2
+ */
+static inline scalar_t disk_sample(rng_t *rng, scalar_t *a, scalar_t *b)
+{
+	scalar_t s;
+	do {
+		*a = rng_frand(rng) * 2.0f - 1.0f;
+		*b = rng_frand(rng) * 2.0f - 1.0f;
+		s = *a * *a + *b * *b;
+	} while(s >= 1.0f);
+	return s;
+}
+
+static inline void sphere_sample(rng_t *rng, scalar_t rad, scalar_t *x, scalar_t *y, scalar_t *z)
+{
+	scalar_t a, b, s, f;
+
+	s = disk_sample(rng, &a, &b);
+	f = 2.0f * sqrt(1.0f - s) * rad;
+	*x = a * f;
+	*y = b * f;
+	*z = (1.0f - 2.0f * s) * rad;
+}
+
+/* Malley's method: project a uniform disk sample up to the hemisphere */
+static inline void cos_sample(rng_t *rng, scalar_t *x, scalar_t *y, scalar_t *z)
+{
+	scalar_t s = disk_sample(rng, x, y);
+	*z = sqrt(1.0f - s);
+}
+
+vec3_t rng_sphere(rng_t *rng, scalar_t rad)
+{
+	vec3_t res;
+	sphere_sample(rng, rad, &res.x, &res.y, &res.z);
+	return res;
+}
+
+vec3_t rng_hemisphere(rng_t *rng)
+{
+	vec3_t res;
+	sphere_sample(rng, 1.0f, &res.x, &res.y, &res.z);
+	res.z = fabs(res.z);
+	return res;
+}
+
+vec3_t rng_hemisphere_cos(rng_t *rng)
+{
+	vec3_t res;
+	cos_sample(rng, &res.x, &res.y, &res.z);
+	return res;
+}
+
+vec2_t rng_disk(rng_t *rng)
+{
+	vec2_t res;
+	disk_sample(rng, &res.x, &res.y);
+	return res;
+}
+
+void rng_frand_array(rng_t *rng, scalar_t *res, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		res[i] = rng_frand(rng);
+	}
+}
+
+void rng_sphere_soa(rng_t *rng, vec3_soa_t res, scalar_t rad, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		sphere_sample(rng, rad, res.x + i, res.y + i, res.z + i);
+	}
+}
+
+void rng_hemisphere_soa(rng_t *rng, vec3_soa_t res, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		sphere_sample(rng, 1.0f, res.x + i, res.y + i, res.z + i);
+		res.z[i] = fabs(res.z[i]);
+	}
+}
+
+void rng_hemisphere_cos_soa(rng_t *rng, vec3_soa_t res, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		cos_sample(rng, res.x + i, res.y + i, res.z + i);
+	}
+}
+
+void rng_disk_soa(rng_t *rng, vec2_soa_t res, int count)
+{
+	int i;
+	for(i=0; i<count; i++) {
+		disk_sample(rng, res.x + i, res.y + i);
+	}
+}
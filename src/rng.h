@@ -0,0 +1,91 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_RNG_H_
+#define LIBVMATH_RNG_H_
+
+#include "vmath_types.h"
+
+/* pseudo-random number generator state: xoshiro128** by Blackman and Vigna,
+ * with a period of 2^128 - 1. The state is 4 32-bit words (unsigned int is
+ * assumed to be 32 bits). Generators don't share anything, so each thread
+ * can use its own without locking.
+ */
+typedef struct {
+	unsigned int s[4];
+} rng_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* initializes the generator from a seed. Different seeds give uncorrelated
+ * sequences, but for multiple threads or tasks rng_init_stream is better.
+ */
+void rng_seed(rng_t *rng, unsigned long seed);
+
+/* advances the generator by 2^64 steps, as if rng_next was called that many
+ * times. Repeated jumps split the period into 2^64 non-overlapping streams.
+ */
+void rng_jump(rng_t *rng);
+
+/* seeds the generator and jumps it to the start of stream number stream, so
+ * that the streams of the same seed never overlap. Takes stream jumps.
+ */
+void rng_init_stream(rng_t *rng, unsigned long seed, int stream);
+
+/* a generator for the calling thread. On first use each thread gets the
+ * next stream of seed 0 (see rng_init_stream), so their sequences don't
+ * overlap. This is what frand and sphrand use. Without compiler support for
+ * thread-local variables it's shared by all threads, and not thread-safe.
+ */
+rng_t *rng_default(void);
+
+/* 32 random bits */
+static inline unsigned int rng_next(rng_t *rng);
+/* uniform number in [0, 1) */
+static inline scalar_t rng_frand(rng_t *rng);
+
+/* uniform samples of various domains. These use rejection sampling, so they
+ * take a variable number of random numbers, but no trigonometric functions:
+ *  - rng_sphere: on the surface of a sphere of radius rad, centered at 0.
+ *  - rng_hemisphere: unit vector in the hemisphere around +Z.
+ *  - rng_hemisphere_cos: same, with a cosine-weighted distribution.
+ *  - rng_disk: point in the unit disk.
+ */
+vec3_t rng_sphere(rng_t *rng, scalar_t rad);
+vec3_t rng_hemisphere(rng_t *rng);
+vec3_t rng_hemisphere_cos(rng_t *rng);
+vec2_t rng_disk(rng_t *rng);
+
+/* bulk versions. They produce exactly the same samples, in the same order,
+ * as calling the single sample functions count times.
+ */
+void rng_frand_array(rng_t *rng, scalar_t *res, int count);
+void rng_sphere_soa(rng_t *rng, vec3_soa_t res, scalar_t rad, int count);
+void rng_hemisphere_soa(rng_t *rng, vec3_soa_t res, int count);
+void rng_hemisphere_cos_soa(rng_t *rng, vec3_soa_t res, int count);
+void rng_disk_soa(rng_t *rng, vec2_soa_t res, int count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "rng.inl"
+
+#endif	/* LIBVMATH_RNG_H_ */
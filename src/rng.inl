@@ -0,0 +1,48 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define RNG_ROTL(x, k)	(((x) << (k)) | ((x) >> (32 - (k))))
+
+#ifdef __cplusplus
+extern "C" {
+#endif	/* __cplusplus */
+
+static inline unsigned int rng_next(rng_t *rng)
+{
+	unsigned int *s = rng->s;
+	unsigned int res = RNG_ROTL(s[1] * 5, 7) * 9;
+	unsigned int t = s[1] << 9;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = RNG_ROTL(s[3], 11);
+	return res;
+}
+
+static inline scalar_t rng_frand(rng_t *rng)
+{
+	/* the top 24 bits, exactly representable in single precision */
+	return (scalar_t)(rng_next(rng) >> 8) * (scalar_t)(1.0 / 16777216.0);
+}
+
+#ifdef __cplusplus
+}
+#endif	/* __cplusplus */
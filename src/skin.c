@@ -0,0 +1,310 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "skin.h"
+#include "vmath_simd.h"
+#include "vmath_thread.h"
+
+struct skin_job {
+	const skin_soa_t *res, *v;
+	mat3x4_t *bones;
+	const int *idx;
+	const scalar_t *weights;
+};
+
+/* the blended matrix is w0 * B0 + w1 * B1 + w2 * B2 + w3 * B3, summed in this
+ * order by all the code paths, so that they produce the same results.
+ */
+static void skin1(const struct skin_job *job, int i)
+{
+	int j, k;
+	scalar_t m[12], x, y, z;
+	const int *idx = job->idx + i * 4;
+	const scalar_t *w = job->weights + i * 4;
+	const scalar_t *b = job->bones[idx[0]][0];
+	const skin_soa_t *v = job->v, *res = job->res;
+
+	for(j=0; j<12; j++) {
+		m[j] = b[j] * w[0];
+	}
+	for(k=1; k<4; k++) {
+		b = job->bones[idx[k]][0];
+		for(j=0; j<12; j++) {
+			m[j] = m[j] + b[j] * w[k];
+		}
+	}
+
+	x = v->pos.x[i];
+	y = v->pos.y[i];
+	z = v->pos.z[i];
+	res->pos.x[i] = m[0] * x + m[1] * y + m[2] * z + m[3];
+	res->pos.y[i] = m[4] * x + m[5] * y + m[6] * z + m[7];
+	res->pos.z[i] = m[8] * x + m[9] * y + m[10] * z + m[11];
+
+	if(v->norm.x) {
+		x = v->norm.x[i];
+		y = v->norm.y[i];
+		z = v->norm.z[i];
+		res->norm.x[i] = m[0] * x + m[1] * y + m[2] * z;
+		res->norm.y[i] = m[4] * x + m[5] * y + m[6] * z;
+		res->norm.z[i] = m[8] * x + m[9] * y + m[10] * z;
+	}
+	if(v->tang.x) {
+		x = v->tang.x[i];
+		y = v->tang.y[i];
+		z = v->tang.z[i];
+		res->tang.x[i] = m[0] * x + m[1] * y + m[2] * z;
+		res->tang.y[i] = m[4] * x + m[5] * y + m[6] * z;
+		res->tang.z[i] = m[8] * x + m[9] * y + m[10] * z;
+	}
+}
+
+static void skin_range_scalar(const struct skin_job *job, int start, int end)
+{
+	int i;
+	for(i=start; i<end; i++) {
+		skin1(job, i);
+	}
+}
+
+#ifdef VMATH_SSE
+/* loads influence k of 4 vertices: m[r * 4 + c] gets element (r, c) of their bone matrices */
+#define LOAD_BONES_SSE(m, k) \
+	do { \
+		int r_; \
+		for(r_=0; r_<3; r_++) { \
+			m[r_ * 4] = _mm_loadu_ps(job->bones[idx[k]][r_]); \
+			m[r_ * 4 + 1] = _mm_loadu_ps(job->bones[idx[4 + k]][r_]); \
+			m[r_ * 4 + 2] = _mm_loadu_ps(job->bones[idx[8 + k]][r_]); \
+			m[r_ * 4 + 3] = _mm_loadu_ps(job->bones[idx[12 + k]][r_]); \
+			_MM_TRANSPOSE4_PS(m[r_ * 4], m[r_ * 4 + 1], m[r_ * 4 + 2], m[r_ * 4 + 3]); \
+		} \
+	} while(0)
+
+#define XFORM_SSE(res, v, m, i, is_point) \
+	do { \
+		__m128 x_ = _mm_loadu_ps(v.x + i); \
+		__m128 y_ = _mm_loadu_ps(v.y + i); \
+		__m128 z_ = _mm_loadu_ps(v.z + i); \
+		__m128 rx_ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], x_), _mm_mul_ps(m[1], y_)), _mm_mul_ps(m[2], z_)); \
+		__m128 ry_ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[4], x_), _mm_mul_ps(m[5], y_)), _mm_mul_ps(m[6], z_)); \
+		__m128 rz_ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[8], x_), _mm_mul_ps(m[9], y_)), _mm_mul_ps(m[10], z_)); \
+		if(is_point) { \
+			rx_ = _mm_add_ps(rx_, m[3]); \
+			ry_ = _mm_add_ps(ry_, m[7]); \
+			rz_ = _mm_add_ps(rz_, m[11]); \
+		} \
+		_mm_storeu_ps(res.x + i, rx_); \
+		_mm_storeu_ps(res.y + i, ry_); \
+		_mm_storeu_ps(res.z + i, rz_); \
+	} while(0)
+
+static void skin4_sse(const struct skin_job *job, int i)
+{
+	int j, k;
+	__m128 w[4], m[12], b[12];
+	const int *idx = job->idx + i * 4;
+	const scalar_t *wptr = job->weights + i * 4;
+
+	w[0] = _mm_loadu_ps(wptr);
+	w[1] = _mm_loadu_ps(wptr + 4);
+	w[2] = _mm_loadu_ps(wptr + 8);
+	w[3] = _mm_loadu_ps(wptr + 12);
+	_MM_TRANSPOSE4_PS(w[0], w[1], w[2], w[3]);
+
+	LOAD_BONES_SSE(m, 0);
+	for(j=0; j<12; j++) {
+		m[j] = _mm_mul_ps(m[j], w[0]);
+	}
+	for(k=1; k<4; k++) {
+		LOAD_BONES_SSE(b, k);
+		for(j=0; j<12; j++) {
+			m[j] = _mm_add_ps(m[j], _mm_mul_ps(b[j], w[k]));
+		}
+	}
+
+	XFORM_SSE(job->res->pos, job->v->pos, m, i, 1);
+	if(job->v->norm.x) {
+		XFORM_SSE(job->res->norm, job->v->norm, m, i, 0);
+	}
+	if(job->v->tang.x) {
+		XFORM_SSE(job->res->tang, job->v->tang, m, i, 0);
+	}
+}
+
+static void skin_range_sse(const struct skin_job *job, int start, int end)
+{
+	int i;
+	for(i=start; i<end - 3; i+=4) {
+		skin4_sse(job, i);
+	}
+	for(; i<end; i++) {
+		skin1(job, i);
+	}
+}
+#endif	/* VMATH_SSE */
+
+#ifdef VMATH_AVX
+/* transposes the 4x4 blocks in each 128-bit half */
+#define TRANSPOSE4_AVX(r0, r1, r2, r3) \
+	do { \
+		__m256 t0_ = _mm256_unpacklo_ps(r0, r1); \
+		__m256 t1_ = _mm256_unpacklo_ps(r2, r3); \
+		__m256 t2_ = _mm256_unpackhi_ps(r0, r1); \
+		__m256 t3_ = _mm256_unpackhi_ps(r2, r3); \
+		r0 = _mm256_shuffle_ps(t0_, t1_, _MM_SHUFFLE(1, 0, 1, 0)); \
+		r1 = _mm256_shuffle_ps(t0_, t1_, _MM_SHUFFLE(3, 2, 3, 2)); \
+		r2 = _mm256_shuffle_ps(t2_, t3_, _MM_SHUFFLE(1, 0, 1, 0)); \
+		r3 = _mm256_shuffle_ps(t2_, t3_, _MM_SHUFFLE(3, 2, 3, 2)); \
+	} while(0)
+
+/* vertex j in the low half, vertex j + 4 in the high half */
+#define LOAD_PAIR_AVX(lo, hi) \
+	_mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1)
+
+#define LOAD_BONES_AVX(m, k) \
+	do { \
+		int r_, j_; \
+		for(r_=0; r_<3; r_++) { \
+			for(j_=0; j_<4; j_++) { \
+				m[r_ * 4 + j_] = LOAD_PAIR_AVX(job->bones[idx[j_ * 4 + k]][r_], \
+						job->bones[idx[(j_ + 4) * 4 + k]][r_]); \
+			} \
+			TRANSPOSE4_AVX(m[r_ * 4], m[r_ * 4 + 1], m[r_ * 4 + 2], m[r_ * 4 + 3]); \
+		} \
+	} while(0)
+
+#define XFORM_AVX(res, v, m, i, is_point) \
+	do { \
+		__m256 x_ = _mm256_loadu_ps(v.x + i); \
+		__m256 y_ = _mm256_loadu_ps(v.y + i); \
+		__m256 z_ = _mm256_loadu_ps(v.z + i); \
+		__m256 rx_ = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x_), _mm256_mul_ps(m[1], y_)), _mm256_mul_ps(m[2], z_)); \
+		__m256 ry_ = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], x_), _mm256_mul_ps(m[5], y_)), _mm256_mul_ps(m[6], z_)); \
+		__m256 rz_ = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], x_), _mm256_mul_ps(m[9], y_)), _mm256_mul_ps(m[10], z_)); \
+		if(is_point) { \
+			rx_ = _mm256_add_ps(rx_, m[3]); \
+			ry_ = _mm256_add_ps(ry_, m[7]); \
+			rz_ = _mm256_add_ps(rz_, m[11]); \
+		} \
+		_mm256_storeu_ps(res.x + i, rx_); \
+		_mm256_storeu_ps(res.y + i, ry_); \
+		_mm256_storeu_ps(res.z + i, rz_); \
+	} while(0)
+
+VMATH_TARGET_AVX
+static void skin8_avx(const struct skin_job *job, int i)
+{
+	int j, k;
+	__m256 w[4], m[12], b[12];
+	const int *idx = job->idx + i * 4;
+	const scalar_t *wptr = job->weights + i * 4;
+
+	for(j=0; j<4; j++) {
+		w[j] = LOAD_PAIR_AVX(wptr + j * 4, wptr + (j + 4) * 4);
+	}
+	TRANSPOSE4_AVX(w[0], w[1], w[2], w[3]);
+
+	LOAD_BONES_AVX(m, 0);
+	for(j=0; j<12; j++) {
+		m[j] = _mm256_mul_ps(m[j], w[0]);
+	}
+	for(k=1; k<4; k++) {
+		LOAD_BONES_AVX(b, k);
+		for(j=0; j<12; j++) {
+			m[j] = _mm256_add_ps(m[j], _mm256_mul_ps(b[j], w[k]));
+		}
+	}
+
+	XFORM_AVX(job->res->pos, job->v->pos, m, i, 1);
+	if(job->v->norm.x) {
+		XFORM_AVX(job->res->norm, job->v->norm, m, i, 0);
+	}
+	if(job->v->tang.x) {
+		XFORM_AVX(job->res->tang, job->v->tang, m, i, 0);
+	}
+}
+
+VMATH_TARGET_AVX
+static void skin_range_avx(const struct skin_job *job, int start, int end)
+{
+	int i;
+	for(i=start; i<end - 7; i+=8) {
+		skin8_avx(job, i);
+	}
+	_mm256_zeroupper();
+	skin_range_sse(job, i, end);
+}
+#endif	/* VMATH_AVX */
+
+/* picked once, on the first call of either skinning function */
+static void (*skin_range)(const struct skin_job*, int, int);
+static vmath_once_t skin_range_once = VMATH_ONCE_INIT;
+
+static void init_skin_range(void)
+{
+	void (*func)(const struct skin_job*, int, int) = skin_range_scalar;
+
+#ifdef VMATH_SSE
+	func = skin_range_sse;
+#endif
+#ifdef VMATH_AVX
+	if(vmath_cpu_features() & VMATH_CPU_AVX) {
+		func = skin_range_avx;
+	}
+#endif
+	skin_range = func;
+}
+
+void skin_lbs_soa(const skin_soa_t *res, const skin_soa_t *v, mat3x4_t *bones,
+		const int *bone_idx, const scalar_t *bone_weights, int count)
+{
+	struct skin_job job;
+
+	job.res = res;
+	job.v = v;
+	job.bones = bones;
+	job.idx = bone_idx;
+	job.weights = bone_weights;
+
+	vmath_once(&skin_range_once, init_skin_range);
+	skin_range(&job, 0, count);
+}
+
+static void skin_range_thread(int start, int end, void *cls)
+{
+	skin_range(cls, start, end);
+}
+
+void skin_lbs_soa_mt(const skin_soa_t *res, const skin_soa_t *v, mat3x4_t *bones,
+		const int *bone_idx, const scalar_t *bone_weights, int count, int num_threads)
+{
+	struct skin_job job;
+
+	job.res = res;
+	job.v = v;
+	job.bones = bones;
+	job.idx = bone_idx;
+	job.weights = bone_weights;
+
+	vmath_once(&skin_range_once, init_skin_range);
+	/* ranges of multiples of 16 vertices (64 bytes of each output array), so
+	 * that threads only share the cache lines at the ends of their ranges
+	 */
+	vmath_parallel_range(count, num_threads, 16, skin_range_thread, &job);
+}
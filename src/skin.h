@@ -0,0 +1,57 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_SKIN_H_
+#define LIBVMATH_SKIN_H_
+
+#include "vmath_types.h"
+
+/* vertex streams of the skinning functions. Normals and tangents are
+ * optional, set their x pointer to null to skip them.
+ */
+typedef struct {
+	vec3_soa_t pos, norm, tang;
+} skin_soa_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* linear blend skinning of count vertices with a palette of affine bone
+ * matrices. Each vertex has 4 bone influences: the palette indices and
+ * weights of vertex i are bone_idx[i * 4 + k] and bone_weights[i * 4 + k]
+ * (k = 0..3). Unused influences need a weight of 0, but still a valid index.
+ * Positions are transformed by the weighted sum of the bone matrices,
+ * normals and tangents by its upper 3x3 part, which is correct as long as
+ * the bones have no non-uniform scaling. Normals and tangents are not
+ * renormalized. The results may overwrite the inputs.
+ */
+void skin_lbs_soa(const skin_soa_t *res, const skin_soa_t *v, mat3x4_t *bones,
+		const int *bone_idx, const scalar_t *bone_weights, int count);
+
+/* same as skin_lbs_soa, with the vertices split in ranges across num_threads
+ * threads (0 for one per processor).
+ */
+void skin_lbs_soa_mt(const skin_soa_t *res, const skin_soa_t *v, mat3x4_t *bones,
+		const int *bone_idx, const scalar_t *bone_weights, int count, int num_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_SKIN_H_ */
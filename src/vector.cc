@@ -208,6 +208,24 @@ Vector3 Vector3::transformed(const Matrix4x4 &mat) const
 	return vec;
 }
 
+void Vector3::transform(const Matrix3x4 &mat)
+{
+	scalar_t nx = mat[0][0] * x + mat[0][1] * y + mat[0][2] * z + mat[0][3];
+	scalar_t ny = mat[1][0] * x + mat[1][1] * y + mat[1][2] * z + mat[1][3];
+	z = mat[2][0] * x + mat[2][1] * y + mat[2][2] * z + mat[2][3];
+	x = nx;
+	y = ny;
+}
+
+Vector3 Vector3::transformed(const Matrix3x4 &mat) const
+{
+	Vector3 vec;
+	vec.x = mat[0][0] * x + mat[0][1] * y + mat[0][2] * z + mat[0][3];
+	vec.y = mat[1][0] * x + mat[1][1] * y + mat[1][2] * z + mat[1][3];
+	vec.z = mat[2][0] * x + mat[2][1] * y + mat[2][2] * z + mat[2][3];
+	return vec;
+}
+
 void Vector3::transform(const Quaternion &quat)
 {
 	Quaternion vq(0.0f, *this);
@@ -236,6 +254,18 @@ Vector3 Vector3::rotated(const Vector3 &euler) const
 	return transformed(rot);
 }
 
+void transform_points(Vector3 *res, const Vector3 *v, int count, const Matrix4x4 &mat,
+		int res_stride, int v_stride)
+{
+	v3_transform_points((vec3_t*)res, res_stride, (const vec3_t*)v, v_stride, count, (scalar_t (*)[4])mat.m);
+}
+
+void transform_dirs(Vector3 *res, const Vector3 *v, int count, const Matrix4x4 &mat,
+		int res_stride, int v_stride)
+{
+	v3_transform_dirs((vec3_t*)res, res_stride, (const vec3_t*)v, v_stride, count, (scalar_t (*)[4])mat.m);
+}
+
 /*
 std::ostream &operator <<(std::ostream &out, const Vector3 &vec)
 {
@@ -326,6 +356,18 @@ Vector4 Vector4::refraction(const Vector4 &normal, scalar_t src_ior, scalar_t ds
 	return *this;
 }
 
+void transform_array(Vector4 *res, const Vector4 *v, int count, const Matrix4x4 &mat,
+		int res_stride, int v_stride)
+{
+	v4_transform_array((vec4_t*)res, res_stride, (const vec4_t*)v, v_stride, count, (scalar_t (*)[4])mat.m);
+}
+
+void transform_project(Vector4 *res, const Vector4 *v, int count, const Matrix4x4 &mat,
+		int res_stride, int v_stride)
+{
+	v4_transform_project((vec4_t*)res, res_stride, (const vec4_t*)v, v_stride, count, (scalar_t (*)[4])mat.m);
+}
+
 /*
 std::ostream &operator <<(std::ostream &out, const Vector4 &vec)
 {
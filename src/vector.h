@@ -55,6 +55,31 @@ static inline scalar_t v3_length(vec3_t v);
 static inline scalar_t v3_length_sq(vec3_t v);
 static inline vec3_t v3_normalize(vec3_t v);
 static inline vec3_t v3_transform(vec3_t v, mat4_t m);
+/* affine 3x4 matrix transforms, of a point and of a direction (no translation) */
+static inline vec3_t v3_transform_m3x4(vec3_t v, mat3x4_t m);
+static inline vec3_t v3_transform_dir_m3x4(vec3_t v, mat3x4_t m);
+
+/* transform count vectors by the same matrix. The strides are the distance in
+ * bytes between consecutive vectors (0 for tightly packed arrays), so these
+ * can operate directly on interleaved vertex buffers. res may point to the same
+ * array as v, as long as the strides are equal.
+ */
+void v3_transform_points(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat4_t m);	/* w = 1 */
+void v3_transform_dirs(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat4_t m);	/* w = 0 */
+
+/* strided array transforms by an affine 3x4 matrix */
+void v3_transform_points_m3x4(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat3x4_t m);
+void v3_transform_dirs_m3x4(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat3x4_t m);
+
+/* same as v3_transform_points/v3_transform_dirs, split across num_threads
+ * threads (0 for one per processor), chunk_size vectors at a time (0 for the
+ * default, see vmath_parallel_for). Only the top 3 rows of m are used, so it
+ * can be a mat3x4_t too.
+ */
+void v3_transform_points_mt(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count,
+		mat4_t m, int num_threads, int chunk_size);
+void v3_transform_dirs_mt(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count,
+		mat4_t m, int num_threads, int chunk_size);
 
 static inline vec3_t v3_rotate(vec3_t v, scalar_t x, scalar_t y, scalar_t z);
 static inline vec3_t v3_rotate_axis(vec3_t v, scalar_t angle, scalar_t x, scalar_t y, scalar_t z);
@@ -64,6 +89,27 @@ static inline vec3_t v3_reflect(vec3_t v, vec3_t n);
 
 static inline vec3_t v3_lerp(vec3_t v1, vec3_t v2, scalar_t t);
 
+/* C 3D vector batch functions, operating on count vectors stored in SoA buffers.
+ * The results are bit-identical to calling the equivalent v3_* function on
+ * each element, and res may alias any of the inputs.
+ */
+static inline vec3_soa_t v3_soa_cons(scalar_t *x, scalar_t *y, scalar_t *z);
+
+void v3_add_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count);
+void v3_sub_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count);
+void v3_neg_soa(vec3_soa_t res, vec3_soa_t v, int count);
+void v3_mul_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count);
+void v3_scale_soa(vec3_soa_t res, vec3_soa_t v, scalar_t s, int count);
+void v3_dot_soa(scalar_t *res, vec3_soa_t v1, vec3_soa_t v2, int count);
+void v3_cross_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count);
+void v3_length_soa(scalar_t *res, vec3_soa_t v, int count);
+void v3_length_sq_soa(scalar_t *res, vec3_soa_t v, int count);
+void v3_normalize_soa(vec3_soa_t res, vec3_soa_t v, int count);
+void v3_transform_soa(vec3_soa_t res, vec3_soa_t v, mat4_t m, int count);
+void v3_transform_soa_m3x4(vec3_soa_t res, vec3_soa_t v, mat3x4_t m, int count);
+void v3_reflect_soa(vec3_soa_t res, vec3_soa_t v, vec3_soa_t n, int count);
+void v3_lerp_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, scalar_t t, int count);
+
 /* C 4D vector functions */
 static inline vec4_t v4_cons(scalar_t x, scalar_t y, scalar_t z, scalar_t w);
 static inline void v4_print(FILE *fp, vec4_t v);
@@ -79,6 +125,12 @@ static inline scalar_t v4_length_sq(vec4_t v);
 static inline vec4_t v4_normalize(vec4_t v);
 static inline vec4_t v4_transform(vec4_t v, mat4_t m);
 
+/* strided array transforms, see v3_transform_points. The _project variant also
+ * performs the perspective divide on x, y, z, and leaves w intact.
+ */
+void v4_transform_array(vec4_t *res, int res_stride, const vec4_t *v, int v_stride, int count, mat4_t m);
+void v4_transform_project(vec4_t *res, int res_stride, const vec4_t *v, int v_stride, int count, mat4_t m);
+
 #ifdef __cplusplus
 }	/* extern "C" */
 
@@ -171,6 +223,8 @@ public:
 	Vector3 transformed(const Matrix3x3 &mat) const;
 	void transform(const Matrix4x4 &mat);
 	Vector3 transformed(const Matrix4x4 &mat) const;
+	void transform(const Matrix3x4 &mat);
+	Vector3 transformed(const Matrix3x4 &mat) const;
 	void transform(const Quaternion &quat);
 	Vector3 transformed(const Quaternion &quat) const;
 
@@ -215,6 +269,12 @@ inline void operator /=(Vector3 &vec, scalar_t scalar);
 
 
 inline Vector3 lerp(const Vector3 &a, const Vector3 &b, scalar_t t);
+
+/* array transforms, see v3_transform_points/v3_transform_dirs */
+void transform_points(Vector3 *res, const Vector3 *v, int count, const Matrix4x4 &mat,
+		int res_stride = 0, int v_stride = 0);
+void transform_dirs(Vector3 *res, const Vector3 *v, int count, const Matrix4x4 &mat,
+		int res_stride = 0, int v_stride = 0);
 inline Vector3 catmull_rom_spline(const Vector3 &v0, const Vector3 &v1,
 		const Vector3 &v2, const Vector3 &v3, scalar_t t);
 inline Vector3 bspline(const Vector3 &v0, const Vector3 &v1,
@@ -279,6 +339,12 @@ inline void operator /=(Vector4 &vec, scalar_t scalar);
 
 
 inline Vector4 lerp(const Vector4 &v0, const Vector4 &v1, scalar_t t);
+
+/* array transforms, see v4_transform_array/v4_transform_project */
+void transform_array(Vector4 *res, const Vector4 *v, int count, const Matrix4x4 &mat,
+		int res_stride = 0, int v_stride = 0);
+void transform_project(Vector4 *res, const Vector4 *v, int count, const Matrix4x4 &mat,
+		int res_stride = 0, int v_stride = 0);
 inline Vector4 catmull_rom_spline(const Vector4 &v0, const Vector4 &v1,
 		const Vector4 &v2, const Vector4 &v3, scalar_t t);
 inline Vector4 bspline(const Vector4 &v0, const Vector4 &v1,
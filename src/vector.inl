@@ -192,6 +192,24 @@ static inline vec3_t v3_transform(vec3_t v, mat4_t m)
 	return res;
 }
 
+static inline vec3_t v3_transform_m3x4(vec3_t v, mat3x4_t m)
+{
+	vec3_t res;
+	res.x = m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3];
+	res.y = m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3];
+	res.z = m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3];
+	return res;
+}
+
+static inline vec3_t v3_transform_dir_m3x4(vec3_t v, mat3x4_t m)
+{
+	vec3_t res;
+	res.x = m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z;
+	res.y = m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z;
+	res.z = m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z;
+	return res;
+}
+
 static inline vec3_t v3_rotate(vec3_t v, scalar_t x, scalar_t y, scalar_t z)
 {
 	void m4_rotate(mat4_t, scalar_t, scalar_t, scalar_t);
@@ -233,6 +251,15 @@ static inline vec3_t v3_lerp(vec3_t v1, vec3_t v2, scalar_t t)
 	return v1;
 }
 
+static inline vec3_soa_t v3_soa_cons(scalar_t *x, scalar_t *y, scalar_t *z)
+{
+	vec3_soa_t v;
+	v.x = x;
+	v.y = y;
+	v.z = z;
+	return v;
+}
+
 /* C 4D vector functions */
 static inline vec4_t v4_cons(scalar_t x, scalar_t y, scalar_t z, scalar_t w)
 {
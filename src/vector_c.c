@@ -0,0 +1,553 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Batch 3D vector functions over structure-of-arrays buffers.
+ *
+ * Each function runs a 4-wide SSE loop (when available) followed by a scalar
+ * loop for the remainder, which calls the regular inline v3_* functions. The
+ * SSE loops perform exactly the same operations in the same order as the
+ * scalar functions, so the results match them bit for bit.
+ */
+#include <math.h>
+#include "vector.h"
+#include "vmath_simd.h"
+#include "vmath_sched.h"
+
+static inline vec3_t load_v3(vec3_soa_t s, int i)
+{
+	return v3_cons(s.x[i], s.y[i], s.z[i]);
+}
+
+static inline void store_v3(vec3_soa_t s, int i, vec3_t v)
+{
+	s.x[i] = v.x;
+	s.y[i] = v.y;
+	s.z[i] = v.z;
+}
+
+#ifdef VMATH_SSE
+#define LOAD4(s, i, vx, vy, vz) \
+	do { \
+		vx = _mm_loadu_ps((s).x + (i)); \
+		vy = _mm_loadu_ps((s).y + (i)); \
+		vz = _mm_loadu_ps((s).z + (i)); \
+	} while(0)
+
+#define STORE4(s, i, vx, vy, vz) \
+	do { \
+		_mm_storeu_ps((s).x + (i), vx); \
+		_mm_storeu_ps((s).y + (i), vy); \
+		_mm_storeu_ps((s).z + (i), vz); \
+	} while(0)
+
+/* (x*x + y*y) + z*z, same evaluation order as v3_dot */
+#define DOT4(ax, ay, az, bx, by, bz) \
+	_mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz))
+#endif
+
+void v3_add_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 ax, ay, az, bx, by, bz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v1, i, ax, ay, az);
+		LOAD4(v2, i, bx, by, bz);
+		STORE4(res, i, _mm_add_ps(ax, bx), _mm_add_ps(ay, by), _mm_add_ps(az, bz));
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_add(load_v3(v1, i), load_v3(v2, i)));
+	}
+}
+
+void v3_sub_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 ax, ay, az, bx, by, bz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v1, i, ax, ay, az);
+		LOAD4(v2, i, bx, by, bz);
+		STORE4(res, i, _mm_sub_ps(ax, bx), _mm_sub_ps(ay, by), _mm_sub_ps(az, bz));
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_sub(load_v3(v1, i), load_v3(v2, i)));
+	}
+}
+
+void v3_neg_soa(vec3_soa_t res, vec3_soa_t v, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 vx, vy, vz;
+	__m128 sign = _mm_set1_ps(-0.0f);
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		STORE4(res, i, _mm_xor_ps(vx, sign), _mm_xor_ps(vy, sign), _mm_xor_ps(vz, sign));
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_neg(load_v3(v, i)));
+	}
+}
+
+void v3_mul_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 ax, ay, az, bx, by, bz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v1, i, ax, ay, az);
+		LOAD4(v2, i, bx, by, bz);
+		STORE4(res, i, _mm_mul_ps(ax, bx), _mm_mul_ps(ay, by), _mm_mul_ps(az, bz));
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_mul(load_v3(v1, i), load_v3(v2, i)));
+	}
+}
+
+void v3_scale_soa(vec3_soa_t res, vec3_soa_t v, scalar_t s, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 vx, vy, vz;
+	__m128 ss = _mm_set1_ps(s);
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		STORE4(res, i, _mm_mul_ps(vx, ss), _mm_mul_ps(vy, ss), _mm_mul_ps(vz, ss));
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_scale(load_v3(v, i), s));
+	}
+}
+
+void v3_dot_soa(scalar_t *res, vec3_soa_t v1, vec3_soa_t v2, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 ax, ay, az, bx, by, bz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v1, i, ax, ay, az);
+		LOAD4(v2, i, bx, by, bz);
+		_mm_storeu_ps(res + i, DOT4(ax, ay, az, bx, by, bz));
+	}
+#endif
+	for(; i<count; i++) {
+		res[i] = v3_dot(load_v3(v1, i), load_v3(v2, i));
+	}
+}
+
+void v3_cross_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 ax, ay, az, bx, by, bz, cx, cy, cz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v1, i, ax, ay, az);
+		LOAD4(v2, i, bx, by, bz);
+		cx = _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by));
+		cy = _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz));
+		cz = _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx));
+		STORE4(res, i, cx, cy, cz);
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_cross(load_v3(v1, i), load_v3(v2, i)));
+	}
+}
+
+void v3_length_soa(scalar_t *res, vec3_soa_t v, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 vx, vy, vz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		_mm_storeu_ps(res + i, _mm_sqrt_ps(DOT4(vx, vy, vz, vx, vy, vz)));
+	}
+#endif
+	for(; i<count; i++) {
+		res[i] = v3_length(load_v3(v, i));
+	}
+}
+
+void v3_length_sq_soa(scalar_t *res, vec3_soa_t v, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 vx, vy, vz;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		_mm_storeu_ps(res + i, DOT4(vx, vy, vz, vx, vy, vz));
+	}
+#endif
+	for(; i<count; i++) {
+		res[i] = v3_length_sq(load_v3(v, i));
+	}
+}
+
+void v3_normalize_soa(vec3_soa_t res, vec3_soa_t v, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 vx, vy, vz, len;
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		len = _mm_sqrt_ps(DOT4(vx, vy, vz, vx, vy, vz));
+		STORE4(res, i, _mm_div_ps(vx, len), _mm_div_ps(vy, len), _mm_div_ps(vz, len));
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_normalize(load_v3(v, i)));
+	}
+}
+
+/* only uses the top 3 rows of m, shared by the 4x4 and 3x4 versions */
+static void transform_soa(vec3_soa_t res, vec3_soa_t v, mat3x4_t m, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	int j;
+	__m128 vx, vy, vz, r[3];
+	__m128 mm[3][4];
+
+	for(j=0; j<3; j++) {
+		mm[j][0] = _mm_set1_ps(m[j][0]);
+		mm[j][1] = _mm_set1_ps(m[j][1]);
+		mm[j][2] = _mm_set1_ps(m[j][2]);
+		mm[j][3] = _mm_set1_ps(m[j][3]);
+	}
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		for(j=0; j<3; j++) {
+			r[j] = _mm_add_ps(_mm_mul_ps(mm[j][0], vx), _mm_mul_ps(mm[j][1], vy));
+			r[j] = _mm_add_ps(_mm_add_ps(r[j], _mm_mul_ps(mm[j][2], vz)), mm[j][3]);
+		}
+		STORE4(res, i, r[0], r[1], r[2]);
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_transform_m3x4(load_v3(v, i), m));
+	}
+}
+
+void v3_transform_soa(vec3_soa_t res, vec3_soa_t v, mat4_t m, int count)
+{
+	transform_soa(res, v, m, count);
+}
+
+void v3_transform_soa_m3x4(vec3_soa_t res, vec3_soa_t v, mat3x4_t m, int count)
+{
+	transform_soa(res, v, m, count);
+}
+
+void v3_reflect_soa(vec3_soa_t res, vec3_soa_t v, vec3_soa_t n, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 vx, vy, vz, nx, ny, nz, s;
+	__m128 two = _mm_set1_ps(2.0f);
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v, i, vx, vy, vz);
+		LOAD4(n, i, nx, ny, nz);
+		s = _mm_mul_ps(DOT4(vx, vy, vz, nx, ny, nz), two);
+		vx = _mm_sub_ps(_mm_mul_ps(nx, s), vx);
+		vy = _mm_sub_ps(_mm_mul_ps(ny, s), vy);
+		vz = _mm_sub_ps(_mm_mul_ps(nz, s), vz);
+		STORE4(res, i, vx, vy, vz);
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_reflect(load_v3(v, i), load_v3(n, i)));
+	}
+}
+
+void v3_lerp_soa(vec3_soa_t res, vec3_soa_t v1, vec3_soa_t v2, scalar_t t, int count)
+{
+	int i = 0;
+#ifdef VMATH_SSE
+	__m128 ax, ay, az, bx, by, bz;
+	__m128 tt = _mm_set1_ps(t);
+
+	for(; i<count - 3; i+=4) {
+		LOAD4(v1, i, ax, ay, az);
+		LOAD4(v2, i, bx, by, bz);
+		ax = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), tt));
+		ay = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), tt));
+		az = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), tt));
+		STORE4(res, i, ax, ay, az);
+	}
+#endif
+	for(; i<count; i++) {
+		store_v3(res, i, v3_lerp(load_v3(v1, i), load_v3(v2, i), t));
+	}
+}
+
+
+/* ---- strided array transforms ----
+ * The matrix columns are kept in SSE registers for the whole array, and each
+ * vector is computed as a linear combination of them. The additions happen in
+ * the same order as in v3_transform/v4_transform.
+ */
+#define NEXT(p, stride)	((p) = (void*)((char*)(p) + (stride)))
+#define NEXT_CONST(p, stride)	((p) = (const void*)((const char*)(p) + (stride)))
+
+#ifdef VMATH_SSE
+static inline void load_columns(__m128 *col, mat4_t m)
+{
+	int i;
+	for(i=0; i<4; i++) {
+		col[i] = _mm_setr_ps(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+}
+
+/* only the top 3 rows, lane 3 is 0 */
+static inline void load_columns3(__m128 *col, mat3x4_t m)
+{
+	int i;
+	for(i=0; i<4; i++) {
+		col[i] = _mm_setr_ps(m[0][i], m[1][i], m[2][i], 0);
+	}
+}
+
+static inline void store3(scalar_t *dest, __m128 v)
+{
+	_mm_storel_pi((__m64*)dest, v);
+	_mm_store_ss(dest + 2, _mm_movehl_ps(v, v));
+}
+#endif
+
+/* the 3D transforms only use the top 3 rows of the matrix, so the 4x4 and
+ * affine 3x4 versions share the same code.
+ */
+static void transform_points(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat3x4_t m)
+{
+	int i;
+#ifdef VMATH_SSE
+	__m128 col[4], r;
+#endif
+	if(!res_stride) res_stride = sizeof *res;
+	if(!v_stride) v_stride = sizeof *v;
+
+#ifdef VMATH_SSE
+	load_columns3(col, m);
+
+	for(i=0; i<count; i++) {
+		r = _mm_add_ps(_mm_mul_ps(col[0], _mm_set1_ps(v->x)), _mm_mul_ps(col[1], _mm_set1_ps(v->y)));
+		r = _mm_add_ps(_mm_add_ps(r, _mm_mul_ps(col[2], _mm_set1_ps(v->z))), col[3]);
+		store3(&res->x, r);
+
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#else
+	for(i=0; i<count; i++) {
+		*res = v3_transform_m3x4(*v, m);
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#endif
+}
+
+static void transform_dirs(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat3x4_t m)
+{
+	int i;
+#ifdef VMATH_SSE
+	__m128 col[4], r;
+#else
+	vec3_t tmp;
+#endif
+	if(!res_stride) res_stride = sizeof *res;
+	if(!v_stride) v_stride = sizeof *v;
+
+#ifdef VMATH_SSE
+	load_columns3(col, m);
+
+	for(i=0; i<count; i++) {
+		r = _mm_add_ps(_mm_mul_ps(col[0], _mm_set1_ps(v->x)), _mm_mul_ps(col[1], _mm_set1_ps(v->y)));
+		r = _mm_add_ps(r, _mm_mul_ps(col[2], _mm_set1_ps(v->z)));
+		store3(&res->x, r);
+
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#else
+	for(i=0; i<count; i++) {
+		tmp.x = m[0][0] * v->x + m[0][1] * v->y + m[0][2] * v->z;
+		tmp.y = m[1][0] * v->x + m[1][1] * v->y + m[1][2] * v->z;
+		tmp.z = m[2][0] * v->x + m[2][1] * v->y + m[2][2] * v->z;
+		*res = tmp;
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#endif
+}
+
+void v3_transform_points(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat4_t m)
+{
+	transform_points(res, res_stride, v, v_stride, count, m);
+}
+
+void v3_transform_dirs(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat4_t m)
+{
+	transform_dirs(res, res_stride, v, v_stride, count, m);
+}
+
+void v3_transform_points_m3x4(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat3x4_t m)
+{
+	transform_points(res, res_stride, v, v_stride, count, m);
+}
+
+void v3_transform_dirs_m3x4(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count, mat3x4_t m)
+{
+	transform_dirs(res, res_stride, v, v_stride, count, m);
+}
+
+struct transform_job {
+	vec3_t *res;
+	const vec3_t *v;
+	int res_stride, v_stride;
+	scalar_t (*m)[4];
+	int dirs;
+};
+
+static void transform_job(int start, int end, void *cls)
+{
+	struct transform_job *job = cls;
+	vec3_t *res = (vec3_t*)((char*)job->res + (size_t)start * job->res_stride);
+	const vec3_t *v = (const vec3_t*)((const char*)job->v + (size_t)start * job->v_stride);
+
+	if(job->dirs) {
+		transform_dirs(res, job->res_stride, v, job->v_stride, end - start, job->m);
+	} else {
+		transform_points(res, job->res_stride, v, job->v_stride, end - start, job->m);
+	}
+}
+
+static void transform_mt(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count,
+		scalar_t (*m)[4], int dirs, int num_threads, int chunk_size)
+{
+	struct transform_job job;
+
+	job.res = res;
+	job.v = v;
+	job.res_stride = res_stride ? res_stride : (int)sizeof *res;
+	job.v_stride = v_stride ? v_stride : (int)sizeof *v;
+	job.m = m;
+	job.dirs = dirs;
+	vmath_parallel_for(count, num_threads, chunk_size, transform_job, &job);
+}
+
+void v3_transform_points_mt(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count,
+		mat4_t m, int num_threads, int chunk_size)
+{
+	transform_mt(res, res_stride, v, v_stride, count, m, 0, num_threads, chunk_size);
+}
+
+void v3_transform_dirs_mt(vec3_t *res, int res_stride, const vec3_t *v, int v_stride, int count,
+		mat4_t m, int num_threads, int chunk_size)
+{
+	transform_mt(res, res_stride, v, v_stride, count, m, 1, num_threads, chunk_size);
+}
+
+void v4_transform_array(vec4_t *res, int res_stride, const vec4_t *v, int v_stride, int count, mat4_t m)
+{
+	int i;
+#ifdef VMATH_SSE
+	__m128 col[4], r;
+#endif
+	if(!res_stride) res_stride = sizeof *res;
+	if(!v_stride) v_stride = sizeof *v;
+
+#ifdef VMATH_SSE
+	load_columns(col, m);
+
+	for(i=0; i<count; i++) {
+		r = _mm_add_ps(_mm_mul_ps(col[0], _mm_set1_ps(v->x)), _mm_mul_ps(col[1], _mm_set1_ps(v->y)));
+		r = _mm_add_ps(r, _mm_mul_ps(col[2], _mm_set1_ps(v->z)));
+		r = _mm_add_ps(r, _mm_mul_ps(col[3], _mm_set1_ps(v->w)));
+		_mm_storeu_ps(&res->x, r);
+
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#else
+	for(i=0; i<count; i++) {
+		*res = v4_transform(*v, m);
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#endif
+}
+
+void v4_transform_project(vec4_t *res, int res_stride, const vec4_t *v, int v_stride, int count, mat4_t m)
+{
+	int i;
+#ifdef VMATH_SSE
+	__m128 col[4], r, q;
+#else
+	vec4_t tmp;
+#endif
+	if(!res_stride) res_stride = sizeof *res;
+	if(!v_stride) v_stride = sizeof *v;
+
+#ifdef VMATH_SSE
+	load_columns(col, m);
+
+	for(i=0; i<count; i++) {
+		r = _mm_add_ps(_mm_mul_ps(col[0], _mm_set1_ps(v->x)), _mm_mul_ps(col[1], _mm_set1_ps(v->y)));
+		r = _mm_add_ps(r, _mm_mul_ps(col[2], _mm_set1_ps(v->z)));
+		r = _mm_add_ps(r, _mm_mul_ps(col[3], _mm_set1_ps(v->w)));
+
+		/* divide by w, then put the original w back in the last lane */
+		q = _mm_div_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+		r = _mm_shuffle_ps(q, r, _MM_SHUFFLE(3, 3, 2, 2));
+		r = _mm_shuffle_ps(q, r, _MM_SHUFFLE(2, 0, 1, 0));
+		_mm_storeu_ps(&res->x, r);
+
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#else
+	for(i=0; i<count; i++) {
+		tmp = v4_transform(*v, m);
+		tmp.x /= tmp.w;
+		tmp.y /= tmp.w;
+		tmp.z /= tmp.w;
+		*res = tmp;
+		NEXT_CONST(v, v_stride);
+		NEXT(res, res_stride);
+	}
+#endif
+}
@@ -18,6 +18,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <math.h>
 #include "vmath.h"
+#include "vmath_noise.h"
+#include "vmath_thread.h"
 
 #if defined(__APPLE__) && !defined(TARGET_IPHONE)
 #include <xmmintrin.h>
@@ -148,131 +150,138 @@ scalar_t bezier(scalar_t a, scalar_t b, scalar_t c, scalar_t d, scalar_t t)
 	return (a * omt3) + (b * f * omt) + (c * f * t) + (d * t3);
 }
 
-/* ---- Ken Perlin's implementation of noise ---- */
-
-#define B	0x100
-#define BM	0xff
-#define N	0x1000
-#define NP	12   /* 2^N */
-#define NM	0xfff
-
-#define s_curve(t) (t * t * (3.0f - 2.0f * t))
-
-#define setup(elem, b0, b1, r0, r1) \
-	do {							\
-		scalar_t t = elem + N;		\
-		b0 = ((int)t) & BM;			\
-		b1 = (b0 + 1) & BM;			\
-		r0 = t - (int)t;			\
-		r1 = r0 - 1.0f;				\
-	} while(0)
+/* ---- Ken Perlin's implementation of noise, see vmath_noise.h ---- */
 
+/* private generator for the noise tables, so that initializing a context
+ * doesn't depend on, or disturb, the state of rand().
+ */
+static unsigned long noise_rand(unsigned long *state)
+{
+	unsigned long x = *state;
+	x ^= (x << 13) & 0xffffffff;
+	x ^= x >> 17;
+	x ^= (x << 5) & 0xffffffff;
+	*state = x;
+	return x >> 8;
+}
 
-static int perm[B + B + 2];			/* permuted index from g_n onto themselves */
-static vec3_t grad3[B + B + 2];		/* 3D random gradients */
-static vec2_t grad2[B + B + 2];		/* 2D random gradients */
-static scalar_t grad1[B + B + 2];	/* 1D random ... slopes */
-static int tables_valid;
+#define RAND_GRAD(st)	((scalar_t)((int)(noise_rand(st) % (B + B)) - B) / B)
 
-static void init_noise()
+void noise_ctx_init(noise_ctx_t *ctx, unsigned int seed)
 {
 	int i;
+	unsigned long state;
+
+	/* scramble the seed a bit, and make sure the xorshift state isn't 0 */
+	state = ((unsigned long)seed * 2654435769UL + 1013904223UL) & 0xffffffff;
+	if(!state) state = 1;
 
 	/* calculate random gradients */
 	for(i=0; i<B; i++) {
-		perm[i] = i;	/* .. and initialize permutation mapping to identity */
-
-		grad1[i] = (scalar_t)((rand() % (B + B)) - B) / B;
-
-		grad2[i].x = (scalar_t)((rand() % (B + B)) - B) / B;
-		grad2[i].y = (scalar_t)((rand() % (B + B)) - B) / B;
-		grad2[i] = v2_normalize(grad2[i]);
-
-		grad3[i].x = (scalar_t)((rand() % (B + B)) - B) / B;
-		grad3[i].y = (scalar_t)((rand() % (B + B)) - B) / B;
-		grad3[i].z = (scalar_t)((rand() % (B + B)) - B) / B;
-		grad3[i] = v3_normalize(grad3[i]);
+		ctx->perm[i] = i;	/* .. and initialize permutation mapping to identity */
+
+		ctx->grad1[i] = RAND_GRAD(&state);
+
+		do {
+			ctx->grad2[i].x = RAND_GRAD(&state);
+			ctx->grad2[i].y = RAND_GRAD(&state);
+		} while(ctx->grad2[i].x == 0.0 && ctx->grad2[i].y == 0.0);
+		ctx->grad2[i] = v2_normalize(ctx->grad2[i]);
+
+		do {
+			ctx->grad3[i].x = RAND_GRAD(&state);
+			ctx->grad3[i].y = RAND_GRAD(&state);
+			ctx->grad3[i].z = RAND_GRAD(&state);
+		} while(ctx->grad3[i].x == 0.0 && ctx->grad3[i].y == 0.0 && ctx->grad3[i].z == 0.0);
+		ctx->grad3[i] = v3_normalize(ctx->grad3[i]);
 	}
 
 	/* permute indices by swapping them randomly */
 	for(i=0; i<B; i++) {
-		int rand_idx = rand() % B;
+		int rand_idx = noise_rand(&state) % B;
 
-		int tmp = perm[i];
-		perm[i] = perm[rand_idx];
-		perm[rand_idx] = tmp;
+		int tmp = ctx->perm[i];
+		ctx->perm[i] = ctx->perm[rand_idx];
+		ctx->perm[rand_idx] = tmp;
 	}
 
 	/* fill up the rest of the arrays by duplicating the existing gradients */
 	/* and permutations */
 	for(i=0; i<B+2; i++) {
-		perm[B + i] = perm[i];
-		grad1[B + i] = grad1[i];
-		grad2[B + i] = grad2[i];
-		grad3[B + i] = grad3[i];
+		ctx->perm[B + i] = ctx->perm[i];
+		ctx->grad1[B + i] = ctx->grad1[i];
+		ctx->grad2[B + i] = ctx->grad2[i];
+		ctx->grad3[B + i] = ctx->grad3[i];
 	}
 }
 
-scalar_t noise1(scalar_t x)
+/* the default context, used by the context-less noise functions, is
+ * initialized exactly once, on first use, from whichever thread gets there first.
+ */
+static noise_ctx_t def_noise_ctx;
+static vmath_once_t def_noise_once = VMATH_ONCE_INIT;
+
+static void init_def_noise(void)
+{
+	noise_ctx_init(&def_noise_ctx, 0);
+}
+
+const noise_ctx_t *noise_default_ctx(void)
+{
+	vmath_once(&def_noise_once, init_def_noise);
+	return &def_noise_ctx;
+}
+
+scalar_t noise1_ctx(const noise_ctx_t *ctx, scalar_t x)
 {
 	int bx0, bx1;
 	scalar_t rx0, rx1, sx, u, v;
 
-	if(!tables_valid) {
-		init_noise();
-		tables_valid = 1;
-	}
-
 	setup(x, bx0, bx1, rx0, rx1);
 	sx = s_curve(rx0);
-	u = rx0 * grad1[perm[bx0]];
-	v = rx1 * grad1[perm[bx1]];
+	u = rx0 * ctx->grad1[ctx->perm[bx0]];
+	v = rx1 * ctx->grad1[ctx->perm[bx1]];
 
 	return lerp(u, v, sx);
 }
 
-scalar_t noise2(scalar_t x, scalar_t y)
+scalar_t noise2_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y)
 {
 	int i, j, b00, b10, b01, b11;
 	int bx0, bx1, by0, by1;
 	scalar_t rx0, rx1, ry0, ry1;
 	scalar_t sx, sy, u, v, a, b;
 
-	if(!tables_valid) {
-		init_noise();
-		tables_valid = 1;
-	}
-
 	setup(x, bx0, bx1, rx0, rx1);
 	setup(y, by0, by1, ry0, ry1);
 
-	i = perm[bx0];
-	j = perm[bx1];
+	i = ctx->perm[bx0];
+	j = ctx->perm[bx1];
 
-	b00 = perm[i + by0];
-	b10 = perm[j + by0];
-	b01 = perm[i + by1];
-	b11 = perm[j + by1];
+	b00 = ctx->perm[i + by0];
+	b10 = ctx->perm[j + by0];
+	b01 = ctx->perm[i + by1];
+	b11 = ctx->perm[j + by1];
 
 	/* calculate hermite inteprolating factors */
 	sx = s_curve(rx0);
 	sy = s_curve(ry0);
 
 	/* interpolate along the left edge */
-	u = v2_dot(grad2[b00], v2_cons(rx0, ry0));
-	v = v2_dot(grad2[b10], v2_cons(rx1, ry0));
+	u = v2_dot(ctx->grad2[b00], v2_cons(rx0, ry0));
+	v = v2_dot(ctx->grad2[b10], v2_cons(rx1, ry0));
 	a = lerp(u, v, sx);
 
 	/* interpolate along the right edge */
-	u = v2_dot(grad2[b01], v2_cons(rx0, ry1));
-	v = v2_dot(grad2[b11], v2_cons(rx1, ry1));
+	u = v2_dot(ctx->grad2[b01], v2_cons(rx0, ry1));
+	v = v2_dot(ctx->grad2[b11], v2_cons(rx1, ry1));
 	b = lerp(u, v, sx);
 
 	/* interpolate between them */
 	return lerp(a, b, sy);
 }
 
-scalar_t noise3(scalar_t x, scalar_t y, scalar_t z)
+scalar_t noise3_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, scalar_t z)
 {
 	int i, j;
 	int bx0, bx1, by0, by1, bz0, bz1;
@@ -281,22 +290,17 @@ scalar_t noise3(scalar_t x, scalar_t y, scalar_t z)
 	scalar_t sx, sy, sz;
 	scalar_t u, v, a, b, c, d;
 
-	if(!tables_valid) {
-		init_noise();
-		tables_valid = 1;
-	}
-
 	setup(x, bx0, bx1, rx0, rx1);
 	setup(y, by0, by1, ry0, ry1);
 	setup(z, bz0, bz1, rz0, rz1);
 
-	i = perm[bx0];
-	j = perm[bx1];
+	i = ctx->perm[bx0];
+	j = ctx->perm[bx1];
 
-	b00 = perm[i + by0];
-	b10 = perm[j + by0];
-	b01 = perm[i + by1];
-	b11 = perm[j + by1];
+	b00 = ctx->perm[i + by0];
+	b10 = ctx->perm[j + by0];
+	b01 = ctx->perm[i + by1];
+	b11 = ctx->perm[j + by1];
 
 	/* calculate hermite interpolating factors */
 	sx = s_curve(rx0);
@@ -304,23 +308,23 @@ scalar_t noise3(scalar_t x, scalar_t y, scalar_t z)
 	sz = s_curve(rz0);
 
 	/* interpolate along the top slice of the cell */
-	u = v3_dot(grad3[b00 + bz0], v3_cons(rx0, ry0, rz0));
-	v = v3_dot(grad3[b10 + bz0], v3_cons(rx1, ry0, rz0));
+	u = v3_dot(ctx->grad3[b00 + bz0], v3_cons(rx0, ry0, rz0));
+	v = v3_dot(ctx->grad3[b10 + bz0], v3_cons(rx1, ry0, rz0));
 	a = lerp(u, v, sx);
 
-	u = v3_dot(grad3[b01 + bz0], v3_cons(rx0, ry1, rz0));
-	v = v3_dot(grad3[b11 + bz0], v3_cons(rx1, ry1, rz0));
+	u = v3_dot(ctx->grad3[b01 + bz0], v3_cons(rx0, ry1, rz0));
+	v = v3_dot(ctx->grad3[b11 + bz0], v3_cons(rx1, ry1, rz0));
 	b = lerp(u, v, sx);
 
 	c = lerp(a, b, sy);
 
 	/* interpolate along the bottom slice of the cell */
-	u = v3_dot(grad3[b00 + bz1], v3_cons(rx0, ry0, rz1));
-	v = v3_dot(grad3[b10 + bz1], v3_cons(rx1, ry0, rz1));
+	u = v3_dot(ctx->grad3[b00 + bz1], v3_cons(rx0, ry0, rz1));
+	v = v3_dot(ctx->grad3[b10 + bz1], v3_cons(rx1, ry0, rz1));
 	a = lerp(u, v, sx);
 
-	u = v3_dot(grad3[b01 + bz1], v3_cons(rx0, ry1, rz1));
-	v = v3_dot(grad3[b11 + bz1], v3_cons(rx1, ry1, rz1));
+	u = v3_dot(ctx->grad3[b01 + bz1], v3_cons(rx0, ry1, rz1));
+	v = v3_dot(ctx->grad3[b11 + bz1], v3_cons(rx1, ry1, rz1));
 	b = lerp(u, v, sx);
 
 	d = lerp(a, b, sy);
@@ -329,68 +333,113 @@ scalar_t noise3(scalar_t x, scalar_t y, scalar_t z)
 	return lerp(c, d, sz);
 }
 
-scalar_t fbm1(scalar_t x, int octaves)
+scalar_t fbm1_ctx(const noise_ctx_t *ctx, scalar_t x, int octaves)
 {
 	int i;
 	scalar_t res = 0.0f, freq = 1.0f;
 	for(i=0; i<octaves; i++) {
-		res += noise1(x * freq) / freq;
+		res += noise1_ctx(ctx, x * freq) / freq;
 		freq *= 2.0f;
 	}
 	return res;
 }
 
-scalar_t fbm2(scalar_t x, scalar_t y, int octaves)
+scalar_t fbm2_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, int octaves)
 {
 	int i;
 	scalar_t res = 0.0f, freq = 1.0f;
 	for(i=0; i<octaves; i++) {
-		res += noise2(x * freq, y * freq) / freq;
+		res += noise2_ctx(ctx, x * freq, y * freq) / freq;
 		freq *= 2.0f;
 	}
 	return res;
 }
 
-scalar_t fbm3(scalar_t x, scalar_t y, scalar_t z, int octaves)
+scalar_t fbm3_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, scalar_t z, int octaves)
 {
 	int i;
 	scalar_t res = 0.0f, freq = 1.0f;
 	for(i=0; i<octaves; i++) {
-		res += noise3(x * freq, y * freq, z * freq) / freq;
+		res += noise3_ctx(ctx, x * freq, y * freq, z * freq) / freq;
 		freq *= 2.0f;
 	}
 	return res;
 }
 
-scalar_t turbulence1(scalar_t x, int octaves)
+scalar_t turbulence1_ctx(const noise_ctx_t *ctx, scalar_t x, int octaves)
 {
 	int i;
 	scalar_t res = 0.0f, freq = 1.0f;
 	for(i=0; i<octaves; i++) {
-		res += fabs(noise1(x * freq) / freq);
+		res += fabs(noise1_ctx(ctx, x * freq) / freq);
 		freq *= 2.0f;
 	}
 	return res;
 }
 
-scalar_t turbulence2(scalar_t x, scalar_t y, int octaves)
+scalar_t turbulence2_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, int octaves)
 {
 	int i;
 	scalar_t res = 0.0f, freq = 1.0f;
 	for(i=0; i<octaves; i++) {
-		res += fabs(noise2(x * freq, y * freq) / freq);
+		res += fabs(noise2_ctx(ctx, x * freq, y * freq) / freq);
 		freq *= 2.0f;
 	}
 	return res;
 }
 
-scalar_t turbulence3(scalar_t x, scalar_t y, scalar_t z, int octaves)
+scalar_t turbulence3_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, scalar_t z, int octaves)
 {
 	int i;
 	scalar_t res = 0.0f, freq = 1.0f;
 	for(i=0; i<octaves; i++) {
-		res += fabs(noise3(x * freq, y * freq, z * freq) / freq);
+		res += fabs(noise3_ctx(ctx, x * freq, y * freq, z * freq) / freq);
 		freq *= 2.0f;
 	}
 	return res;
 }
+
+scalar_t noise1(scalar_t x)
+{
+	return noise1_ctx(noise_default_ctx(), x);
+}
+
+scalar_t noise2(scalar_t x, scalar_t y)
+{
+	return noise2_ctx(noise_default_ctx(), x, y);
+}
+
+scalar_t noise3(scalar_t x, scalar_t y, scalar_t z)
+{
+	return noise3_ctx(noise_default_ctx(), x, y, z);
+}
+
+scalar_t fbm1(scalar_t x, int octaves)
+{
+	return fbm1_ctx(noise_default_ctx(), x, octaves);
+}
+
+scalar_t fbm2(scalar_t x, scalar_t y, int octaves)
+{
+	return fbm2_ctx(noise_default_ctx(), x, y, octaves);
+}
+
+scalar_t fbm3(scalar_t x, scalar_t y, scalar_t z, int octaves)
+{
+	return fbm3_ctx(noise_default_ctx(), x, y, z, octaves);
+}
+
+scalar_t turbulence1(scalar_t x, int octaves)
+{
+	return turbulence1_ctx(noise_default_ctx(), x, octaves);
+}
+
+scalar_t turbulence2(scalar_t x, scalar_t y, int octaves)
+{
+	return turbulence2_ctx(noise_default_ctx(), x, y, octaves);
+}
+
+scalar_t turbulence3(scalar_t x, scalar_t y, scalar_t z, int octaves)
+{
+	return turbulence3_ctx(noise_default_ctx(), x, y, z, octaves);
+}
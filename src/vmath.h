@@ -21,6 +21,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <math.h>
 #include "vmath_types.h"
+#include "vmath_sched.h"
+#include "rng.h"
+#include "qmc.h"
 
 #ifndef M_PI
 #define M_PI	PI
@@ -48,6 +51,19 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define round(x)	((x) >= 0 ? (x) + 0.5 : (x) - 0.5)
 #endif
 
+#define NOISE_TABLE_SIZE	256
+
+/* noise context: the permutation and gradient tables of the perlin noise
+ * functions. It's never modified after noise_ctx_init, so the same context
+ * can be used by any number of threads concurrently.
+ */
+typedef struct {
+	int perm[NOISE_TABLE_SIZE * 2 + 2];
+	vec3_t grad3[NOISE_TABLE_SIZE * 2 + 2];
+	vec2_t grad2[NOISE_TABLE_SIZE * 2 + 2];
+	scalar_t grad1[NOISE_TABLE_SIZE * 2 + 2];
+} noise_ctx_t;
+
 #ifdef __cplusplus
 extern "C" {
 #endif	/* __cplusplus */
@@ -57,6 +73,7 @@ void disable_fpexcept(void);
 
 static inline scalar_t smoothstep(float a, float b, float x);
 
+/* compatibility wrappers, using the generator of the calling thread (rng_default) */
 static inline scalar_t frand(scalar_t range);
 static inline vec3_t sphrand(scalar_t rad);
 
@@ -69,6 +86,67 @@ scalar_t bspline(scalar_t a, scalar_t b, scalar_t c, scalar_t d, scalar_t t);
 scalar_t spline(scalar_t a, scalar_t b, scalar_t c, scalar_t d, scalar_t t);
 scalar_t bezier(scalar_t a, scalar_t b, scalar_t c, scalar_t d, scalar_t t);
 
+void noise_ctx_init(noise_ctx_t *ctx, unsigned int seed);
+
+/* the context used by the noise functions without a context argument. It's
+ * initialized on first use in a thread-safe manner.
+ */
+const noise_ctx_t *noise_default_ctx(void);
+
+scalar_t noise1_ctx(const noise_ctx_t *ctx, scalar_t x);
+scalar_t noise2_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y);
+scalar_t noise3_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, scalar_t z);
+
+scalar_t fbm1_ctx(const noise_ctx_t *ctx, scalar_t x, int octaves);
+scalar_t fbm2_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, int octaves);
+scalar_t fbm3_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, scalar_t z, int octaves);
+
+scalar_t turbulence1_ctx(const noise_ctx_t *ctx, scalar_t x, int octaves);
+scalar_t turbulence2_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, int octaves);
+scalar_t turbulence3_ctx(const noise_ctx_t *ctx, scalar_t x, scalar_t y, scalar_t z, int octaves);
+
+/* batch evaluation over a regular grid: sample (i, j, k) is taken at
+ * (x0 + i * dx, y0 + j * dy, z0 + k * dz) and written to res[(k * ysz + j) * xsz + i].
+ * The results are the same as calling the scalar functions for each sample.
+ * Returns -1 if it fails to allocate its scratch memory, 0 otherwise.
+ */
+int noise2_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy);
+int noise3_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz);
+
+int fbm2_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int octaves);
+int fbm3_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves);
+
+int turbulence2_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int octaves);
+int turbulence3_grid_ctx(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves);
+
+/* same as the 3D grid functions, with the rows of xsz samples split across
+ * num_threads threads (0 for one per processor), chunk_size rows at a time
+ * (0 for the default, see vmath_parallel_for)
+ */
+int noise3_grid_ctx_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz,
+		int num_threads, int chunk_size);
+int fbm3_grid_ctx_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves,
+		int num_threads, int chunk_size);
+int turbulence3_grid_ctx_mt(const noise_ctx_t *ctx, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int octaves,
+		int num_threads, int chunk_size);
+
+/* batch evaluation at an array of points */
+void noise2_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count);
+void noise3_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count);
+void fbm2_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count, int octaves);
+void fbm3_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count, int octaves);
+void turbulence2_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec2_t *pts, int count, int octaves);
+void turbulence3_points_ctx(const noise_ctx_t *ctx, scalar_t *res, const vec3_t *pts, int count, int octaves);
+
 scalar_t noise1(scalar_t x);
 scalar_t noise2(scalar_t x, scalar_t y);
 scalar_t noise3(scalar_t x, scalar_t y, scalar_t z);
@@ -90,7 +168,14 @@ scalar_t turbulence3(scalar_t x, scalar_t y, scalar_t z, int octaves);
 #include "vector.h"
 #include "matrix.h"
 #include "quat.h"
+#include "dualquat.h"
 #include "ray.h"
 #include "geom.h"
+#include "frustum.h"
+#include "ray_stream.h"
+#include "bvh.h"
+#include "bvh_inst.h"
+#include "skin.h"
+#include "xform_tree.h"
 
 #endif	/* LIBVMATH_VMATH_H_ */
@@ -0,0 +1,47 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* internal header, shared by the scalar noise functions and the batch
+ * (grid and array) ones, which must find the same lattice cells.
+ */
+#ifndef LIBVMATH_NOISE_H_
+#define LIBVMATH_NOISE_H_
+
+#include "vmath.h"
+
+/* ---- Ken Perlin's implementation of noise ---- */
+
+#define B	NOISE_TABLE_SIZE
+#define BM	(NOISE_TABLE_SIZE - 1)
+#define N	0x1000
+
+/* the lattice coordinates are wrapped with BM as a mask */
+typedef char noise_table_size_is_pow2[(B & BM) == 0 ? 1 : -1];
+
+#define s_curve(t) (t * t * (3.0f - 2.0f * t))
+
+#define setup(elem, b0, b1, r0, r1) \
+	do {							\
+		scalar_t t = elem + N;		\
+		b0 = ((int)t) & BM;			\
+		b1 = (b0 + 1) & BM;			\
+		r0 = t - (int)t;			\
+		r1 = r0 - 1.0f;				\
+	} while(0)
+
+#endif	/* LIBVMATH_NOISE_H_ */
@@ -0,0 +1,78 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* the task scheduler behind all the multi-threaded batch functions (the ones
+ * with a num_threads argument). A pool of threads is started on first use,
+ * and kept waiting for the next batch. A batch is split in chunks, and every
+ * thread starts with an equal share of consecutive chunks in its own deque.
+ * A thread takes its own chunks in order from the front, and when it runs
+ * out, it steals the back half of the chunks left to another thread. So
+ * uneven work balances itself out, while each thread mostly works through
+ * adjacent data.
+ *
+ * Idle pool threads wait each on its own condition variable. A batch takes
+ * only the idle threads it needs off the idle stack (the one short critical
+ * section under the pool lock) and wakes each of them directly. If there
+ * aren't enough idle threads, because other batches are running, the batch
+ * is listed as open, and threads finishing their part of any batch join an
+ * open one before going idle. That way concurrent batches, and batches
+ * started from within another batch, share the pool instead of waiting for
+ * each other.
+ */
+#ifndef LIBVMATH_SCHED_H_
+#define LIBVMATH_SCHED_H_
+
+/* largest number of threads working on one batch */
+#define VMATH_MAX_THREADS	256
+
+typedef void (*vmath_range_func_t)(int start, int end, void *cls);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* number of processors available, at least 1 */
+int vmath_num_cpus(void);
+
+/* calls func for every chunk of chunk_size items of [0, count), chunk k being
+ * [k * chunk_size, (k + 1) * chunk_size) (the last one may be shorter), and
+ * waits for all of them. func is called from up to num_threads threads at
+ * once, including the calling one. num_threads <= 0 means one thread per
+ * processor, and chunk_size <= 0 picks one which gives each thread several
+ * chunks to balance. May be called from several threads at once, and from
+ * within func: the batches share the pool threads, and the calling thread
+ * always works on its own batch, so it completes even when no pool thread is
+ * free to help.
+ */
+void vmath_parallel_for(int count, int num_threads, int chunk_size, vmath_range_func_t func, void *cls);
+
+/* the chunk size vmath_parallel_for uses for these arguments, rounded up to a
+ * multiple of align, so that callers can keep per chunk results
+ */
+int vmath_chunk_size(int count, int num_threads, int chunk_size, int align);
+
+/* stops the threads of the pool, for instance before unloading the library.
+ * The next batch starts them again. Must not be called during a batch.
+ */
+void vmath_sched_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_SCHED_H_ */
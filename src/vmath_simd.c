@@ -0,0 +1,107 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include "vmath_simd.h"
+#include "vmath_thread.h"
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define CPU_X86
+#endif
+
+#if defined(CPU_X86) && defined(_MSC_VER)
+#include <intrin.h>
+
+static void cpuid(int leaf, unsigned int *regs)
+{
+	int r[4];
+	__cpuidex(r, leaf, 0);
+	regs[0] = r[0]; regs[1] = r[1]; regs[2] = r[2]; regs[3] = r[3];
+}
+
+static unsigned int get_xcr0(void)
+{
+	return (unsigned int)_xgetbv(0);
+}
+
+#elif defined(CPU_X86) && defined(__GNUC__)
+#include <cpuid.h>
+
+static void cpuid(int leaf, unsigned int *regs)
+{
+	regs[0] = regs[1] = regs[2] = regs[3] = 0;
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+}
+
+static unsigned int get_xcr0(void)
+{
+	unsigned int eax, edx;
+	/* xgetbv opcode, for assemblers which don't know the mnemonic */
+	__asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+}
+#else
+#undef CPU_X86
+#endif
+
+static int detect_features(void)
+{
+	int res = 0;
+#ifdef CPU_X86
+	unsigned int regs[4], max_leaf;
+
+	cpuid(0, regs);
+	max_leaf = regs[0];
+	if(max_leaf < 1) return 0;
+
+	cpuid(1, regs);
+	if(regs[3] & (1 << 26)) res |= VMATH_CPU_SSE2;
+
+	/* AVX needs OSXSAVE, and the OS must save the XMM and YMM state */
+	if((regs[2] & (1 << 27)) && (regs[2] & (1 << 28)) && (get_xcr0() & 6) == 6) {
+		res |= VMATH_CPU_AVX;
+		if(regs[2] & (1 << 12)) res |= VMATH_CPU_FMA;
+
+		if(max_leaf >= 7) {
+			cpuid(7, regs);
+			if(regs[1] & (1 << 5)) res |= VMATH_CPU_AVX2;
+		}
+	}
+#endif
+	return res;
+}
+
+static int features;
+static vmath_once_t features_once = VMATH_ONCE_INIT;
+
+static void init_features(void)
+{
+	int res = detect_features();
+	const char *mask = getenv("VMATH_CPU_MASK");
+
+	if(mask) {
+		res &= (int)strtol(mask, 0, 0);
+	}
+	features = res;
+}
+
+int vmath_cpu_features(void)
+{
+	vmath_once(&features_once, init_features);
+	return features;
+}
@@ -0,0 +1,75 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* internal header, only included by the library source files which
+ * implement the batch (array) functions.
+ */
+#ifndef LIBVMATH_SIMD_H_
+#define LIBVMATH_SIMD_H_
+
+#include "vmath_config.h"
+
+/* the SSE paths are only usable with single precision scalars. Define
+ * VMATH_NO_SIMD to force the plain C loops everywhere.
+ */
+#if defined(SINGLE_PRECISION_MATH) && !defined(VMATH_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VMATH_SSE
+#include <emmintrin.h>
+#endif
+#endif
+
+/* AVX/FMA code paths are compiled separately with per-function target
+ * attributes and selected at runtime with vmath_cpu_features, so the library
+ * doesn't need to be built with -mavx to use them.
+ */
+#if defined(VMATH_SSE) && (defined(__clang__) || defined(_MSC_VER) || \
+		(__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)))
+#define VMATH_AVX
+#include <immintrin.h>
+
+#ifdef __GNUC__
+#define VMATH_TARGET_AVX	__attribute__((target("avx")))
+#define VMATH_TARGET_FMA	__attribute__((target("avx,fma")))
+#else
+#define VMATH_TARGET_AVX
+#define VMATH_TARGET_FMA
+#endif
+#endif	/* VMATH_AVX */
+
+#define VMATH_CPU_SSE2	1
+#define VMATH_CPU_AVX	2
+#define VMATH_CPU_FMA	4
+#define VMATH_CPU_AVX2	8
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* returns a bitmask of the VMATH_CPU_* features supported by the CPU and
+ * the operating system. Detected once and cached. If the VMATH_CPU_MASK
+ * environment variable is set, features not in its value are turned off, so
+ * VMATH_CPU_MASK=0 runs the baseline code paths (used by make check).
+ */
+int vmath_cpu_features(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_SIMD_H_ */
@@ -0,0 +1,586 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* clock_gettime is hidden by -std=c89 otherwise */
+#if defined(__unix__) && !defined(__APPLE__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE	199309L
+#endif
+
+#include <stdlib.h>
+#include <time.h>
+#include "vmath_thread.h"
+
+#if defined(_WIN32)
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT	0x0600
+#endif
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define USE_WIN32_THREADS
+#elif defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#define USE_PTHREADS
+#endif
+
+/* chunks per thread picked by vmath_chunk_size, enough to even out the load */
+#define CHUNKS_PER_THREAD	8
+
+#if defined(USE_WIN32_THREADS)
+typedef HANDLE thread_t;
+typedef SRWLOCK mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define MUTEX_INITIALIZER	SRWLOCK_INIT
+#elif defined(USE_PTHREADS)
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define MUTEX_INITIALIZER	PTHREAD_MUTEX_INITIALIZER
+#else
+typedef int thread_t;
+typedef int mutex_t;
+typedef int cond_t;
+#define MUTEX_INITIALIZER	0
+#endif
+
+/* chunks [lo, hi) of a batch, not started yet. The owner takes them from lo,
+ * thieves from hi. Padded to keep the locks of different threads out of each
+ * other's cache lines.
+ */
+struct deque {
+	int lo, hi;
+	mutex_t lock;
+	char pad[64];
+};
+
+struct batch {
+	vmath_range_func_t func;
+	void *cls;
+	int count, chunk_size;
+	int num_slots;		/* deques, one for each worker the batch can have */
+	struct deque *dq;
+
+	/* protected by pool_lock */
+	int num_joined;		/* slots taken, slot 0 is the calling thread */
+	int open;			/* in the open_batches list */
+	struct batch *next_open;
+
+	/* protected by lock */
+	mutex_t lock;
+	cond_t done_cond;
+	int num_active;		/* pool threads working on the batch */
+};
+
+/* a pool thread. The thread starting a batch hands it the batch and its slot
+ * in it, and wakes only the threads it took this way.
+ */
+struct worker {
+	mutex_t lock;
+	cond_t wake;
+	struct batch *batch;
+	int slot, quit;
+	struct worker *next_idle;	/* protected by pool_lock */
+	char pad[64];
+};
+
+/* the pool: idle threads are on the idle stack. Batches which didn't get all
+ * the threads they asked for are on the open_batches list, and threads
+ * finishing their batch join them before going idle, so concurrent (or
+ * nested) batches share the pool.
+ */
+static mutex_t pool_lock = MUTEX_INITIALIZER;
+static thread_t pool_thread[VMATH_MAX_THREADS - 1];
+static struct worker worker[VMATH_MAX_THREADS - 1];
+static int pool_size;
+static struct worker *idle;
+static struct batch *open_batches;
+
+static void grow_pool(int num_threads);
+static void run_worker(struct batch *b, int self);
+
+static int num_cpus;
+static vmath_once_t num_cpus_once = VMATH_ONCE_INIT;
+
+static void init_num_cpus(void)
+{
+#if defined(USE_WIN32_THREADS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	num_cpus = info.dwNumberOfProcessors;
+#elif defined(USE_PTHREADS) && defined(_SC_NPROCESSORS_ONLN)
+	num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if(num_cpus < 1) num_cpus = 1;
+}
+
+int vmath_num_cpus(void)
+{
+	vmath_once(&num_cpus_once, init_num_cpus);
+	return num_cpus;
+}
+
+double vmath_time(void)
+{
+#if defined(USE_WIN32_THREADS)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if(!freq.QuadPart) {
+		QueryPerformanceFrequency(&freq);
+	}
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+#elif defined(USE_PTHREADS) && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#elif defined(USE_PTHREADS)
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+#else
+	return (double)clock() / (double)CLOCKS_PER_SEC;
+#endif
+}
+
+#if defined(USE_WIN32_THREADS)
+static BOOL CALLBACK once_func(PINIT_ONCE once, PVOID arg, PVOID *ctx)
+{
+	(*(void (**)(void))arg)();
+	return TRUE;
+}
+
+void vmath_once(vmath_once_t *once, void (*init)(void))
+{
+	InitOnceExecuteOnce((PINIT_ONCE)once, once_func, &init, 0);
+}
+#elif defined(USE_PTHREADS)
+void vmath_once(vmath_once_t *once, void (*init)(void))
+{
+	pthread_once(once, init);
+}
+#else
+/* no threads API known, fall back to a plain (unsynchronized) flag */
+void vmath_once(vmath_once_t *once, void (*init)(void))
+{
+	if(!*once) {
+		init();
+		*once = 1;
+	}
+}
+#endif
+
+#if defined(USE_WIN32_THREADS)
+static void mutex_init(mutex_t *m) { InitializeSRWLock(m); }
+static void mutex_destroy(mutex_t *m) {}
+static void mutex_lock(mutex_t *m) { AcquireSRWLockExclusive(m); }
+static void mutex_unlock(mutex_t *m) { ReleaseSRWLockExclusive(m); }
+static void cond_init(cond_t *c) { InitializeConditionVariable(c); }
+static void cond_destroy(cond_t *c) {}
+static void cond_wait(cond_t *c, mutex_t *m) { SleepConditionVariableSRW(c, m, INFINITE, 0); }
+static void cond_signal(cond_t *c) { WakeConditionVariable(c); }
+
+static void pool_main(struct worker *w);
+
+static DWORD WINAPI thread_func(void *arg)
+{
+	pool_main(arg);
+	return 0;
+}
+
+static int start_thread(int id)
+{
+	return (pool_thread[id] = CreateThread(0, 0, thread_func, worker + id, 0, 0)) ? 0 : -1;
+}
+
+static void join_thread(int id)
+{
+	WaitForSingleObject(pool_thread[id], INFINITE);
+	CloseHandle(pool_thread[id]);
+}
+
+#elif defined(USE_PTHREADS)
+static void mutex_init(mutex_t *m) { pthread_mutex_init(m, 0); }
+static void mutex_destroy(mutex_t *m) { pthread_mutex_destroy(m); }
+static void mutex_lock(mutex_t *m) { pthread_mutex_lock(m); }
+static void mutex_unlock(mutex_t *m) { pthread_mutex_unlock(m); }
+static void cond_init(cond_t *c) { pthread_cond_init(c, 0); }
+static void cond_destroy(cond_t *c) { pthread_cond_destroy(c); }
+static void cond_wait(cond_t *c, mutex_t *m) { pthread_cond_wait(c, m); }
+static void cond_signal(cond_t *c) { pthread_cond_signal(c); }
+
+static void pool_main(struct worker *w);
+
+static void *thread_func(void *arg)
+{
+	pool_main(arg);
+	return 0;
+}
+
+static int start_thread(int id)
+{
+	return pthread_create(pool_thread + id, 0, thread_func, worker + id) == 0 ? 0 : -1;
+}
+
+static void join_thread(int id)
+{
+	pthread_join(pool_thread[id], 0);
+}
+
+#else
+static void mutex_init(mutex_t *m) {}
+static void mutex_destroy(mutex_t *m) {}
+static void mutex_lock(mutex_t *m) {}
+static void mutex_unlock(mutex_t *m) {}
+static void cond_init(cond_t *c) {}
+static void cond_destroy(cond_t *c) {}
+static void cond_wait(cond_t *c, mutex_t *m) {}
+static void cond_signal(cond_t *c) {}
+
+static int start_thread(int id)
+{
+	return -1;
+}
+
+static void join_thread(int id)
+{
+}
+#endif
+
+/* deques in the batch itself for up to this many workers, more are allocated */
+#define LOCAL_DEQUES	8
+
+int vmath_chunk_size(int count, int num_threads, int chunk_size, int align)
+{
+	if(align < 1) align = 1;
+	if(num_threads <= 0) num_threads = vmath_num_cpus();
+
+	if(chunk_size <= 0) {
+		chunk_size = count / (num_threads * CHUNKS_PER_THREAD);
+	}
+	if(chunk_size < 1) chunk_size = 1;
+	return (chunk_size + align - 1) / align * align;
+}
+
+static void run_serial(int count, int chunk_size, vmath_range_func_t func, void *cls)
+{
+	int start;
+
+	for(start=0; start<count; start+=chunk_size) {
+		func(start, count - start > chunk_size ? start + chunk_size : count, cls);
+	}
+}
+
+void vmath_parallel_for(int count, int num_threads, int chunk_size, vmath_range_func_t func, void *cls)
+{
+	int i, num_chunks, num_got, per_worker, extra, start;
+	struct batch b;
+	struct deque local_dq[LOCAL_DEQUES];
+	struct worker *got[VMATH_MAX_THREADS - 1];
+
+	if(count <= 0) return;
+	if(num_threads <= 0) num_threads = vmath_num_cpus();
+	if(chunk_size <= 0) chunk_size = vmath_chunk_size(count, num_threads, 0, 1);
+
+	num_chunks = (count - 1) / chunk_size + 1;
+	if(num_threads > num_chunks) num_threads = num_chunks;
+	if(num_threads > VMATH_MAX_THREADS) num_threads = VMATH_MAX_THREADS;
+
+	if(num_threads <= 1) {
+		run_serial(count, chunk_size, func, cls);
+		return;
+	}
+
+	if(num_threads <= LOCAL_DEQUES) {
+		b.dq = local_dq;
+	} else if(!(b.dq = malloc(num_threads * sizeof *b.dq))) {
+		run_serial(count, chunk_size, func, cls);
+		return;
+	}
+
+	/* take idle threads off the stack, as many as there are up to what the
+	 * batch needs. Only the pool lock is held, and only for this.
+	 */
+	mutex_lock(&pool_lock);
+	grow_pool(num_threads - 1);
+	if(!pool_size) {
+		mutex_unlock(&pool_lock);
+		if(b.dq != local_dq) free(b.dq);
+		run_serial(count, chunk_size, func, cls);
+		return;
+	}
+	num_got = 0;
+	while(idle && num_got < num_threads - 1) {
+		got[num_got++] = idle;
+		idle = idle->next_idle;
+	}
+	mutex_unlock(&pool_lock);
+
+	b.func = func;
+	b.cls = cls;
+	b.count = count;
+	b.chunk_size = chunk_size;
+	b.num_slots = num_threads;
+	b.num_joined = num_got + 1;
+	b.open = 0;
+	b.next_open = 0;
+	mutex_init(&b.lock);
+	cond_init(&b.done_cond);
+	b.num_active = num_got;
+
+	/* an equal share of consecutive chunks for the calling thread and each
+	 * thread it got. The slots left over start empty, threads joining later
+	 * steal from the others.
+	 */
+	per_worker = num_chunks / (num_got + 1);
+	extra = num_chunks % (num_got + 1);
+	start = 0;
+	for(i=0; i<num_threads; i++) {
+		mutex_init(&b.dq[i].lock);
+		b.dq[i].lo = start;
+		if(i <= num_got) {
+			start += per_worker + (i < extra ? 1 : 0);
+		}
+		b.dq[i].hi = start;
+	}
+
+	if(num_got < num_threads - 1) {
+		mutex_lock(&pool_lock);
+		b.open = 1;
+		b.next_open = open_batches;
+		open_batches = &b;
+		mutex_unlock(&pool_lock);
+	}
+
+	for(i=0; i<num_got; i++) {
+		mutex_lock(&got[i]->lock);
+		got[i]->batch = &b;
+		got[i]->slot = i + 1;
+		cond_signal(&got[i]->wake);
+		mutex_unlock(&got[i]->lock);
+	}
+
+	run_worker(&b, 0);
+
+	/* the batch lives on this stack: once it's off the open list nothing can
+	 * join it, then wait for the threads still in it.
+	 */
+	if(num_got < num_threads - 1) {
+		struct batch **pp;
+
+		mutex_lock(&pool_lock);
+		if(b.open) {
+			for(pp=&open_batches; *pp != &b; pp=&(*pp)->next_open);
+			*pp = b.next_open;
+			b.open = 0;
+		}
+		mutex_unlock(&pool_lock);
+	}
+
+	mutex_lock(&b.lock);
+	while(b.num_active > 0) {
+		cond_wait(&b.done_cond, &b.lock);
+	}
+	mutex_unlock(&b.lock);
+
+	for(i=0; i<num_threads; i++) {
+		mutex_destroy(&b.dq[i].lock);
+	}
+	mutex_destroy(&b.lock);
+	cond_destroy(&b.done_cond);
+	if(b.dq != local_dq) {
+		free(b.dq);
+	}
+}
+
+void vmath_parallel_range(int count, int num_threads, int align, vmath_range_func_t func, void *cls)
+{
+	vmath_parallel_for(count, num_threads, vmath_chunk_size(count, num_threads, 0, align), func, cls);
+}
+
+void vmath_sched_shutdown(void)
+{
+	int i, n;
+
+	mutex_lock(&pool_lock);
+	n = pool_size;
+	mutex_unlock(&pool_lock);
+
+	for(i=0; i<n; i++) {
+		mutex_lock(&worker[i].lock);
+		worker[i].quit = 1;
+		cond_signal(&worker[i].wake);
+		mutex_unlock(&worker[i].lock);
+	}
+	for(i=0; i<n; i++) {
+		join_thread(i);
+		worker[i].quit = 0;
+	}
+
+	mutex_lock(&pool_lock);
+	pool_size = 0;
+	idle = 0;
+	mutex_unlock(&pool_lock);
+}
+
+/* starts pool threads until there are num_threads, called with pool_lock
+ * held. New threads go on the idle stack, and there may be fewer if they fail
+ * to start.
+ */
+static void grow_pool(int num_threads)
+{
+	static int num_worker_init;
+	struct worker *w;
+
+	while(pool_size < num_threads) {
+		w = worker + pool_size;
+		if(num_worker_init <= pool_size) {
+			mutex_init(&w->lock);
+			cond_init(&w->wake);
+			num_worker_init++;
+		}
+		w->batch = 0;
+		if(start_thread(pool_size) == -1) {
+			break;
+		}
+		w->next_idle = idle;
+		idle = w;
+		pool_size++;
+	}
+}
+
+#if defined(USE_WIN32_THREADS) || defined(USE_PTHREADS)
+/* takes the next free slot of an open batch, called with pool_lock held.
+ * Returns 0 if there's no open batch.
+ */
+static struct batch *join_open(int *slot)
+{
+	struct batch *b;
+
+	if(!(b = open_batches)) {
+		return 0;
+	}
+	*slot = b->num_joined++;
+	if(b->num_joined >= b->num_slots) {
+		open_batches = b->next_open;
+		b->open = 0;
+	}
+
+	mutex_lock(&b->lock);
+	b->num_active++;
+	mutex_unlock(&b->lock);
+	return b;
+}
+
+static void pool_main(struct worker *w)
+{
+	struct batch *b;
+	int slot;
+
+	for(;;) {
+		mutex_lock(&w->lock);
+		while(!w->batch && !w->quit) {
+			cond_wait(&w->wake, &w->lock);
+		}
+		if(!(b = w->batch)) {
+			mutex_unlock(&w->lock);
+			break;
+		}
+		slot = w->slot;
+		w->batch = 0;
+		mutex_unlock(&w->lock);
+
+		/* work on batches until none needs more threads, then go idle */
+		while(b) {
+			run_worker(b, slot);
+
+			mutex_lock(&b->lock);
+			if(--b->num_active == 0) {
+				cond_signal(&b->done_cond);
+			}
+			mutex_unlock(&b->lock);
+
+			mutex_lock(&pool_lock);
+			if(!(b = join_open(&slot))) {
+				w->next_idle = idle;
+				idle = w;
+			}
+			mutex_unlock(&pool_lock);
+		}
+	}
+}
+#endif
+
+/* steals the back half of the chunks left to some other worker, trying them
+ * all from a random one. Returns 0 if none has any chunks left, and since a
+ * batch never gets more chunks, this worker is done with it then.
+ */
+static int steal(struct batch *b, int self, unsigned int *rnd, int *lo, int *hi)
+{
+	int i, v, n = b->num_slots;
+	struct deque *dq;
+
+	*rnd = *rnd * 1103515245 + 12345;
+	v = (int)((*rnd >> 16) % n);
+
+	for(i=0; i<n; i++, v = v + 1 < n ? v + 1 : 0) {
+		if(v == self) continue;
+		dq = b->dq + v;
+		mutex_lock(&dq->lock);
+		if(dq->lo < dq->hi) {
+			*hi = dq->hi;
+			dq->hi -= (dq->hi - dq->lo + 1) / 2;
+			*lo = dq->hi;
+			mutex_unlock(&dq->lock);
+			return 1;
+		}
+		mutex_unlock(&dq->lock);
+	}
+	return 0;
+}
+
+static void run_worker(struct batch *b, int self)
+{
+	int c, start, end, lo, hi;
+	unsigned int rnd = (unsigned int)self * 2654435761u;
+	struct deque *dq = b->dq + self;
+
+	for(;;) {
+		mutex_lock(&dq->lock);
+		if(dq->lo < dq->hi) {
+			c = dq->lo++;
+			mutex_unlock(&dq->lock);
+
+			start = c * b->chunk_size;
+			end = b->count - start > b->chunk_size ? start + b->chunk_size : b->count;
+			b->func(start, end, b->cls);
+			continue;
+		}
+		mutex_unlock(&dq->lock);
+
+		if(!steal(b, self, &rnd, &lo, &hi)) {
+			break;
+		}
+		/* the stolen chunks can be stolen again from here */
+		mutex_lock(&dq->lock);
+		dq->lo = lo;
+		dq->hi = hi;
+		mutex_unlock(&dq->lock);
+	}
+}
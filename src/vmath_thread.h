@@ -0,0 +1,65 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* internal header, only included by the library source files which split
+ * batch operations across multiple threads.
+ */
+#ifndef LIBVMATH_THREAD_H_
+#define LIBVMATH_THREAD_H_
+
+#include "vmath_sched.h"
+
+#if defined(_WIN32)
+typedef void *vmath_once_t;	/* an INIT_ONCE, which is a single pointer */
+#define VMATH_ONCE_INIT	0
+#elif defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+typedef pthread_once_t vmath_once_t;
+#define VMATH_ONCE_INIT	PTHREAD_ONCE_INIT
+#else
+typedef int vmath_once_t;
+#define VMATH_ONCE_INIT	0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* vmath_parallel_for with the default chunk size, rounded up to a multiple
+ * of align. func gets one chunk per call.
+ */
+void vmath_parallel_range(int count, int num_threads, int align, vmath_range_func_t func, void *cls);
+
+/* wall-clock time in seconds, from a monotonic clock where there is one. Only
+ * differences are meaningful. Unlike clock(), which adds up the processor
+ * time of all the threads, this measures how long a multithreaded build took.
+ */
+double vmath_time(void);
+
+/* calls init exactly once for each flag, which must start as VMATH_ONCE_INIT.
+ * Whichever thread gets there first runs it, and any others wait until it's
+ * done, so everything init stores is visible to all callers afterwards. Used
+ * to pick the runtime dispatched code paths.
+ */
+void vmath_once(vmath_once_t *once, void (*init)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_THREAD_H_ */
@@ -37,12 +37,27 @@ typedef struct { scalar_t x, y; } vec2_t;
 typedef struct { scalar_t x, y, z; } vec3_t;
 typedef struct { scalar_t x, y, z, w; } vec4_t;
 
+/* structure-of-arrays vector buffers, used by the batch (_soa) functions */
+typedef struct { scalar_t *x, *y; } vec2_soa_t;
+typedef struct { scalar_t *x, *y, *z; } vec3_soa_t;
+
 /* quaternions */
 typedef vec4_t quat_t;
 
+/* structure-of-arrays quaternion buffers */
+typedef struct { scalar_t *x, *y, *z, *w; } quat_soa_t;
+
+/* dual quaternions: real + dual * e, where e^2 = 0 */
+typedef struct { quat_t real, dual; } dualquat_t;
+
 /* matrices */
 typedef scalar_t mat3_t[3][3];
 typedef scalar_t mat4_t[4][4];
+/* affine matrices: the top 3 rows of a mat4_t, the bottom row is always 0 0 0 1 */
+typedef scalar_t mat3x4_t[3][4];
+
+/* structure-of-arrays matrix buffers: m[i][j] points to element (i, j) of all the matrices */
+typedef struct { scalar_t *m[3][3]; } mat3_soa_t;
 
 
 #ifdef __cplusplus
@@ -50,8 +65,10 @@ class Vector2;
 class Vector3;
 class Vector4;
 class Quaternion;
+class DualQuaternion;
 class Matrix3x3;
 class Matrix4x4;
+class Matrix3x4;
 #endif	/* __cplusplus */
 
 #endif	/* LIBVMATH_TYPES_H_ */
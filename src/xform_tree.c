@@ -0,0 +1,263 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "vmath.h"
+#include "xform_tree.h"
+#include "vmath_thread.h"
+
+struct update_job {
+	xform_tree_t *tree;
+	int base;
+};
+
+void xform_tree_init(xform_tree_t *tree)
+{
+	tree->num_nodes = tree->num_levels = 0;
+	tree->level_start = 0;
+	tree->parent = 0;
+	tree->slot = 0;
+	tree->node = 0;
+	tree->local = 0;
+	tree->world = 0;
+	tree->dirty = 0;
+	tree->first_dirty = 0;
+	tree->num_marked = 0;
+
+	tree->stats.num_dirty = tree->stats.num_visited = tree->stats.num_updated = 0;
+}
+
+void xform_tree_destroy(xform_tree_t *tree)
+{
+	free(tree->level_start);
+	free(tree->parent);
+	free(tree->slot);
+	free(tree->node);
+	free(tree->local);
+	free(tree->world);
+	free(tree->dirty);
+	xform_tree_init(tree);
+}
+
+int xform_tree_build(xform_tree_t *tree, const int *parent, int count)
+{
+	int i, j, s, head, tail, lvl;
+	int *child_start = 0, *child = 0;
+
+	xform_tree_destroy(tree);
+	if(count <= 0) {
+		return count < 0 ? -1 : 0;
+	}
+	for(i=0; i<count; i++) {
+		if(parent[i] < -1 || parent[i] >= count || parent[i] == i) {
+			return -1;
+		}
+	}
+
+	if(!(tree->level_start = malloc((count + 1) * sizeof *tree->level_start)) ||
+			!(tree->parent = malloc(count * sizeof *tree->parent)) ||
+			!(tree->slot = malloc(count * sizeof *tree->slot)) ||
+			!(tree->node = malloc(count * sizeof *tree->node)) ||
+			!(tree->local = malloc(count * sizeof *tree->local)) ||
+			!(tree->world = malloc(count * sizeof *tree->world)) ||
+			!(tree->dirty = malloc(count)) ||
+			!(child_start = calloc(count + 1, sizeof *child_start)) ||
+			!(child = malloc(count * sizeof *child))) {
+		goto fail;
+	}
+
+	/* children of node i: child[child_start[i]] .. child[child_start[i + 1] - 1] */
+	for(i=0; i<count; i++) {
+		if(parent[i] >= 0) {
+			child_start[parent[i] + 1]++;
+		}
+	}
+	for(i=0; i<count; i++) {
+		child_start[i + 1] += child_start[i];
+	}
+	for(i=0; i<count; i++) {
+		if(parent[i] >= 0) {
+			child[child_start[parent[i]]++] = i;
+		}
+	}
+	/* the fill loop advanced each start to the next one */
+	for(i=count; i>0; i--) {
+		child_start[i] = child_start[i - 1];
+	}
+	child_start[0] = 0;
+
+	/* breadth-first traversal, tree->node is the queue */
+	tail = 0;
+	for(i=0; i<count; i++) {
+		if(parent[i] < 0) {
+			tree->node[tail] = i;
+			tree->parent[tail++] = -1;
+		}
+	}
+	head = 0;
+	lvl = 0;
+	while(head < tail) {
+		int level_end = tail;
+		tree->level_start[lvl++] = head;
+
+		while(head < level_end) {
+			int n = tree->node[head];
+			for(j=child_start[n]; j<child_start[n + 1]; j++) {
+				tree->node[tail] = child[j];
+				tree->parent[tail++] = head;
+			}
+			head++;
+		}
+	}
+	if(tail < count) {
+		/* the rest of the nodes are in cycles, unreachable from any root */
+		goto fail;
+	}
+	tree->level_start[lvl] = count;
+	tree->num_levels = lvl;
+	tree->num_nodes = count;
+
+	for(s=0; s<count; s++) {
+		tree->slot[tree->node[s]] = s;
+		m3x4_identity(tree->local[s]);
+	}
+	memset(tree->dirty, 1, count);
+	tree->first_dirty = 0;
+	tree->num_marked = count;
+
+	free(child_start);
+	free(child);
+	return 0;
+
+fail:
+	free(child_start);
+	free(child);
+	xform_tree_destroy(tree);
+	return -1;
+}
+
+void xform_tree_set_local(xform_tree_t *tree, int node, mat3x4_t m)
+{
+	m3x4_copy(tree->local[tree->slot[node]], m);
+	xform_tree_mark_dirty(tree, node);
+}
+
+void xform_tree_mark_dirty(xform_tree_t *tree, int node)
+{
+	int s = tree->slot[node];
+
+	if(!tree->dirty[s]) {
+		tree->dirty[s] = 1;
+		tree->num_marked++;
+		if(s < tree->first_dirty) {
+			tree->first_dirty = s;
+		}
+	}
+}
+
+void xform_tree_get_local(const xform_tree_t *tree, int node, mat3x4_t res)
+{
+	m3x4_copy(res, tree->local[tree->slot[node]]);
+}
+
+void xform_tree_get_world(const xform_tree_t *tree, int node, mat3x4_t res)
+{
+	m3x4_copy(res, tree->world[tree->slot[node]]);
+}
+
+/* a node is recomputed if it's dirty or its parent was recomputed, in which
+ * case it's marked dirty too, for its own children on the next level.
+ */
+static void update_range(xform_tree_t *tree, int start, int end)
+{
+	int s, p;
+	unsigned char *dirty = tree->dirty;
+
+	for(s=start; s<end; s++) {
+		p = tree->parent[s];
+		if(!dirty[s]) {
+			if(p < 0 || !dirty[p]) continue;
+			dirty[s] = 1;
+		}
+
+		if(p < 0) {
+			m3x4_copy(tree->world[s], tree->local[s]);
+		} else {
+			m3x4_mult(tree->world[s], tree->world[p], tree->local[s]);
+		}
+	}
+}
+
+static void update_range_thread(int start, int end, void *cls)
+{
+	struct update_job *job = cls;
+	update_range(job->tree, job->base + start, job->base + end);
+}
+
+static void update(xform_tree_t *tree, int num_threads)
+{
+	int i, s, start, end, num_updated = 0;
+	struct update_job job;
+
+	tree->stats.num_dirty = tree->num_marked;
+	tree->stats.num_visited = tree->stats.num_updated = 0;
+	if(tree->first_dirty >= tree->num_nodes) {
+		return;
+	}
+
+	job.tree = tree;
+	for(i=0; i<tree->num_levels; i++) {
+		end = tree->level_start[i + 1];
+		if(end <= tree->first_dirty) continue;
+		start = MAX(tree->level_start[i], tree->first_dirty);
+
+		if(num_threads != 1 && end - start >= XFORM_TREE_MT_MIN) {
+			/* ranges of multiples of 64 slots, so that threads only share the
+			 * cache lines at the ends of their ranges
+			 */
+			job.base = start;
+			vmath_parallel_range(end - start, num_threads, 64, update_range_thread, &job);
+		} else {
+			update_range(tree, start, end);
+		}
+	}
+
+	/* the flags are needed until the last level is done, clear them afterwards */
+	for(s=tree->first_dirty; s<tree->num_nodes; s++) {
+		if(tree->dirty[s]) {
+			tree->dirty[s] = 0;
+			num_updated++;
+		}
+	}
+
+	tree->stats.num_visited = tree->num_nodes - tree->first_dirty;
+	tree->stats.num_updated = num_updated;
+	tree->num_marked = 0;
+	tree->first_dirty = tree->num_nodes;
+}
+
+void xform_tree_update(xform_tree_t *tree)
+{
+	update(tree, 1);
+}
+
+void xform_tree_update_mt(xform_tree_t *tree, int num_threads)
+{
+	update(tree, num_threads);
+}
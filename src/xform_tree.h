@@ -0,0 +1,97 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIBVMATH_XFORM_TREE_H_
+#define LIBVMATH_XFORM_TREE_H_
+
+#include "vmath_types.h"
+
+/* levels with at least this many nodes after the first dirty one are split
+ * across threads by xform_tree_update_mt
+ */
+#define XFORM_TREE_MT_MIN	4096
+
+/* counters of the last update */
+typedef struct {
+	int num_dirty;		/* nodes that were marked dirty */
+	int num_visited;	/* nodes whose dirty flags were checked */
+	int num_updated;	/* world matrices recomputed, including descendants of dirty nodes */
+} xform_tree_stats_t;
+
+/* a transformation hierarchy (or a forest of them) stored in flat arrays.
+ * Nodes are identified by the indices of the parent array they were built
+ * from, but are stored in "slots" sorted by level: all the roots first, then
+ * their children, then the grandchildren etc. Every parent comes before its
+ * children, and the nodes of each level only depend on the previous one.
+ * The slot arrays can be read directly, for instance to upload all the world
+ * matrices at once, using slot[] and node[] to map between the two orders.
+ */
+typedef struct {
+	int num_nodes, num_levels;
+	int *level_start;	/* slots of level i are level_start[i] .. level_start[i + 1] - 1 */
+	int *parent;		/* per slot: slot of the parent, or -1 for roots */
+	int *slot;			/* node index -> slot */
+	int *node;			/* slot -> node index */
+	mat3x4_t *local;	/* per slot, relative to the parent */
+	mat3x4_t *world;	/* per slot, valid after xform_tree_update */
+	unsigned char *dirty;
+	int first_dirty;	/* lowest dirty slot, or num_nodes if none */
+	int num_marked;		/* nodes marked dirty since the last update */
+
+	xform_tree_stats_t stats;
+} xform_tree_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void xform_tree_init(xform_tree_t *tree);
+void xform_tree_destroy(xform_tree_t *tree);
+
+/* builds the hierarchy of count nodes, where parent[i] is the index of the
+ * parent of node i, or -1 if it's a root. All local matrices start as
+ * identity and all nodes as dirty. Returns 0 on success, -1 if it runs out
+ * of memory or parent has invalid indices or cycles.
+ */
+int xform_tree_build(xform_tree_t *tree, const int *parent, int count);
+
+/* sets the local transformation of a node and marks it dirty */
+void xform_tree_set_local(xform_tree_t *tree, int node, mat3x4_t m);
+/* marks a node dirty, after changing tree->local[tree->slot[node]] directly */
+void xform_tree_mark_dirty(xform_tree_t *tree, int node);
+
+void xform_tree_get_local(const xform_tree_t *tree, int node, mat3x4_t res);
+void xform_tree_get_world(const xform_tree_t *tree, int node, mat3x4_t res);
+
+/* recomputes the world matrices of the dirty nodes and all their descendants,
+ * one level at a time, and clears the dirty flags. Slots before the first
+ * dirty one are not even visited, and nothing is done if no node is dirty.
+ */
+void xform_tree_update(xform_tree_t *tree);
+
+/* same as xform_tree_update, with large levels split across num_threads
+ * threads (0 for one per processor). The nodes of a level are independent
+ * of each other, so each thread gets a range of sibling subtrees.
+ */
+void xform_tree_update_mt(xform_tree_t *tree, int num_threads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* LIBVMATH_XFORM_TREE_H_ */
@@ -0,0 +1,3337 @@
+/*
+libvmath - a vector math library
+Copyright (C) 2004-2015 John Tsiombikas <nuclear@member.fsf.org>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published
+by the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* vmath consistency checks
+ *
+ * usage: check [-l] [name filters ...]
+ *
+ * Every SIMD, batch, SoA and multi-threaded code path is compared against a
+ * straightforward scalar reference: either the matching single-element
+ * library function, or a plain loop written out here. Runtime dispatched
+ * kernels only run where the CPU supports them; make check runs the checks
+ * once more with VMATH_CPU_MASK=0 to cover the baseline versions. Exits with
+ * status 1 if any check fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "vmath.h"
+#include "vmath_simd.h"
+
+struct Test {
+	const char *name;
+	void (*func)();
+};
+
+static int num_checks, num_failed;
+
+static void check(bool cond, const char *expr, const char *file, int line);
+static bool near(scalar_t a, scalar_t b, scalar_t tol);
+static scalar_t rnd(scalar_t low, scalar_t high);
+
+#define CHECK(x)	check((x), #x, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, tol)	check(near((a), (b), (tol)), #a " ~ " #b, __FILE__, __LINE__)
+
+#define NUM_SAMPLES	1000
+
+/* ---- matrices ---- */
+
+static void ref_m4_mult(mat4_t res, mat4_t m1, mat4_t m2)
+{
+	mat4_t tmp;
+	for(int i=0; i<4; i++) {
+		for(int j=0; j<4; j++) {
+			tmp[i][j] = m1[i][0] * m2[0][j] + m1[i][1] * m2[1][j] + m1[i][2] * m2[2][j] + m1[i][3] * m2[3][j];
+		}
+	}
+	memcpy(res, tmp, sizeof tmp);
+}
+
+static void rnd_mat4(mat4_t m)
+{
+	for(int i=0; i<4; i++) {
+		for(int j=0; j<4; j++) {
+			m[i][j] = rnd(-10, 10);
+		}
+	}
+}
+
+static void m4_check(mat4_t a, mat4_t b, bool exact)
+{
+	for(int i=0; i<4; i++) {
+		for(int j=0; j<4; j++) {
+			if(exact) {
+				CHECK(a[i][j] == b[i][j]);
+			} else {
+				CHECK_NEAR(a[i][j], b[i][j], 1e-4);
+			}
+		}
+	}
+}
+
+static void t_m4_mult()
+{
+	/* all but the FMA kernel round exactly like the scalar code */
+	bool exact = !(vmath_cpu_features() & VMATH_CPU_FMA);
+
+	for(int i=0; i<NUM_SAMPLES; i++) {
+		mat4_t a, b, res, ref;
+		rnd_mat4(a);
+		rnd_mat4(b);
+
+		ref_m4_mult(ref, a, b);
+		m4_mult(res, a, b);
+		m4_check(res, ref, exact);
+
+		/* in place, on either side */
+		mat4_t tmp;
+		memcpy(tmp, a, sizeof tmp);
+		m4_mult(tmp, tmp, b);
+		m4_check(tmp, ref, exact);
+		memcpy(tmp, b, sizeof tmp);
+		m4_mult(tmp, a, tmp);
+		m4_check(tmp, ref, exact);
+
+		Matrix4x4 ma, mb;
+		memcpy(ma.m, a, sizeof a);
+		memcpy(mb.m, b, sizeof b);
+		Matrix4x4 mres = ma * mb;
+		m4_check(mres.m, ref, exact);
+	}
+}
+
+/* ---- strided vector transforms ---- */
+
+struct Vertex {
+	vec3_t pos, norm;
+	scalar_t tc[2];
+};
+
+static bool v3_equal(vec3_t a, vec3_t b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool v4_equal(vec4_t a, vec4_t b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+static vec3_t ref_transform_dir(vec3_t v, mat4_t m)
+{
+	vec3_t res;
+	res.x = m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z;
+	res.y = m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z;
+	res.z = m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z;
+	return res;
+}
+
+static void t_v3_transform_array()
+{
+	const int count = NUM_SAMPLES + 3;
+	Vertex *verts = new Vertex[count];
+	vec3_t *pos = new vec3_t[count];
+	vec3_t *norm = new vec3_t[count];
+	vec3_t *res = new vec3_t[count];
+	mat4_t m;
+	mat3x4_t m34;
+
+	rnd_mat4(m);
+	m4_to_m3x4(m34, m);
+	for(int i=0; i<count; i++) {
+		verts[i].pos = pos[i] = v3_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10));
+		verts[i].norm = norm[i] = v3_cons(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1));
+		verts[i].tc[0] = verts[i].tc[1] = (scalar_t)i;
+	}
+
+	/* packed */
+	v3_transform_points(res, 0, pos, 0, count, m);
+	for(int i=0; i<count; i++) {
+		CHECK(v3_equal(res[i], v3_transform(pos[i], m)));
+	}
+	v3_transform_points_m3x4(res, 0, pos, 0, count, m34);
+	for(int i=0; i<count; i++) {
+		CHECK(v3_equal(res[i], v3_transform(pos[i], m)));
+	}
+	v3_transform_dirs(res, 0, pos, 0, count, m);
+	for(int i=0; i<count; i++) {
+		CHECK(v3_equal(res[i], ref_transform_dir(pos[i], m)));
+	}
+	v3_transform_dirs_m3x4(res, 0, pos, 0, count, m34);
+	for(int i=0; i<count; i++) {
+		CHECK(v3_equal(res[i], ref_transform_dir(pos[i], m)));
+	}
+
+	/* interleaved, in place, leaving the other attributes alone */
+	v3_transform_points(&verts->pos, sizeof *verts, &verts->pos, sizeof *verts, count, m);
+	v3_transform_dirs(&verts->norm, sizeof *verts, &verts->norm, sizeof *verts, count, m);
+	for(int i=0; i<count; i++) {
+		CHECK(v3_equal(verts[i].pos, v3_transform(pos[i], m)));
+		CHECK(v3_equal(verts[i].norm, ref_transform_dir(norm[i], m)));
+		CHECK(verts[i].tc[0] == (scalar_t)i && verts[i].tc[1] == (scalar_t)i);
+	}
+
+	/* strided source into a packed array */
+	v3_transform_points(res, 0, &verts->pos, sizeof *verts, count, m);
+	for(int i=0; i<count; i++) {
+		CHECK(v3_equal(res[i], v3_transform(verts[i].pos, m)));
+	}
+
+	delete [] verts;
+	delete [] pos;
+	delete [] norm;
+	delete [] res;
+}
+
+static void t_v4_transform_array()
+{
+	const int count = NUM_SAMPLES + 3;
+	vec4_t *v = new vec4_t[count];
+	vec4_t *res = new vec4_t[count];
+	mat4_t m;
+
+	rnd_mat4(m);
+	for(int i=0; i<count; i++) {
+		v[i] = v4_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10), rnd(0.5, 2));
+	}
+
+	v4_transform_array(res, 0, v, 0, count, m);
+	for(int i=0; i<count; i++) {
+		CHECK(v4_equal(res[i], v4_transform(v[i], m)));
+	}
+
+	v4_transform_project(res, 0, v, 0, count, m);
+	for(int i=0; i<count; i++) {
+		vec4_t ref = v4_transform(v[i], m);
+		ref.x /= ref.w;
+		ref.y /= ref.w;
+		ref.z /= ref.w;
+		CHECK(v4_equal(res[i], ref));
+	}
+
+	/* every other element, in place */
+	memcpy(res, v, count * sizeof *v);
+	v4_transform_array(res, 2 * sizeof *res, res, 2 * sizeof *res, (count + 1) / 2, m);
+	for(int i=0; i<count; i++) {
+		CHECK(v4_equal(res[i], i & 1 ? v[i] : v4_transform(v[i], m)));
+	}
+
+	delete [] v;
+	delete [] res;
+}
+
+/* ---- SoA vector batch functions ---- */
+
+enum {
+	SOA_ADD, SOA_SUB, SOA_NEG, SOA_MUL, SOA_SCALE, SOA_CROSS, SOA_NORMALIZE,
+	SOA_TRANSFORM, SOA_TRANSFORM_M3X4, SOA_REFLECT, SOA_LERP,
+	SOA_DOT, SOA_LENGTH, SOA_LENGTH_SQ,
+	NUM_SOA_OPS
+};
+#define SOA_SCALAR_OPS	SOA_DOT		/* ops from here on have a scalar result */
+
+struct SoaArgs {
+	scalar_t s;
+	mat4_t m;
+	mat3x4_t m34;
+};
+
+static void soa_op(int op, vec3_soa_t res, scalar_t *sres, vec3_soa_t a, vec3_soa_t b,
+		SoaArgs *args, int count)
+{
+	switch(op) {
+	case SOA_ADD: v3_add_soa(res, a, b, count); break;
+	case SOA_SUB: v3_sub_soa(res, a, b, count); break;
+	case SOA_NEG: v3_neg_soa(res, a, count); break;
+	case SOA_MUL: v3_mul_soa(res, a, b, count); break;
+	case SOA_SCALE: v3_scale_soa(res, a, args->s, count); break;
+	case SOA_CROSS: v3_cross_soa(res, a, b, count); break;
+	case SOA_NORMALIZE: v3_normalize_soa(res, a, count); break;
+	case SOA_TRANSFORM: v3_transform_soa(res, a, args->m, count); break;
+	case SOA_TRANSFORM_M3X4: v3_transform_soa_m3x4(res, a, args->m34, count); break;
+	case SOA_REFLECT: v3_reflect_soa(res, a, b, count); break;
+	case SOA_LERP: v3_lerp_soa(res, a, b, args->s, count); break;
+	case SOA_DOT: v3_dot_soa(sres, a, b, count); break;
+	case SOA_LENGTH: v3_length_soa(sres, a, count); break;
+	case SOA_LENGTH_SQ: v3_length_sq_soa(sres, a, count); break;
+	}
+}
+
+/* the scalar function each batch function must match, x only for the scalar ops */
+static vec3_t ref_soa_op(int op, vec3_t a, vec3_t b, SoaArgs *args)
+{
+	switch(op) {
+	case SOA_ADD: return v3_add(a, b);
+	case SOA_SUB: return v3_sub(a, b);
+	case SOA_NEG: return v3_neg(a);
+	case SOA_MUL: return v3_mul(a, b);
+	case SOA_SCALE: return v3_scale(a, args->s);
+	case SOA_CROSS: return v3_cross(a, b);
+	case SOA_NORMALIZE: return v3_normalize(a);
+	case SOA_TRANSFORM: return v3_transform(a, args->m);
+	case SOA_TRANSFORM_M3X4: return v3_transform_m3x4(a, args->m34);
+	case SOA_REFLECT: return v3_reflect(a, b);
+	case SOA_LERP: return v3_lerp(a, b, args->s);
+	case SOA_DOT: return v3_cons(v3_dot(a, b), 0, 0);
+	case SOA_LENGTH: return v3_cons(v3_length(a), 0, 0);
+	default: return v3_cons(v3_length_sq(a), 0, 0);
+	}
+}
+
+static void t_v3_soa()
+{
+	/* not a multiple of 8, so the SIMD loops leave a scalar tail. The arrays
+	 * start one element past the allocation, to cover unaligned loads.
+	 */
+	const int max_count = NUM_SAMPLES + 3;
+	const int size = max_count + 1;
+	scalar_t *mem = new scalar_t[size * 10];
+	vec3_soa_t a = v3_soa_cons(mem + 1, mem + size + 1, mem + size * 2 + 1);
+	vec3_soa_t b = v3_soa_cons(mem + size * 3 + 1, mem + size * 4 + 1, mem + size * 5 + 1);
+	vec3_soa_t res = v3_soa_cons(mem + size * 6 + 1, mem + size * 7 + 1, mem + size * 8 + 1);
+	scalar_t *sres = mem + size * 9 + 1;
+	vec3_t *va = new vec3_t[max_count];
+	vec3_t *vb = new vec3_t[max_count];
+
+	SoaArgs args;
+	args.s = rnd(-2, 2);
+	rnd_mat4(args.m);
+	m4_to_m3x4(args.m34, args.m);
+
+	int counts[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 17, max_count};
+	for(int c=0; c<(int)(sizeof counts / sizeof *counts); c++) {
+		int count = counts[c];
+
+		for(int op=0; op<NUM_SOA_OPS; op++) {
+			/* 0: separate output, 1: res is the first input, 2: the second */
+			for(int alias=0; alias<3; alias++) {
+				bool scalar_res = op >= SOA_SCALAR_OPS;
+				for(int i=0; i<count; i++) {
+					va[i] = v3_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10));
+					vb[i] = v3_cons(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10));
+					a.x[i] = va[i].x; a.y[i] = va[i].y; a.z[i] = va[i].z;
+					b.x[i] = vb[i].x; b.y[i] = vb[i].y; b.z[i] = vb[i].z;
+				}
+				vec3_soa_t r = alias == 1 ? a : (alias == 2 ? b : res);
+				scalar_t *sr = alias == 1 ? a.y : (alias == 2 ? b.z : sres);
+				/* the element past the end must be left alone */
+				scalar_t *guard = scalar_res ? sr + count : r.x + count;
+				scalar_t old_guard = *guard;
+
+				soa_op(op, r, sr, a, b, &args, count);
+
+				int bad = 0;
+				for(int i=0; i<count; i++) {
+					vec3_t ref = ref_soa_op(op, va[i], vb[i], &args);
+					if(scalar_res) {
+						if(sr[i] != ref.x) bad++;
+					} else {
+						if(r.x[i] != ref.x || r.y[i] != ref.y || r.z[i] != ref.z) bad++;
+					}
+				}
+				CHECK(bad == 0);
+				CHECK(*guard == old_guard);
+			}
+		}
+	}
+
+	delete [] mem;
+	delete [] va;
+	delete [] vb;
+}
+
+/* ---- ray/box tests ---- */
+
+static vec3_t rnd_v3(scalar_t low, scalar_t high)
+{
+	return v3_cons(rnd(low, high), rnd(low, high), rnd(low, high));
+}
+
+static aabox_t rnd_box(scalar_t range, scalar_t size)
+{
+	vec3_t c = rnd_v3(-range, range);
+	vec3_t h = rnd_v3(0.1, size);
+	return aabox_cons(c.x - h.x, c.y - h.y, c.z - h.z, c.x + h.x, c.y + h.y, c.z + h.z);
+}
+
+/* rays through the [-range, range] cube, some of them parallel to an axis
+ * or two, so that the reciprocal direction has infinities.
+ */
+static ray_rcp_t rnd_ray_rcp(scalar_t range)
+{
+	ray_t ray;
+	ray.origin = rnd_v3(-range, range);
+	ray.dir = v3_sub(rnd_v3(-range, range), ray.origin);
+	switch((int)rnd(0, 6)) {
+	case 0:
+		ray.dir.x = 0;
+		break;
+	case 1:
+		ray.dir.y = ray.dir.z = 0;
+		break;
+	default:
+		break;
+	}
+	ray_rcp_t rr = ray_rcp_cons(ray);
+	rr.tmin = rnd(0, 0.2);
+	rr.tmax = rnd(0.5, 1.5);
+	return rr;
+}
+
+static void t_aabox_ray_slab()
+{
+	for(int i=0; i<NUM_SAMPLES * 10; i++) {
+		ray_t ray;
+		ray.origin = rnd_v3(-5, 5);
+		ray.dir = rnd_v3(-10, 10);
+		aabox_t box = rnd_box(5, 2);
+
+		/* reference: clip the parametric interval against each slab */
+		scalar_t t0 = 0, t1 = 1;
+		for(int j=0; j<3; j++) {
+			scalar_t o = (&ray.origin.x)[j], d = (&ray.dir.x)[j];
+			scalar_t a = ((&box.min.x)[j] - o) / d;
+			scalar_t b = ((&box.max.x)[j] - o) / d;
+			if(a > b) {
+				scalar_t tmp = a; a = b; b = tmp;
+			}
+			if(a > t0) t0 = a;
+			if(b < t1) t1 = b;
+		}
+
+		scalar_t pos;
+		int hit = aabox_ray_intersect(ray, box, &pos);
+		/* skip grazing cases, which depend on the rounding of 1/d */
+		if(fabs(t1 - t0) > 1e-4) {
+			CHECK(hit == (t0 <= t1));
+			if(hit) {
+				CHECK_NEAR(pos, t0, 1e-4);
+			}
+		}
+	}
+}
+
+static void t_aabox_ray_packets()
+{
+	for(int i=0; i<NUM_SAMPLES; i++) {
+		ray_rcp_t rays[8];
+		aabox_t boxes[8];
+		int count = i % 8 + 1;
+
+		for(int j=0; j<8; j++) {
+			rays[j] = rnd_ray_rcp(5);
+			boxes[j] = rnd_box(5, 2);
+		}
+
+		/* rays against one box */
+		ray4_t r4;
+		ray8_t r8;
+		ray4_pack(&r4, rays, count < 4 ? count : 4);
+		ray8_pack(&r8, rays, count);
+		for(int k=0; k<8; k++) {
+			scalar_t tn4[4], tn8[8];
+			int mask4 = aabox_ray4_intersect(&r4, boxes + k, tn4);
+			int mask8 = aabox_ray8_intersect(&r8, boxes + k, tn8);
+			int ref = 0;
+			for(int j=0; j<count; j++) {
+				scalar_t pos;
+				if(aabox_ray_slab(rays + j, boxes + k, &pos)) {
+					ref |= 1 << j;
+					if(j < 4) CHECK(tn4[j] == pos);
+					CHECK(tn8[j] == pos);
+				}
+			}
+			CHECK(mask4 == (ref & 0xf));
+			CHECK(mask8 == ref);
+		}
+
+		/* one ray against several boxes */
+		aabox4_t b4;
+		aabox8_t b8;
+		aabox4_pack(&b4, boxes, count < 4 ? count : 4);
+		aabox8_pack(&b8, boxes, count);
+		for(int k=0; k<8; k++) {
+			scalar_t tn4[4], tn8[8];
+			int mask4 = aabox4_ray_intersect(&b4, rays + k, tn4);
+			int mask8 = aabox8_ray_intersect(&b8, rays + k, tn8);
+			int ref = 0;
+			for(int j=0; j<count; j++) {
+				scalar_t pos;
+				if(aabox_ray_slab(rays + k, boxes + j, &pos)) {
+					ref |= 1 << j;
+					if(j < 4) CHECK(tn4[j] == pos);
+					CHECK(tn8[j] == pos);
+				}
+			}
+			CHECK(mask4 == (ref & 0xf));
+			CHECK(mask8 == ref);
+		}
+	}
+}
+
+/* ---- BVH ---- */
+
+#define SCENE_PRIMS	4000
+#define SCENE_RAYS	2000
+
+static sphere_t scene_spheres[SCENE_PRIMS];
+static aabox_t scene_bounds[SCENE_PRIMS];
+static ray_t scene_rays[SCENE_RAYS];
+
+static aabox_t sphere_box(const sphere_t &sph)
+{
+	return aabox_cons(sph.pos.x - sph.rad, sph.pos.y - sph.rad, sph.pos.z - sph.rad,
+			sph.pos.x + sph.rad, sph.pos.y + sph.rad, sph.pos.z + sph.rad);
+}
+
+/* small spheres scattered in a cube, with a denser cluster in one corner,
+ * and rays across the cube in all directions
+ */
+static void init_scene()
+{
+	static bool done;
+	if(done) return;
+	done = true;
+
+	for(int i=0; i<SCENE_PRIMS; i++) {
+		vec3_t c = i < SCENE_PRIMS / 4 ? rnd_v3(10, 12) : rnd_v3(-20, 20);
+		scene_spheres[i] = sphere_cons(c.x, c.y, c.z, rnd(0.1, 1.0));
+		scene_bounds[i] = sphere_box(scene_spheres[i]);
+	}
+	for(int i=0; i<SCENE_RAYS; i++) {
+		scene_rays[i].origin = rnd_v3(-25, 25);
+		scene_rays[i].dir = v3_scale(v3_sub(rnd_v3(-15, 15), scene_rays[i].origin), 2.0);
+	}
+}
+
+static int hit_sphere(int prim, ray_t ray, scalar_t tmax, scalar_t *t, void *cls)
+{
+	scalar_t tt;
+	if(sphere_ray_intersect(ray, ((sphere_t*)cls)[prim], &tt) && tt < tmax) {
+		*t = tt;
+		return 1;
+	}
+	return 0;
+}
+
+/* brute force reference for bvh_ray_closest_tmax */
+static int ref_ray_closest(const sphere_t *spheres, int count, ray_t ray, scalar_t tmax, scalar_t *pos)
+{
+	int res = -1;
+	scalar_t t;
+
+	for(int i=0; i<count; i++) {
+		if(hit_sphere(i, ray, tmax, &t, (void*)spheres)) {
+			tmax = t;
+			res = i;
+		}
+	}
+	*pos = tmax;
+	return res;
+}
+
+static bool box_inside(const scalar_t *bmin, const scalar_t *bmax, const scalar_t *outer_min,
+		const scalar_t *outer_max)
+{
+	for(int i=0; i<3; i++) {
+		if(bmin[i] < outer_min[i] || bmax[i] > outer_max[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static int check_bvh_node(const bvh_t *bvh, const aabox_t *bounds, int n, int depth,
+		int *seen, int *max_depth)
+{
+	const bvh_node_t *node = bvh->nodes + n;
+
+	if(depth > *max_depth) *max_depth = depth;
+
+	if(node->count) {
+		CHECK(node->offs >= 0 && node->offs + node->count <= bvh->num_prims);
+		for(int i=0; i<node->count; i++) {
+			int p = bvh->prim[node->offs + i];
+			seen[p]++;
+			CHECK(box_inside(&bounds[p].min.x, &bounds[p].max.x, node->bmin, node->bmax));
+		}
+		return 1;
+	}
+
+	const bvh_node_t *ch = bvh->nodes + node->offs;
+	CHECK(node->offs >= 2 && node->offs % 2 == 0 && node->offs + 1 < bvh->num_nodes);
+	if(node->offs < 2 || node->offs + 1 >= bvh->num_nodes) {
+		return 0;
+	}
+	CHECK(box_inside(ch[0].bmin, ch[0].bmax, node->bmin, node->bmax));
+	CHECK(box_inside(ch[1].bmin, ch[1].bmax, node->bmin, node->bmax));
+	return 1 + check_bvh_node(bvh, bounds, node->offs, depth + 1, seen, max_depth) +
+		check_bvh_node(bvh, bounds, node->offs + 1, depth + 1, seen, max_depth);
+}
+
+/* checks the structure of the tree: every primitive is in exactly one leaf,
+ * every box contains its children, and every node is reachable
+ */
+static void check_bvh_tree(const bvh_t *bvh, const aabox_t *bounds, int count)
+{
+	int *seen = new int[count];
+	int max_depth = 0;
+
+	memset(seen, 0, count * sizeof *seen);
+	CHECK(bvh->num_prims == count);
+	int reached = check_bvh_node(bvh, bounds, 0, 0, seen, &max_depth);
+	/* a lone root leaf has no padding node */
+	CHECK(reached == 1 ? bvh->num_nodes <= 2 : reached + 1 == bvh->num_nodes);
+	CHECK(max_depth < BVH_MAX_DEPTH);
+
+	int bad = 0;
+	for(int i=0; i<count; i++) {
+		if(seen[i] != 1) bad++;
+	}
+	CHECK(bad == 0);
+	delete [] seen;
+}
+
+/* compares the queries of bvh with brute force over the scene, or the
+ * spheres of the scene moved elsewhere
+ */
+static void check_bvh_rays(const bvh_t *bvh, const sphere_t *spheres = scene_spheres)
+{
+	for(int i=0; i<SCENE_RAYS; i++) {
+		ray_t ray = scene_rays[i];
+		scalar_t tmax = i & 1 ? 1.0 : rnd(0.2, 1.0);
+		scalar_t ref_pos, pos;
+		int ref = ref_ray_closest(spheres, SCENE_PRIMS, ray, tmax, &ref_pos);
+
+		int res = bvh_ray_closest_tmax(bvh, ray, tmax, hit_sphere, (void*)spheres, &pos, 0);
+		CHECK((res >= 0) == (ref >= 0));
+		if(res >= 0 && ref >= 0) {
+			CHECK(pos == ref_pos);
+		}
+
+		res = bvh_ray_any_tmax(bvh, ray, tmax, hit_sphere, (void*)spheres, &pos, 0);
+		CHECK((res >= 0) == (ref >= 0));
+		if(res >= 0) {
+			scalar_t t;
+			CHECK(hit_sphere(res, ray, tmax, &t, (void*)spheres) && t == pos);
+		}
+	}
+}
+
+static void t_bvh_build()
+{
+	init_scene();
+
+	bvh_t bvh;
+	bvh_init(&bvh);
+	for(int leaf=1; leaf<=8; leaf*=2) {
+		bvh.max_leaf_prims = leaf;
+		CHECK(bvh_build(&bvh, scene_bounds, SCENE_PRIMS) == 0);
+		check_bvh_tree(&bvh, scene_bounds, SCENE_PRIMS);
+		CHECK(bvh.stats.max_leaf_prims <= leaf);
+	}
+
+	/* all primitives in the same place, which has no useful split */
+	aabox_t same[100];
+	for(int i=0; i<100; i++) {
+		same[i] = aabox_cons(0, 0, 0, 1, 1, 1);
+	}
+	CHECK(bvh_build(&bvh, same, 100) == 0);
+	check_bvh_tree(&bvh, same, 100);
+	bvh_destroy(&bvh);
+}
+
+static void t_bvh_ray()
+{
+	init_scene();
+
+	bvh_t bvh;
+	bvh_init(&bvh);
+	bvh_build(&bvh, scene_bounds, SCENE_PRIMS);
+	check_bvh_rays(&bvh);
+
+	/* the [0, 1] versions */
+	for(int i=0; i<SCENE_RAYS; i++) {
+		scalar_t ref_pos, pos;
+		int ref = ref_ray_closest(scene_spheres, SCENE_PRIMS, scene_rays[i], 1.0, &ref_pos);
+		int res = bvh_ray_closest(&bvh, scene_rays[i], hit_sphere, scene_spheres, &pos, 0);
+		CHECK((res >= 0) == (ref >= 0));
+		if(res >= 0 && ref >= 0) {
+			CHECK(pos == ref_pos);
+		}
+		res = bvh_ray_any(&bvh, scene_rays[i], hit_sphere, scene_spheres, 0, 0);
+		CHECK((res >= 0) == (ref >= 0));
+	}
+	bvh_destroy(&bvh);
+}
+
+/* ---- noise ---- */
+
+enum { NOISE, FBM, TURB };
+
+static scalar_t ref_noise2(const noise_ctx_t *ctx, int func, scalar_t x, scalar_t y, int oct)
+{
+	switch(func) {
+	case NOISE:
+		return noise2_ctx(ctx, x, y);
+	case FBM:
+		return fbm2_ctx(ctx, x, y, oct);
+	default:
+		return turbulence2_ctx(ctx, x, y, oct);
+	}
+}
+
+static scalar_t ref_noise3(const noise_ctx_t *ctx, int func, scalar_t x, scalar_t y, scalar_t z, int oct)
+{
+	switch(func) {
+	case NOISE:
+		return noise3_ctx(ctx, x, y, z);
+	case FBM:
+		return fbm3_ctx(ctx, x, y, z, oct);
+	default:
+		return turbulence3_ctx(ctx, x, y, z, oct);
+	}
+}
+
+static int noise2_grid(const noise_ctx_t *ctx, int func, scalar_t *res, int xsz, int ysz,
+		scalar_t x0, scalar_t y0, scalar_t dx, scalar_t dy, int oct)
+{
+	switch(func) {
+	case NOISE:
+		return noise2_grid_ctx(ctx, res, xsz, ysz, x0, y0, dx, dy);
+	case FBM:
+		return fbm2_grid_ctx(ctx, res, xsz, ysz, x0, y0, dx, dy, oct);
+	default:
+		return turbulence2_grid_ctx(ctx, res, xsz, ysz, x0, y0, dx, dy, oct);
+	}
+}
+
+static int noise3_grid(const noise_ctx_t *ctx, int func, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int oct)
+{
+	switch(func) {
+	case NOISE:
+		return noise3_grid_ctx(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz);
+	case FBM:
+		return fbm3_grid_ctx(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct);
+	default:
+		return turbulence3_grid_ctx(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct);
+	}
+}
+
+static void t_noise_grid()
+{
+	noise_ctx_t ctx;
+	noise_ctx_init(&ctx, 1234);
+
+	const int xsz = 37, ysz = 11, zsz = 9;
+	scalar_t *res = new scalar_t[xsz * ysz * zsz];
+
+	for(int func=NOISE; func<=TURB; func++) {
+		int oct = func == NOISE ? 1 : 4;
+		scalar_t x0 = rnd(-50, 50), y0 = rnd(-50, 50), z0 = rnd(-50, 50);
+		scalar_t dx = rnd(0.05, 0.6), dy = rnd(0.05, 0.6), dz = rnd(0.05, 0.6);
+
+		CHECK(noise2_grid(&ctx, func, res, xsz, ysz, x0, y0, dx, dy, oct) == 0);
+		int bad = 0;
+		for(int j=0; j<ysz; j++) {
+			for(int i=0; i<xsz; i++) {
+				if(res[j * xsz + i] != ref_noise2(&ctx, func, x0 + i * dx, y0 + j * dy, oct)) {
+					bad++;
+				}
+			}
+		}
+		CHECK(bad == 0);
+
+		CHECK(noise3_grid(&ctx, func, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct) == 0);
+		bad = 0;
+		for(int k=0; k<zsz; k++) {
+			for(int j=0; j<ysz; j++) {
+				for(int i=0; i<xsz; i++) {
+					if(res[(k * ysz + j) * xsz + i] !=
+							ref_noise3(&ctx, func, x0 + i * dx, y0 + j * dy, z0 + k * dz, oct)) {
+						bad++;
+					}
+				}
+			}
+		}
+		CHECK(bad == 0);
+	}
+	delete [] res;
+}
+
+static void t_noise_points()
+{
+	noise_ctx_t ctx;
+	noise_ctx_init(&ctx, 4321);
+
+	const int count = NUM_SAMPLES + 3;
+	vec2_t *p2 = new vec2_t[count];
+	vec3_t *p3 = new vec3_t[count];
+	scalar_t *res = new scalar_t[count];
+
+	for(int i=0; i<count; i++) {
+		p2[i].x = rnd(-100, 100);
+		p2[i].y = rnd(-100, 100);
+		p3[i] = rnd_v3(-100, 100);
+	}
+
+	noise2_points_ctx(&ctx, res, p2, count);
+	for(int i=0; i<count; i++) CHECK(res[i] == noise2_ctx(&ctx, p2[i].x, p2[i].y));
+	fbm2_points_ctx(&ctx, res, p2, count, 5);
+	for(int i=0; i<count; i++) CHECK(res[i] == fbm2_ctx(&ctx, p2[i].x, p2[i].y, 5));
+	turbulence2_points_ctx(&ctx, res, p2, count, 5);
+	for(int i=0; i<count; i++) CHECK(res[i] == turbulence2_ctx(&ctx, p2[i].x, p2[i].y, 5));
+
+	noise3_points_ctx(&ctx, res, p3, count);
+	for(int i=0; i<count; i++) CHECK(res[i] == noise3_ctx(&ctx, p3[i].x, p3[i].y, p3[i].z));
+	fbm3_points_ctx(&ctx, res, p3, count, 5);
+	for(int i=0; i<count; i++) CHECK(res[i] == fbm3_ctx(&ctx, p3[i].x, p3[i].y, p3[i].z, 5));
+	turbulence3_points_ctx(&ctx, res, p3, count, 5);
+	for(int i=0; i<count; i++) CHECK(res[i] == turbulence3_ctx(&ctx, p3[i].x, p3[i].y, p3[i].z, 5));
+
+	delete [] p2;
+	delete [] p3;
+	delete [] res;
+}
+
+/* ---- quaternion interpolation ---- */
+
+static quat_t rnd_quat()
+{
+	Quaternion q(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+	return quat_cons(q.s, q.v.x, q.v.y, q.v.z);
+}
+
+/* double precision slerp and nlerp along the shortest arc */
+static void ref_quat_lerp(double *res, quat_t q1, quat_t q2, double t, bool slerp)
+{
+	double a[4] = {q1.x, q1.y, q1.z, q1.w};
+	double b[4] = {q2.x, q2.y, q2.z, q2.w};
+	double dot = a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+	double wa = 1.0 - t, wb = t;
+
+	if(dot < 0.0) {
+		dot = -dot;
+		wa = -wa;
+	}
+	if(slerp && dot < 1.0) {
+		double angle = acos(dot);
+		double s = sin(angle);
+		if(s > 1e-9) {
+			wa = (wa < 0.0 ? -1.0 : 1.0) * sin((1.0 - t) * angle) / s;
+			wb = sin(t * angle) / s;
+		}
+	}
+
+	double len = 0.0;
+	for(int i=0; i<4; i++) {
+		res[i] = wa * a[i] + wb * b[i];
+		len += res[i] * res[i];
+	}
+	if(!slerp) {
+		len = sqrt(len);
+		for(int i=0; i<4; i++) res[i] /= len;
+	}
+}
+
+static void t_quat_lerp_soa()
+{
+	const int count = NUM_SAMPLES + 3;
+	scalar_t *mem = new scalar_t[count * 13];
+	quat_soa_t q1 = {mem, mem + count, mem + count * 2, mem + count * 3};
+	quat_soa_t q2 = {mem + count * 4, mem + count * 5, mem + count * 6, mem + count * 7};
+	quat_soa_t res = {mem + count * 8, mem + count * 9, mem + count * 10, mem + count * 11};
+	scalar_t *t = mem + count * 12;
+
+	for(int i=0; i<count; i++) {
+		quat_t a = rnd_quat(), b;
+		switch(i % 4) {
+		case 0:
+			b = a;		/* identical */
+			break;
+		case 1:
+			b = quat_cons(-a.w, -a.x, -a.y, -a.z);	/* same rotation, other hemisphere */
+			break;
+		default:
+			b = rnd_quat();
+		}
+		q1.x[i] = a.x; q1.y[i] = a.y; q1.z[i] = a.z; q1.w[i] = a.w;
+		q2.x[i] = b.x; q2.y[i] = b.y; q2.z[i] = b.z; q2.w[i] = b.w;
+		t[i] = i % 7 == 0 ? (i & 8 ? 1.0 : 0.0) : rnd(0, 1);
+	}
+
+	for(int pass=0; pass<2; pass++) {
+		bool slerp = pass == 0;
+		if(slerp) {
+			quat_slerp_soa(res, q1, q2, t, count);
+		} else {
+			quat_nlerp_soa(res, q1, q2, t, count);
+		}
+
+		double max_err = 0.0;
+		for(int i=0; i<count; i++) {
+			quat_t a = quat_cons(q1.w[i], q1.x[i], q1.y[i], q1.z[i]);
+			quat_t b = quat_cons(q2.w[i], q2.x[i], q2.y[i], q2.z[i]);
+			double ref[4];
+			ref_quat_lerp(ref, a, b, t[i], slerp);
+
+			scalar_t r[4] = {res.x[i], res.y[i], res.z[i], res.w[i]};
+			for(int j=0; j<4; j++) {
+				double err = fabs(r[j] - ref[j]);
+				if(err > max_err) max_err = err;
+			}
+		}
+		CHECK(max_err <= 1e-6);
+	}
+
+	delete [] mem;
+}
+
+/* ---- affine 3x4 matrices ---- */
+
+static void rnd_affine(mat3x4_t m, bool rigid)
+{
+	Matrix4x4 xform;
+	xform.translate(Vector3(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10)));
+	xform.rotate(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+	if(!rigid) {
+		xform.scale(Vector4(rnd(0.5, 2), rnd(0.5, 2), rnd(0.5, 2), 1));
+	}
+	m4_to_m3x4(m, xform.m);
+}
+
+static void m3x4_check(mat3x4_t a, mat3x4_t b, scalar_t tol)
+{
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<4; j++) {
+			if(tol > 0.0) {
+				CHECK_NEAR(a[i][j], b[i][j], tol);
+			} else {
+				CHECK(a[i][j] == b[i][j]);
+			}
+		}
+	}
+}
+
+static void t_m3x4()
+{
+	const int count = NUM_SAMPLES + 1;
+	mat3x4_t *a = new mat3x4_t[count];
+	mat3x4_t *b = new mat3x4_t[count];
+	mat3x4_t *res = new mat3x4_t[count];
+
+	for(int i=0; i<count; i++) {
+		rnd_affine(a[i], i & 1);
+		rnd_affine(b[i], false);
+	}
+
+	/* products and inverses agree with the 4x4 ones */
+	for(int i=0; i<count; i++) {
+		mat4_t a4, b4, ref4;
+		mat3x4_t ref, tmp;
+		m3x4_to_m4(a4, a[i]);
+		m3x4_to_m4(b4, b[i]);
+
+		ref_m4_mult(ref4, a4, b4);
+		m4_to_m3x4(ref, ref4);
+		m3x4_mult(tmp, a[i], b[i]);
+		m3x4_check(tmp, ref, 1e-5);
+
+		m3x4_copy(tmp, a[i]);
+		m3x4_mult(tmp, tmp, b[i]);
+		m3x4_check(tmp, ref, 1e-5);
+
+		m4_inverse(ref4, b4);
+		m4_to_m3x4(ref, ref4);
+		m3x4_inverse(tmp, b[i]);
+		m3x4_check(tmp, ref, 1e-4);
+
+		if(i & 1) {
+			m4_inverse(ref4, a4);
+			m4_to_m3x4(ref, ref4);
+			m3x4_inverse_rigid(tmp, a[i]);
+			m3x4_check(tmp, ref, 1e-4);
+		}
+	}
+
+	/* the batch versions agree with the single ones, also in place */
+	m3x4_mult_array(res, a, b, count);
+	for(int i=0; i<count; i++) {
+		mat3x4_t ref;
+		m3x4_mult(ref, a[i], b[i]);
+		m3x4_check(res[i], ref, 1e-6);
+	}
+	m3x4_inverse_array(res, b, count);
+	for(int i=0; i<count; i++) {
+		mat3x4_t ref;
+		m3x4_inverse(ref, b[i]);
+		m3x4_check(res[i], ref, 1e-5);
+	}
+	memcpy(res, b, count * sizeof *res);
+	m3x4_inverse_array(res, res, count);
+	for(int i=0; i<count; i++) {
+		mat3x4_t ref;
+		m3x4_inverse(ref, b[i]);
+		m3x4_check(res[i], ref, 1e-5);
+	}
+
+	delete [] a;
+	delete [] b;
+	delete [] res;
+}
+
+/* well conditioned 3x3 matrices: random, plus a dominant diagonal */
+static void rnd_mat3(mat3_t m)
+{
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<3; j++) {
+			m[i][j] = rnd(-1, 1) + (i == j ? (rnd(0, 1) < 0.5 ? -3 : 3) : 0);
+		}
+	}
+}
+
+static void m3_check(mat3_t a, mat3_t b, scalar_t tol)
+{
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<3; j++) {
+			if(tol > 0.0) {
+				CHECK_NEAR(a[i][j], b[i][j], tol);
+			} else {
+				CHECK(a[i][j] == b[i][j]);
+			}
+		}
+	}
+}
+
+static void t_m3_inverse()
+{
+	/* not a multiple of 4, so the SIMD loop leaves a scalar tail */
+	const int count = NUM_SAMPLES + 3;
+	mat3_t *mats = new mat3_t[count];
+	scalar_t *mem = new scalar_t[count * 18];
+	mat3_soa_t m, res;
+	for(int i=0; i<3; i++) {
+		for(int j=0; j<3; j++) {
+			m.m[i][j] = mem + (i * 3 + j) * count;
+			res.m[i][j] = mem + (9 + i * 3 + j) * count;
+		}
+	}
+
+	for(int n=0; n<count; n++) {
+		mat3_t inv, prod, ident, trans, nmat;
+		mat4_t m4;
+		rnd_mat3(mats[n]);
+		for(int i=0; i<3; i++) {
+			for(int j=0; j<3; j++) {
+				m.m[i][j][n] = mats[n][i][j];
+			}
+		}
+
+		/* M * inverse(M) = I */
+		m3_inverse(inv, mats[n]);
+		m3_identity(ident);
+		for(int i=0; i<3; i++) {
+			for(int j=0; j<3; j++) {
+				prod[i][j] = mats[n][i][0] * inv[0][j] + mats[n][i][1] * inv[1][j] + mats[n][i][2] * inv[2][j];
+				trans[i][j] = inv[j][i];
+			}
+		}
+		m3_check(prod, ident, 1e-5);
+
+		/* Matrix3x3::inverse used to return *this */
+		Matrix3x3 mm;
+		memcpy(mm.m, mats[n], sizeof mats[n]);
+		m3_check(mm.inverse().m, inv, 0);
+		Matrix3x3 mprod = mm * mm.inverse();
+		m3_check(mprod.m, ident, 1e-5);
+
+		/* the normal matrix is the transpose of the inverse of the upper 3x3 part */
+		m3_to_m4(m4, mats[n]);
+		m4[0][3] = rnd(-10, 10);
+		m4[1][3] = rnd(-10, 10);
+		m4[2][3] = rnd(-10, 10);
+		m4_normal_matrix(nmat, m4);
+		m3_check(nmat, trans, 0);
+	}
+
+	/* the batch versions match the scalar ones exactly */
+	m3_inverse_soa(res, m, count);
+	int bad = 0;
+	for(int n=0; n<count; n++) {
+		mat3_t inv;
+		m3_inverse(inv, mats[n]);
+		for(int i=0; i<3; i++) {
+			for(int j=0; j<3; j++) {
+				if(res.m[i][j][n] != inv[i][j]) bad++;
+			}
+		}
+	}
+	CHECK(bad == 0);
+
+	m3_normal_matrix_soa(res, m, count);
+	bad = 0;
+	for(int n=0; n<count; n++) {
+		mat3_t inv;
+		m3_inverse(inv, mats[n]);
+		for(int i=0; i<3; i++) {
+			for(int j=0; j<3; j++) {
+				if(res.m[i][j][n] != inv[j][i]) bad++;
+			}
+		}
+	}
+	CHECK(bad == 0);
+
+	delete [] mats;
+	delete [] mem;
+}
+
+/* the specialized 4x4 inverses agree with the general one on the matrices of
+ * their class, and m4_inverse_auto picks the right one
+ */
+static void t_m4_inverse_special()
+{
+	for(int i=0; i<NUM_SAMPLES; i++) {
+		mat3x4_t m34;
+		mat4_t m, ref, res, prod, ident;
+
+		/* 0: rigid, 1: affine, 2: general */
+		int kind = i % 3;
+		if(kind == 2) {
+			rnd_mat4(m);
+		} else {
+			rnd_affine(m34, kind == 0);
+			m3x4_to_m4(m, m34);
+		}
+		int type = kind == 0 ? M4_RIGID : (kind == 1 ? M4_AFFINE : M4_GENERAL);
+		CHECK(m4_classify(m) == type);
+
+		m4_inverse(ref, m);
+		if(kind < 2) {
+			if(kind == 0) {
+				m4_inverse_rigid(res, m);
+			} else {
+				m4_inverse_affine(res, m);
+			}
+			m4_check(res, ref, false);
+			CHECK(res[3][0] == 0.0 && res[3][1] == 0.0 && res[3][2] == 0.0 && res[3][3] == 1.0);
+
+			m4_identity(ident);
+			ref_m4_mult(prod, m, res);
+			m4_check(prod, ident, false);
+		}
+
+		/* auto must use exactly the function for the class */
+		mat4_t spec;
+		if(kind == 0) {
+			m4_inverse_rigid(spec, m);
+		} else if(kind == 1) {
+			m4_inverse_affine(spec, m);
+		} else {
+			memcpy(spec, ref, sizeof spec);
+		}
+		CHECK(m4_inverse_auto(res, m) == type);
+		m4_check(res, spec, true);
+
+		/* and so must the C++ wrappers */
+		Matrix4x4 mm;
+		memcpy(mm.m, m, sizeof m);
+		m4_check(mm.inverse_auto().m, spec, true);
+		if(kind == 0) {
+			m4_check(mm.inverse_rigid().m, spec, true);
+		}
+		if(kind < 2) {
+			m4_inverse_affine(spec, m);
+			m4_check(mm.inverse_affine().m, spec, true);
+		}
+	}
+
+	/* the class boundaries */
+	mat4_t m;
+	m4_identity(m);
+	CHECK(m4_classify(m) == M4_RIGID);
+	m[0][0] = -1.0;		/* a reflection is still orthonormal */
+	CHECK(m4_classify(m) == M4_RIGID);
+	m[1][1] = 1.001;
+	CHECK(m4_classify(m) == M4_AFFINE);
+	m4_identity(m);
+	m[0][1] = 0.001;
+	CHECK(m4_classify(m) == M4_AFFINE);
+	m4_identity(m);
+	m[3][3] = 2.0;
+	CHECK(m4_classify(m) == M4_GENERAL);
+	m4_identity(m);
+	m[3][1] = 0.5;
+	CHECK(m4_classify(m) == M4_GENERAL);
+}
+
+/* get_rotation_quat must recover the quaternion (up to its sign) for all
+ * angles, including the ones where the matrix trace is negative
+ */
+static void t_get_rotation_quat()
+{
+	for(int i=0; i<NUM_SAMPLES; i++) {
+		Quaternion q(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+		Matrix3x3 m = q.get_rotation_matrix();
+		Quaternion r = m.get_rotation_quat();
+		if(r.s * q.s + dot_product(r.v, q.v) < 0.0) {
+			r = -r;
+		}
+		CHECK_NEAR(r.s, q.s, 1e-5);
+		CHECK_NEAR(r.v.x, q.v.x, 1e-5);
+		CHECK_NEAR(r.v.y, q.v.y, 1e-5);
+		CHECK_NEAR(r.v.z, q.v.z, 1e-5);
+
+		Matrix4x4 m4;
+		m4.rotate(q);
+		r = m4.get_rotation_quat();
+		CHECK_NEAR(fabs(r.s * q.s + dot_product(r.v, q.v)), 1.0, 1e-5);
+	}
+}
+
+/* ---- skinning ---- */
+
+#define SKIN_BONES	32
+#define SKIN_VERTS	(NUM_SAMPLES + 3)
+
+static mat4_t skin_mat[SKIN_BONES];
+static int skin_idx[SKIN_VERTS * 4];
+static scalar_t skin_weights[SKIN_VERTS * 4];
+static scalar_t skin_mem[SKIN_VERTS * 9];
+static vec3_soa_t skin_pos, skin_norm, skin_tang;
+
+/* rigid bone transformations, and vertices with 1 to 4 influences */
+static void init_skin()
+{
+	static bool done;
+	if(done) return;
+	done = true;
+
+	for(int i=0; i<SKIN_BONES; i++) {
+		Matrix4x4 xform;
+		xform.translate(Vector3(rnd(-5, 5), rnd(-5, 5), rnd(-5, 5)));
+		xform.rotate(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+		memcpy(skin_mat[i], xform.m, sizeof(mat4_t));
+	}
+
+	skin_pos = v3_soa_cons(skin_mem, skin_mem + SKIN_VERTS, skin_mem + SKIN_VERTS * 2);
+	skin_norm = v3_soa_cons(skin_mem + SKIN_VERTS * 3, skin_mem + SKIN_VERTS * 4, skin_mem + SKIN_VERTS * 5);
+	skin_tang = v3_soa_cons(skin_mem + SKIN_VERTS * 6, skin_mem + SKIN_VERTS * 7, skin_mem + SKIN_VERTS * 8);
+
+	for(int i=0; i<SKIN_VERTS; i++) {
+		vec3_t n = v3_normalize(rnd_v3(-1, 1));
+		vec3_t t = v3_normalize(v3_cross(n, v3_cons(0, 1, 0)));
+		skin_pos.x[i] = rnd(-1, 1);
+		skin_pos.y[i] = rnd(0, 2);
+		skin_pos.z[i] = rnd(-1, 1);
+		skin_norm.x[i] = n.x; skin_norm.y[i] = n.y; skin_norm.z[i] = n.z;
+		skin_tang.x[i] = t.x; skin_tang.y[i] = t.y; skin_tang.z[i] = t.z;
+
+		int used = i % 4 + 1;
+		scalar_t wsum = 0.0;
+		for(int j=0; j<4; j++) {
+			skin_idx[i * 4 + j] = (int)rnd(0, SKIN_BONES - 0.01);
+			skin_weights[i * 4 + j] = j < used ? rnd(0.1, 1) : 0.0;
+			wsum += skin_weights[i * 4 + j];
+		}
+		for(int j=0; j<4; j++) {
+			skin_weights[i * 4 + j] /= wsum;
+		}
+	}
+}
+
+static void t_dq_skin_soa()
+{
+	init_skin();
+
+	dualquat_t bones[SKIN_BONES];
+	for(int i=0; i<SKIN_BONES; i++) {
+		bones[i] = dq_from_mat4(skin_mat[i]);
+	}
+
+	/* a single bone moves the vertices like its matrix */
+	for(int i=0; i<SKIN_BONES; i++) {
+		mat4_t m;
+		dq_to_mat4(m, bones[i]);
+		for(int j=0; j<3; j++) {
+			for(int k=0; k<4; k++) {
+				CHECK_NEAR(m[j][k], skin_mat[i][j][k], 1e-5);
+			}
+		}
+	}
+
+	scalar_t *out_mem = new scalar_t[SKIN_VERTS * 6];
+	vec3_soa_t pos_res = v3_soa_cons(out_mem, out_mem + SKIN_VERTS, out_mem + SKIN_VERTS * 2);
+	vec3_soa_t norm_res = v3_soa_cons(out_mem + SKIN_VERTS * 3, out_mem + SKIN_VERTS * 4, out_mem + SKIN_VERTS * 5);
+
+	dq_skin_soa(pos_res, norm_res, skin_pos, skin_norm, bones, skin_idx, skin_weights, SKIN_VERTS);
+
+	/* reference: blend in double precision, flipping the bones in the other
+	 * hemisphere from the first one, normalize, convert to a matrix
+	 */
+	int bad = 0;
+	for(int i=0; i<SKIN_VERTS; i++) {
+		const dualquat_t *b0 = bones + skin_idx[i * 4];
+		double real[4] = {0, 0, 0, 0}, dual[4] = {0, 0, 0, 0};
+		for(int j=0; j<4; j++) {
+			const dualquat_t *b = bones + skin_idx[i * 4 + j];
+			double w = skin_weights[i * 4 + j];
+			if(v4_dot(b->real, b0->real) < 0.0) w = -w;
+			for(int k=0; k<4; k++) {
+				real[k] += w * (&b->real.x)[k];
+				dual[k] += w * (&b->dual.x)[k];
+			}
+		}
+		double len = sqrt(real[0] * real[0] + real[1] * real[1] + real[2] * real[2] + real[3] * real[3]);
+		dualquat_t dq;
+		dq.real = v4_cons(real[0] / len, real[1] / len, real[2] / len, real[3] / len);
+		dq.dual = v4_cons(dual[0] / len, dual[1] / len, dual[2] / len, dual[3] / len);
+		mat4_t m;
+		dq_to_mat4(m, dq);
+
+		vec3_t p = v3_transform(v3_cons(skin_pos.x[i], skin_pos.y[i], skin_pos.z[i]), m);
+		vec3_t n = v3_cons(skin_norm.x[i], skin_norm.y[i], skin_norm.z[i]);
+		n = v3_cons(m[0][0] * n.x + m[0][1] * n.y + m[0][2] * n.z,
+				m[1][0] * n.x + m[1][1] * n.y + m[1][2] * n.z,
+				m[2][0] * n.x + m[2][1] * n.y + m[2][2] * n.z);
+
+		if(!near(pos_res.x[i], p.x, 1e-4) || !near(pos_res.y[i], p.y, 1e-4) || !near(pos_res.z[i], p.z, 1e-4) ||
+				!near(norm_res.x[i], n.x, 1e-4) || !near(norm_res.y[i], n.y, 1e-4) || !near(norm_res.z[i], n.z, 1e-4)) {
+			bad++;
+		}
+	}
+	CHECK(bad == 0);
+
+	/* without normals, and in place */
+	vec3_soa_t no_norm = {0, 0, 0};
+	scalar_t *copy = new scalar_t[SKIN_VERTS * 3];
+	memcpy(copy, skin_mem, SKIN_VERTS * 3 * sizeof *copy);
+	vec3_soa_t inplace = v3_soa_cons(copy, copy + SKIN_VERTS, copy + SKIN_VERTS * 2);
+	dq_skin_soa(inplace, no_norm, inplace, no_norm, bones, skin_idx, skin_weights, SKIN_VERTS);
+	CHECK(memcmp(copy, out_mem, SKIN_VERTS * 3 * sizeof *copy) == 0);
+
+	delete [] copy;
+	delete [] out_mem;
+}
+
+static void t_skin_lbs_soa()
+{
+	init_skin();
+
+	mat3x4_t bones[SKIN_BONES];
+	for(int i=0; i<SKIN_BONES; i++) {
+		m4_to_m3x4(bones[i], skin_mat[i]);
+	}
+
+	scalar_t *out_mem = new scalar_t[SKIN_VERTS * 18];
+	skin_soa_t in, out, out_mt;
+	in.pos = skin_pos;
+	in.norm = skin_norm;
+	in.tang = skin_tang;
+	vec3_soa_t *streams[] = {&out.pos, &out.norm, &out.tang, &out_mt.pos, &out_mt.norm, &out_mt.tang};
+	for(int i=0; i<6; i++) {
+		scalar_t *p = out_mem + i * 3 * SKIN_VERTS;
+		*streams[i] = v3_soa_cons(p, p + SKIN_VERTS, p + SKIN_VERTS * 2);
+	}
+
+	skin_lbs_soa(&out, &in, bones, skin_idx, skin_weights, SKIN_VERTS);
+
+	/* reference: weighted sum of the matrices in double precision */
+	int bad = 0;
+	for(int i=0; i<SKIN_VERTS; i++) {
+		double m[3][4] = {{0}};
+		for(int j=0; j<4; j++) {
+			double w = skin_weights[i * 4 + j];
+			for(int r=0; r<3; r++) {
+				for(int c=0; c<4; c++) {
+					m[r][c] += w * bones[skin_idx[i * 4 + j]][r][c];
+				}
+			}
+		}
+		for(int r=0; r<3; r++) {
+			double p = m[r][0] * skin_pos.x[i] + m[r][1] * skin_pos.y[i] + m[r][2] * skin_pos.z[i] + m[r][3];
+			double n = m[r][0] * skin_norm.x[i] + m[r][1] * skin_norm.y[i] + m[r][2] * skin_norm.z[i];
+			double t = m[r][0] * skin_tang.x[i] + m[r][1] * skin_tang.y[i] + m[r][2] * skin_tang.z[i];
+			if(!near((&out.pos.x)[r][i], p, 1e-5) || !near((&out.norm.x)[r][i], n, 1e-5) ||
+					!near((&out.tang.x)[r][i], t, 1e-5)) {
+				bad++;
+			}
+		}
+	}
+	CHECK(bad == 0);
+
+	/* any split across threads gives the same results */
+	int threads[] = {1, 3, 0};
+	for(int i=0; i<3; i++) {
+		memset(out_mem + SKIN_VERTS * 9, 0, SKIN_VERTS * 9 * sizeof *out_mem);
+		skin_lbs_soa_mt(&out_mt, &in, bones, skin_idx, skin_weights, SKIN_VERTS, threads[i]);
+		CHECK(memcmp(out_mem, out_mem + SKIN_VERTS * 9, SKIN_VERTS * 9 * sizeof *out_mem) == 0);
+	}
+
+	/* positions only */
+	skin_soa_t pos_only = out_mt;
+	skin_soa_t in_pos = in;
+	pos_only.norm.x = pos_only.tang.x = 0;
+	in_pos.norm.x = in_pos.tang.x = 0;
+	memset(out_mem + SKIN_VERTS * 9, 0, SKIN_VERTS * 9 * sizeof *out_mem);
+	skin_lbs_soa(&pos_only, &in_pos, bones, skin_idx, skin_weights, SKIN_VERTS);
+	CHECK(memcmp(out_mem, out_mem + SKIN_VERTS * 9, SKIN_VERTS * 3 * sizeof *out_mem) == 0);
+	CHECK(out_mt.norm.x[0] == 0.0 && out_mt.tang.x[SKIN_VERTS - 1] == 0.0);
+
+	delete [] out_mem;
+}
+
+/* ---- transformation hierarchy ---- */
+
+#define XFORM_NODES	20000
+
+static void ref_world(const int *parent, mat3x4_t *local, mat3x4_t *world, bool *done, int n)
+{
+	if(done[n]) return;
+	if(parent[n] < 0) {
+		m3x4_copy(world[n], local[n]);
+	} else {
+		ref_world(parent, local, world, done, parent[n]);
+		m3x4_mult(world[n], world[parent[n]], local[n]);
+	}
+	done[n] = true;
+}
+
+static int check_xform_world(const xform_tree_t *tree, const int *parent, mat3x4_t *local)
+{
+	mat3x4_t *world = new mat3x4_t[XFORM_NODES];
+	bool *done = new bool[XFORM_NODES];
+	int bad = 0;
+
+	memset(done, 0, XFORM_NODES * sizeof *done);
+	for(int i=0; i<XFORM_NODES; i++) {
+		ref_world(parent, local, world, done, i);
+		mat3x4_t res;
+		xform_tree_get_world(tree, i, res);
+		if(memcmp(res, world[i], sizeof res) != 0) {
+			bad++;
+		}
+	}
+	delete [] world;
+	delete [] done;
+	return bad;
+}
+
+static void t_xform_tree()
+{
+	/* a random forest with a few levels wider than XFORM_TREE_MT_MIN, so
+	 * that xform_tree_update_mt splits them. Parents are not always before
+	 * their children in node order.
+	 */
+	int *parent = new int[XFORM_NODES];
+	int *perm = new int[XFORM_NODES];
+	mat3x4_t *local = new mat3x4_t[XFORM_NODES];
+
+	for(int i=0; i<XFORM_NODES; i++) {
+		perm[i] = i;
+	}
+	for(int i=XFORM_NODES-1; i>0; i--) {
+		int j = (int)rnd(0, i + 0.99);
+		int tmp = perm[i]; perm[i] = perm[j]; perm[j] = tmp;
+	}
+	/* node perm[i] has a parent among the first 64 (or i) nodes of perm */
+	for(int i=0; i<XFORM_NODES; i++) {
+		parent[perm[i]] = i < 8 ? -1 : perm[(int)rnd(0, (i < 64 ? i : 64) - 0.01)];
+	}
+
+	xform_tree_t tree, tree_mt;
+	xform_tree_init(&tree);
+	xform_tree_init(&tree_mt);
+	CHECK(xform_tree_build(&tree, parent, XFORM_NODES) == 0);
+	CHECK(xform_tree_build(&tree_mt, parent, XFORM_NODES) == 0);
+
+	/* parents before children in the slot order */
+	int bad = 0;
+	for(int s=0; s<XFORM_NODES; s++) {
+		if(tree.node[tree.slot[s]] != s || tree.parent[s] >= s) bad++;
+	}
+	CHECK(bad == 0);
+
+	for(int i=0; i<XFORM_NODES; i++) {
+		rnd_affine(local[i], false);
+		xform_tree_set_local(&tree, i, local[i]);
+		xform_tree_set_local(&tree_mt, i, local[i]);
+	}
+	xform_tree_update(&tree);
+	xform_tree_update_mt(&tree_mt, 3);
+	CHECK(check_xform_world(&tree, parent, local) == 0);
+	CHECK(memcmp(tree.world, tree_mt.world, XFORM_NODES * sizeof *tree.world) == 0);
+
+	/* partial updates */
+	for(int iter=0; iter<4; iter++) {
+		int num = iter == 3 ? XFORM_NODES / 2 : 50;
+		for(int i=0; i<num; i++) {
+			int n = (int)rnd(0, XFORM_NODES - 0.01);
+			rnd_affine(local[n], false);
+			xform_tree_set_local(&tree, n, local[n]);
+			xform_tree_set_local(&tree_mt, n, local[n]);
+		}
+		xform_tree_update(&tree);
+		xform_tree_update_mt(&tree_mt, 0);
+		CHECK(check_xform_world(&tree, parent, local) == 0);
+		CHECK(memcmp(tree.world, tree_mt.world, XFORM_NODES * sizeof *tree.world) == 0);
+	}
+
+	/* nothing dirty: nothing visited */
+	xform_tree_update(&tree);
+	CHECK(tree.stats.num_visited == 0 && tree.stats.num_updated == 0);
+
+	/* a cycle is rejected */
+	parent[perm[0]] = perm[1];
+	parent[perm[1]] = perm[0];
+	CHECK(xform_tree_build(&tree, parent, XFORM_NODES) == -1);
+
+	xform_tree_destroy(&tree);
+	xform_tree_destroy(&tree_mt);
+	delete [] parent;
+	delete [] perm;
+	delete [] local;
+}
+
+/* ---- frustum culling ---- */
+
+#define CULL_OBJECTS	(NUM_SAMPLES * 4 + 5)
+
+static void init_frustum(frustum_t *frust, mat4_t viewproj)
+{
+	Matrix4x4 proj, view;
+	proj.set_perspective(DEG_TO_RAD(60), 1.333, 0.5, 30.0);
+	view.set_lookat(Vector3(1, 2, 20), Vector3(0, 0, 0), Vector3(0, 1, 0));
+	Matrix4x4 vp = proj * view;
+	memcpy(viewproj, vp.m, sizeof(mat4_t));
+	frustum_from_matrix(frust, vp);
+}
+
+/* signed distance of the plane to the farthest point of the object along the
+ * plane normal: negative if the object is entirely outside
+ */
+static scalar_t sphere_plane_dist(const plane_t *pl, const sphere_t &sph)
+{
+	return v3_dot(pl->norm, sph.pos) - pl->d + sph.rad;
+}
+
+static scalar_t box_plane_dist(const plane_t *pl, const aabox_t &box)
+{
+	vec3_t pv;
+	pv.x = pl->norm.x >= 0.0 ? box.max.x : box.min.x;
+	pv.y = pl->norm.y >= 0.0 ? box.max.y : box.min.y;
+	pv.z = pl->norm.z >= 0.0 ? box.max.z : box.min.z;
+	return v3_dot(pl->norm, pv) - pl->d;
+}
+
+static void t_frustum_planes()
+{
+	frustum_t frust;
+	mat4_t vp;
+	init_frustum(&frust, vp);
+
+	for(int i=0; i<6; i++) {
+		CHECK_NEAR(v3_length(frust.plane[i].norm), 1.0, 1e-5);
+	}
+
+	/* a point is inside all the planes if it's inside the clip volume */
+	for(int i=0; i<NUM_SAMPLES * 10; i++) {
+		vec4_t p = v4_cons(rnd(-20, 20), rnd(-20, 20), rnd(-15, 25), 1.0);
+		vec4_t c = v4_transform(p, vp);
+		scalar_t margin = fabs(c.w) * 1e-3;
+		bool in_clip = c.w > 0.0 && fabs(c.x) < c.w - margin && fabs(c.y) < c.w - margin &&
+			fabs(c.z) < c.w - margin;
+		bool out_clip = c.w <= 0.0 || fabs(c.x) > c.w + margin || fabs(c.y) > c.w + margin ||
+			fabs(c.z) > c.w + margin;
+
+		bool inside = true;
+		for(int j=0; j<6; j++) {
+			if(v3_dot(frust.plane[j].norm, v3_cons(p.x, p.y, p.z)) < frust.plane[j].d) {
+				inside = false;
+			}
+		}
+		if(in_clip) CHECK(inside);
+		if(out_clip) CHECK(!inside);
+	}
+}
+
+static void t_frustum_cull()
+{
+	frustum_t frust;
+	mat4_t vp;
+	init_frustum(&frust, vp);
+
+	const int count = CULL_OBJECTS;
+	scalar_t *mem = new scalar_t[count * 10];
+	sphere_soa_t sph = {mem, mem + count, mem + count * 2, mem + count * 3};
+	aabox_soa_t box;
+	box.min = v3_soa_cons(mem + count * 4, mem + count * 5, mem + count * 6);
+	box.max = v3_soa_cons(mem + count * 7, mem + count * 8, mem + count * 9);
+	unsigned char *ref_vis = new unsigned char[count];
+	unsigned char *vis = new unsigned char[count];
+	unsigned char *hint = new unsigned char[count];
+	int *idx = new int[count];
+	int *ref_idx = new int[count];
+
+	for(int pass=0; pass<2; pass++) {
+		bool spheres = pass == 0;
+
+		for(int i=0; i<count; i++) {
+			vec3_t c = rnd_v3(-25, 25);
+			scalar_t r = rnd(0.1, 2.0);
+			sph.x[i] = c.x; sph.y[i] = c.y; sph.z[i] = c.z; sph.rad[i] = r;
+			box.min.x[i] = c.x - r; box.min.y[i] = c.y - r * 0.5; box.min.z[i] = c.z - r * 2.0;
+			box.max.x[i] = c.x + r; box.max.y[i] = c.y + r * 0.5; box.max.z[i] = c.z + r * 2.0;
+		}
+
+		/* single object tests against the plane distances */
+		int num_ref = 0, bad = 0;
+		for(int i=0; i<count; i++) {
+			sphere_t s = sphere_cons(sph.x[i], sph.y[i], sph.z[i], sph.rad[i]);
+			aabox_t b = aabox_cons(box.min.x[i], box.min.y[i], box.min.z[i],
+					box.max.x[i], box.max.y[i], box.max.z[i]);
+			scalar_t dmin = 1e10;
+			for(int j=0; j<6; j++) {
+				scalar_t d = spheres ? sphere_plane_dist(frust.plane + j, s) : box_plane_dist(frust.plane + j, b);
+				if(d < dmin) dmin = d;
+			}
+			unsigned char h = (unsigned char)(i % 6);
+			int res = spheres ? frustum_sphere_test(&frust, s, &h) : frustum_aabox_test(&frust, &b, &h);
+			if(fabs(dmin) > 1e-4 && res != (dmin >= 0.0)) bad++;
+			if(h >= 6) bad++;
+
+			ref_vis[i] = spheres ? frustum_sphere_test(&frust, s, 0) : frustum_aabox_test(&frust, &b, 0);
+			if(ref_vis[i]) ref_idx[num_ref++] = i;
+		}
+		CHECK(bad == 0);
+		CHECK(num_ref > count / 20 && num_ref < count / 2);
+
+		/* the batch versions, with and without hints, and split across threads */
+		memset(hint, 0, count);
+		for(int iter=0; iter<6; iter++) {
+			int num;
+			unsigned char *h = iter == 0 ? 0 : hint;
+			memset(vis, 0xff, count);
+			memset(idx, 0xff, count * sizeof *idx);
+
+			if(iter < 3) {
+				num = spheres ? frustum_cull_spheres_soa(&frust, sph, count, vis, idx, h) :
+					frustum_cull_aabox_soa(&frust, box, count, vis, idx, h);
+			} else {
+				int nthr = iter == 3 ? 1 : (iter == 4 ? 3 : 0);
+				int chunk = iter == 3 ? 0 : (iter == 4 ? 13 : 256);
+				num = spheres ? frustum_cull_spheres_soa_mt(&frust, sph, count, vis, idx, h, nthr, chunk) :
+					frustum_cull_aabox_soa_mt(&frust, box, count, vis, idx, h, nthr, chunk);
+			}
+			CHECK(num == num_ref);
+			CHECK(memcmp(vis, ref_vis, count) == 0);
+			CHECK(memcmp(idx, ref_idx, num_ref * sizeof *idx) == 0);
+		}
+		int bad_hint = 0;
+		for(int i=0; i<count; i++) {
+			if(hint[i] >= 6) bad_hint++;
+		}
+		CHECK(bad_hint == 0);
+
+		/* count only */
+		CHECK((spheres ? frustum_cull_spheres_soa(&frust, sph, count, 0, 0, 0) :
+			frustum_cull_aabox_soa(&frust, box, count, 0, 0, 0)) == num_ref);
+	}
+
+	delete [] mem;
+	delete [] ref_vis;
+	delete [] vis;
+	delete [] hint;
+	delete [] idx;
+	delete [] ref_idx;
+}
+
+/* ---- random numbers ---- */
+
+static void t_rng_bulk()
+{
+	const int count = NUM_SAMPLES + 3;
+	scalar_t *mem = new scalar_t[count * 3];
+	vec3_soa_t v3 = v3_soa_cons(mem, mem + count, mem + count * 2);
+	vec2_soa_t v2 = {mem, mem + count};
+	rng_t rng, ref;
+	int bad;
+
+	rng_seed(&rng, 42);
+	ref = rng;
+	rng_frand_array(&rng, mem, count);
+	bad = 0;
+	for(int i=0; i<count; i++) {
+		scalar_t x = rng_frand(&ref);
+		if(mem[i] != x || x < 0.0 || x >= 1.0) bad++;
+	}
+	CHECK(bad == 0);
+	CHECK(memcmp(&rng, &ref, sizeof rng) == 0);
+
+	for(int func=0; func<4; func++) {
+		bad = 0;
+		switch(func) {
+		case 0:
+			rng_sphere_soa(&rng, v3, 2.5, count);
+			for(int i=0; i<count; i++) {
+				vec3_t v = rng_sphere(&ref, 2.5);
+				if(v.x != v3.x[i] || v.y != v3.y[i] || v.z != v3.z[i]) bad++;
+				if(fabs(v3_length(v) - 2.5) > 1e-5) bad++;
+			}
+			break;
+		case 1:
+			rng_hemisphere_soa(&rng, v3, count);
+			for(int i=0; i<count; i++) {
+				vec3_t v = rng_hemisphere(&ref);
+				if(v.x != v3.x[i] || v.y != v3.y[i] || v.z != v3.z[i]) bad++;
+				if(fabs(v3_length(v) - 1.0) > 1e-5 || v.z < 0.0) bad++;
+			}
+			break;
+		case 2:
+			rng_hemisphere_cos_soa(&rng, v3, count);
+			for(int i=0; i<count; i++) {
+				vec3_t v = rng_hemisphere_cos(&ref);
+				if(v.x != v3.x[i] || v.y != v3.y[i] || v.z != v3.z[i]) bad++;
+				if(fabs(v3_length(v) - 1.0) > 1e-5 || v.z < 0.0) bad++;
+			}
+			break;
+		default:
+			rng_disk_soa(&rng, v2, count);
+			for(int i=0; i<count; i++) {
+				vec2_t v = rng_disk(&ref);
+				if(v.x != v2.x[i] || v.y != v2.y[i]) bad++;
+				if(v.x * v.x + v.y * v.y >= 1.0) bad++;
+			}
+		}
+		CHECK(bad == 0);
+		CHECK(memcmp(&rng, &ref, sizeof rng) == 0);
+	}
+	delete [] mem;
+}
+
+/* the default generators of different threads are different streams of the
+ * same seed
+ */
+#define RNG_THREADS	4
+#define RNG_STREAMS	64
+
+struct RngSeen {
+	rng_t *rng[RNG_THREADS * 8];
+	rng_t state[RNG_THREADS * 8];
+};
+
+static void rng_thread_chunk(int start, int end, void *cls)
+{
+	RngSeen *seen = (RngSeen*)cls;
+	seen->rng[start] = rng_default();
+	seen->state[start] = *seen->rng[start];
+
+	/* long enough for the pool threads to get some of the chunks, even on a
+	 * single processor
+	 */
+	clock_t t0 = clock();
+	while(clock() - t0 < CLOCKS_PER_SEC / 200);
+}
+
+static void t_rng_default()
+{
+	RngSeen seen;
+	vmath_parallel_for(RNG_THREADS * 8, RNG_THREADS, 1, rng_thread_chunk, &seen);
+
+	rng_t streams[RNG_STREAMS];
+	rng_seed(streams, 0);
+	for(int i=1; i<RNG_STREAMS; i++) {
+		streams[i] = streams[i - 1];
+		rng_jump(streams + i);
+	}
+
+	rng_t *main_rng = rng_default();
+	int num_pool = 0;
+	for(int i=0; i<RNG_THREADS * 8; i++) {
+		if(seen.rng[i] != main_rng) num_pool++;
+	}
+	CHECK(num_pool > 0);
+
+	for(int i=0; i<RNG_THREADS * 8; i++) {
+		for(int j=0; j<i; j++) {
+			if(seen.rng[i] != seen.rng[j]) {
+				CHECK(memcmp(seen.state + i, seen.state + j, sizeof(rng_t)) != 0);
+			}
+		}
+		/* the pool threads haven't drawn any numbers yet */
+		if(seen.rng[i] != main_rng) {
+			bool found = false;
+			for(int j=0; j<RNG_STREAMS; j++) {
+				if(memcmp(seen.state + i, streams + j, sizeof(rng_t)) == 0) {
+					found = true;
+				}
+			}
+			CHECK(found);
+		}
+	}
+
+	/* new threads keep getting new streams */
+	RngSeen seen2;
+	vmath_sched_shutdown();
+	vmath_parallel_for(RNG_THREADS * 8, RNG_THREADS, 1, rng_thread_chunk, &seen2);
+	for(int i=0; i<RNG_THREADS * 8; i++) {
+		if(seen2.rng[i] == main_rng) continue;
+
+		bool found = false;
+		for(int j=0; j<RNG_STREAMS; j++) {
+			if(memcmp(seen2.state + i, streams + j, sizeof(rng_t)) == 0) {
+				found = true;
+			}
+		}
+		CHECK(found);
+		for(int j=0; j<RNG_THREADS * 8; j++) {
+			if(seen.rng[j] != main_rng) {
+				CHECK(memcmp(seen2.state + i, seen.state + j, sizeof(rng_t)) != 0);
+			}
+		}
+	}
+}
+
+/* ---- quasi-Monte Carlo sequences ---- */
+
+static void t_qmc_array()
+{
+	const int count = 1027;
+	scalar_t *res = new scalar_t[count * QMC_MAX_DIM];
+	unsigned int starts[] = {0, 1, 1000};
+	unsigned int seeds[] = {0, 1, 0xdeadbeef};
+
+	for(int ndim=1; ndim<=QMC_MAX_DIM; ndim++) {
+		for(int si=0; si<3; si++) {
+			unsigned int start = starts[si];
+			int bad = 0;
+
+			for(int seq=0; seq<3; seq++) {
+				for(int k=0; k<(seq == 0 ? 3 : 1); k++) {
+					switch(seq) {
+					case 0:
+						qmc_sobol_array(res, start, count, ndim, seeds[k]);
+						break;
+					case 1:
+						qmc_halton_array(res, start, count, ndim);
+						break;
+					default:
+						qmc_rd_array(res, start, count, ndim);
+					}
+					for(int i=0; i<count; i++) {
+						scalar_t pt[QMC_MAX_DIM];
+						switch(seq) {
+						case 0:
+							qmc_sobol(pt, start + i, ndim, seeds[k]);
+							break;
+						case 1:
+							qmc_halton(pt, start + i, ndim);
+							break;
+						default:
+							qmc_rd(pt, start + i, ndim);
+						}
+						for(int j=0; j<ndim; j++) {
+							if(res[i * ndim + j] != pt[j] || pt[j] < 0.0 || pt[j] >= 1.0) bad++;
+						}
+					}
+				}
+			}
+			CHECK(bad == 0);
+		}
+	}
+	delete [] res;
+}
+
+static void t_qmc_sobol()
+{
+	/* the first dimension of the plain sequence is the base 2 radical
+	 * inverse, like the first dimension of Halton
+	 */
+	int bad = 0;
+	for(unsigned int i=0; i<4096; i++) {
+		unsigned int rev = 0;
+		for(int b=0; b<32; b++) {
+			if(i & (1u << b)) rev |= 1u << (31 - b);
+		}
+		scalar_t pt[2], hpt[2];
+		qmc_sobol(pt, i, 2, 0);
+		qmc_halton(hpt, i, 2);
+		if(fabs(pt[0] - rev / 4294967296.0) > 1e-6 || fabs(hpt[0] - pt[0]) > 1e-6) bad++;
+	}
+	CHECK(bad == 0);
+
+	/* the first two dimensions form a (0, m, 2)-net: any 2^m points starting
+	 * at a multiple of 2^m have exactly one point in every elementary
+	 * interval of area 2^-m. Scrambling keeps that property.
+	 */
+	const int m = 8, num = 1 << m;
+	unsigned int seeds[] = {0, 7, 12345};
+	for(int k=0; k<3; k++) {
+		scalar_t *pts = new scalar_t[num * 2];
+		qmc_sobol_array(pts, num * 3, num, 2, seeds[k]);
+		for(int a=0; a<=m; a++) {
+			int nx = 1 << a, ny = 1 << (m - a);
+			int *cells = new int[num];
+			memset(cells, 0, num * sizeof *cells);
+			for(int i=0; i<num; i++) {
+				int cx = (int)(pts[i * 2] * nx);
+				int cy = (int)(pts[i * 2 + 1] * ny);
+				cells[cy * nx + cx]++;
+			}
+			int bad_cells = 0;
+			for(int i=0; i<num; i++) {
+				if(cells[i] != 1) bad_cells++;
+			}
+			CHECK(bad_cells == 0);
+			delete [] cells;
+		}
+		delete [] pts;
+	}
+}
+
+static void t_qmc_warp()
+{
+	const int count = NUM_SAMPLES + 3;
+	scalar_t *uv = new scalar_t[count * 2];
+	scalar_t *mem = new scalar_t[count * 3];
+	vec3_soa_t v3 = v3_soa_cons(mem, mem + count, mem + count * 2);
+	vec2_soa_t v2 = {mem, mem + count};
+
+	qmc_sobol_array(uv, 0, count, 2, 99);
+
+	for(int func=0; func<4; func++) {
+		int bad = 0;
+		switch(func) {
+		case 0:
+			warp_sphere_soa(v3, uv, count);
+			break;
+		case 1:
+			warp_hemisphere_soa(v3, uv, count);
+			break;
+		case 2:
+			warp_hemisphere_cos_soa(v3, uv, count);
+			break;
+		default:
+			warp_disk_soa(v2, uv, count);
+		}
+		for(int i=0; i<count; i++) {
+			scalar_t u = uv[i * 2], v = uv[i * 2 + 1];
+			if(func == 3) {
+				vec2_t p = warp_disk(u, v);
+				if(p.x != v2.x[i] || p.y != v2.y[i] || p.x * p.x + p.y * p.y > 1.0 + 1e-6) bad++;
+				continue;
+			}
+			vec3_t p = func == 0 ? warp_sphere(u, v) : (func == 1 ? warp_hemisphere(u, v) : warp_hemisphere_cos(u, v));
+			if(p.x != v3.x[i] || p.y != v3.y[i] || p.z != v3.z[i]) bad++;
+			if(fabs(v3_length(p) - 1.0) > 1e-5 || (func > 0 && p.z < 0.0)) bad++;
+		}
+		CHECK(bad == 0);
+	}
+	delete [] uv;
+	delete [] mem;
+}
+
+/* ---- ray-triangle intersection ---- */
+
+/* double precision Moller-Trumbore, returns the barycentric coordinates and
+ * distance even for misses, so that the caller can skip borderline cases
+ */
+static bool ref_tri_ray(ray_t ray, const triangle_t &tri, double *t, double *u, double *v)
+{
+	double e1[3], e2[3], s[3], d[3], p[3], q[3];
+	const vec3_t *vt = tri.v;
+
+	e1[0] = vt[1].x - vt[0].x; e1[1] = vt[1].y - vt[0].y; e1[2] = vt[1].z - vt[0].z;
+	e2[0] = vt[2].x - vt[0].x; e2[1] = vt[2].y - vt[0].y; e2[2] = vt[2].z - vt[0].z;
+	s[0] = ray.origin.x - vt[0].x; s[1] = ray.origin.y - vt[0].y; s[2] = ray.origin.z - vt[0].z;
+	d[0] = ray.dir.x; d[1] = ray.dir.y; d[2] = ray.dir.z;
+
+	p[0] = d[1] * e2[2] - d[2] * e2[1];
+	p[1] = d[2] * e2[0] - d[0] * e2[2];
+	p[2] = d[0] * e2[1] - d[1] * e2[0];
+	q[0] = s[1] * e1[2] - s[2] * e1[1];
+	q[1] = s[2] * e1[0] - s[0] * e1[2];
+	q[2] = s[0] * e1[1] - s[1] * e1[0];
+
+	double det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+	if(fabs(det) < 1e-12) return false;
+	*u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) / det;
+	*v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) / det;
+	*t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) / det;
+	return *u >= 0 && *v >= 0 && *u + *v <= 1 && *t > 0 && *t <= 1;
+}
+
+static triangle_t rnd_tri(scalar_t range, scalar_t size)
+{
+	vec3_t c = rnd_v3(-range, range);
+	return triangle_cons(v3_add(c, rnd_v3(-size, size)), v3_add(c, rnd_v3(-size, size)),
+			v3_add(c, rnd_v3(-size, size)));
+}
+
+static ray_t rnd_tri_ray(scalar_t range)
+{
+	ray_t ray;
+	ray.origin = rnd_v3(-range, range);
+	ray.dir = v3_sub(rnd_v3(-range * 0.5, range * 0.5), ray.origin);
+	ray.dir = v3_scale(ray.dir, rnd(0.5, 2.0));
+	return ray;
+}
+
+static void t_triangle_ray()
+{
+	int num_hits = 0, bad = 0;
+
+	for(int i=0; i<NUM_SAMPLES * 20; i++) {
+		triangle_t tri = rnd_tri(2, 3);
+		ray_t ray = rnd_tri_ray(6);
+		double rt = 0, ru = 0, rv = 0;
+		bool ref = ref_tri_ray(ray, tri, &rt, &ru, &rv);
+
+		/* away from the edges and the ends of the ray the answer is clear */
+		double margin = 1e-4;
+		if(fabs(ru) < margin || fabs(rv) < margin || fabs(1 - ru - rv) < margin ||
+				fabs(rt) < margin || fabs(rt - 1) < margin) {
+			continue;
+		}
+
+		scalar_t t;
+		vec2_t bary;
+		int res = triangle_ray_intersect(ray, &tri, &t, &bary);
+		if(res != (ref ? 1 : 0)) {
+			bad++;
+			continue;
+		}
+		if(res) {
+			num_hits++;
+			if(fabs(t - rt) > 1e-4 || fabs(bary.x - ru) > 1e-4 || fabs(bary.y - rv) > 1e-4) bad++;
+		}
+	}
+	CHECK(bad == 0);
+	CHECK(num_hits > 1000);
+}
+
+/* rays through the vertices and edges of a closed patch of a mesh must hit it */
+static void t_triangle_watertight()
+{
+	const int grid = 8;
+	const int num_tris = grid * grid * 2;
+	vec3_t vert[(grid + 1) * (grid + 1)];
+
+	for(int iter=0; iter<4; iter++) {
+		Matrix4x4 xform;
+		if(iter > 0) {
+			xform.rotate(Vector3(rnd(-1, 1), rnd(-1, 1), rnd(-1, 1)).normalized(), rnd(0, TWO_PI));
+		}
+		for(int i=0; i<=grid; i++) {
+			for(int j=0; j<=grid; j++) {
+				vec3_t v = v3_cons(j - grid / 2, i - grid / 2, 0);
+				vert[i * (grid + 1) + j] = v3_transform(v, (scalar_t (*)[4])xform.m);
+			}
+		}
+
+		triangle_t tri[num_tris];
+		scalar_t *mem = new scalar_t[num_tris * 9];
+		triangle_soa_t soa;
+		soa.v0 = v3_soa_cons(mem, mem + num_tris, mem + num_tris * 2);
+		soa.v1 = v3_soa_cons(mem + num_tris * 3, mem + num_tris * 4, mem + num_tris * 5);
+		soa.v2 = v3_soa_cons(mem + num_tris * 6, mem + num_tris * 7, mem + num_tris * 8);
+
+		for(int i=0; i<grid; i++) {
+			for(int j=0; j<grid; j++) {
+				int a = i * (grid + 1) + j, b = a + 1, c = a + grid + 1, d = c + 1;
+				int k = (i * grid + j) * 2;
+				/* alternate the diagonals, so that vertices have 4 or 8 triangles */
+				if((i + j) & 1) {
+					tri[k] = triangle_cons(vert[a], vert[b], vert[d]);
+					tri[k + 1] = triangle_cons(vert[a], vert[d], vert[c]);
+				} else {
+					tri[k] = triangle_cons(vert[a], vert[b], vert[c]);
+					tri[k + 1] = triangle_cons(vert[b], vert[d], vert[c]);
+				}
+				for(int m=0; m<2; m++) {
+					soa.v0.x[k + m] = tri[k + m].v[0].x;
+					soa.v0.y[k + m] = tri[k + m].v[0].y;
+					soa.v0.z[k + m] = tri[k + m].v[0].z;
+					soa.v1.x[k + m] = tri[k + m].v[1].x;
+					soa.v1.y[k + m] = tri[k + m].v[1].y;
+					soa.v1.z[k + m] = tri[k + m].v[1].z;
+					soa.v2.x[k + m] = tri[k + m].v[2].x;
+					soa.v2.y[k + m] = tri[k + m].v[2].y;
+					soa.v2.z[k + m] = tri[k + m].v[2].z;
+				}
+			}
+		}
+
+		int num_rays = 0, num_missed = 0, num_missed_soa = 0;
+		for(int i=1; i<grid; i++) {
+			for(int j=1; j<grid; j++) {
+				vec3_t v = vert[i * (grid + 1) + j];
+				vec3_t targets[3];
+				/* the vertex, and points of its edges to the right and up */
+				targets[0] = v;
+				targets[1] = v3_lerp(v, vert[i * (grid + 1) + j + 1], rnd(0, 1));
+				targets[2] = v3_lerp(v, vert[(i + 1) * (grid + 1) + j], rnd(0, 1));
+
+				for(int k=0; k<3; k++) {
+					for(int r=0; r<8; r++) {
+						/* from either side, straight along the normal for r == 0 */
+						vec3_t offs = v3_cons(rnd(-20, 20), rnd(-20, 20), rnd(1, 20));
+						if(r == 0) offs.x = offs.y = 0;
+						if(r & 1) offs.z = -offs.z;
+						ray_t ray;
+						ray.origin = v3_add(targets[k], v3_transform(offs, (scalar_t (*)[4])xform.m));
+						ray.dir = v3_scale(v3_sub(targets[k], ray.origin), 2);
+						num_rays++;
+
+						bool hit = false;
+						for(int m=0; m<num_tris; m++) {
+							if(triangle_ray_intersect(ray, tri + m, 0, 0)) {
+								hit = true;
+								break;
+							}
+						}
+						if(!hit) num_missed++;
+						if(triangle_soa_ray_intersect(ray, soa, num_tris, 0, 0) == -1) {
+							num_missed_soa++;
+						}
+					}
+				}
+			}
+		}
+		CHECK(num_rays > 0 && num_missed == 0);
+		CHECK(num_missed_soa == 0);
+		delete [] mem;
+	}
+}
+
+/* the SoA versions must return exactly what the single ray tests do */
+static void t_triangle_soa()
+{
+	const int num_tris = 203;
+	const int num_rays = 1003;
+	triangle_t tri[num_tris];
+	scalar_t *tmem = new scalar_t[num_tris * 9];
+	scalar_t *rmem = new scalar_t[num_rays * 6];
+	triangle_soa_t tsoa;
+	ray_soa_t rsoa;
+	ray_t *rays = new ray_t[num_rays];
+
+	tsoa.v0 = v3_soa_cons(tmem, tmem + num_tris, tmem + num_tris * 2);
+	tsoa.v1 = v3_soa_cons(tmem + num_tris * 3, tmem + num_tris * 4, tmem + num_tris * 5);
+	tsoa.v2 = v3_soa_cons(tmem + num_tris * 6, tmem + num_tris * 7, tmem + num_tris * 8);
+	rsoa.origin = v3_soa_cons(rmem, rmem + num_rays, rmem + num_rays * 2);
+	rsoa.dir = v3_soa_cons(rmem + num_rays * 3, rmem + num_rays * 4, rmem + num_rays * 5);
+
+	for(int i=0; i<num_tris; i++) {
+		tri[i] = rnd_tri(3, 1.5);
+		/* some edges and vertices shared, to exercise the exact fallback */
+		if(i > 0 && (i % 5) == 0) {
+			tri[i].v[0] = tri[i - 1].v[1];
+			tri[i].v[1] = tri[i - 1].v[0];
+		}
+		tsoa.v0.x[i] = tri[i].v[0].x; tsoa.v0.y[i] = tri[i].v[0].y; tsoa.v0.z[i] = tri[i].v[0].z;
+		tsoa.v1.x[i] = tri[i].v[1].x; tsoa.v1.y[i] = tri[i].v[1].y; tsoa.v1.z[i] = tri[i].v[1].z;
+		tsoa.v2.x[i] = tri[i].v[2].x; tsoa.v2.y[i] = tri[i].v[2].y; tsoa.v2.z[i] = tri[i].v[2].z;
+	}
+	for(int i=0; i<num_rays; i++) {
+		rays[i] = rnd_tri_ray(6);
+		if(i % 7 == 0) {
+			/* straight through a vertex */
+			rays[i].dir = v3_scale(v3_sub(tri[i % num_tris].v[0], rays[i].origin), 1.5);
+		}
+		rsoa.origin.x[i] = rays[i].origin.x;
+		rsoa.origin.y[i] = rays[i].origin.y;
+		rsoa.origin.z[i] = rays[i].origin.z;
+		rsoa.dir.x[i] = rays[i].dir.x;
+		rsoa.dir.y[i] = rays[i].dir.y;
+		rsoa.dir.z[i] = rays[i].dir.z;
+	}
+
+	/* one ray against the triangle array, against the closest single hit */
+	int bad = 0, num_hits = 0;
+	int *ref_hit = new int[num_rays];
+	scalar_t *ref_pos = new scalar_t[num_rays];
+	vec2_t *ref_bary = new vec2_t[num_rays];
+	for(int i=0; i<num_rays; i++) {
+		ref_hit[i] = -1;
+		ref_pos[i] = 1;
+		for(int j=0; j<num_tris; j++) {
+			scalar_t t;
+			vec2_t b;
+			if(triangle_ray_intersect(rays[i], tri + j, &t, &b) && t <= ref_pos[i]) {
+				ref_hit[i] = j;
+				ref_pos[i] = t;
+				ref_bary[i] = b;
+			}
+		}
+
+		scalar_t t;
+		vec2_t b;
+		int hit = triangle_soa_ray_intersect(rays[i], tsoa, num_tris, &t, &b);
+		if(hit != ref_hit[i]) {
+			bad++;
+		} else if(hit >= 0) {
+			num_hits++;
+			if(t != ref_pos[i] || b.x != ref_bary[i].x || b.y != ref_bary[i].y) bad++;
+		}
+	}
+	CHECK(bad == 0);
+	CHECK(num_hits > num_rays / 4);
+
+	/* the ray array against every triangle in turn finds the same hits */
+	scalar_t *pos = new scalar_t[num_rays];
+	scalar_t *bmem = new scalar_t[num_rays * 2];
+	vec2_soa_t bary = {bmem, bmem + num_rays};
+	int *hit_id = new int[num_rays];
+	for(int i=0; i<num_rays; i++) {
+		pos[i] = 1;
+		hit_id[i] = -1;
+	}
+	int num_updates = 0, ref_updates = 0;
+	for(int j=0; j<num_tris; j++) {
+		num_updates += triangle_ray_soa_intersect(tri + j, j, rsoa, num_rays, pos, bary, hit_id);
+	}
+	bad = 0;
+	for(int i=0; i<num_rays; i++) {
+		if(hit_id[i] != ref_hit[i]) {
+			bad++;
+		} else if(hit_id[i] >= 0) {
+			if(pos[i] != ref_pos[i] || bary.x[i] != ref_bary[i].x || bary.y[i] != ref_bary[i].y) bad++;
+		}
+	}
+	CHECK(bad == 0);
+
+	/* the count of updates, and null outputs */
+	for(int i=0; i<num_rays; i++) {
+		pos[i] = 1;
+	}
+	vec2_soa_t no_bary = {0, 0};
+	for(int j=0; j<num_tris; j++) {
+		int n = triangle_ray_soa_intersect(tri + j, j, rsoa, num_rays, pos, no_bary, 0);
+		ref_updates += n;
+	}
+	CHECK(num_updates == ref_updates && num_updates >= num_hits);
+	bad = 0;
+	for(int i=0; i<num_rays; i++) {
+		if(ref_hit[i] >= 0 ? pos[i] != ref_pos[i] : pos[i] != 1) bad++;
+	}
+	CHECK(bad == 0);
+
+	delete [] tmem;
+	delete [] rmem;
+	delete [] rays;
+	delete [] ref_hit;
+	delete [] ref_pos;
+	delete [] ref_bary;
+	delete [] pos;
+	delete [] bmem;
+	delete [] hit_id;
+}
+
+/* ---- sphere intersection and overlap ---- */
+
+static void t_sphere_sphere_intersect()
+{
+	int bad = 0, num_hits = 0;
+
+	for(int i=0; i<NUM_SAMPLES * 10; i++) {
+		sphere_t s1 = sphere_cons(rnd(-2, 2), rnd(-2, 2), rnd(-2, 2), rnd(0.1, 2));
+		sphere_t s2 = sphere_cons(rnd(-2, 2), rnd(-2, 2), rnd(-2, 2), rnd(0.1, 2));
+		double dx = s2.pos.x - s1.pos.x, dy = s2.pos.y - s1.pos.y, dz = s2.pos.z - s1.pos.z;
+		double dist = sqrt(dx * dx + dy * dy + dz * dz);
+		double rsum = s1.rad + s2.rad, rdiff = fabs(s1.rad - s2.rad);
+
+		/* skip the borderline cases */
+		if(fabs(dist - rsum) < 1e-4 || fabs(dist - rdiff) < 1e-4) continue;
+		bool ref = dist <= rsum && dist >= rdiff;
+
+		scalar_t pos, rad;
+		int res = sphere_sphere_intersect(s1, s2, &pos, &rad);
+		if(res != (ref ? 1 : 0)) {
+			bad++;
+			continue;
+		}
+		if(!res) continue;
+		num_hits++;
+
+		/* points of the circle are on both spheres */
+		Vector3 c1(s1.pos.x, s1.pos.y, s1.pos.z), axis(dx / dist, dy / dist, dz / dist);
+		Vector3 perp = cross_product(axis, fabs(axis.x) < 0.5 ? Vector3(1, 0, 0) : Vector3(0, 1, 0));
+		perp.normalize();
+		for(int j=0; j<4; j++) {
+			Quaternion q(axis, j * HALF_PI);
+			Vector3 pt = c1 + axis * pos + perp.transformed(q) * rad;
+			double d1 = (pt - c1).length();
+			double d2 = (pt - Vector3(s2.pos.x, s2.pos.y, s2.pos.z)).length();
+			if(fabs(d1 - s1.rad) > 1e-4 || fabs(d2 - s2.rad) > 1e-4) bad++;
+		}
+	}
+	CHECK(bad == 0);
+	CHECK(num_hits > 1000);
+
+	/* touching from outside and inside, concentric, apart, nested */
+	sphere_t a = sphere_cons(1, 2, 3, 1);
+	scalar_t pos = -1, rad = -1;
+	CHECK(sphere_sphere_intersect(a, sphere_cons(4, 2, 3, 2), &pos, &rad) == 1);
+	CHECK(pos == 1 && rad == 0);
+	CHECK(sphere_sphere_intersect(a, sphere_cons(1, 2, 2.5, 0.5), &pos, &rad) == 1);
+	CHECK(pos == 1 && rad == 0);
+	CHECK(sphere_sphere_intersect(a, sphere_cons(1, 2, 3, 1), &pos, &rad) == 0);
+	CHECK(sphere_sphere_intersect(a, sphere_cons(1, 2, 3, 2), 0, 0) == 0);
+	CHECK(sphere_sphere_intersect(a, sphere_cons(5, 2, 3, 1), 0, 0) == 0);
+	CHECK(sphere_sphere_intersect(a, sphere_cons(1.1, 2, 3, 0.5), 0, 0) == 0);
+	CHECK(sphere_sphere_intersect(a, sphere_cons(2, 2, 3, 1), 0, 0) == 1);
+}
+
+static sphere_soa_t alloc_sphere_soa(int count)
+{
+	sphere_soa_t arr;
+	/* one extra element, so that arrays can start unaligned */
+	scalar_t *mem = new scalar_t[(count + 1) * 4];
+	arr.x = mem + 1;
+	arr.y = arr.x + count + 1;
+	arr.z = arr.y + count;
+	arr.rad = arr.z + count;
+	return arr;
+}
+
+static void free_sphere_soa(sphere_soa_t arr)
+{
+	delete [] (arr.x - 1);
+}
+
+static sphere_t soa_sphere(sphere_soa_t arr, int i)
+{
+	return sphere_cons(arr.x[i], arr.y[i], arr.z[i], arr.rad[i]);
+}
+
+static void rnd_spheres(sphere_soa_t arr, int count, scalar_t range)
+{
+	for(int i=0; i<count; i++) {
+		arr.x[i] = rnd(-range, range);
+		arr.y[i] = rnd(-range, range);
+		arr.z[i] = rnd(-range, range);
+		arr.rad[i] = rnd(0.1, 1.5);
+		if(i > 0 && i % 9 == 0) {
+			/* exactly touching the previous one */
+			arr.x[i] = arr.x[i - 1] + arr.rad[i - 1] + arr.rad[i];
+			arr.y[i] = arr.y[i - 1];
+			arr.z[i] = arr.z[i - 1];
+		}
+	}
+}
+
+static void t_sphere_overlap_soa()
+{
+	const int max_count = 203;
+	sphere_soa_t arr = alloc_sphere_soa(max_count);
+	unsigned char *res = new unsigned char[max_count];
+	int *idx = new int[max_count];
+	int counts[] = {0, 1, 3, 4, 7, 8, 9, 16, 31, max_count};
+
+	for(int c=0; c<(int)(sizeof counts / sizeof *counts); c++) {
+		int count = counts[c];
+		for(int iter=0; iter<10; iter++) {
+			rnd_spheres(arr, count, 5);
+			sphere_t sph = sphere_cons(rnd(-5, 5), rnd(-5, 5), rnd(-5, 5), rnd(0.5, 3));
+			if(count > 0 && iter == 0) {
+				/* touching one of the array exactly */
+				sph = soa_sphere(arr, count - 1);
+				sph.pos.y += sph.rad + 1;
+				sph.rad = 1;
+			}
+
+			int ref_num = 0, bad = 0;
+			for(int i=0; i<count; i++) {
+				res[i] = 0xff;
+			}
+			int num = sphere_overlap_soa(sph, arr, count, res, idx);
+			for(int i=0; i<count; i++) {
+				int ov = sphere_sphere_overlap(sph, soa_sphere(arr, i));
+				if(res[i] != ov) bad++;
+				if(ov && (ref_num >= num || idx[ref_num++] != i)) bad++;
+			}
+			CHECK(bad == 0 && num == ref_num);
+			CHECK(sphere_overlap_soa(sph, arr, count, 0, 0) == ref_num);
+		}
+	}
+	free_sphere_soa(arr);
+	delete [] res;
+	delete [] idx;
+}
+
+static void t_sphere_overlap_pairs()
+{
+	const int count = 301;
+	sphere_soa_t arr = alloc_sphere_soa(count);
+	int max_ref = count * (count - 1) / 2;
+	int *ref = new int[max_ref * 2];
+	int *pairs = new int[max_ref * 2 + 2];
+
+	for(int iter=0; iter<4; iter++) {
+		int n = iter == 0 ? 7 : count;
+		rnd_spheres(arr, n, iter == 0 || iter == 3 ? 2 : 10);
+		/* at least one pair, whatever the random numbers */
+		arr.x[n - 1] = arr.x[1];
+		arr.y[n - 1] = arr.y[1];
+		arr.z[n - 1] = arr.z[1];
+
+		int ref_num = 0;
+		for(int i=0; i<n; i++) {
+			for(int j=i+1; j<n; j++) {
+				if(sphere_sphere_overlap(soa_sphere(arr, i), soa_sphere(arr, j))) {
+					ref[ref_num * 2] = i;
+					ref[ref_num * 2 + 1] = j;
+					ref_num++;
+				}
+			}
+		}
+		CHECK(ref_num > 0);
+
+		CHECK(sphere_overlap_pairs_soa(arr, n, pairs, max_ref) == ref_num);
+		CHECK(memcmp(pairs, ref, ref_num * 2 * sizeof *pairs) == 0);
+
+		/* short buffers get the first pairs, and nothing past the end */
+		int limits[] = {0, 1, ref_num / 2, ref_num - 1};
+		for(int k=0; k<4; k++) {
+			int lim = limits[k];
+			for(int i=0; i<max_ref * 2 + 2; i++) {
+				pairs[i] = -7;
+			}
+			CHECK(sphere_overlap_pairs_soa(arr, n, pairs, lim) == ref_num);
+			CHECK(memcmp(pairs, ref, lim * 2 * sizeof *pairs) == 0);
+			CHECK(pairs[lim * 2] == -7 && pairs[lim * 2 + 1] == -7);
+		}
+		CHECK(sphere_overlap_pairs_soa(arr, n, 0, 0) == ref_num);
+	}
+	CHECK(sphere_overlap_pairs_soa(arr, 1, pairs, max_ref) == 0);
+	CHECK(sphere_overlap_pairs_soa(arr, 0, pairs, max_ref) == 0);
+
+	free_sphere_soa(arr);
+	delete [] ref;
+	delete [] pairs;
+}
+
+/* ---- linear BVH builder ---- */
+
+static void t_bvh_lbvh()
+{
+	init_scene();
+
+	bvh_t bvh;
+	bvh_init(&bvh);
+	int bits[] = {BVH_MORTON30, BVH_MORTON63};
+	for(int b=0; b<2; b++) {
+		for(int leaf=1; leaf<=4; leaf*=2) {
+			bvh.max_leaf_prims = leaf;
+			CHECK(bvh_build_lbvh(&bvh, scene_bounds, SCENE_PRIMS, bits[b], 1) == 0);
+			check_bvh_tree(&bvh, scene_bounds, SCENE_PRIMS);
+			CHECK(bvh.stats.max_leaf_prims <= leaf);
+			CHECK(bvh.stats.build_time >= 0.0);
+			check_bvh_rays(&bvh);
+
+			CHECK(bvh_build_lbvh_spheres(&bvh, scene_spheres, SCENE_PRIMS, bits[b], 1) == 0);
+			check_bvh_tree(&bvh, scene_bounds, SCENE_PRIMS);
+			check_bvh_rays(&bvh);
+		}
+	}
+
+	/* tiny trees, and equal codes, which are split by primitive index */
+	aabox_t same[100];
+	for(int i=0; i<100; i++) {
+		same[i] = aabox_cons(0, 0, 0, 1, 1, 1);
+	}
+	bvh.max_leaf_prims = 1;
+	for(int n=1; n<=100; n+=33) {
+		CHECK(bvh_build_lbvh(&bvh, same, n, BVH_MORTON63, 1) == 0);
+		check_bvh_tree(&bvh, same, n);
+	}
+	bvh_destroy(&bvh);
+}
+
+/* big enough to be split across threads, which must not change the tree */
+static void t_bvh_lbvh_mt()
+{
+	const int count = BVH_LBVH_MT_MIN * 2 + 5;
+	aabox_t *bounds = new aabox_t[count];
+	for(int i=0; i<count; i++) {
+		bounds[i] = rnd_box(100, 1);
+		if(i % 17 == 0 && i > 0) {
+			/* some duplicates */
+			bounds[i] = bounds[i - 1];
+		}
+	}
+
+	int bits[] = {BVH_MORTON30, BVH_MORTON63};
+	for(int b=0; b<2; b++) {
+		bvh_t ref, bvh;
+		bvh_init(&ref);
+		CHECK(bvh_build_lbvh(&ref, bounds, count, bits[b], 1) == 0);
+		check_bvh_tree(&ref, bounds, count);
+
+		int threads[] = {3, 0, 8};
+		for(int t=0; t<3; t++) {
+			bvh_init(&bvh);
+			CHECK(bvh_build_lbvh(&bvh, bounds, count, bits[b], threads[t]) == 0);
+			CHECK(bvh.num_nodes == ref.num_nodes);
+			if(bvh.num_nodes == ref.num_nodes) {
+				/* node 1 is unused padding */
+				CHECK(memcmp(bvh.nodes, ref.nodes, sizeof *ref.nodes) == 0);
+				CHECK(memcmp(bvh.nodes + 2, ref.nodes + 2, (ref.num_nodes - 2) * sizeof *ref.nodes) == 0);
+				CHECK(memcmp(bvh.prim, ref.prim, count * sizeof *ref.prim) == 0);
+			}
+			bvh_destroy(&bvh);
+		}
+		bvh_destroy(&ref);
+	}
+	delete [] bounds;
+}
+
+/* ---- BVH refitting ---- */
+
+static void move_spheres(sphere_t *spheres, aabox_t *bounds, int *changed, int *num_changed,
+		int stride, scalar_t dist)
+{
+	*num_changed = 0;
+	for(int i=0; i<SCENE_PRIMS; i+=stride) {
+		spheres[i].pos = v3_add(spheres[i].pos, rnd_v3(-dist, dist));
+		bounds[i] = sphere_box(spheres[i]);
+		if(changed) changed[(*num_changed)++] = i;
+	}
+}
+
+static void t_bvh_refit()
+{
+	init_scene();
+
+	sphere_t *spheres = new sphere_t[SCENE_PRIMS];
+	aabox_t *bounds = new aabox_t[SCENE_PRIMS];
+	int *changed = new int[SCENE_PRIMS];
+	int num_changed;
+
+	for(int rotate=0; rotate<2; rotate++) {
+		for(int lbvh=0; lbvh<2; lbvh++) {
+			memcpy(spheres, scene_spheres, SCENE_PRIMS * sizeof *spheres);
+			memcpy(bounds, scene_bounds, SCENE_PRIMS * sizeof *bounds);
+
+			bvh_t bvh;
+			bvh_init(&bvh);
+			if(lbvh) {
+				CHECK(bvh_build_lbvh(&bvh, bounds, SCENE_PRIMS, BVH_MORTON30, 1) == 0);
+			} else {
+				CHECK(bvh_build(&bvh, bounds, SCENE_PRIMS) == 0);
+			}
+			CHECK(bvh_rebuild_pays_off(&bvh, 1e6) == 0);
+
+			/* nothing moved: the same boxes and no decay. Rotations can
+			 * still improve the built tree a little.
+			 */
+			bvh_node_t *nodes = new bvh_node_t[bvh.num_nodes];
+			memcpy(nodes, bvh.nodes, bvh.num_nodes * sizeof *nodes);
+			CHECK(bvh_refit(&bvh, bounds, 0, 0, rotate) == 0);
+			if(rotate) {
+				check_bvh_tree(&bvh, bounds, SCENE_PRIMS);
+				CHECK(bvh.refit_stats.sah_cost <= bvh.stats.sah_cost * (1.0 + 1e-4));
+			} else {
+				CHECK(memcmp(nodes, bvh.nodes, sizeof *nodes) == 0);
+				CHECK(memcmp(nodes + 2, bvh.nodes + 2, (bvh.num_nodes - 2) * sizeof *nodes) == 0);
+				CHECK(fabs(bvh.refit_stats.sah_cost - bvh.stats.sah_cost) <= 1e-4 * bvh.stats.sah_cost);
+			}
+			CHECK(bvh_rebuild_pays_off(&bvh, bvh.stats.build_time * 10.0) == 0);
+			delete [] nodes;
+
+			/* everything moved a bit */
+			move_spheres(spheres, bounds, 0, &num_changed, 1, 1.0);
+			CHECK(bvh_refit(&bvh, bounds, 0, 0, rotate) == 0);
+			check_bvh_tree(&bvh, bounds, SCENE_PRIMS);
+			check_bvh_rays(&bvh, spheres);
+			CHECK(bvh.refit_stats.num_refit == bvh.num_nodes - 1);
+
+			/* some of them moved far, several times */
+			for(int iter=0; iter<4; iter++) {
+				move_spheres(spheres, bounds, changed, &num_changed, 7 + iter, 10.0);
+				CHECK(bvh_refit(&bvh, bounds, changed, num_changed, rotate) == 0);
+				check_bvh_tree(&bvh, bounds, SCENE_PRIMS);
+				CHECK(bvh.refit_stats.num_refit > 0 && bvh.refit_stats.num_refit < bvh.num_nodes - 1);
+			}
+			check_bvh_rays(&bvh, spheres);
+			if(rotate) {
+				CHECK(bvh.refit_stats.num_rotations > 0);
+			}
+
+			/* the tree decayed: the lost query time adds up until it's
+			 * more than the build took
+			 */
+			double decay = bvh.refit_stats.sah_cost / bvh.stats.sah_cost - 1.0;
+			CHECK(decay > 0.01);
+			double left = bvh.stats.build_time - bvh.refit_stats.lost_time;
+			CHECK(left > 0.0);
+			CHECK(bvh_rebuild_pays_off(&bvh, left * 0.5 / decay) == 0);
+			CHECK(bvh_rebuild_pays_off(&bvh, left * 0.4 / decay) == 0);
+			CHECK(bvh_rebuild_pays_off(&bvh, left * 0.2 / decay) == 1);
+
+			bvh_destroy(&bvh);
+		}
+	}
+	delete [] spheres;
+	delete [] bounds;
+	delete [] changed;
+}
+
+/* ---- two-level BVH ---- */
+
+#define TLAS_INST	24
+
+/* the object space ray of an instance, as the queries compute it */
+static ray_t inst_ray(const bvh_inst_t *inst, ray_t ray)
+{
+	ray_t oray;
+	oray.origin = v3_transform_m3x4(ray.origin, (scalar_t (*)[4])inst->inv_xform);
+	oray.dir = v3_transform_dir_m3x4(ray.dir, (scalar_t (*)[4])inst->inv_xform);
+	return oray;
+}
+
+/* brute force over every primitive of every instance, with the rays moved to
+ * object space by the same inverses as the queries
+ */
+static int ref_tlas_closest(const bvh_tlas_t *tlas, const int *num_prims, ray_t ray,
+		int *prim, scalar_t *pos)
+{
+	int res = -1;
+	scalar_t tmax = 1.0, t;
+
+	for(int i=0; i<tlas->num_inst; i++) {
+		const bvh_inst_t *inst = tlas->inst + i;
+		ray_t oray = inst_ray(inst, ray);
+		for(int j=0; j<num_prims[i]; j++) {
+			if(hit_sphere(j, oray, tmax, &t, inst->cls)) {
+				tmax = t;
+				res = i;
+				*prim = j;
+			}
+		}
+	}
+	*pos = tmax;
+	return res;
+}
+
+static void check_tlas(const bvh_tlas_t *tlas, const int *num_prims)
+{
+	/* the world bounds contain the corners of the bottom level roots */
+	for(int i=0; i<tlas->num_inst; i++) {
+		const bvh_inst_t *inst = tlas->inst + i;
+		const bvh_node_t *root = inst->bvh->nodes;
+		aabox_t wb = tlas->bounds[i];
+		for(int c=0; c<8; c++) {
+			vec3_t p = v3_cons(c & 1 ? root->bmax[0] : root->bmin[0],
+					c & 2 ? root->bmax[1] : root->bmin[1], c & 4 ? root->bmax[2] : root->bmin[2]);
+			p = v3_transform_m3x4(p, (scalar_t (*)[4])inst->xform);
+			scalar_t eps = 1e-4 * (1 + fabs(p.x) + fabs(p.y) + fabs(p.z));
+			CHECK(p.x >= wb.min.x - eps && p.y >= wb.min.y - eps && p.z >= wb.min.z - eps &&
+					p.x <= wb.max.x + eps && p.y <= wb.max.y + eps && p.z <= wb.max.z + eps);
+		}
+
+		mat3x4_t prod, ident;
+		m3x4_mult(prod, (scalar_t (*)[4])inst->xform, (scalar_t (*)[4])inst->inv_xform);
+		m3x4_identity(ident);
+		m3x4_check(prod, ident, 1e-4);
+	}
+	check_bvh_tree(&tlas->top, tlas->bounds, tlas->num_inst);
+
+	int num_hits = 0;
+	for(int i=0; i<SCENE_RAYS; i++) {
+		ray_t ray = scene_rays[i];
+		int ref_prim = -1, prim = -1;
+		scalar_t ref_pos, pos;
+		int ref = ref_tlas_closest(tlas, num_prims, ray, &ref_prim, &ref_pos);
+
+		int res = bvh_tlas_ray_closest(tlas, ray, &prim, &pos, 0);
+		CHECK((res >= 0) == (ref >= 0));
+		if(res >= 0 && ref >= 0) {
+			num_hits++;
+			CHECK(pos == ref_pos);
+			CHECK(prim >= 0 && prim < num_prims[res]);
+		}
+
+		res = bvh_tlas_ray_any(tlas, ray, &prim, &pos, 0);
+		CHECK((res >= 0) == (ref >= 0));
+		if(res >= 0) {
+			const bvh_inst_t *inst = tlas->inst + res;
+			scalar_t t;
+			CHECK(hit_sphere(prim, inst_ray(inst, ray), 1.0, &t, inst->cls) && t == pos);
+		}
+	}
+	CHECK(num_hits > SCENE_RAYS / 10);
+}
+
+static void t_bvh_tlas()
+{
+	init_scene();
+
+	/* two bottom level trees over different parts of the scene */
+	const int count[2] = {SCENE_PRIMS / 4, SCENE_PRIMS / 2};
+	sphere_t *spheres[2] = {scene_spheres, scene_spheres + SCENE_PRIMS / 2};
+	bvh_t blas[2];
+	for(int i=0; i<2; i++) {
+		bvh_init(blas + i);
+		CHECK(bvh_build(blas + i, scene_bounds + (spheres[i] - scene_spheres), count[i]) == 0);
+	}
+
+	bvh_inst_t inst[TLAS_INST];
+	int num_prims[TLAS_INST];
+	for(int i=0; i<TLAS_INST; i++) {
+		inst[i].bvh = blas + (i & 1);
+		inst[i].hit = hit_sphere;
+		inst[i].cls = spheres[i & 1];
+		num_prims[i] = count[i & 1];
+		rnd_affine(inst[i].xform, i % 3 == 0);
+	}
+
+	bvh_tlas_t tlas;
+	bvh_tlas_init(&tlas);
+	CHECK(bvh_tlas_build(&tlas, inst, TLAS_INST) == 0);
+	CHECK(tlas.num_inst == TLAS_INST);
+	check_tlas(&tlas, num_prims);
+
+	/* move some of the instances, then all of them */
+	for(int rotate=0; rotate<2; rotate++) {
+		int changed[TLAS_INST], num_changed = 0;
+		for(int i=rotate; i<TLAS_INST; i+=3) {
+			mat3x4_t m;
+			rnd_affine(m, false);
+			bvh_tlas_set_xform(&tlas, i, m);
+			changed[num_changed++] = i;
+		}
+		CHECK(bvh_tlas_update(&tlas, changed, num_changed, rotate) == 0);
+		check_tlas(&tlas, num_prims);
+	}
+	for(int i=0; i<TLAS_INST; i++) {
+		Matrix4x4 m;
+		m.translate(Vector3(rnd(-10, 10), rnd(-10, 10), rnd(-10, 10)));
+		bvh_tlas_set_xform(&tlas, i, m);
+	}
+	CHECK(bvh_tlas_update(&tlas, 0, 0, 1) == 0);
+	check_tlas(&tlas, num_prims);
+
+	bvh_tlas_destroy(&tlas);
+	bvh_destroy(blas);
+	bvh_destroy(blas + 1);
+}
+
+/* ---- ray streams ---- */
+
+static void check_stream(const ray_stream_t *rs, const ray_t *rays, int count)
+{
+	CHECK(rs->count == count);
+	char *seen = new char[count + 1];
+	memset(seen, 0, count + 1);
+	int bad = 0;
+	for(int i=0; i<count; i++) {
+		int r = rs->order[i];
+		if(r < 0 || r >= count || seen[r]++) {
+			bad++;
+			continue;
+		}
+		if(memcmp(rs->rays + i, rays + r, sizeof *rays) != 0) bad++;
+		/* the sort is stable, equal rays keep their order */
+		if(i > 0 && memcmp(rs->rays + i, rs->rays + i - 1, sizeof *rays) == 0 &&
+				rs->order[i - 1] > r) {
+			bad++;
+		}
+	}
+	CHECK(bad == 0);
+	delete [] seen;
+}
+
+static void t_ray_stream_sort()
+{
+	const int max_count = RAY_STREAM_MT_MIN * 2 + 3;
+	ray_t *rays = new ray_t[max_count];
+	for(int i=0; i<max_count; i++) {
+		if(i % 11 == 5) {
+			rays[i] = rays[i - 3];	/* some duplicates */
+			continue;
+		}
+		rays[i].origin = rnd_v3(-25, 25);
+		rays[i].dir = rnd_v3(-10, 10);
+		if(i % 13 == 0) rays[i].dir.y = 0;
+	}
+	aabox_t box = aabox_cons(-10, -10, -10, 10, 10, 10);
+
+	int counts[] = {0, 1, 2, 1000, max_count};
+	int keys[] = {RAY_SORT_OCTANT_CELL, RAY_SORT_MORTON};
+	for(int c=0; c<5; c++) {
+		for(int k=0; k<2; k++) {
+			for(int b=0; b<2; b++) {
+				ray_stream_t ref, rs;
+				ray_stream_init(&ref);
+				CHECK(ray_stream_sort(&ref, rays, counts[c], b ? &box : 0, keys[k], 1) == 0);
+				check_stream(&ref, rays, counts[c]);
+				if(keys[k] == RAY_SORT_OCTANT_CELL) {
+					/* the direction octant is the top of the key */
+					int bad = 0, prev = 0;
+					for(int i=0; i<counts[c]; i++) {
+						vec3_t d = ref.rays[i].dir;
+						int oct = (d.x < 0 ? 1 : 0) | (d.y < 0 ? 2 : 0) | (d.z < 0 ? 4 : 0);
+						if(oct < prev) bad++;
+						prev = oct;
+					}
+					CHECK(bad == 0);
+				}
+
+				/* threads don't change the order */
+				int threads[] = {3, 0};
+				for(int t=0; t<2; t++) {
+					ray_stream_init(&rs);
+					CHECK(ray_stream_sort(&rs, rays, counts[c], b ? &box : 0, keys[k], threads[t]) == 0);
+					CHECK(memcmp(rs.order, ref.order, counts[c] * sizeof *rs.order) == 0);
+					ray_stream_destroy(&rs);
+				}
+
+				/* the buffers are reused for smaller batches */
+				if(counts[c] > 2) {
+					CHECK(ray_stream_sort(&ref, rays + 1, counts[c] - 2, 0, keys[k], 1) == 0);
+					check_stream(&ref, rays + 1, counts[c] - 2);
+				}
+				ray_stream_destroy(&ref);
+			}
+		}
+	}
+
+	/* scatter puts every element back in the input order */
+	ray_stream_t rs;
+	ray_stream_init(&rs);
+	const int count = 1003;
+	CHECK(ray_stream_sort(&rs, rays, count, 0, RAY_SORT_MORTON, 1) == 0);
+	int sizes[] = {4, 8, 12};
+	for(int k=0; k<3; k++) {
+		int n = sizes[k] / 4;
+		int *src = new int[count * n];
+		int *dest = new int[count * n];
+		for(int i=0; i<count * n; i++) {
+			src[i] = i;
+		}
+		ray_stream_scatter(&rs, src, dest, sizes[k]);
+		int bad = 0;
+		for(int i=0; i<count; i++) {
+			for(int j=0; j<n; j++) {
+				if(dest[rs.order[i] * n + j] != i * n + j) bad++;
+			}
+		}
+		CHECK(bad == 0);
+		delete [] src;
+		delete [] dest;
+	}
+	ray_stream_destroy(&rs);
+	delete [] rays;
+}
+
+static void t_bvh_ray_stream()
+{
+	init_scene();
+
+	bvh_t bvh;
+	bvh_init(&bvh);
+	CHECK(bvh_build(&bvh, scene_bounds, SCENE_PRIMS) == 0);
+
+	ray_stream_t rs;
+	ray_stream_init(&rs);
+	CHECK(ray_stream_sort(&rs, scene_rays, SCENE_RAYS, 0, RAY_SORT_MORTON, 1) == 0);
+
+	int *ref_prim = new int[SCENE_RAYS];
+	scalar_t *ref_pos = new scalar_t[SCENE_RAYS];
+	int ref_hits = 0;
+	for(int i=0; i<SCENE_RAYS; i++) {
+		ref_prim[i] = bvh_ray_closest(&bvh, scene_rays[i], hit_sphere, scene_spheres, ref_pos + i, 0);
+		if(ref_prim[i] >= 0) ref_hits++;
+	}
+	CHECK(ref_hits > 0);
+
+	int *prim = new int[SCENE_RAYS];
+	scalar_t *pos = new scalar_t[SCENE_RAYS];
+	for(int any=0; any<2; any++) {
+		bvh_query_stats_t ref_stats;
+		memset(&ref_stats, 0, sizeof ref_stats);
+		for(int i=0; i<SCENE_RAYS; i++) {
+			prim[i] = -2;
+		}
+		int hits = any ? bvh_ray_any_stream(&bvh, &rs, hit_sphere, scene_spheres, prim, pos, &ref_stats) :
+			bvh_ray_closest_stream(&bvh, &rs, hit_sphere, scene_spheres, prim, pos, &ref_stats);
+		CHECK(hits == ref_hits);
+
+		int bad = 0;
+		for(int i=0; i<SCENE_RAYS; i++) {
+			if((prim[i] >= 0) != (ref_prim[i] >= 0)) {
+				bad++;
+			} else if(prim[i] >= 0) {
+				scalar_t t;
+				if(any) {
+					if(!hit_sphere(prim[i], scene_rays[i], 1.0, &t, scene_spheres) || t != pos[i]) bad++;
+				} else if(prim[i] != ref_prim[i] || pos[i] != ref_pos[i]) {
+					bad++;
+				}
+			}
+		}
+		CHECK(bad == 0);
+
+		/* the same results and counters, split across threads */
+		int threads[] = {1, 3, 0};
+		int chunks[] = {0, 7, 5000};
+		for(int t=0; t<3; t++) {
+			for(int c=0; c<3; c++) {
+				bvh_query_stats_t stats;
+				memset(&stats, 0, sizeof stats);
+				int *mt_prim = new int[SCENE_RAYS];
+				scalar_t *mt_pos = new scalar_t[SCENE_RAYS];
+				memcpy(mt_pos, pos, SCENE_RAYS * sizeof *pos);
+				int mt_hits = any ?
+					bvh_ray_any_stream_mt(&bvh, &rs, hit_sphere, scene_spheres, mt_prim, mt_pos,
+							&stats, threads[t], chunks[c]) :
+					bvh_ray_closest_stream_mt(&bvh, &rs, hit_sphere, scene_spheres, mt_prim, mt_pos,
+							&stats, threads[t], chunks[c]);
+				CHECK(mt_hits == hits);
+				CHECK(memcmp(mt_prim, prim, SCENE_RAYS * sizeof *prim) == 0);
+				CHECK(memcmp(mt_pos, pos, SCENE_RAYS * sizeof *pos) == 0);
+				CHECK(stats.nodes_visited == ref_stats.nodes_visited &&
+						stats.boxes_tested == ref_stats.boxes_tested &&
+						stats.prims_tested == ref_stats.prims_tested);
+				delete [] mt_prim;
+				delete [] mt_pos;
+			}
+		}
+
+		/* null outputs */
+		CHECK((any ? bvh_ray_any_stream(&bvh, &rs, hit_sphere, scene_spheres, 0, 0, 0) :
+				bvh_ray_closest_stream(&bvh, &rs, hit_sphere, scene_spheres, 0, 0, 0)) == ref_hits);
+	}
+
+	ray_stream_destroy(&rs);
+	bvh_destroy(&bvh);
+	delete [] ref_prim;
+	delete [] ref_pos;
+	delete [] prim;
+	delete [] pos;
+}
+
+/* ---- scheduler and the multi-threaded batch functions ---- */
+
+struct ForJob {
+	int count, chunk_size;
+	int *hits;
+	int bad_ranges;
+	bool nested;
+};
+
+static void for_chunk(int start, int end, void *cls)
+{
+	ForJob *job = (ForJob*)cls;
+
+	if(job->chunk_size > 0 && (start % job->chunk_size != 0 ||
+				end != (start + job->chunk_size < job->count ? start + job->chunk_size : job->count))) {
+		job->bad_ranges++;
+	}
+	if(start < 0 || end > job->count || start >= end) {
+		job->bad_ranges++;
+		return;
+	}
+	if(job->nested) {
+		/* a batch within a batch, sharing the pool with this one */
+		ForJob inner = *job;
+		inner.nested = false;
+		inner.chunk_size = 1;
+		inner.count = end - start;
+		inner.hits = job->hits + start;
+		inner.bad_ranges = 0;
+		vmath_parallel_for(end - start, 0, 1, for_chunk, &inner);
+		if(inner.bad_ranges) job->bad_ranges++;
+		return;
+	}
+	for(int i=start; i<end; i++) {
+		job->hits[i]++;
+	}
+}
+
+/* one chunk of the outer batch starts a slow inner batch, the others return
+ * right away and their threads are free to help with it
+ */
+#define SHARED_THREADS	4
+#define SHARED_CHUNKS	64
+
+struct SharedJob {
+	int hits[SHARED_CHUNKS];
+	rng_t *rng[SHARED_CHUNKS];
+};
+
+static void shared_inner(int start, int end, void *cls)
+{
+	SharedJob *job = (SharedJob*)cls;
+	job->hits[start]++;
+	job->rng[start] = rng_default();
+
+	clock_t t0 = clock();
+	while(clock() - t0 < CLOCKS_PER_SEC / 500);
+}
+
+static void shared_outer(int start, int end, void *cls)
+{
+	if(start == 0) {
+		vmath_parallel_for(SHARED_CHUNKS, SHARED_THREADS, 1, shared_inner, cls);
+	}
+}
+
+static void t_parallel_for()
+{
+	int counts[] = {0, 1, 7, 1000, 100003};
+	int threads[] = {1, 2, 3, 8, 0, VMATH_MAX_THREADS + 10};
+	int *hits = new int[100003];
+
+	for(int c=0; c<5; c++) {
+		int count = counts[c];
+		int chunks[] = {0, 1, 3, 64, count + 5};
+		for(int t=0; t<6; t++) {
+			for(int k=0; k<5; k++) {
+				for(int nested=0; nested<2; nested++) {
+					if(nested && count > 1000) continue;
+
+					ForJob job;
+					job.count = count;
+					job.chunk_size = chunks[k];
+					job.hits = hits;
+					job.bad_ranges = 0;
+					job.nested = nested != 0;
+					memset(hits, 0, count * sizeof *hits);
+
+					vmath_parallel_for(count, threads[t], chunks[k], for_chunk, &job);
+
+					int bad = 0;
+					for(int i=0; i<count; i++) {
+						if(hits[i] != 1) bad++;
+					}
+					CHECK(bad == 0 && job.bad_ranges == 0);
+				}
+			}
+		}
+	}
+	delete [] hits;
+
+	/* threads done with their part of a batch join the batches still running */
+	SharedJob shared;
+	memset(&shared, 0, sizeof shared);
+	vmath_parallel_for(SHARED_THREADS, SHARED_THREADS, 1, shared_outer, &shared);
+	int num_threads = 0, num_hits = 0;
+	for(int i=0; i<SHARED_CHUNKS; i++) {
+		num_hits += shared.hits[i];
+		bool first = true;
+		for(int j=0; j<i; j++) {
+			if(shared.rng[j] == shared.rng[i]) first = false;
+		}
+		if(first) num_threads++;
+	}
+	CHECK(num_hits == SHARED_CHUNKS);
+	CHECK(num_threads > 1);
+
+	/* chunk sizes: rounded up to the alignment, never 0 */
+	CHECK(vmath_chunk_size(1000, 4, 10, 8) == 16);
+	CHECK(vmath_chunk_size(0, 4, 0, 1) >= 1);
+	CHECK(vmath_chunk_size(100000, 4, 0, 64) % 64 == 0);
+}
+
+static void t_transform_mt()
+{
+	const int count = 5003;
+	/* vertices with a position and a normal, transformed as a strided array */
+	struct Vertex { vec3_t pos, norm; };
+	Vertex *verts = new Vertex[count];
+	vec3_t *ref = new vec3_t[count];
+	vec3_t *res = new vec3_t[count];
+	for(int i=0; i<count; i++) {
+		verts[i].pos = rnd_v3(-10, 10);
+		verts[i].norm = rnd_v3(-1, 1);
+	}
+	mat4_t m;
+	rnd_mat4(m);
+
+	int threads[] = {1, 3, 0};
+	int chunks[] = {0, 1, 7, 1000};
+	for(int dirs=0; dirs<2; dirs++) {
+		const vec3_t *src = dirs ? &verts[0].norm : &verts[0].pos;
+		if(dirs) {
+			v3_transform_dirs(ref, 0, src, sizeof *verts, count, m);
+		} else {
+			v3_transform_points(ref, 0, src, sizeof *verts, count, m);
+		}
+		for(int t=0; t<3; t++) {
+			for(int c=0; c<4; c++) {
+				memset(res, 0, count * sizeof *res);
+				if(dirs) {
+					v3_transform_dirs_mt(res, 0, src, sizeof *verts, count, m, threads[t], chunks[c]);
+				} else {
+					v3_transform_points_mt(res, 0, src, sizeof *verts, count, m, threads[t], chunks[c]);
+				}
+				CHECK(memcmp(res, ref, count * sizeof *res) == 0);
+			}
+		}
+
+		/* in place, with equal strides */
+		Vertex *copy = new Vertex[count];
+		memcpy(copy, verts, count * sizeof *verts);
+		vec3_t *inplace = dirs ? &copy[0].norm : &copy[0].pos;
+		if(dirs) {
+			v3_transform_dirs_mt(inplace, sizeof *copy, inplace, sizeof *copy, count, m, 3, 0);
+		} else {
+			v3_transform_points_mt(inplace, sizeof *copy, inplace, sizeof *copy, count, m, 3, 0);
+		}
+		int bad = 0;
+		for(int i=0; i<count; i++) {
+			vec3_t v = dirs ? copy[i].norm : copy[i].pos;
+			vec3_t other = dirs ? copy[i].pos : copy[i].norm;
+			vec3_t orig = dirs ? verts[i].pos : verts[i].norm;
+			if(!v3_equal(v, ref[i]) || !v3_equal(other, orig)) bad++;
+		}
+		CHECK(bad == 0);
+		delete [] copy;
+	}
+	delete [] verts;
+	delete [] ref;
+	delete [] res;
+}
+
+static int noise3_grid_mt(const noise_ctx_t *ctx, int func, scalar_t *res, int xsz, int ysz, int zsz,
+		scalar_t x0, scalar_t y0, scalar_t z0, scalar_t dx, scalar_t dy, scalar_t dz, int oct,
+		int num_threads, int chunk_size)
+{
+	switch(func) {
+	case NOISE:
+		return noise3_grid_ctx_mt(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz,
+				num_threads, chunk_size);
+	case FBM:
+		return fbm3_grid_ctx_mt(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct,
+				num_threads, chunk_size);
+	default:
+		return turbulence3_grid_ctx_mt(ctx, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct,
+				num_threads, chunk_size);
+	}
+}
+
+static void t_noise_grid_mt()
+{
+	noise_ctx_t ctx;
+	noise_ctx_init(&ctx, 4321);
+
+	const int xsz = 33, ysz = 17, zsz = 13;
+	const int size = xsz * ysz * zsz;
+	scalar_t *ref = new scalar_t[size];
+	scalar_t *res = new scalar_t[size];
+
+	int threads[] = {1, 3, 0};
+	int chunks[] = {0, 1, 5, 1000};
+	for(int func=NOISE; func<=TURB; func++) {
+		int oct = func == NOISE ? 1 : 5;
+		scalar_t x0 = rnd(-50, 50), y0 = rnd(-50, 50), z0 = rnd(-50, 50);
+		scalar_t dx = rnd(0.05, 0.6), dy = rnd(0.05, 0.6), dz = rnd(0.05, 0.6);
+
+		CHECK(noise3_grid(&ctx, func, ref, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct) == 0);
+		for(int t=0; t<3; t++) {
+			for(int c=0; c<4; c++) {
+				memset(res, 0, size * sizeof *res);
+				CHECK(noise3_grid_mt(&ctx, func, res, xsz, ysz, zsz, x0, y0, z0, dx, dy, dz, oct,
+							threads[t], chunks[c]) == 0);
+				CHECK(memcmp(res, ref, size * sizeof *res) == 0);
+			}
+		}
+	}
+	delete [] ref;
+	delete [] res;
+}
+
+static void t_sphere_overlap_mt()
+{
+	const int count = 2003;
+	sphere_soa_t arr = alloc_sphere_soa(count);
+	rnd_spheres(arr, count, 12);
+
+	unsigned char *ref_res = new unsigned char[count], *res = new unsigned char[count];
+	int *ref_idx = new int[count], *idx = new int[count];
+	int max_pairs = count * 8;
+	int *ref_pairs = new int[max_pairs * 2], *pairs = new int[max_pairs * 2 + 2];
+
+	sphere_t sph = sphere_cons(1, 2, 3, 5);
+	int ref_num = sphere_overlap_soa(sph, arr, count, ref_res, ref_idx);
+	int ref_total = sphere_overlap_pairs_soa(arr, count, ref_pairs, max_pairs);
+	CHECK(ref_num > 0 && ref_total > count && ref_total <= max_pairs);
+
+	int threads[] = {1, 3, 0};
+	int chunks[] = {0, 1, 13, 256, count + 1};
+	for(int t=0; t<3; t++) {
+		for(int c=0; c<5; c++) {
+			memset(res, 0xff, count);
+			CHECK(sphere_overlap_soa_mt(sph, arr, count, res, idx, threads[t], chunks[c]) == ref_num);
+			CHECK(memcmp(res, ref_res, count) == 0);
+			CHECK(memcmp(idx, ref_idx, ref_num * sizeof *idx) == 0);
+			CHECK(sphere_overlap_soa_mt(sph, arr, count, 0, 0, threads[t], chunks[c]) == ref_num);
+
+			CHECK(sphere_overlap_pairs_soa_mt(arr, count, pairs, max_pairs, threads[t], chunks[c]) == ref_total);
+			CHECK(memcmp(pairs, ref_pairs, ref_total * 2 * sizeof *pairs) == 0);
+
+			/* a short buffer gets the first pairs, and nothing past its end */
+			int lim = ref_total / 3;
+			pairs[lim * 2] = pairs[lim * 2 + 1] = -7;
+			CHECK(sphere_overlap_pairs_soa_mt(arr, count, pairs, lim, threads[t], chunks[c]) == ref_total);
+			CHECK(memcmp(pairs, ref_pairs, lim * 2 * sizeof *pairs) == 0);
+			CHECK(pairs[lim * 2] == -7 && pairs[lim * 2 + 1] == -7);
+			CHECK(sphere_overlap_pairs_soa_mt(arr, count, 0, 0, threads[t], chunks[c]) == ref_total);
+		}
+	}
+	CHECK(sphere_overlap_pairs_soa_mt(arr, 1, pairs, max_pairs, 3, 0) == 0);
+	CHECK(sphere_overlap_soa_mt(sph, arr, 0, res, idx, 3, 0) == 0);
+
+	free_sphere_soa(arr);
+	delete [] ref_res;
+	delete [] res;
+	delete [] ref_idx;
+	delete [] idx;
+	delete [] ref_pairs;
+	delete [] pairs;
+}
+
+static Test tests[] = {
+	{"m4_mult", t_m4_mult},
+	{"v3_transform_array", t_v3_transform_array},
+	{"v4_transform_array", t_v4_transform_array},
+	{"v3_soa", t_v3_soa},
+	{"aabox_ray_slab", t_aabox_ray_slab},
+	{"aabox_ray_packets", t_aabox_ray_packets},
+	{"bvh_build", t_bvh_build},
+	{"bvh_ray", t_bvh_ray},
+	{"noise_grid", t_noise_grid},
+	{"noise_points", t_noise_points},
+	{"quat_lerp_soa", t_quat_lerp_soa},
+	{"get_rotation_quat", t_get_rotation_quat},
+	{"dq_skin_soa", t_dq_skin_soa},
+	{"skin_lbs_soa", t_skin_lbs_soa},
+	{"m3x4", t_m3x4},
+	{"m3_inverse", t_m3_inverse},
+	{"m4_inverse_special", t_m4_inverse_special},
+	{"xform_tree", t_xform_tree},
+	{"frustum_planes", t_frustum_planes},
+	{"frustum_cull", t_frustum_cull},
+	{"rng_bulk", t_rng_bulk},
+	{"rng_default", t_rng_default},
+	{"qmc_array", t_qmc_array},
+	{"qmc_sobol", t_qmc_sobol},
+	{"qmc_warp", t_qmc_warp},
+	{"triangle_ray", t_triangle_ray},
+	{"triangle_watertight", t_triangle_watertight},
+	{"triangle_soa", t_triangle_soa},
+	{"sphere_sphere_intersect", t_sphere_sphere_intersect},
+	{"sphere_overlap_soa", t_sphere_overlap_soa},
+	{"sphere_overlap_pairs", t_sphere_overlap_pairs},
+	{"bvh_lbvh", t_bvh_lbvh},
+	{"bvh_lbvh_mt", t_bvh_lbvh_mt},
+	{"bvh_refit", t_bvh_refit},
+	{"bvh_tlas", t_bvh_tlas},
+	{"ray_stream_sort", t_ray_stream_sort},
+	{"bvh_ray_stream", t_bvh_ray_stream},
+	{"parallel_for", t_parallel_for},
+	{"transform_mt", t_transform_mt},
+	{"noise_grid_mt", t_noise_grid_mt},
+	{"sphere_overlap_mt", t_sphere_overlap_mt},
+	{0, 0}
+};
+
+int main(int argc, char **argv)
+{
+	const char **filters = new const char*[argc];
+	int num_filters = 0;
+
+	for(int i=1; i<argc; i++) {
+		if(argv[i][0] == '-') {
+			if(strcmp(argv[i], "-l") == 0) {
+				for(int j=0; tests[j].name; j++) {
+					puts(tests[j].name);
+				}
+				return 0;
+			} else {
+				fprintf(stderr, "usage: %s [-l] [name filters ...]\n", argv[0]);
+				fprintf(stderr, "  -l: list the available checks\n");
+				return strcmp(argv[i], "-h") == 0 ? 0 : 1;
+			}
+		} else {
+			filters[num_filters++] = argv[i];
+		}
+	}
+
+	printf("cpu features: %x\n", vmath_cpu_features());
+
+	int total_failed = 0;
+	for(int i=0; tests[i].name; i++) {
+		const Test *t = tests + i;
+
+		if(num_filters) {
+			bool match = false;
+			for(int j=0; j<num_filters; j++) {
+				if(strstr(t->name, filters[j])) {
+					match = true;
+					break;
+				}
+			}
+			if(!match) continue;
+		}
+
+		num_checks = num_failed = 0;
+		t->func();
+		if(num_failed) {
+			printf("%-32s FAILED (%d of %d checks)\n", t->name, num_failed, num_checks);
+			total_failed++;
+		} else {
+			printf("%-32s ok (%d checks)\n", t->name, num_checks);
+		}
+		fflush(stdout);
+	}
+
+	delete [] filters;
+	return total_failed ? 1 : 0;
+}
+
+/* only the first few failures of each test are printed */
+static void check(bool cond, const char *expr, const char *file, int line)
+{
+	num_checks++;
+	if(!cond) {
+		if(num_failed++ < 8) {
+			fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+		}
+	}
+}
+
+/* relative tolerance, absolute for values smaller than 1 */
+static bool near(scalar_t a, scalar_t b, scalar_t tol)
+{
+	scalar_t mag = fabs(a) > fabs(b) ? fabs(a) : fabs(b);
+	return fabs(a - b) <= tol * (mag > 1.0 ? mag : 1.0);
+}
+
+/* deterministic input data, independent of rand() */
+static scalar_t rnd(scalar_t low, scalar_t high)
+{
+	static unsigned long state = 1;
+	state = (state * 1103515245 + 12345) & 0x7fffffff;
+	return low + (high - low) * (scalar_t)(state >> 8) / (scalar_t)(0x7fffffff >> 8);
+}